@@ -0,0 +1,434 @@
+/*
+ * Copyright 2019-2020 Cypress Semiconductor Corporation
+ * SPDX-License-Identifier: Apache-2.0
+ * 
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ * 
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ * 
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+/** file
+ *
+ * In-process MQTT broker stand-in with fault injection, used by MQTTNetwork in LOOPBACK_MQTT mode.
+ * The broker is compiled only when AWS_IOT_LOOPBACK is defined; the fault description is always available.
+ */
+#ifndef _MQTTLOOPBACK_H_
+#define _MQTTLOOPBACK_H_
+
+#include "mbed.h"
+
+#define MQTT_LOOPBACK_DEBUG( x )  //printf x
+
+#define MQTT_LOOPBACK_MAX_PACKET_SIZE       512
+#define MQTT_LOOPBACK_QUEUE_DEPTH           16
+#define MQTT_LOOPBACK_MAX_SUBSCRIPTIONS     8
+#define MQTT_LOOPBACK_MAX_TOPIC_LENGTH      64
+
+/* Faults applied by the loopback link. All values of 0 describe a perfect link. */
+typedef struct {
+    uint32_t latency_ms;                /* One-way latency added to every packet */
+    uint32_t jitter_ms;                 /* Random extra latency in [0, jitter_ms] */
+    uint32_t bandwidth_bytes_per_s;     /* Link rate in each direction; 0 is unlimited */
+    uint16_t drop_per_mille;            /* Probability (in 1/1000) that a packet is lost, in each direction */
+    uint32_t disconnect_after_packets;  /* Close the link after this many client packets */
+    uint32_t half_open_after_packets;   /* After this many client packets, accept writes but never answer again */
+    uint32_t write_stall_ms;            /* Block a write for this long ... */
+    uint32_t write_stall_every;         /* ... every write_stall_every client packets */
+    uint32_t seed;                      /* Seed of the pseudo-random generator, for repeatable runs */
+} mqtt_loopback_faults_t;
+
+#ifdef AWS_IOT_LOOPBACK
+class MQTTLoopback {
+public:
+    MQTTLoopback() {
+        memset(&faults, 0, sizeof(faults));
+        reset();
+    }
+
+    void set_faults(const mqtt_loopback_faults_t& link_faults) {
+        faults = link_faults;
+        random_state = faults.seed ? faults.seed : 0x2545F491;
+    }
+
+    int connect() {
+        reset();
+        connected = true;
+        return 0;
+    }
+
+    int disconnect() {
+        connected = false;
+        return 0;
+    }
+
+    int write(unsigned char* buffer, int len) {
+        int i;
+
+        if (!connected) {
+            return -1;
+        }
+
+        for (i = 0; i < len; i++) {
+            if (rx_length < MQTT_LOOPBACK_MAX_PACKET_SIZE) {
+                rx_packet[rx_length] = buffer[i];
+            }
+            rx_length++;
+            if (rx_length >= 2 && rx_expected == 0) {
+                rx_expected = expected_length(rx_packet, rx_length);
+            }
+            if (rx_expected != 0 && rx_length == rx_expected) {
+                if (!client_packet_complete()) {
+                    return -1;
+                }
+                rx_length = 0;
+                rx_expected = 0;
+            }
+        }
+        return len;
+    }
+
+    int read(unsigned char* buffer, int len, int timeout) {
+        uint64_t deadline = Kernel::get_ms_count() + (timeout > 0 ? timeout : 0);
+        uint64_t now;
+        uint64_t wake;
+        int bytes_read = 0;
+
+        while (bytes_read < len) {
+            if (!connected) {
+                return bytes_read > 0 ? bytes_read : -1;
+            }
+
+            now = Kernel::get_ms_count();
+            bytes_read += take(buffer + bytes_read, len - bytes_read, now);
+            if (bytes_read >= len || (timeout >= 0 && now >= deadline)) {
+                break;
+            }
+
+            /* Sleep until the next packet is due, or the timeout */
+            wake = (count > 0) ? queue[head].deliver_at : now + 10;
+            if (timeout >= 0 && wake > deadline) {
+                wake = deadline;
+            }
+            ThisThread::sleep_for((uint32_t) (wake > now ? wake - now : 1));
+        }
+        return bytes_read;
+    }
+
+private:
+    struct packet {
+        uint64_t deliver_at;
+        uint16_t length;
+        uint16_t offset;
+        unsigned char data[MQTT_LOOPBACK_MAX_PACKET_SIZE];
+    };
+
+    struct subscription {
+        bool used;
+        unsigned char qos;
+        char filter[MQTT_LOOPBACK_MAX_TOPIC_LENGTH + 1];
+    };
+
+    mqtt_loopback_faults_t faults;
+    uint32_t random_state;
+    bool connected;
+    bool half_open;
+    uint32_t client_packets;
+    unsigned char rx_packet[MQTT_LOOPBACK_MAX_PACKET_SIZE];
+    uint32_t rx_length;
+    uint32_t rx_expected;
+    packet queue[MQTT_LOOPBACK_QUEUE_DEPTH];
+    int head;
+    int count;
+    uint64_t uplink_free_at;
+    uint64_t downlink_free_at;
+    unsigned short next_packet_id;
+    subscription subscriptions[MQTT_LOOPBACK_MAX_SUBSCRIPTIONS];
+
+    void reset() {
+        connected = false;
+        half_open = false;
+        client_packets = 0;
+        rx_length = 0;
+        rx_expected = 0;
+        head = 0;
+        count = 0;
+        uplink_free_at = 0;
+        downlink_free_at = 0;
+        next_packet_id = 1;
+        memset(subscriptions, 0, sizeof(subscriptions));
+        random_state = faults.seed ? faults.seed : 0x2545F491;
+    }
+
+    uint32_t next_random() {
+        /* xorshift32 */
+        random_state ^= random_state << 13;
+        random_state ^= random_state >> 17;
+        random_state ^= random_state << 5;
+        return random_state;
+    }
+
+    bool dropped() {
+        return faults.drop_per_mille > 0 && (next_random() % 1000) < faults.drop_per_mille;
+    }
+
+    /* Time at which a packet sent now arrives at the other end of a link that is busy until 'link_free_at' */
+    uint64_t transit(uint64_t now, uint32_t length, uint64_t& link_free_at) {
+        uint64_t start = (link_free_at > now) ? link_free_at : now;
+
+        if (faults.bandwidth_bytes_per_s > 0) {
+            start += ((uint64_t) length * 1000) / faults.bandwidth_bytes_per_s;
+        }
+        link_free_at = start;
+        return start + faults.latency_ms + (faults.jitter_ms ? next_random() % (faults.jitter_ms + 1) : 0);
+    }
+
+    static uint32_t expected_length(const unsigned char* data, uint32_t length) {
+        uint32_t remaining = 0;
+        uint32_t multiplier = 1;
+        uint32_t i;
+
+        for (i = 1; i < length && i <= 4; i++) {
+            remaining += (data[i] & 127) * multiplier;
+            multiplier *= 128;
+            if ((data[i] & 128) == 0) {
+                return 1 + i + remaining;
+            }
+        }
+        return 0;
+    }
+
+    static bool topic_matches(const char* filter, const char* topic, uint32_t topic_length) {
+        const char* end = topic + topic_length;
+
+        while (*filter != '\0') {
+            if (*filter == '#') {
+                return true;
+            }
+            if (*filter == '+') {
+                while (topic < end && *topic != '/') {
+                    topic++;
+                }
+                filter++;
+            } else {
+                if (topic >= end || *filter != *topic) {
+                    return false;
+                }
+                filter++;
+                topic++;
+            }
+        }
+        return topic == end;
+    }
+
+    /* Queues a packet from the broker to the client, arriving at 'deliver_at' */
+    void send_to_client(const unsigned char* data, uint32_t length, uint64_t deliver_at) {
+        packet* p;
+
+        if (count == MQTT_LOOPBACK_QUEUE_DEPTH || length > MQTT_LOOPBACK_MAX_PACKET_SIZE || dropped()) {
+            return;
+        }
+        deliver_at = transit(deliver_at, length, downlink_free_at);
+
+        p = &queue[(head + count) % MQTT_LOOPBACK_QUEUE_DEPTH];
+        memcpy(p->data, data, length);
+        p->length = (uint16_t) length;
+        p->offset = 0;
+        p->deliver_at = deliver_at;
+        count++;
+    }
+
+    void send_ack(unsigned char header, unsigned short packet_id, uint64_t at) {
+        unsigned char ack[4] = { header, 2, (unsigned char) (packet_id >> 8), (unsigned char) packet_id };
+        send_to_client(ack, sizeof(ack), at);
+    }
+
+    int take(unsigned char* buffer, int len, uint64_t now) {
+        int bytes = 0;
+        uint32_t chunk;
+        packet* p;
+
+        while (bytes < len && count > 0 && queue[head].deliver_at <= now) {
+            p = &queue[head];
+            chunk = p->length - p->offset;
+            if (chunk > (uint32_t) (len - bytes)) {
+                chunk = len - bytes;
+            }
+            memcpy(buffer + bytes, p->data + p->offset, chunk);
+            p->offset += chunk;
+            bytes += chunk;
+            if (p->offset == p->length) {
+                head = (head + 1) % MQTT_LOOPBACK_QUEUE_DEPTH;
+                count--;
+            }
+        }
+        return bytes;
+    }
+
+    /* Applies the link faults to a packet from the client, then lets the broker handle it */
+    bool client_packet_complete() {
+        uint64_t arrival;
+
+        client_packets++;
+        if (faults.disconnect_after_packets && client_packets > faults.disconnect_after_packets) {
+            MQTT_LOOPBACK_DEBUG(("[MQTT LOOPBACK] : injected disconnect\r\n"));
+            connected = false;
+            return false;
+        }
+        if (faults.half_open_after_packets && client_packets > faults.half_open_after_packets) {
+            half_open = true;
+        }
+        if (faults.write_stall_ms && faults.write_stall_every && (client_packets % faults.write_stall_every) == 0) {
+            ThisThread::sleep_for(faults.write_stall_ms);
+        }
+        if (half_open || rx_length > MQTT_LOOPBACK_MAX_PACKET_SIZE || dropped()) {
+            return true;
+        }
+
+        arrival = transit(Kernel::get_ms_count(), rx_length, uplink_free_at);
+        handle_packet(rx_packet, rx_length, arrival);
+        return true;
+    }
+
+    void handle_packet(const unsigned char* data, uint32_t length, uint64_t at) {
+        uint32_t pos = 1;
+        unsigned char type = data[0] >> 4;
+        unsigned short packet_id;
+        uint32_t topic_length;
+        int i;
+
+        /* Skip the remaining length to the start of the variable header */
+        while (data[pos++] & 128) {
+        }
+
+        switch (type) {
+        case 1: {   /* CONNECT */
+            unsigned char connack[4] = { 0x20, 2, 0, 0 };
+            send_to_client(connack, sizeof(connack), at);
+            break;
+        }
+        case 3: {   /* PUBLISH */
+            unsigned char qos = (data[0] >> 1) & 3;
+            const char* topic = (const char*) &data[pos + 2];
+
+            topic_length = (data[pos] << 8) | data[pos + 1];
+            packet_id = 0;
+            if (qos > 0) {
+                packet_id = (data[pos + 2 + topic_length] << 8) | data[pos + 3 + topic_length];
+                send_ack(0x40, packet_id, at);
+            }
+            for (i = 0; i < MQTT_LOOPBACK_MAX_SUBSCRIPTIONS; i++) {
+                if (subscriptions[i].used && topic_matches(subscriptions[i].filter, topic, topic_length)) {
+                    forward(data, length, pos, topic_length, qos < subscriptions[i].qos ? qos : subscriptions[i].qos, at);
+                }
+            }
+            break;
+        }
+        case 8:     /* SUBSCRIBE */
+        case 10: {  /* UNSUBSCRIBE */
+            unsigned char ack[4 + MQTT_LOOPBACK_MAX_SUBSCRIPTIONS];
+            uint32_t ack_length = 4;
+
+            packet_id = (data[pos] << 8) | data[pos + 1];
+            pos += 2;
+            while (pos + 2 <= length) {
+                topic_length = (data[pos] << 8) | data[pos + 1];
+                pos += 2;
+                if (type == 8) {
+                    ack[ack_length++] = subscribe((const char*) &data[pos], topic_length, data[pos + topic_length]);
+                    pos++;
+                } else {
+                    unsubscribe((const char*) &data[pos], topic_length);
+                }
+                pos += topic_length;
+                if (ack_length == sizeof(ack)) {
+                    break;
+                }
+            }
+            ack[0] = (type == 8) ? 0x90 : 0xB0;
+            ack[1] = (unsigned char) (ack_length - 2);
+            ack[2] = (unsigned char) (packet_id >> 8);
+            ack[3] = (unsigned char) packet_id;
+            send_to_client(ack, ack_length, at);
+            break;
+        }
+        case 12: {  /* PINGREQ */
+            unsigned char pingresp[2] = { 0xD0, 0 };
+            send_to_client(pingresp, sizeof(pingresp), at);
+            break;
+        }
+        case 14:    /* DISCONNECT */
+            connected = false;
+            break;
+        default:    /* PUBACK and others need no answer */
+            break;
+        }
+    }
+
+    /* Re-encodes a PUBLISH for a subscriber with the granted QoS and a broker packet identifier */
+    void forward(const unsigned char* data, uint32_t length, uint32_t pos, uint32_t topic_length, unsigned char qos, uint64_t at) {
+        unsigned char out[MQTT_LOOPBACK_MAX_PACKET_SIZE];
+        uint32_t payload_start = pos + 2 + topic_length + (((data[0] >> 1) & 3) ? 2 : 0);
+        uint32_t payload_length = length - payload_start;
+        uint32_t remaining = 2 + topic_length + (qos ? 2 : 0) + payload_length;
+        uint32_t out_length = 0;
+        uint32_t r = remaining;
+
+        out[out_length++] = 0x30 | (qos << 1);
+        do {
+            unsigned char byte = r % 128;
+            r /= 128;
+            out[out_length++] = byte | (r > 0 ? 128 : 0);
+        } while (r > 0);
+
+        if (out_length + remaining > sizeof(out)) {
+            return;
+        }
+        memcpy(&out[out_length], &data[pos], 2 + topic_length);
+        out_length += 2 + topic_length;
+        if (qos) {
+            out[out_length++] = (unsigned char) (next_packet_id >> 8);
+            out[out_length++] = (unsigned char) next_packet_id;
+            next_packet_id = (next_packet_id == 65535) ? 1 : next_packet_id + 1;
+        }
+        memcpy(&out[out_length], &data[payload_start], payload_length);
+        out_length += payload_length;
+        send_to_client(out, out_length, at);
+    }
+
+    unsigned char subscribe(const char* filter, uint32_t length, unsigned char qos) {
+        int i;
+
+        unsubscribe(filter, length);
+        for (i = 0; i < MQTT_LOOPBACK_MAX_SUBSCRIPTIONS; i++) {
+            if (!subscriptions[i].used && length <= MQTT_LOOPBACK_MAX_TOPIC_LENGTH) {
+                subscriptions[i].used = true;
+                subscriptions[i].qos = (qos & 3) > 1 ? 1 : (qos & 3);
+                memcpy(subscriptions[i].filter, filter, length);
+                subscriptions[i].filter[length] = '\0';
+                return subscriptions[i].qos;
+            }
+        }
+        return 0x80;
+    }
+
+    void unsubscribe(const char* filter, uint32_t length) {
+        int i;
+
+        for (i = 0; i < MQTT_LOOPBACK_MAX_SUBSCRIPTIONS; i++) {
+            if (subscriptions[i].used && strlen(subscriptions[i].filter) == length &&
+                    memcmp(subscriptions[i].filter, filter, length) == 0) {
+                subscriptions[i].used = false;
+            }
+        }
+    }
+};
+#endif
+
+#endif // _MQTTLOOPBACK_H_
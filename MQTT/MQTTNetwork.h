@@ -22,150 +22,97 @@
 #define _MQTTNETWORK_H_
 
 #include "mbed.h"
+#include "aws_trace.h"
+#include "aws_mqtt5.h"
+#include "MQTTTransport.h"
 
 #define MQTT_NETWORK_DEBUG( x )  //printf x
 #define MQTT_NETWORK_ERROR( x )  printf x
 #define MQTT_NETWORK_INFO( x )   printf x
 
 
-typedef enum {
-    SECURED_MQTT,
-    NON_SECURED_MQTT
-} mqtt_security_flag;
-
-
-class MQTTNetwork {
+/* Called for every PUBACK read, whichever reader consumes it. 'reason' is the MQTT 5 reason code; 0 ( success ) in MQTT 3.1.1 */
+typedef void (*mqtt_ack_observer)(unsigned short packet_id, unsigned char reason, void* arg);
+
+/* Incremental MQTT fixed-header parser used to find packet boundaries in the byte stream.
+ * It also picks the packet identifier out of the variable header without buffering the packet. */
+typedef struct {
+    unsigned char header;
+    unsigned char state;
+    unsigned char capture;          /* What the bytes in [capture_start, capture_end) of the body hold */
+    uint32_t multiplier;
+    uint32_t remaining;
+    uint32_t length;                /* Total packet length, fixed header included */
+    uint32_t offset;                /* Bytes of the body seen so far */
+    uint32_t capture_start;
+    uint32_t capture_end;
+    uint32_t value;
+    unsigned short packet_id;
+    unsigned char reason;           /* Reason code following the packet identifier of an MQTT 5 PUBACK */
+} mqtt_packet_tracker_t;
+
+#define MQTT_TRACK_HEADER   0
+#define MQTT_TRACK_LENGTH   1
+#define MQTT_TRACK_BODY     2
+
+#define MQTT_CAPTURE_NONE          0
+#define MQTT_CAPTURE_TOPIC_LENGTH  1
+#define MQTT_CAPTURE_PACKET_ID     2
+
+#define MQTT_PACKET_TYPE(header)  ((header) >> 4)
+#define MQTT_PACKET_QOS(header)   (((header) >> 1) & 0x03)
+#define MQTT_PUBLISH_TYPE         3
+#define MQTT_PUBACK_TYPE          4
+#define MQTT_UNSUBACK_TYPE        11
+#define MQTT_PINGREQ_TYPE         12
+#define MQTT_PINGRESP_TYPE        13
+
+/* MQTT network for MQTT::Client over a transport policy ( MQTTTransport.h ). The transport is fixed at compile time,
+ * so reads and writes go straight to its socket; this layer adds packet tracking, statistics and tracing.
+ * With an MQTT 5 codec set, packets are translated on the way ( AWSIoTMqtt5 ); statistics count the bytes on the wire. */
+template <class Transport>
+class MQTTNetworkT {
 public:
-    MQTTNetwork(NetworkInterface* aNetwork, mqtt_security_flag is_security =
+    MQTTNetworkT(NetworkInterface* aNetwork, mqtt_security_flag is_security =
             NON_SECURED_MQTT) :
-            network(aNetwork) {
-        is_security_enabled = is_security;
-
-        is_security_enabled = is_security;
-
-        if (is_security_enabled == SECURED_MQTT) {
-            TLSSocket *socket;
-            socket = new TLSSocket;
-            socket_context = socket;
-
-        } else {
-            TCPSocket *socket;
-            socket = new TCPSocket;
-            socket_context = socket;
-        }
+            network(aNetwork), transport(is_security) {
+        stats = NULL;
+        mqtt5 = NULL;
+        ack_observer = NULL;
+        ack_observer_arg = NULL;
+        memset(&rx_tracker, 0, sizeof(rx_tracker));
+        memset(&tx_tracker, 0, sizeof(tx_tracker));
     }
 
-    ~MQTTNetwork() {
-
-        if (is_security_enabled == SECURED_MQTT) {
-            TLSSocket *socket;
-
-            socket = (TLSSocket *) socket_context;
-            delete socket;
-
-        } else {
-            TCPSocket *socket;
-
-            socket = (TCPSocket *) socket_context;
-            delete socket;
-
-        }
-
+    /* True if this network can carry connections of the given kind */
+    static bool supports(mqtt_security_flag is_security) {
+        return Transport::supports(is_security);
     }
 
     int read(unsigned char* buffer, int len, int timeout) {
-        int bytes_read = 0;
-        int total_bytes = len;
-        int ret = 0;
-        Timer timer;
-        if (is_security_enabled == SECURED_MQTT) {
-            TLSSocket *socket;
-
-            socket = (TLSSocket *) socket_context;
-
-            socket->set_timeout(timeout);
-            /* Consider negative timeout value as blocking call and wait till all the expected bytes available and then return. If timeout is positive value then wait for the timeout to get the expected data */
-            if ( timeout < 0 )
-            {
-                do {
-                    ret = socket->recv(buffer + bytes_read,
-                            total_bytes - bytes_read);
-
-                    if (ret < 0) {
-                        if (ret != NSAPI_ERROR_WOULD_BLOCK) {
-                            MQTT_NETWORK_ERROR((" Socket receive error : %d \n", ret));
-                            return -1;
-                        }
-                    } else {
-                        bytes_read += ret;
-                    }
-
-                } while (bytes_read < total_bytes);
-
-                return bytes_read;
-            }
-            else {
-                timer.reset();
-                timer.start();
-
-                do {
-
-                    ret = socket->recv(buffer + bytes_read,
-                            total_bytes - bytes_read);
-
-                    if (ret < 0) {
-                        if (ret != NSAPI_ERROR_WOULD_BLOCK) {
-                            MQTT_NETWORK_ERROR((" Socket receive error : %d \n", ret));
-                            timer.stop();
-                            return -1;
-                        }
-                    } else {
-                        bytes_read += ret;
-                    }
-                } while (bytes_read < total_bytes && timer.read_ms() < timeout);
-
-                timer.stop();
-
-                return bytes_read;
-            }
-
-        } else {
-            TCPSocket *socket;
-
-            socket = (TCPSocket *) socket_context;
-            do {
-                ret = socket->recv(buffer + bytes_read,
-                        total_bytes - bytes_read);
-                if (ret < 0)
-                    return -1;
-                bytes_read += ret;
-            } while (bytes_read < total_bytes);
-            return bytes_read;
+        AWS_TRACE_EVENT(AWS_TRACE_RECV_BEGIN, 0, 0, len);
+        if (mqtt5 != NULL) {
+            return read_mqtt5(buffer, len, timeout);
         }
-
+        return account_read(buffer, transport.read(buffer, len, timeout));
     }
 
 
     int write(unsigned char* buffer, int len, int timeout) {
 
-        if (is_security_enabled == SECURED_MQTT) {
-            TLSSocket *socket;
-
-            socket = (TLSSocket *) socket_context;
-            return socket->send(buffer, len);
-
-        } else {
-            TCPSocket *socket;
-
-            socket = (TCPSocket *) socket_context;
-            return socket->send(buffer, len);
+        AWS_TRACE_EVENT(AWS_TRACE_SEND_BEGIN, MQTT_PACKET_TYPE(buffer[0]), 0, len);
+        if (mqtt5 != NULL) {
+            return write_mqtt5(buffer, len);
         }
-
+        return account_write(buffer, transport.write(buffer, len));
     }
 
     int set_root_ca_certificate(const char* root_ca_certifcate) {
-        TLSSocket *socket = NULL;
-        socket = (TLSSocket *) socket_context;
+        TLSSocketWrapper *socket = transport.tls_socket();
+
+        if (socket == NULL) {
+            return 0;
+        }
 
         if (root_ca_certifcate == NULL)
         {
@@ -175,9 +122,17 @@ public:
         return socket->set_root_ca_cert(root_ca_certifcate);
     }
 
+    /* TLS socket to be configured before connect, e.g. with pre-parsed credentials; NULL unless the network is secured */
+    TLSSocketWrapper* get_tls_socket() {
+        return transport.tls_socket();
+    }
+
     int set_client_cert_key(const char* client_cert, const char* client_key) {
-        TLSSocket *socket = NULL;
-        socket = (TLSSocket *) socket_context;
+        TLSSocketWrapper *socket = transport.tls_socket();
+
+        if (socket == NULL) {
+            return 0;
+        }
         if (client_cert == NULL || client_key == NULL) {
             MQTT_NETWORK_ERROR(("[MQTT ERROR] : PASS VALID client certificate and client private key\r\n"));
             return -1;
@@ -186,89 +141,300 @@ public:
     }
 
     int connect(const char* hostname, int port, const char* peer_cn) {
+        memset(&rx_tracker, 0, sizeof(rx_tracker));
+        memset(&tx_tracker, 0, sizeof(tx_tracker));
 
-        if (is_security_enabled == SECURED_MQTT) {
-            TLSSocket *socket;
-            nsapi_error_t rc = NSAPI_ERROR_OK;
+        MQTT_NETWORK_DEBUG(("[MQTT INFO] : hostname set : %s \n", peer_cn ));
+        return transport.connect(network, hostname, port, peer_cn, stats);
+    }
 
-            socket = (TLSSocket *) socket_context;
+    int disconnect() {
+        return transport.disconnect();
+    }
 
-            rc = socket->open(network);
-            if (rc != NSAPI_ERROR_OK) {
-                MQTT_NETWORK_ERROR(
-                        ("[MQTT ERROR] : TLS SOCKET OPEN FAILED\r\n"));
-               return ((int)rc);
-            }
+    /* Upgrade request path of the WEBSOCKET_MQTT link ( e.g. a SigV4-presigned query ); ignored by the other modes */
+    void set_upgrade_path(const char* path) {
+        transport.set_upgrade_path(path);
+    }
 
-            MQTT_NETWORK_DEBUG(("[MQTT INFO] : hostname set : %s \n", peer_cn ));
-            socket->set_hostname(peer_cn);
+    /* Faults injected by the LOOPBACK_MQTT link; ignored by the other modes */
+    void set_loopback_faults(const mqtt_loopback_faults_t& faults) {
+        transport.set_loopback_faults(faults);
+    }
 
-            rc = network->gethostbyname(hostname, &address, NSAPI_UNSPEC, NULL);
-            if (rc != NSAPI_ERROR_OK) {
-                MQTT_NETWORK_ERROR(
-                        ("[MQTT ERROR] : GET HOST BY NAME FAILED\r\n"));
-                return ((int)rc);
+    /* Statistics are accumulated into caller-owned storage so that they survive reconnects */
+    void set_stats(mqtt_network_stats_t* network_stats) {
+        stats = network_stats;
+    }
+
+    /* Speaks MQTT 5 on the wire through the codec from now on; NULL returns to MQTT 3.1.1. Set before connecting */
+    void set_mqtt5(AWSIoTMqtt5* codec) {
+        mqtt5 = codec;
+    }
+
+    /* Lets packets written around the MQTT client, such as pipelined publishes, learn about their acknowledgements */
+    void set_ack_observer(mqtt_ack_observer observer, void* arg) {
+        ack_observer = observer;
+        ack_observer_arg = arg;
+    }
+
+private:
+    NetworkInterface* network;
+    Transport transport;
+    mqtt_network_stats_t* stats;
+    AWSIoTMqtt5* mqtt5;
+    mqtt_ack_observer ack_observer;
+    void* ack_observer_arg;
+    mqtt_packet_tracker_t rx_tracker;
+    mqtt_packet_tracker_t tx_tracker;
+
+    void packet_complete(mqtt_packet_tracker_t& tracker, bool outbound) {
+        AWS_TRACE_EVENT(outbound ? AWS_TRACE_PACKET_OUT : AWS_TRACE_PACKET_IN,
+                MQTT_PACKET_TYPE(tracker.header), tracker.packet_id, tracker.length);
+
+        if (!outbound && ack_observer != NULL && MQTT_PACKET_TYPE(tracker.header) == MQTT_PUBACK_TYPE) {
+            ack_observer(tracker.packet_id, tracker.reason, ack_observer_arg);
+        }
+
+        if (stats == NULL) {
+            return;
+        }
+        if (outbound) {
+            stats->packets_sent++;
+            stats->last_sent_ms = Kernel::get_ms_count();
+            if (MQTT_PACKET_TYPE(tracker.header) == MQTT_PINGREQ_TYPE) {
+                stats->pings_sent++;
             }
-            address.set_port(port);
+        } else {
+            stats->packets_received++;
+            stats->last_received_ms = Kernel::get_ms_count();
+            if (MQTT_PACKET_TYPE(tracker.header) == MQTT_PINGRESP_TYPE) {
+                stats->pingresps_received++;
+                stats->last_pingresp_ms = stats->last_received_ms;
+            }
+        }
+    }
 
-            return socket->connect(address);
+    /* Packet identifier sits at the start of the variable header, except for PUBLISH where it follows the topic */
+    void start_body(mqtt_packet_tracker_t& tracker) {
+        unsigned char type = MQTT_PACKET_TYPE(tracker.header);
+
+        tracker.offset = 0;
+        tracker.value = 0;
+        tracker.packet_id = 0;
+        tracker.reason = 0;
+        tracker.capture_start = 0;
+        tracker.capture_end = 2;
+        if (type == MQTT_PUBLISH_TYPE) {
+            tracker.capture = MQTT_CAPTURE_TOPIC_LENGTH;
+        } else if (type == MQTT_PUBACK_TYPE && tracker.remaining >= 3) {
+            /* an MQTT 5 PUBACK with a reason code */
+            tracker.capture = MQTT_CAPTURE_PACKET_ID;
+            tracker.capture_end = 3;
+        } else if (type >= MQTT_PUBACK_TYPE && type <= MQTT_UNSUBACK_TYPE) {
+            tracker.capture = MQTT_CAPTURE_PACKET_ID;
+        } else {
+            tracker.capture = MQTT_CAPTURE_NONE;
+            tracker.capture_end = 0;
+        }
+    }
 
+    void capture_byte(mqtt_packet_tracker_t& tracker, unsigned char byte) {
+        tracker.value = (tracker.value << 8) | byte;
+        if (tracker.offset + 1 < tracker.capture_end) {
+            return;
+        }
+
+        if (tracker.capture == MQTT_CAPTURE_TOPIC_LENGTH && MQTT_PACKET_QOS(tracker.header) > 0) {
+            tracker.capture = MQTT_CAPTURE_PACKET_ID;
+            tracker.capture_start = 2 + tracker.value;
+            tracker.capture_end = tracker.capture_start + 2;
+            tracker.value = 0;
         } else {
-            TCPSocket *socket;
-            nsapi_error_t rc = NSAPI_ERROR_OK;
-            socket = (TCPSocket *) socket_context;
-
-            rc = socket->open(network);
-            if (rc != NSAPI_ERROR_OK) {
-                MQTT_NETWORK_ERROR(
-                        ("[MQTT ERROR] :  TCP SOCKET OPEN FAILED\r\n"));
-                return ((int)rc);
+            if (tracker.capture == MQTT_CAPTURE_PACKET_ID && tracker.capture_end - tracker.capture_start == 3) {
+                tracker.packet_id = (unsigned short) (tracker.value >> 8);
+                tracker.reason = (unsigned char) tracker.value;
+            } else if (tracker.capture == MQTT_CAPTURE_PACKET_ID) {
+                tracker.packet_id = (unsigned short) tracker.value;
             }
+            tracker.capture = MQTT_CAPTURE_NONE;
+            tracker.capture_end = 0;
+        }
+    }
 
-            rc = network->gethostbyname(hostname, &address, NSAPI_UNSPEC, NULL);
-            if (rc != NSAPI_ERROR_OK) {
-                MQTT_NETWORK_ERROR(
-                        ("[MQTT ERROR] : GET HOST BY NAME FAILED\r\n"));
-                return ((int)rc);
+    /* MQTT::Client reads and writes whole or partial packets; walk the fixed headers to find packet boundaries */
+    void track(mqtt_packet_tracker_t& tracker, const unsigned char* buffer, int len, bool outbound) {
+        int i = 0;
+        uint32_t chunk;
+
+        while (i < len) {
+            switch (tracker.state) {
+            case MQTT_TRACK_HEADER:
+                tracker.header = buffer[i++];
+                tracker.remaining = 0;
+                tracker.multiplier = 1;
+                tracker.length = 1;
+                tracker.state = MQTT_TRACK_LENGTH;
+                break;
+
+            case MQTT_TRACK_LENGTH:
+                tracker.remaining += (buffer[i] & 127) * tracker.multiplier;
+                tracker.multiplier *= 128;
+                tracker.length++;
+                if ((buffer[i++] & 128) == 0 || tracker.multiplier > 128 * 128 * 128) {
+                    tracker.length += tracker.remaining;
+                    tracker.state = MQTT_TRACK_BODY;
+                    start_body(tracker);
+                    if (tracker.remaining == 0) {
+                        packet_complete(tracker, outbound);
+                        tracker.state = MQTT_TRACK_HEADER;
+                    }
+                }
+                break;
+
+            default:
+                chunk = (uint32_t) (len - i);
+                if (chunk > tracker.remaining) {
+                    chunk = tracker.remaining;
+                }
+                if (tracker.offset < tracker.capture_end) {
+                    /* Skip up to the bytes of interest, then take them one at a time */
+                    if (tracker.offset < tracker.capture_start) {
+                        if (chunk > tracker.capture_start - tracker.offset) {
+                            chunk = tracker.capture_start - tracker.offset;
+                        }
+                    } else {
+                        chunk = 1;
+                        capture_byte(tracker, buffer[i]);
+                    }
+                }
+                i += chunk;
+                tracker.offset += chunk;
+                tracker.remaining -= chunk;
+                if (tracker.remaining == 0) {
+                    packet_complete(tracker, outbound);
+                    tracker.state = MQTT_TRACK_HEADER;
+                }
+                break;
             }
-            address.set_port(port);
+        }
+    }
 
-            return socket->connect(address);
+    int account_read(unsigned char* buffer, int bytes_read) {
+        AWS_TRACE_EVENT(AWS_TRACE_RECV_END, 0, 0, bytes_read > 0 ? bytes_read : 0);
+        if ((stats != NULL || AWS_TRACE_ENABLED) && bytes_read > 0) {
+            if (stats != NULL) {
+                stats->bytes_received += bytes_read;
+            }
+            track(rx_tracker, buffer, bytes_read, false);
         }
+        return bytes_read;
+    }
 
+    int account_write(unsigned char* buffer, int bytes_sent) {
+        AWS_TRACE_EVENT(AWS_TRACE_SEND_END, MQTT_PACKET_TYPE(buffer[0]), 0, bytes_sent > 0 ? bytes_sent : 0);
+        account_sent(buffer, bytes_sent);
+        return bytes_sent;
     }
 
-    int disconnect() {
+    void account_sent(const unsigned char* buffer, int bytes_sent) {
+        if ((stats != NULL || AWS_TRACE_ENABLED) && bytes_sent > 0) {
+            if (stats != NULL) {
+                stats->bytes_sent += bytes_sent;
+            }
+            track(tx_tracker, buffer, bytes_sent, true);
+        }
+    }
 
-        int ret;
-        if (is_security_enabled == SECURED_MQTT) {
-            TLSSocket *socket;
+    /* Reads a whole MQTT 5 packet, since its MQTT 3.1.1 length is only known once its properties are gone;
+     * the MQTT client then takes the translated packet in whatever pieces it asks for. */
+    int read_mqtt5(unsigned char* buffer, int len, int timeout) {
+        unsigned char* packet = mqtt5->rx_buffer();
+        uint32_t remaining = 0;
+        uint32_t multiplier = 1;
+        int length = 0;
+        int rc = 0;
+
+        if (mqtt5->pending() > 0) {
+            return mqtt5->take(buffer, len);
+        }
 
-            socket = (TLSSocket *) socket_context;
-            ret = socket->close();
-            delete socket;
-            socket = NULL;
-            socket_context = NULL;
-            return ret;
+        rc = transport.read(packet, 1, timeout);
+        if (rc <= 0) {
+            return account_read(packet, rc);
+        }
+        length = 1;
+        do {
+            rc = (length < 5) ? transport.read(packet + length, 1, AWS_MQTT5_PACKET_TIMEOUT) : -1;
+            if (rc != 1) {
+                rc = -1;
+                goto exit;
+            }
+            remaining += (packet[length] & 127) * multiplier;
+            multiplier *= 128;
+        } while ((packet[length++] & 128) != 0);
+
+        /* the broker was told not to send more than the buffer holds */
+        rc = (length + remaining <= mqtt5->rx_size()) ? 0 : -1;
+        if (rc == 0 && remaining > 0) {
+            rc = transport.read(packet + length, (int) remaining, AWS_MQTT5_PACKET_TIMEOUT);
+            rc = (rc == (int) remaining) ? 0 : -1;
+        }
+        if (rc == 0) {
+            length += remaining;
+        }
 
-        } else {
-            TCPSocket *socket;
-
-            socket = (TCPSocket *) socket_context;
-            ret = socket->close();
-            delete socket;
-            socket = NULL;
-            socket_context = NULL;
-            return ret;
+    exit:
+        account_read(packet, length);
+        if (rc < 0 || mqtt5->decode(length) != 0) {
+            return -1;
         }
+        return mqtt5->take(buffer, len);
+    }
 
+    int write_mqtt5(unsigned char* buffer, int len) {
+        unsigned char* prefix = mqtt5->tx_buffer();
+        int resume = 0;
+        int length = mqtt5->encode(buffer, len, &resume);
+        int sent = 0;
+
+        if (length >= 0) {
+            sent = write_all(prefix, length);
+            account_sent(prefix, sent);
+            if (sent == length && resume < len) {
+                length = len - resume;
+                sent = write_all(buffer + resume, length);
+                account_sent(buffer + resume, sent);
+            }
+        }
+        AWS_TRACE_EVENT(AWS_TRACE_SEND_END, MQTT_PACKET_TYPE(buffer[0]), 0, (length >= 0 && sent == length) ? len : 0);
+
+        /* the MQTT client expects the length of what it wrote */
+        return (length >= 0 && sent == length) ? len : -1;
     }
 
-private:
-    NetworkInterface* network;
-    void* socket_context;
-    mqtt_security_flag is_security_enabled;
-    SocketAddress address;
+    int write_all(unsigned char* buffer, int len) {
+        int sent = 0;
+        int rc = 0;
+
+        while (sent < len) {
+            rc = transport.write(buffer + sent, len - sent);
+            if (rc <= 0) {
+                return sent;
+            }
+            sent += rc;
+        }
+        return sent;
+    }
 };
 
+/* Transport the AWS IoT client is built with. The default picks TLS, TCP, WebSocket or ( with AWS_IOT_LOOPBACK ) loopback
+ * per connection; defining AWS_IOT_TRANSPORT as one of the fixed transports ( e.g. MQTTTlsTransport ) removes that choice
+ * and the storage of the other transports. */
+#ifndef AWS_IOT_TRANSPORT
+#define AWS_IOT_TRANSPORT MQTTSelectTransport
+#endif
+
+typedef MQTTNetworkT<AWS_IOT_TRANSPORT> MQTTNetwork;
+
 #endif // _MQTTNETWORK_H_
@@ -0,0 +1,776 @@
+/*
+ * Copyright 2019-2020 Cypress Semiconductor Corporation
+ * SPDX-License-Identifier: Apache-2.0
+ * 
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ * 
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ * 
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+/** file
+ *
+ * Transport policies for MQTTNetworkT
+ *
+ * A transport moves the bytes of an MQTT connection. It provides:
+ *   Transport(mqtt_security_flag mode)
+ *   static bool supports(mqtt_security_flag mode)
+ *   int connect(NetworkInterface* network, const char* hostname, int port, const char* peer_cn, mqtt_network_stats_t* stats)
+ *   int read(unsigned char* buffer, int len, int timeout)
+ *   int write(unsigned char* buffer, int len)
+ *   int disconnect()
+ *   TLSSocketWrapper* tls_socket()                   NULL unless the transport runs TLS
+ *   void set_upgrade_path(const char* path)          Request path of transports that start with an HTTP upgrade
+ *   void set_loopback_faults(const mqtt_loopback_faults_t& faults)
+ * MQTTNetworkT adds packet tracking, statistics and tracing on top, so a new transport only deals with its socket.
+ */
+#ifndef _MQTTTRANSPORT_H_
+#define _MQTTTRANSPORT_H_
+
+#include "mbed.h"
+#include <new>
+#include "MQTTLoopback.h"
+#include "MQTTWebSocket.h"
+#include "mbedtls/entropy.h"
+#include "mbedtls/ctr_drbg.h"
+
+#define MQTT_TRANSPORT_ERROR( x )  printf x
+
+typedef enum {
+    SECURED_MQTT,
+    NON_SECURED_MQTT,
+    LOOPBACK_MQTT,          /* In-process broker stand-in with fault injection, no network */
+    WEBSOCKET_MQTT          /* MQTT over WebSockets over TLS */
+} mqtt_security_flag;
+
+/* Traffic and connection statistics collected by MQTTNetwork */
+typedef struct {
+    uint64_t bytes_sent;
+    uint64_t bytes_received;
+    uint32_t packets_sent;
+    uint32_t packets_received;
+    uint32_t pings_sent;
+    uint32_t pingresps_received;
+    uint64_t last_sent_ms;      /* Time at which the last complete packet was written */
+    uint64_t last_received_ms;  /* Time at which the last complete packet was read */
+    uint64_t last_pingresp_ms;  /* Time at which the last PINGRESP was read */
+    uint32_t dns_ms;            /* Duration of the last DNS lookup */
+    uint32_t tcp_ms;            /* Duration of the last TCP connect */
+    uint32_t tls_ms;            /* Duration of the last TLS handshake */
+} mqtt_network_stats_t;
+
+static inline void mqtt_record_phase(Timer& phase_timer, uint32_t* phase_ms) {
+    if (phase_ms != NULL) {
+        *phase_ms = phase_timer.read_ms();
+    }
+    phase_timer.reset();
+}
+
+/* Resolves the broker address and connects the TCP socket, timing both phases */
+static inline int mqtt_connect_tcp(NetworkInterface* network, TCPSocket& tcp, const char* hostname, int port,
+        SocketAddress& address, Timer& phase_timer, mqtt_network_stats_t* stats) {
+    nsapi_error_t rc = NSAPI_ERROR_OK;
+
+    rc = tcp.open(network);
+    if (rc != NSAPI_ERROR_OK) {
+        MQTT_TRANSPORT_ERROR(("[MQTT ERROR] : TCP SOCKET OPEN FAILED\r\n"));
+        return ((int)rc);
+    }
+
+    phase_timer.start();
+    rc = network->gethostbyname(hostname, &address, NSAPI_UNSPEC, NULL);
+    mqtt_record_phase(phase_timer, stats ? &stats->dns_ms : NULL);
+    if (rc != NSAPI_ERROR_OK) {
+        MQTT_TRANSPORT_ERROR(("[MQTT ERROR] : GET HOST BY NAME FAILED\r\n"));
+        return ((int)rc);
+    }
+    address.set_port(port);
+
+    rc = tcp.connect(address);
+    mqtt_record_phase(phase_timer, stats ? &stats->tcp_ms : NULL);
+    if (rc != NSAPI_ERROR_OK) {
+        MQTT_TRANSPORT_ERROR(("[MQTT ERROR] : TCP CONNECT FAILED\r\n"));
+    }
+    return ((int)rc);
+}
+
+/* TLS over a separately owned TCP socket, so that TCP connect and TLS handshake can be timed apart */
+class MQTTTlsTransport {
+public:
+    MQTTTlsTransport(mqtt_security_flag mode = SECURED_MQTT) :
+            tls(&tcp, NULL, TLSSocketWrapper::TRANSPORT_KEEP) {
+    }
+
+    static bool supports(mqtt_security_flag mode) {
+        return mode == SECURED_MQTT;
+    }
+
+    int connect(NetworkInterface* network, const char* hostname, int port, const char* peer_cn, mqtt_network_stats_t* stats) {
+        SocketAddress address;
+        Timer phase_timer;
+        int rc = 0;
+
+        tls.set_hostname(peer_cn);
+        rc = mqtt_connect_tcp(network, tcp, hostname, port, address, phase_timer, stats);
+        if (rc != NSAPI_ERROR_OK) {
+            return rc;
+        }
+
+        rc = tls.connect(address);
+        mqtt_record_phase(phase_timer, stats ? &stats->tls_ms : NULL);
+        return rc;
+    }
+
+    int read(unsigned char* buffer, int len, int timeout) {
+        int bytes_read = 0;
+        int ret = 0;
+        uint64_t start_ms = Kernel::get_ms_count();
+
+        tls.set_timeout(timeout);
+        /* Consider negative timeout value as blocking call and wait till all the expected bytes available and then return. If timeout is positive value then wait for the timeout to get the expected data.
+         * Timed with the kernel tick: a Timer per read would also hold off deep sleep while it runs */
+        do {
+            ret = tls.recv(buffer + bytes_read, len - bytes_read);
+            if (ret < 0) {
+                if (ret != NSAPI_ERROR_WOULD_BLOCK) {
+                    MQTT_TRANSPORT_ERROR((" Socket receive error : %d \n", ret));
+                    return -1;
+                }
+            } else {
+                bytes_read += ret;
+            }
+        } while (bytes_read < len && (timeout < 0 || Kernel::get_ms_count() - start_ms < (uint64_t)timeout));
+
+        return bytes_read;
+    }
+
+    int write(unsigned char* buffer, int len) {
+        return tls.send(buffer, len);
+    }
+
+    int disconnect() {
+        int ret = tls.close();
+        tcp.close();
+        return ret;
+    }
+
+    TLSSocketWrapper* tls_socket() {
+        return &tls;
+    }
+
+    void set_upgrade_path(const char* upgrade_path) {
+    }
+
+    void set_loopback_faults(const mqtt_loopback_faults_t& faults) {
+    }
+
+private:
+    TCPSocket tcp;
+    TLSSocketWrapper tls;
+};
+
+/* MQTT over WebSockets on top of the TLS transport, for networks that only let HTTPS ( port 443 ) out.
+ * The upgrade request asks for the path given to set_upgrade_path, e.g. a SigV4-presigned /mqtt query. Each write is sent as
+ * one binary frame, masked straight from the caller's buffer into the staging buffer; reads strip frame headers and answer pings. */
+class MQTTWebSocketTransport {
+public:
+    MQTTWebSocketTransport(mqtt_security_flag mode = WEBSOCKET_MQTT) :
+            tls(SECURED_MQTT) {
+        path = MQTT_WEBSOCKET_DEFAULT_PATH;
+        upgraded = false;
+        random_ready = false;
+        masks_used = sizeof(masks);
+        rx_remaining = 0;
+        rx_header_length = 0;
+    }
+
+    ~MQTTWebSocketTransport() {
+        free_random();
+    }
+
+    static bool supports(mqtt_security_flag mode) {
+        return mode == WEBSOCKET_MQTT;
+    }
+
+    /* Request path of the upgrade, including any query; must stay valid until connect returns */
+    void set_upgrade_path(const char* upgrade_path) {
+        path = (upgrade_path != NULL) ? upgrade_path : MQTT_WEBSOCKET_DEFAULT_PATH;
+    }
+
+    int connect(NetworkInterface* network, const char* hostname, int port, const char* peer_cn, mqtt_network_stats_t* stats) {
+        int rc = 0;
+
+        upgraded = false;
+        rx_remaining = 0;
+        rx_header_length = 0;
+        rc = tls.connect(network, hostname, port, peer_cn, stats);
+        if (rc != NSAPI_ERROR_OK) {
+            return rc;
+        }
+
+        rc = seed_random();
+        if (rc == 0) {
+            rc = handshake(hostname);
+        }
+        if (rc != 0) {
+            MQTT_TRANSPORT_ERROR(("[MQTT ERROR] : WEBSOCKET UPGRADE FAILED\r\n"));
+            return -1;
+        }
+        upgraded = true;
+        return 0;
+    }
+
+    int read(unsigned char* buffer, int len, int timeout) {
+        int bytes_read = 0;
+        int chunk = 0;
+        int ret = 0;
+        uint64_t start_ms = Kernel::get_ms_count();
+
+        while (bytes_read < len) {
+            if (rx_remaining == 0) {
+                ret = read_frame_header(time_left(start_ms, timeout));
+                if (ret < 0) {
+                    return -1;
+                }
+                if (ret == 0) {
+                    break;
+                }
+                continue;
+            }
+
+            chunk = (rx_remaining < (uint64_t)(len - bytes_read)) ? (int)rx_remaining : len - bytes_read;
+            ret = tls.read(buffer + bytes_read, chunk, time_left(start_ms, timeout));
+            if (ret < 0) {
+                return -1;
+            }
+            bytes_read += ret;
+            rx_remaining -= ret;
+            if (ret < chunk) {
+                break;
+            }
+        }
+        return bytes_read;
+    }
+
+    int write(unsigned char* buffer, int len) {
+        return (send_frame(MQTT_WEBSOCKET_BINARY, buffer, len) == 0) ? len : -1;
+    }
+
+    int disconnect() {
+        static const unsigned char normal_closure[2] = { 0x03, 0xE8 };
+
+        if (upgraded) {
+            send_frame(MQTT_WEBSOCKET_CLOSE, normal_closure, sizeof(normal_closure));
+            upgraded = false;
+        }
+        free_random();
+        return tls.disconnect();
+    }
+
+    TLSSocketWrapper* tls_socket() {
+        return tls.tls_socket();
+    }
+
+    void set_loopback_faults(const mqtt_loopback_faults_t& faults) {
+    }
+
+private:
+    MQTTTlsTransport tls;
+    const char* path;
+    bool upgraded;
+    bool random_ready;
+    mbedtls_entropy_context entropy;
+    mbedtls_ctr_drbg_context drbg;
+    unsigned char masks[64];
+    unsigned int masks_used;
+    uint64_t rx_remaining;              /* Payload bytes left in the current inbound data frame */
+    unsigned char rx_header[MQTT_WEBSOCKET_MAX_HEADER_LENGTH];
+    int rx_header_length;               /* Bytes of a frame header read before a timeout */
+    unsigned char staging[MQTT_WEBSOCKET_BUFFER_SIZE];
+
+    static int time_left(uint64_t start_ms, int timeout) {
+        uint64_t elapsed = 0;
+
+        if (timeout < 0) {
+            return timeout;
+        }
+        elapsed = Kernel::get_ms_count() - start_ms;
+        return (elapsed < (uint64_t)timeout) ? timeout - (int)elapsed : 0;
+    }
+
+    int write_all(const unsigned char* buffer, int len) {
+        int sent = 0;
+        int ret = 0;
+
+        while (sent < len) {
+            ret = tls.write((unsigned char*)buffer + sent, len - sent);
+            if (ret <= 0) {
+                return -1;
+            }
+            sent += ret;
+        }
+        return 0;
+    }
+
+    /* Sends one final frame. The header goes out together with the start of the payload, larger payloads
+     * continue in further TLS records, each masked from the caller's buffer at its offset in the frame. */
+    int send_frame(unsigned char opcode, const unsigned char* payload, int len) {
+        unsigned char mask[4];
+        int header_len = 0;
+        int chunk = 0;
+        int sent = 0;
+
+        if (next_mask(mask) != 0) {
+            return -1;
+        }
+        header_len = mqtt_websocket_frame_header(staging, opcode, (uint64_t)len, mask);
+        chunk = (len < (int)sizeof(staging) - header_len) ? len : (int)sizeof(staging) - header_len;
+        mqtt_websocket_mask(payload, staging + header_len, chunk, mask, 0);
+        if (write_all(staging, header_len + chunk) != 0) {
+            return -1;
+        }
+
+        for (sent = chunk; sent < len; sent += chunk) {
+            chunk = (len - sent < (int)sizeof(staging)) ? len - sent : (int)sizeof(staging);
+            mqtt_websocket_mask(payload + sent, staging, chunk, mask, sent);
+            if (write_all(staging, chunk) != 0) {
+                return -1;
+            }
+        }
+        return 0;
+    }
+
+    /* Returns 1 once a frame header is consumed, 0 if the timeout passed first ( a partial header is kept ) and -1 on error */
+    int read_frame_header(int timeout) {
+        unsigned char control[MQTT_WEBSOCKET_MAX_CONTROL_PAYLOAD];
+        unsigned char opcode = 0;
+        uint64_t payload_len = 0;
+        int needed = 0;
+        int ret = 0;
+
+        for (;;) {
+            needed = (rx_header_length >= 2) ? mqtt_websocket_header_length(rx_header) : 2;
+            if (rx_header_length >= needed) {
+                break;
+            }
+            ret = tls.read(rx_header + rx_header_length, needed - rx_header_length, timeout);
+            if (ret < 0) {
+                return -1;
+            }
+            rx_header_length += ret;
+            if (rx_header_length < needed) {
+                return 0;
+            }
+        }
+        rx_header_length = 0;
+
+        if (rx_header[1] & MQTT_WEBSOCKET_MASKED) {
+            MQTT_TRANSPORT_ERROR(("[MQTT ERROR] : MASKED WEBSOCKET FRAME FROM SERVER\r\n"));
+            return -1;
+        }
+        opcode = MQTT_WEBSOCKET_OPCODE(rx_header[0]);
+        payload_len = mqtt_websocket_payload_length(rx_header);
+
+        switch (opcode) {
+        case MQTT_WEBSOCKET_BINARY:
+        case MQTT_WEBSOCKET_CONTINUATION:
+            rx_remaining = payload_len;
+            return 1;
+
+        case MQTT_WEBSOCKET_PING:
+        case MQTT_WEBSOCKET_PONG:
+            if (payload_len > sizeof(control)) {
+                return -1;
+            }
+            if (payload_len > 0 && tls.read(control, (int)payload_len, MQTT_WEBSOCKET_CONTROL_TIMEOUT) != (int)payload_len) {
+                return -1;
+            }
+            if (opcode == MQTT_WEBSOCKET_PING && send_frame(MQTT_WEBSOCKET_PONG, control, (int)payload_len) != 0) {
+                return -1;
+            }
+            return 1;
+
+        case MQTT_WEBSOCKET_CLOSE:
+            MQTT_TRANSPORT_ERROR(("[MQTT ERROR] : WEBSOCKET CLOSED BY SERVER\r\n"));
+            upgraded = false;
+            return -1;
+
+        default:
+            MQTT_TRANSPORT_ERROR(("[MQTT ERROR] : UNEXPECTED WEBSOCKET OPCODE : %d\r\n", opcode));
+            return -1;
+        }
+    }
+
+    /* Reads one CRLF-terminated line of the upgrade response; returns its length without the line ending, or -1 */
+    int read_line(char* line, int size) {
+        int len = 0;
+        unsigned char c = 0;
+
+        for (;;) {
+            if (tls.read(&c, 1, MQTT_WEBSOCKET_HANDSHAKE_TIMEOUT) != 1) {
+                return -1;
+            }
+            if (c == '\n') {
+                break;
+            }
+            if (c != '\r') {
+                if (len >= size - 1) {
+                    return -1;
+                }
+                line[len++] = (char)c;
+            }
+        }
+        while (len > 0 && (line[len - 1] == ' ' || line[len - 1] == '\t')) {
+            len--;
+        }
+        line[len] = '\0';
+        return len;
+    }
+
+    int handshake(const char* hostname) {
+        unsigned char nonce[16];
+        char key[MQTT_WEBSOCKET_KEY_LENGTH + 1];
+        char accept[MQTT_WEBSOCKET_ACCEPT_LENGTH + 1];
+        const char* value = NULL;
+        size_t olen = 0;
+        int status = 0;
+        bool accepted = false;
+        int len = 0;
+
+        if (mbedtls_ctr_drbg_random(&drbg, nonce, sizeof(nonce)) != 0 ||
+                mbedtls_base64_encode((unsigned char*)key, sizeof(key), &olen, nonce, sizeof(nonce)) != 0 ||
+                mqtt_websocket_accept_key(key, accept) != 0) {
+            return -1;
+        }
+
+        len = snprintf((char*)staging, sizeof(staging), " HTTP/1.1\r\nHost: %s\r\nUpgrade: websocket\r\nConnection: Upgrade\r\n"
+                "Sec-WebSocket-Key: %s\r\nSec-WebSocket-Protocol: mqtt\r\nSec-WebSocket-Version: 13\r\n\r\n", hostname, key);
+        if (len <= 0 || len >= (int)sizeof(staging)) {
+            return -1;
+        }
+        /* a presigned path with a session token can be longer than the staging buffer, so it is sent from where it is */
+        if (write_all((const unsigned char*)"GET ", 4) != 0 || write_all((const unsigned char*)path, strlen(path)) != 0 ||
+                write_all(staging, len) != 0) {
+            return -1;
+        }
+
+        /* status line, then headers up to the empty line */
+        for (;;) {
+            len = read_line((char*)staging, sizeof(staging));
+            if (len < 0) {
+                return -1;
+            }
+            if (len == 0) {
+                break;
+            }
+            if (status == 0) {
+                if (strncmp((char*)staging, "HTTP/1.1 ", 9) != 0) {
+                    return -1;
+                }
+                status = atoi((char*)staging + 9);
+                continue;
+            }
+            value = mqtt_websocket_header_value((char*)staging, "Sec-WebSocket-Accept");
+            if (value != NULL && strcmp(value, accept) == 0) {
+                accepted = true;
+            }
+        }
+
+        if (status != 101 || !accepted) {
+            MQTT_TRANSPORT_ERROR(("[MQTT ERROR] : WEBSOCKET UPGRADE REJECTED : %d\r\n", status));
+            return -1;
+        }
+        return 0;
+    }
+
+    int seed_random() {
+        if (random_ready) {
+            return 0;
+        }
+        mbedtls_entropy_init(&entropy);
+        mbedtls_ctr_drbg_init(&drbg);
+        random_ready = true;
+        masks_used = sizeof(masks);
+        return mbedtls_ctr_drbg_seed(&drbg, mbedtls_entropy_func, &entropy, (const unsigned char*)"mqtt-websocket", 14);
+    }
+
+    void free_random() {
+        if (random_ready) {
+            mbedtls_ctr_drbg_free(&drbg);
+            mbedtls_entropy_free(&entropy);
+            random_ready = false;
+        }
+    }
+
+    /* Masking keys must be unpredictable ( RFC 6455 10.3 ); they are drawn in batches so the DRBG runs once per 16 frames */
+    int next_mask(unsigned char mask[4]) {
+        if (masks_used >= sizeof(masks)) {
+            if (mbedtls_ctr_drbg_random(&drbg, masks, sizeof(masks)) != 0) {
+                return -1;
+            }
+            masks_used = 0;
+        }
+        memcpy(mask, masks + masks_used, 4);
+        masks_used += 4;
+        return 0;
+    }
+};
+
+/* Plain TCP; reads block until the requested bytes are in */
+class MQTTTcpTransport {
+public:
+    MQTTTcpTransport(mqtt_security_flag mode = NON_SECURED_MQTT) {
+    }
+
+    static bool supports(mqtt_security_flag mode) {
+        return mode == NON_SECURED_MQTT;
+    }
+
+    int connect(NetworkInterface* network, const char* hostname, int port, const char* peer_cn, mqtt_network_stats_t* stats) {
+        SocketAddress address;
+        Timer phase_timer;
+        int rc = mqtt_connect_tcp(network, tcp, hostname, port, address, phase_timer, stats);
+
+        mqtt_record_phase(phase_timer, stats ? &stats->tls_ms : NULL);
+        return rc;
+    }
+
+    int read(unsigned char* buffer, int len, int timeout) {
+        int bytes_read = 0;
+        int ret = 0;
+
+        do {
+            ret = tcp.recv(buffer + bytes_read, len - bytes_read);
+            if (ret < 0) {
+                return -1;
+            }
+            bytes_read += ret;
+        } while (bytes_read < len);
+        return bytes_read;
+    }
+
+    int write(unsigned char* buffer, int len) {
+        return tcp.send(buffer, len);
+    }
+
+    int disconnect() {
+        return tcp.close();
+    }
+
+    TLSSocketWrapper* tls_socket() {
+        return NULL;
+    }
+
+    void set_upgrade_path(const char* upgrade_path) {
+    }
+
+    void set_loopback_faults(const mqtt_loopback_faults_t& faults) {
+    }
+
+private:
+    TCPSocket tcp;
+};
+
+#ifdef AWS_IOT_LOOPBACK
+/* In-process broker stand-in; no network is used. Built only with AWS_IOT_LOOPBACK, as it holds its packet queues in place. */
+class MQTTLoopbackTransport {
+public:
+    MQTTLoopbackTransport(mqtt_security_flag mode = LOOPBACK_MQTT) {
+    }
+
+    static bool supports(mqtt_security_flag mode) {
+        return mode == LOOPBACK_MQTT;
+    }
+
+    int connect(NetworkInterface* network, const char* hostname, int port, const char* peer_cn, mqtt_network_stats_t* stats) {
+        if (stats != NULL) {
+            stats->dns_ms = stats->tcp_ms = stats->tls_ms = 0;
+        }
+        return loopback.connect();
+    }
+
+    int read(unsigned char* buffer, int len, int timeout) {
+        return loopback.read(buffer, len, timeout);
+    }
+
+    int write(unsigned char* buffer, int len) {
+        return loopback.write(buffer, len);
+    }
+
+    int disconnect() {
+        return loopback.disconnect();
+    }
+
+    TLSSocketWrapper* tls_socket() {
+        return NULL;
+    }
+
+    void set_upgrade_path(const char* upgrade_path) {
+    }
+
+    void set_loopback_faults(const mqtt_loopback_faults_t& faults) {
+        loopback.set_faults(faults);
+    }
+
+private:
+    MQTTLoopback loopback;
+};
+#endif
+
+/* Picks one of the transports above when the network is created, for clients that choose per endpoint.
+ * Only the selected transport is constructed; with AWS_IOT_STATIC_ALLOCATION it goes into storage shared by all of them,
+ * so the network holds the largest transport rather than all of them. The branch is taken once per call. */
+class MQTTSelectTransport {
+public:
+    MQTTSelectTransport(mqtt_security_flag selected_mode) :
+            mode(selected_mode) {
+        if (mode == SECURED_MQTT) {
+            transport.tls = create<MQTTTlsTransport>();
+#ifdef AWS_IOT_LOOPBACK
+        } else if (mode == LOOPBACK_MQTT) {
+            transport.loopback = create<MQTTLoopbackTransport>();
+#endif
+        } else if (mode == WEBSOCKET_MQTT) {
+            transport.websocket = create<MQTTWebSocketTransport>();
+        } else {
+            mode = NON_SECURED_MQTT;
+            transport.tcp = create<MQTTTcpTransport>();
+        }
+    }
+
+    ~MQTTSelectTransport() {
+        switch (mode) {
+        case SECURED_MQTT:   destroy(transport.tls); break;
+#ifdef AWS_IOT_LOOPBACK
+        case LOOPBACK_MQTT:  destroy(transport.loopback); break;
+#endif
+        case WEBSOCKET_MQTT: destroy(transport.websocket); break;
+        default:             destroy(transport.tcp); break;
+        }
+    }
+
+    static bool supports(mqtt_security_flag mode) {
+#ifdef AWS_IOT_LOOPBACK
+        return true;
+#else
+        return mode != LOOPBACK_MQTT;
+#endif
+    }
+
+    int connect(NetworkInterface* network, const char* hostname, int port, const char* peer_cn, mqtt_network_stats_t* stats) {
+        switch (mode) {
+        case SECURED_MQTT:   return transport.tls->connect(network, hostname, port, peer_cn, stats);
+#ifdef AWS_IOT_LOOPBACK
+        case LOOPBACK_MQTT:  return transport.loopback->connect(network, hostname, port, peer_cn, stats);
+#endif
+        case WEBSOCKET_MQTT: return transport.websocket->connect(network, hostname, port, peer_cn, stats);
+        default:             return transport.tcp->connect(network, hostname, port, peer_cn, stats);
+        }
+    }
+
+    int read(unsigned char* buffer, int len, int timeout) {
+        switch (mode) {
+        case SECURED_MQTT:   return transport.tls->read(buffer, len, timeout);
+#ifdef AWS_IOT_LOOPBACK
+        case LOOPBACK_MQTT:  return transport.loopback->read(buffer, len, timeout);
+#endif
+        case WEBSOCKET_MQTT: return transport.websocket->read(buffer, len, timeout);
+        default:             return transport.tcp->read(buffer, len, timeout);
+        }
+    }
+
+    int write(unsigned char* buffer, int len) {
+        switch (mode) {
+        case SECURED_MQTT:   return transport.tls->write(buffer, len);
+#ifdef AWS_IOT_LOOPBACK
+        case LOOPBACK_MQTT:  return transport.loopback->write(buffer, len);
+#endif
+        case WEBSOCKET_MQTT: return transport.websocket->write(buffer, len);
+        default:             return transport.tcp->write(buffer, len);
+        }
+    }
+
+    int disconnect() {
+        switch (mode) {
+        case SECURED_MQTT:   return transport.tls->disconnect();
+#ifdef AWS_IOT_LOOPBACK
+        case LOOPBACK_MQTT:  return transport.loopback->disconnect();
+#endif
+        case WEBSOCKET_MQTT: return transport.websocket->disconnect();
+        default:             return transport.tcp->disconnect();
+        }
+    }
+
+    TLSSocketWrapper* tls_socket() {
+        switch (mode) {
+        case SECURED_MQTT:   return transport.tls->tls_socket();
+        case WEBSOCKET_MQTT: return transport.websocket->tls_socket();
+        default:             return NULL;
+        }
+    }
+
+    void set_upgrade_path(const char* upgrade_path) {
+        if (mode == WEBSOCKET_MQTT) {
+            transport.websocket->set_upgrade_path(upgrade_path);
+        }
+    }
+
+    void set_loopback_faults(const mqtt_loopback_faults_t& faults) {
+#ifdef AWS_IOT_LOOPBACK
+        if (mode == LOOPBACK_MQTT) {
+            transport.loopback->set_loopback_faults(faults);
+        }
+#endif
+    }
+
+private:
+    MQTTSelectTransport(const MQTTSelectTransport&);
+    MQTTSelectTransport& operator=(const MQTTSelectTransport&);
+
+    template<typename T>
+    T* create() {
+#ifdef AWS_IOT_STATIC_ALLOCATION
+        return new (&storage) T(mode);
+#else
+        return new T(mode);
+#endif
+    }
+
+    template<typename T>
+    void destroy(T* selected) {
+#ifdef AWS_IOT_STATIC_ALLOCATION
+        selected->~T();
+#else
+        delete selected;
+#endif
+    }
+
+    mqtt_security_flag mode;
+    union {
+        MQTTTlsTransport* tls;
+        MQTTTcpTransport* tcp;
+        MQTTWebSocketTransport* websocket;
+#ifdef AWS_IOT_LOOPBACK
+        MQTTLoopbackTransport* loopback;
+#endif
+    } transport;
+#ifdef AWS_IOT_STATIC_ALLOCATION
+    /* uint64_t elements keep the storage aligned for any member of the transports */
+    union {
+        uint64_t tls[(sizeof(MQTTTlsTransport) + sizeof(uint64_t) - 1) / sizeof(uint64_t)];
+        uint64_t tcp[(sizeof(MQTTTcpTransport) + sizeof(uint64_t) - 1) / sizeof(uint64_t)];
+        uint64_t websocket[(sizeof(MQTTWebSocketTransport) + sizeof(uint64_t) - 1) / sizeof(uint64_t)];
+#ifdef AWS_IOT_LOOPBACK
+        uint64_t loopback[(sizeof(MQTTLoopbackTransport) + sizeof(uint64_t) - 1) / sizeof(uint64_t)];
+#endif
+    } storage;
+#endif
+};
+
+#endif // _MQTTTRANSPORT_H_
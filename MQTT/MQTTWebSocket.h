@@ -0,0 +1,184 @@
+/*
+ * Copyright 2019-2020 Cypress Semiconductor Corporation
+ * SPDX-License-Identifier: Apache-2.0
+ * 
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ * 
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ * 
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+/** file
+ *
+ * WebSocket ( RFC 6455 ) framing used by MQTTWebSocketTransport: frame headers, payload masking and the upgrade handshake keys
+ */
+#ifndef _MQTTWEBSOCKET_H_
+#define _MQTTWEBSOCKET_H_
+
+#include <ctype.h>
+#include "mbed.h"
+#include "mbedtls/sha1.h"
+#include "mbedtls/base64.h"
+
+#define MQTT_WEBSOCKET_GUID                 "258EAFA5-E914-47DA-95CA-C5AB0DC85B11"
+#define MQTT_WEBSOCKET_DEFAULT_PATH         "/mqtt"
+
+/* Staging buffer for masked payload and handshake lines; a larger buffer means fewer TLS records per frame */
+#ifndef MQTT_WEBSOCKET_BUFFER_SIZE
+#define MQTT_WEBSOCKET_BUFFER_SIZE          512
+#endif
+#define MQTT_WEBSOCKET_HANDSHAKE_TIMEOUT    5000
+#define MQTT_WEBSOCKET_CONTROL_TIMEOUT      1000
+
+#define MQTT_WEBSOCKET_KEY_LENGTH           24      /* base64 of 16 random bytes */
+#define MQTT_WEBSOCKET_ACCEPT_LENGTH        28      /* base64 of a SHA-1 digest */
+#define MQTT_WEBSOCKET_MAX_HEADER_LENGTH    14
+#define MQTT_WEBSOCKET_MAX_CONTROL_PAYLOAD  125
+
+#define MQTT_WEBSOCKET_FIN                  0x80
+#define MQTT_WEBSOCKET_MASKED               0x80
+#define MQTT_WEBSOCKET_OPCODE(byte)         ((byte) & 0x0F)
+#define MQTT_WEBSOCKET_CONTINUATION         0x0
+#define MQTT_WEBSOCKET_BINARY               0x2
+#define MQTT_WEBSOCKET_CLOSE                0x8
+#define MQTT_WEBSOCKET_PING                 0x9
+#define MQTT_WEBSOCKET_PONG                 0xA
+
+/* Widest register the target XORs in one instruction: 32 bits on Cortex-M, 64 bits on a 64-bit host */
+typedef size_t mqtt_websocket_word_t;
+
+/* out[i] = in[i] ^ mask[(offset + i) % 4]; in and out may be the same buffer.
+ * Masking is applied to every byte a client sends, so after aligning the output the payload is XORed a word at a time,
+ * four words per iteration, with the mask replicated across the word. Unaligned input is loaded with memcpy, which the
+ * compiler turns into a plain load on targets that allow it. */
+static inline void mqtt_websocket_mask(const unsigned char* in, unsigned char* out, size_t len, const unsigned char mask[4], size_t offset) {
+    mqtt_websocket_word_t pattern;
+    mqtt_websocket_word_t words[4];
+    unsigned char pattern_bytes[sizeof(mqtt_websocket_word_t)];
+    size_t i = 0;
+    size_t j = 0;
+
+    while (i < len && ((uintptr_t)(out + i) % sizeof(mqtt_websocket_word_t)) != 0) {
+        out[i] = in[i] ^ mask[(offset + i) & 3];
+        i++;
+    }
+
+    /* the word size is a multiple of 4, so every word starts at the same mask phase */
+    for (j = 0; j < sizeof(pattern_bytes); j++) {
+        pattern_bytes[j] = mask[(offset + i + j) & 3];
+    }
+    memcpy(&pattern, pattern_bytes, sizeof(pattern));
+
+    for (; i + sizeof(words) <= len; i += sizeof(words)) {
+        memcpy(words, in + i, sizeof(words));
+        words[0] ^= pattern;
+        words[1] ^= pattern;
+        words[2] ^= pattern;
+        words[3] ^= pattern;
+        memcpy(out + i, words, sizeof(words));
+    }
+    for (; i + sizeof(pattern) <= len; i += sizeof(pattern)) {
+        memcpy(words, in + i, sizeof(pattern));
+        words[0] ^= pattern;
+        memcpy(out + i, words, sizeof(pattern));
+    }
+
+    for (; i < len; i++) {
+        out[i] = in[i] ^ mask[(offset + i) & 3];
+    }
+}
+
+/* Writes the header of a final, masked client frame and returns its length */
+static inline int mqtt_websocket_frame_header(unsigned char* header, unsigned char opcode, uint64_t payload_len, const unsigned char mask[4]) {
+    int n = 0;
+    int i = 0;
+
+    header[n++] = MQTT_WEBSOCKET_FIN | opcode;
+    if (payload_len < 126) {
+        header[n++] = MQTT_WEBSOCKET_MASKED | (unsigned char)payload_len;
+    } else if (payload_len <= 0xFFFF) {
+        header[n++] = MQTT_WEBSOCKET_MASKED | 126;
+        header[n++] = (unsigned char)(payload_len >> 8);
+        header[n++] = (unsigned char)payload_len;
+    } else {
+        header[n++] = MQTT_WEBSOCKET_MASKED | 127;
+        for (i = 7; i >= 0; i--) {
+            header[n++] = (unsigned char)(payload_len >> (8 * i));
+        }
+    }
+    memcpy(header + n, mask, 4);
+    return n + 4;
+}
+
+/* Length of a frame header, known once its first two bytes are in */
+static inline int mqtt_websocket_header_length(const unsigned char* header) {
+    int len = 2;
+    unsigned char payload_len = header[1] & 0x7F;
+
+    if (payload_len == 126) {
+        len += 2;
+    } else if (payload_len == 127) {
+        len += 8;
+    }
+    if (header[1] & MQTT_WEBSOCKET_MASKED) {
+        len += 4;
+    }
+    return len;
+}
+
+static inline uint64_t mqtt_websocket_payload_length(const unsigned char* header) {
+    unsigned char payload_len = header[1] & 0x7F;
+    uint64_t len = 0;
+    int i = 0;
+
+    if (payload_len < 126) {
+        return payload_len;
+    }
+    for (i = 0; i < (payload_len == 126 ? 2 : 8); i++) {
+        len = (len << 8) | header[2 + i];
+    }
+    return len;
+}
+
+/* Sec-WebSocket-Accept expected for a Sec-WebSocket-Key: base64( SHA-1( key + GUID ) ) */
+static inline int mqtt_websocket_accept_key(const char* key, char accept[MQTT_WEBSOCKET_ACCEPT_LENGTH + 1]) {
+    unsigned char input[MQTT_WEBSOCKET_KEY_LENGTH + sizeof(MQTT_WEBSOCKET_GUID)];
+    unsigned char digest[20];
+    size_t key_len = strlen(key);
+    size_t olen = 0;
+
+    if (key_len > MQTT_WEBSOCKET_KEY_LENGTH) {
+        return -1;
+    }
+    memcpy(input, key, key_len);
+    memcpy(input + key_len, MQTT_WEBSOCKET_GUID, sizeof(MQTT_WEBSOCKET_GUID) - 1);
+    if (mbedtls_sha1_ret(input, key_len + sizeof(MQTT_WEBSOCKET_GUID) - 1, digest) != 0) {
+        return -1;
+    }
+    return mbedtls_base64_encode((unsigned char*)accept, MQTT_WEBSOCKET_ACCEPT_LENGTH + 1, &olen, digest, sizeof(digest));
+}
+
+/* Case-insensitive match of an HTTP header name at the start of a response line; returns the value with leading blanks skipped */
+static inline const char* mqtt_websocket_header_value(const char* line, const char* name) {
+    size_t i = 0;
+
+    for (i = 0; name[i] != '\0'; i++) {
+        if (line[i] == '\0' || tolower((unsigned char)line[i]) != tolower((unsigned char)name[i])) {
+            return NULL;
+        }
+    }
+    if (line[i] != ':') {
+        return NULL;
+    }
+    for (i++; line[i] == ' ' || line[i] == '\t'; i++) {
+    }
+    return line + i;
+}
+
+#endif // _MQTTWEBSOCKET_H_
@@ -0,0 +1,139 @@
+/*
+ * Copyright 2019-2020 Cypress Semiconductor Corporation
+ * SPDX-License-Identifier: Apache-2.0
+ * 
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ * 
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ * 
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+
+/** @file
+ *
+ * Implementation for the send window of a chunked AWS IoT publish
+ *
+ */
+#include "aws_chunk_window.h"
+#include "string.h"
+
+AWSIoTChunkWindow::AWSIoTChunkWindow()
+{
+    uint8_t i = 0;
+
+    transfer = NULL;
+    window = 1;
+    timeout_ms = 0;
+    expired = 0;
+    next = 0;
+    for( i = 0; i < AWS_CHUNK_MAX_WINDOW; i++ ) {
+        slots[i].in_flight = false;
+        slots[i].acked = false;
+        slots[i].id = 0;
+    }
+}
+
+AWSIoTChunkWindow::~AWSIoTChunkWindow()
+{
+    cancel_deadlines();
+}
+
+void AWSIoTChunkWindow::deadline_passed( void* arg )
+{
+    core_util_atomic_store_u8( &( (AWSIoTChunkWindow*) arg )->expired, 1 );
+}
+
+void AWSIoTChunkWindow::cancel_deadlines()
+{
+    uint8_t i = 0;
+
+    for( i = 0; i < AWS_CHUNK_MAX_WINDOW; i++ ) {
+        AWSIoTTimerWheel::shared().cancel( &slots[i].deadline );
+    }
+}
+
+void AWSIoTChunkWindow::start( aws_chunk_transfer_t* progress, uint8_t size, uint32_t timeout_ms )
+{
+    uint8_t i = 0;
+
+    cancel_deadlines();
+    transfer = progress;
+    window = ( size == 0 ) ? 1 : ( size > AWS_CHUNK_MAX_WINDOW ) ? AWS_CHUNK_MAX_WINDOW : size;
+    AWSIoTChunkWindow::timeout_ms = timeout_ms;
+    next = transfer->acked_chunks;
+    for( i = 0; i < AWS_CHUNK_MAX_WINDOW; i++ ) {
+        slots[i].in_flight = false;
+        slots[i].acked = false;
+        slots[i].id = 0;
+    }
+    core_util_atomic_store_u8( &expired, 0 );
+}
+
+bool AWSIoTChunkWindow::done() const
+{
+    return transfer->acked_chunks >= transfer->chunk_count;
+}
+
+bool AWSIoTChunkWindow::can_send() const
+{
+    return next < transfer->chunk_count && next - transfer->acked_chunks < window;
+}
+
+uint32_t AWSIoTChunkWindow::next_chunk() const
+{
+    return next;
+}
+
+void AWSIoTChunkWindow::sent( uint64_t now_ms, uint16_t id )
+{
+    slot& s = slots[next % window];
+
+    s.in_flight = true;
+    s.acked = false;
+    s.id = id;
+    AWSIoTTimerWheel::shared().schedule( &s.deadline, now_ms + timeout_ms + 1, deadline_passed, this );
+
+    if( next < transfer->sent_chunks ) {
+        transfer->retransmits++;
+    } else {
+        transfer->sent_chunks = next + 1;
+    }
+    next++;
+}
+
+void AWSIoTChunkWindow::acked( uint16_t id )
+{
+    uint8_t i = 0;
+
+    for( i = 0; i < window; i++ ) {
+        if( slots[i].in_flight && slots[i].id == id ) {
+            slots[i].acked = true;
+            AWSIoTTimerWheel::shared().cancel( &slots[i].deadline );
+            break;
+        }
+    }
+    if( i == window ) {
+        return;
+    }
+
+    /* slide over the acknowledged prefix */
+    while( transfer->acked_chunks < next && slots[transfer->acked_chunks % window].acked ) {
+        slots[transfer->acked_chunks % window].in_flight = false;
+        slots[transfer->acked_chunks % window].acked = false;
+        transfer->acked_chunks++;
+    }
+}
+
+bool AWSIoTChunkWindow::timed_out( uint64_t now_ms )
+{
+    AWSIoTTimerWheel::shared().advance( now_ms );
+    return core_util_atomic_load_u8( &expired ) != 0;
+}
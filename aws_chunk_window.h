@@ -0,0 +1,115 @@
+/*
+ * Copyright 2019-2020 Cypress Semiconductor Corporation
+ * SPDX-License-Identifier: Apache-2.0
+ * 
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ * 
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ * 
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+/** @file
+ *  Send window of a chunked AWS IoT publish
+ */
+#ifndef AWS_CHUNK_WINDOW_H
+#define AWS_CHUNK_WINDOW_H
+
+#include "aws_common.h"
+#include "aws_timer_wheel.h"
+
+/**
+ * @addtogroup aws_iot_classes
+ *
+ * @{
+ */
+
+/** Tracks which chunks of a chunked publish are in flight and which have been acknowledged.
+ *
+ * Up to 'window' QoS1 chunks are outstanding at a time. Each is sent with a packet identifier from the client's
+ * allocator, which the window keeps to map a PUBACK back to its chunk. PUBACKs may arrive in any order; the
+ * acknowledged prefix of the transfer ( @ref aws_chunk_transfer_t::acked_chunks ) only advances over chunks
+ * that have no unacknowledged chunk ahead of them, which makes it the point a resumed transfer restarts from.
+ * The PUBACK deadline of each chunk is a timer on the shared @ref AWSIoTTimerWheel, armed on send and cancelled on PUBACK.
+ */
+class AWSIoTChunkWindow
+{
+public:
+    /** Default constructor of AWSIoTChunkWindow class. */
+    AWSIoTChunkWindow();
+
+    /** Cancels the PUBACK deadlines still armed. */
+    ~AWSIoTChunkWindow();
+
+    /** Starts or resumes a transfer. Chunks that were in flight are forgotten and will be sent again.
+     *
+     * @param[in] progress        : Progress of the transfer, updated as chunks are acknowledged
+     * @param[in] size            : Number of chunks that may be in flight, at most @ref AWS_CHUNK_MAX_WINDOW
+     * @param[in] timeout_ms      : Time allowed for a PUBACK
+     *
+     */
+    void start( aws_chunk_transfer_t* progress, uint8_t size, uint32_t timeout_ms );
+
+    /** Returns true if every chunk has been acknowledged. */
+    bool done() const;
+
+    /** Returns true if the window has room for @ref next_chunk. */
+    bool can_send() const;
+
+    /** Returns the sequence number of the chunk to send next. */
+    uint32_t next_chunk() const;
+
+    /** Records that @ref next_chunk was written.
+     *
+     * @param[in] now_ms          : Current time in milliseconds
+     * @param[in] id              : Packet identifier the chunk was sent with
+     *
+     */
+    void sent( uint64_t now_ms, uint16_t id );
+
+    /** Records a PUBACK. Identifiers that do not belong to an in-flight chunk are ignored.
+     *
+     * @param[in] id              : Packet identifier of the PUBACK
+     *
+     */
+    void acked( uint16_t id );
+
+    /** Returns true if a chunk has waited longer than the timeout given to @ref start for its PUBACK.
+     *
+     * @param[in] now_ms          : Current time in milliseconds
+     *
+     */
+    bool timed_out( uint64_t now_ms );
+
+private:
+    struct slot
+    {
+        bool     in_flight;
+        bool     acked;
+        uint16_t id;
+        AWSIoTTimerWheel::timer deadline;
+    };
+
+    static void deadline_passed( void* arg );
+    void cancel_deadlines();
+
+    aws_chunk_transfer_t* transfer;
+    uint8_t window;
+    uint32_t timeout_ms;
+    volatile uint8_t expired;       /**< Set by the timer wheel, possibly from another connection's thread */
+    uint32_t next;
+    slot slots[AWS_CHUNK_MAX_WINDOW];
+};
+
+/**
+ * @}
+ */
+
+#endif
@@ -21,11 +21,98 @@
  *
  */
 #include "aws_client.h"
-#include "https_request.h"
+
+#if AWS_SESSION_MAX_TOPIC_LENGTH > AWS_SUBMIT_MAX_TOPIC_LENGTH
+#error "AWS_SESSION_MAX_TOPIC_LENGTH exceeds the topic of a submission slot"
+#endif
 
 static aws_greengrass_discovery_callback_data_t discovery_data;
 extern cy_linked_list_t* group_list;
 
+/* Size of the PUBLISH packet on the wire, as accounted by AWS IoT throughput limits */
+static uint32_t publish_packet_size( const char* topic, uint32_t length, aws_iot_qos_level_t qos )
+{
+    return AWSIoTPublishPacket::size( strlen( topic ), length, qos );
+}
+
+static void chunk_acked( unsigned short packet_id, unsigned char reason, void* arg )
+{
+    /* a chunk the broker refused stays unacknowledged, and the transfer fails once it times out */
+    if( reason < 0x80 ) {
+        ( (AWSIoTChunkWindow*) arg )->acked( packet_id );
+    }
+}
+
+/* PUBACK wait of a publish through a registered topic */
+typedef struct
+{
+    unsigned short packet_id;
+    unsigned char  reason;
+    bool           acked;
+} topic_ack_t;
+
+static void topic_acked( unsigned short packet_id, unsigned char reason, void* arg )
+{
+    topic_ack_t* ack = (topic_ack_t*) arg;
+
+    if( packet_id == ack->packet_id ) {
+        ack->reason = reason;
+        ack->acked = true;
+    }
+}
+
+static void put_uint32( unsigned char* buffer, uint32_t value )
+{
+    buffer[0] = (unsigned char) ( value >> 24 );
+    buffer[1] = (unsigned char) ( value >> 16 );
+    buffer[2] = (unsigned char) ( value >> 8 );
+    buffer[3] = (unsigned char) value;
+}
+
+static void record_latency( uint32_t* histogram, uint32_t* max_ms, uint32_t latency_ms )
+{
+    uint32_t bucket = 0;
+    uint32_t value = latency_ms;
+
+    while( value > 0 && bucket < AWS_METRICS_LATENCY_BUCKETS - 1 ) {
+        bucket++;
+        value >>= 1;
+    }
+
+    histogram[bucket]++;
+    if( latency_ms > *max_ms ) {
+        *max_ms = latency_ms;
+    }
+}
+
+static void record_publish_latency( aws_iot_metrics_t* metrics, uint32_t latency_ms )
+{
+    record_latency( metrics->publish_latency, &metrics->publish_latency_max_ms, latency_ms );
+}
+
+static aws_priority_params_t default_priority_params()
+{
+    aws_priority_params_t params;
+    uint32_t i = 0;
+
+    for( i = 0; i < AWS_PRIORITY_LANES; i++ ) {
+        params.budget[i] = (uint32_t) AWS_PRIORITY_DEFAULT_BUDGET << ( AWS_PRIORITY_LANES - 1 - i );
+    }
+    return params;
+}
+
+/* Publish parameters as far as the caller declared them; the fields after QoS are garbage in parameters filled in by older applications */
+static aws_publish_params_t declared_publish_params( const aws_publish_params_t& params )
+{
+    aws_publish_params_t declared = AWS_PUBLISH_PARAMS_INITIALIZER;
+
+    if( params.params_version == AWS_PARAMS_VERSION ) {
+        return params;
+    }
+    declared.QoS = params.QoS;
+    return declared;
+}
+
 AWSIoTClient::AWSIoTClient()
 {
     /* Assign thing name and credentials to AWS client members */
@@ -39,8 +126,22 @@ AWSIoTClient::AWSIoTClient()
     AWSIoTClient::network = NULL;
     AWSIoTClient::flag = SECURED_MQTT;
     AWSIoTClient::mqttnetwork = NULL;
+    AWSIoTClient::mqtt5 = NULL;
     AWSIoTClient::mqtt_obj = NULL;
     AWSIoTClient::ep = NULL;
+    memset( &loopback_faults, 0, sizeof(loopback_faults) );
+    memset( &sigv4_credentials, 0, sizeof(sigv4_credentials) );
+    AWSIoTClient::pingresps_seen = 0;
+    AWSIoTClient::async_used = 0;
+    memset( topics, 0, sizeof(topics) );
+    memset( handler_topics, 0, sizeof(handler_topics) );
+    AWSIoTClient::last_packet_id = 0;
+    AWSIoTClient::packet_lease = 0;
+    AWSIoTClient::session_present = false;
+    AWSIoTClient::link_lost = false;
+    AWSIoTClient::credentials = &own_credentials;
+    set_priority_params( default_priority_params() );
+    reset_metrics();
 };
 
 AWSIoTClient::AWSIoTClient(NetworkInterface* network, const char* thing_name, const char* private_key, uint16_t key_length, const char* certificate, uint16_t certificate_length)
@@ -56,8 +157,22 @@ AWSIoTClient::AWSIoTClient(NetworkInterface* network, const char* thing_name, co
     AWSIoTClient::network = network;
     AWSIoTClient::flag = SECURED_MQTT;
     AWSIoTClient::mqttnetwork = NULL;
+    AWSIoTClient::mqtt5 = NULL;
     AWSIoTClient::mqtt_obj = NULL;
     AWSIoTClient::ep = NULL;
+    memset( &loopback_faults, 0, sizeof(loopback_faults) );
+    memset( &sigv4_credentials, 0, sizeof(sigv4_credentials) );
+    AWSIoTClient::pingresps_seen = 0;
+    AWSIoTClient::async_used = 0;
+    memset( topics, 0, sizeof(topics) );
+    memset( handler_topics, 0, sizeof(handler_topics) );
+    AWSIoTClient::last_packet_id = 0;
+    AWSIoTClient::packet_lease = 0;
+    AWSIoTClient::session_present = false;
+    AWSIoTClient::link_lost = false;
+    AWSIoTClient::credentials = &own_credentials;
+    set_priority_params( default_priority_params() );
+    reset_metrics();
 }
 
 void AWSIoTClient::set_command_timeout( int command_timeout )
@@ -65,11 +180,303 @@ void AWSIoTClient::set_command_timeout( int command_timeout )
     AWSIoTClient::command_timeout = command_timeout;
 }
 
+void AWSIoTClient::set_rate_limit( aws_rate_limit_params_t params )
+{
+    rate_limiter.configure( params );
+}
+
+void AWSIoTClient::get_rate_limit_stats( aws_rate_limit_stats_t* stats )
+{
+    rate_limiter.get_stats( stats );
+}
+
+void AWSIoTClient::set_loopback_faults( mqtt_loopback_faults_t faults )
+{
+    loopback_faults = faults;
+}
+
+void AWSIoTClient::set_sigv4_credentials( aws_sigv4_credentials_t credentials )
+{
+    sigv4_credentials = credentials;
+}
+
+void AWSIoTClient::set_keep_alive_params( aws_keep_alive_params_t params )
+{
+    keep_alive.configure( params );
+}
+
+void AWSIoTClient::set_priority_params( aws_priority_params_t params )
+{
+    uint32_t i = 0;
+
+    for( i = 0; i < AWS_PRIORITY_LANES; i++ ) {
+        outbound_lanes.set_budget( i, params.budget[i] );
+    }
+}
+
+cy_rslt_t AWSIoTClient::enable_dispatch( aws_dispatch_params_t params )
+{
+    /* a received topic and payload never exceed the packet size, so every message fits a slot */
+    if( AWS_DISPATCH_MAX_MESSAGE_LENGTH < AWS_MAX_PACKET_SIZE ) {
+        AWS_LIBRARY_ERROR(("AWS_DISPATCH_MAX_MESSAGE_LENGTH is smaller than AWS_MAX_PACKET_SIZE \n"));
+        return CY_RSLT_AWS_ERROR_BUFFER_OVERFLOW;
+    }
+    return dispatcher.start( params );
+}
+
+void AWSIoTClient::disable_dispatch()
+{
+    dispatcher.stop();
+}
+
+cy_rslt_t AWSIoTClient::enable_duplicate_filter( aws_duplicate_filter_params_t params )
+{
+    return dispatcher.enable_duplicate_filter( params );
+}
+
+void AWSIoTClient::disable_duplicate_filter()
+{
+    dispatcher.disable_duplicate_filter();
+}
+
+cy_rslt_t AWSIoTClient::enable_value_cache( const char* topic_filter )
+{
+    return dispatcher.enable_value_cache( topic_filter );
+}
+
+void AWSIoTClient::disable_value_cache( const char* topic_filter )
+{
+    dispatcher.disable_value_cache( topic_filter );
+}
+
+cy_rslt_t AWSIoTClient::get_last_value( const char* topic, char* buffer, uint32_t size, aws_cached_value_t* value )
+{
+    return dispatcher.get_last_value( topic, buffer, size, value );
+}
+
+uint32_t AWSIoTClient::get_value_cache_version()
+{
+    return dispatcher.value_cache_version();
+}
+
+cy_rslt_t AWSIoTClient::enable_session_journal( aws_session_params_t params )
+{
+    cy_rslt_t result = session.open( params );
+
+    if( result != CY_RSLT_SUCCESS ) {
+        return result;
+    }
+
+    /* identifiers up to the recorded lease may have been used before the restart */
+    last_packet_id = session.packet_id();
+    lease_packet_ids();
+
+    return session.is_open() ? CY_RSLT_SUCCESS : CY_RSLT_AWS_ERROR_JOURNAL_FAILED;
+}
+
+void AWSIoTClient::disable_session_journal()
+{
+    session.close();
+    session_present = false;
+}
+
+bool AWSIoTClient::session_resumed() const
+{
+    return session_present;
+}
+
+void AWSIoTClient::lease_packet_ids()
+{
+    /* identifiers run from 1 to 65535; 0 is not a valid packet identifier */
+    packet_lease = (uint16_t) ( ( last_packet_id + AWS_SESSION_PACKET_ID_LEASE - 1 ) % 65535 + 1 );
+    session.set_packet_id( packet_lease );
+}
+
+uint16_t AWSIoTClient::next_packet_id()
+{
+    last_packet_id = ( last_packet_id == 65535 ) ? 1 : last_packet_id + 1;
+    if( last_packet_id == packet_lease && session.is_open() ) {
+        lease_packet_ids();
+    }
+    return last_packet_id;
+}
+
+int AWSIoTClient::send_acked_publish( const unsigned char* packet, int length, uint16_t packet_id )
+{
+    topic_ack_t ack;
+    uint64_t start_ms = Kernel::get_ms_count();
+    uint64_t now_ms = start_ms;
+    int rc = 0;
+
+    ack.packet_id = packet_id;
+    ack.reason = 0;
+    ack.acked = false;
+    mqttnetwork->set_ack_observer( topic_acked, &ack );
+
+    rc = mqttnetwork->write( (unsigned char*) packet, length, AWSIoTClient::command_timeout );
+    if( rc == length ) {
+        /* the MQTT client ignores PUBACKs it did not ask for; the network's ack observer reports ours */
+        while( !ack.acked && now_ms - start_ms < (uint64_t) AWSIoTClient::command_timeout ) {
+            if( mqtt_obj->yield( AWS_PUBLISH_ACK_POLL_INTERVAL ) == -1 ) {
+                break;
+            }
+            now_ms = Kernel::get_ms_count();
+        }
+    }
+    mqttnetwork->set_ack_observer( NULL, NULL );
+
+    if( !ack.acked ) {
+        /* the link is as good as lost, as the MQTT client treats a missed PUBACK; no DISCONNECT, so the broker still
+         * publishes the Will. process_requests, yield and the journal see it through connection_lost */
+        link_lost = true;
+        return -1;
+    }
+    if( ack.reason >= 0x80 ) {
+        /* an MQTT 5 broker answered, but did not take the message */
+        AWS_LIBRARY_ERROR(("Publish refused by the broker, reason code 0x%02x \n", ack.reason));
+        return -1;
+    }
+    return 0;
+}
+
+bool AWSIoTClient::prepare_publish( const aws_publish_params_t& pub_params, uint32_t topic_length, uint32_t packet_length )
+{
+    if( mqtt5 == NULL ) {
+        return true;
+    }
+
+    /* the network adds the properties to the next PUBLISH it writes */
+    if( mqtt5->set_publish_properties( pub_params.message_expiry, pub_params.user_properties, pub_params.user_property_count ) != 0 ) {
+        return false;
+    }
+    if( !mqtt5->fits( topic_length, packet_length ) ) {
+        AWS_LIBRARY_ERROR(("Publish exceeds the maximum packet size of the MQTT 5 connection \n"));
+        mqtt5->clear_publish_properties();
+        return false;
+    }
+    return true;
+}
+
+int AWSIoTClient::publish_acked( const char* topic, const char* data, uint32_t length )
+{
+    uint16_t packet_id = 0;
+    int packet_length = 0;
+
+    /* same limit as a publish built in the MQTT client's send buffer */
+    if( publish_packet_size( topic, length, AWS_QOS_ATLEAST_ONCE ) > sizeof(publish_buffer) ) {
+        AWS_LIBRARY_ERROR(("Message does not fit into a packet of %d bytes \n", AWS_MAX_PACKET_SIZE));
+        return -1;
+    }
+
+    packet_id = next_packet_id();
+    packet_length = AWSIoTPublishPacket::encode( publish_buffer, sizeof(publish_buffer), topic, strlen( topic ),
+                                                 AWS_QOS_ATLEAST_ONCE, packet_id, data, length );
+
+    return send_acked_publish( publish_buffer, packet_length, packet_id );
+}
+
+bool AWSIoTClient::connection_lost()
+{
+    return link_lost || !mqtt_obj->isConnected();
+}
+
+void AWSIoTClient::get_dispatch_stats( aws_dispatch_stats_t* stats )
+{
+    dispatcher.get_stats( stats );
+}
+
+void AWSIoTClient::set_credentials( AWSIoTCredentials* credentials )
+{
+    AWSIoTClient::credentials = ( credentials != NULL ) ? credentials : &own_credentials;
+}
+
+cy_rslt_t AWSIoTClient::load_credentials()
+{
+    /* Parsed once; later connects and discoveries only attach the parsed objects to the socket */
+    if( credentials->has_client_cert_key() ) {
+        return CY_RSLT_SUCCESS;
+    }
+
+    return credentials->set_client_cert_key( AWSIoTClient::certificate, AWSIoTClient::certificate_length,
+            AWSIoTClient::private_key, AWSIoTClient::key_length );
+}
+
+cy_rslt_t AWSIoTClient::apply_credentials( TLSSocketWrapper& socket, const char* root_ca, uint16_t root_ca_length, AWSIoTCredentials::attachment* attached )
+{
+    cy_rslt_t result = load_credentials();
+
+    if( result != CY_RSLT_SUCCESS ) {
+        return result;
+    }
+
+    return credentials->apply( socket, root_ca, root_ca_length, attached );
+}
+
+void AWSIoTClient::get_metrics( aws_iot_metrics_t* metrics )
+{
+    if( metrics == NULL ) {
+        return;
+    }
+
+    *metrics = AWSIoTClient::metrics;
+    metrics->bytes_sent = network_stats.bytes_sent;
+    metrics->bytes_received = network_stats.bytes_received;
+    metrics->packets_sent = network_stats.packets_sent;
+    metrics->packets_received = network_stats.packets_received;
+    metrics->keep_alive_pings = network_stats.pings_sent;
+    keep_alive.get_metrics( metrics );
+}
+
+void AWSIoTClient::reset_metrics()
+{
+    uint64_t last_sent_ms = network_stats.last_sent_ms;
+    uint64_t last_received_ms = network_stats.last_received_ms;
+
+    memset( &metrics, 0, sizeof(metrics) );
+    memset( &network_stats, 0, sizeof(network_stats) );
+    keep_alive.reset_metrics();
+
+    /* Keep-alive scheduling depends on these, so they survive a reset */
+    network_stats.last_sent_ms = last_sent_ms;
+    network_stats.last_received_ms = last_received_ms;
+    pingresps_seen = 0;
+}
+
+int AWSIoTClient::service_keep_alive()
+{
+    unsigned char pingreq[2];
+    int len = 0;
+    uint64_t now_ms = Kernel::get_ms_count();
+
+    if( network_stats.pingresps_received != pingresps_seen ) {
+        pingresps_seen = network_stats.pingresps_received;
+        keep_alive.pong_received( network_stats.last_pingresp_ms );
+    }
+
+    if( keep_alive.ping_timed_out( now_ms, AWSIoTClient::command_timeout ) ) {
+        AWS_LIBRARY_ERROR(("PINGRESP not received within %d ms \n", AWSIoTClient::command_timeout));
+        return -1;
+    }
+
+    if( keep_alive.next_ping_in( now_ms, network_stats.last_sent_ms, network_stats.last_received_ms ) != 0 ) {
+        return 0;
+    }
+
+    len = MQTTSerialize_pingreq( pingreq, sizeof(pingreq) );
+    if( len <= 0 || mqttnetwork->write( pingreq, len, AWSIoTClient::command_timeout ) != len ) {
+        AWS_LIBRARY_ERROR(("Failed to send PINGREQ \n"));
+        return -1;
+    }
+    keep_alive.ping_sent( now_ms );
+
+    return 0;
+}
+
 AWSIoTEndpoint* AWSIoTClient::create_endpoint(aws_iot_transport_type_t transport, const char* uri, int port, const char* root_ca, uint16_t root_ca_length)
 {
     AWSIoTEndpoint* ep = NULL;
 
-    if(uri == NULL || root_ca == NULL || root_ca_length == 0) {
+    if(uri == NULL) {
         AWS_LIBRARY_ERROR (("Invalid End point parameters\n"));
         goto exit;
     }
@@ -77,10 +484,19 @@ AWSIoTEndpoint* AWSIoTClient::create_endpoint(aws_iot_transport_type_t transport
     switch (transport)
     {
         case AWS_TRANSPORT_MQTT_NATIVE:
+        case AWS_TRANSPORT_MQTT_WEBSOCKET:
+        case AWS_TRANSPORT_RESTFUL_HTTPS:
+        {
+            if(root_ca == NULL || root_ca_length == 0) {
+                AWS_LIBRARY_ERROR (("Invalid End point parameters\n"));
+                goto exit;
+            }
+            break;
+        }
+        case AWS_TRANSPORT_MQTT_LOOPBACK:
         {
             break;
         }
-        case AWS_TRANSPORT_RESTFUL_HTTPS:
         case AWS_TRANSPORT_INVALID:
         default:
         {
@@ -88,7 +504,7 @@ AWSIoTEndpoint* AWSIoTClient::create_endpoint(aws_iot_transport_type_t transport
         }
     }
 
-    ep = new AWSIoTEndpoint();
+    ep = endpoint_storage.create();
     ep->root_ca = root_ca;
     ep->root_ca_length = root_ca_length;
     ep->transport = transport;
@@ -102,7 +518,7 @@ exit:
 void AWSIoTClient::free_endpoint(AWSIoTEndpoint* ep)
 {
     if(ep!=NULL) {
-        delete ep;
+        endpoint_storage.destroy();
         ep = NULL;
         AWS_LIBRARY_DEBUG (("AWSIoTEndpoint Freed \n"));
     } else {
@@ -114,6 +530,25 @@ cy_rslt_t AWSIoTClient::connect(aws_connect_params_t conn_params,aws_endpoint_pa
 {
     int rc = 0;
     cy_rslt_t result = CY_RSLT_SUCCESS;
+    uint64_t connect_start_ms = 0;
+    mqtt_security_flag mode = SECURED_MQTT;
+    websocket_path* path = NULL;
+    MQTT::connackData connack;
+    uint8_t mqtt_version = ( conn_params.params_version == AWS_PARAMS_VERSION && conn_params.mqtt_version ) ? conn_params.mqtt_version : AWS_MQTT_VERSION_3_1_1;
+
+    if (endpoint_params.transport == AWS_TRANSPORT_RESTFUL_HTTPS) {
+        return connect_https(endpoint_params);
+    }
+
+    if (mqtt_version != AWS_MQTT_VERSION_3_1 && mqtt_version != AWS_MQTT_VERSION_3_1_1 && mqtt_version != AWS_MQTT_VERSION_5) {
+        AWS_LIBRARY_ERROR (("MQTT version %d is not supported \n", mqtt_version));
+        return CY_RSLT_AWS_ERROR_UNSUPPORTED;
+    }
+    if (mqtt_version == AWS_MQTT_VERSION_5 && endpoint_params.transport == AWS_TRANSPORT_MQTT_LOOPBACK) {
+        AWS_LIBRARY_ERROR (("The loopback broker speaks MQTT 3.1.1 only \n"));
+        return CY_RSLT_AWS_ERROR_UNSUPPORTED;
+    }
+
     ep = create_endpoint(endpoint_params.transport, endpoint_params.uri, endpoint_params.port, endpoint_params.root_ca, endpoint_params.root_ca_length);
     if (ep == NULL) {
         AWS_LIBRARY_ERROR (("Error in creating endpoint\n"));
@@ -121,62 +556,129 @@ cy_rslt_t AWSIoTClient::connect(aws_connect_params_t conn_params,aws_endpoint_pa
         goto exit;
     }
 
-    mqttnetwork = new MQTTNetwork(AWSIoTClient::network, flag);
-    if (mqttnetwork == NULL) {
-        result = CY_RSLT_AWS_ERROR_CONNECT_FAILED;
+    if (ep->transport == AWS_TRANSPORT_MQTT_LOOPBACK) {
+        mode = LOOPBACK_MQTT;
+    } else if (ep->transport == AWS_TRANSPORT_MQTT_WEBSOCKET) {
+        mode = WEBSOCKET_MQTT;
+    } else {
+        mode = flag;
+    }
+    if (!MQTTNetwork::supports(mode)) {
+        AWS_LIBRARY_ERROR (("Transport not available in this build ( AWS_IOT_TRANSPORT, AWS_IOT_LOOPBACK ) \n"));
+        result = CY_RSLT_AWS_ERROR_UNSUPPORTED;
         goto exit;
     }
 
-    rc = mqttnetwork->set_root_ca_certificate(ep->root_ca);
-    if (rc != 0) {
-        AWS_LIBRARY_ERROR (("Error in setting root CA certificate \n"));
-        result = CY_RSLT_AWS_ERROR_INVALID_ROOTCA;
+    mqttnetwork = network_storage.create(AWSIoTClient::network, mode);
+    if (mqttnetwork == NULL) {
+        result = CY_RSLT_AWS_ERROR_CONNECT_FAILED;
         goto exit;
     }
+    mqttnetwork->set_stats( &network_stats );
+    mqttnetwork->set_loopback_faults( loopback_faults );
+    if (mqtt_version == AWS_MQTT_VERSION_5) {
+        /* the MQTT client keeps speaking MQTT 3.1.1; the network translates each packet */
+        mqtt5 = &mqtt5_storage.create()->codec;
+        mqttnetwork->set_mqtt5( mqtt5 );
+    }
 
-    rc = mqttnetwork->set_client_cert_key(AWSIoTClient::certificate,
-            AWSIoTClient::private_key);
-    if (rc != 0) {
-        AWS_LIBRARY_ERROR (("Error in setting client certificate and private key\n"));
-        result = CY_RSLT_AWS_ERROR_INVALID_CLIENT_KEY;
-        goto exit;
+    if (mode == WEBSOCKET_MQTT) {
+        /* the server is still verified; the client signs the upgrade request instead of presenting a certificate */
+        result = credentials->apply_root_ca(*mqttnetwork->get_tls_socket(), ep->root_ca, ep->root_ca_length, &network_credentials);
+        if (result != CY_RSLT_SUCCESS) {
+            AWS_LIBRARY_ERROR (("Error in setting root CA certificate \n"));
+            goto exit;
+        }
+        path = websocket_path_storage.create();
+        result = AWSIoTSigV4::presign_websocket_path(ep->uri, sigv4_credentials, time(NULL), path->value, sizeof(path->value));
+        if (result != CY_RSLT_SUCCESS) {
+            goto exit;
+        }
+        mqttnetwork->set_upgrade_path(path->value);
+    } else if (mqttnetwork->get_tls_socket() != NULL) {
+        result = apply_credentials(*mqttnetwork->get_tls_socket(), ep->root_ca, ep->root_ca_length, &network_credentials);
+        if (result != CY_RSLT_SUCCESS) {
+            AWS_LIBRARY_ERROR (("Error in setting root CA certificate or client certificate and private key \n"));
+            goto exit;
+        }
     }
 
     rc = mqttnetwork->connect(ep->uri, ep->port, (char*) conn_params.peer_cn);
+    if (path != NULL) {
+        websocket_path_storage.destroy();
+        path = NULL;
+    }
     if (rc != 0) {
         AWS_LIBRARY_ERROR (("TLS connection to MQTT broker failed \n"));
         result = CY_RSLT_AWS_ERROR_CONNECT_FAILED;
         goto exit;
     } else {
         AWS_LIBRARY_DEBUG(("TLS connection to AWS endpoint established \n"));
-        mqtt_obj = new MQTT::Client<MQTTNetwork, Countdown, AWS_MAX_PACKET_SIZE, AWS_MAX_MESSAGE_HANDLERS>(*mqttnetwork,
+        mqtt_obj = mqtt_storage.create(*mqttnetwork,
                 AWSIoTClient::command_timeout);
+        /* a new MQTT client starts without message handlers */
+        memset( handler_topics, 0, sizeof(handler_topics) );
+        link_lost = false;
 
         MQTTPacket_connectData data = MQTTPacket_connectData_initializer;
-        data.MQTTVersion = 4;
+        data.MQTTVersion = ( mqtt_version == AWS_MQTT_VERSION_5 ) ? AWS_MQTT_VERSION_3_1_1 : mqtt_version;
         data.clientID.cstring = (char*) conn_params.client_id;
         data.username.cstring = (char*) conn_params.username;
         data.password.cstring = (char*) conn_params.password;
         data.keepAliveInterval = conn_params.keep_alive;
+        /* without a journal the subscriptions of a kept session would be unknown, so only then is clean_session honoured */
+        data.cleansession = ( session.is_open() && !conn_params.clean_session ) ? 0 : 1;
 
         AWS_LIBRARY_DEBUG(("Send MQTT connect frame \n"));
-        if ((rc = mqtt_obj->connect(data)) != 0) {
+        connect_start_ms = Kernel::get_ms_count();
+        memset( &connack, 0, sizeof(connack) );
+        AWS_TRACE_EVENT(AWS_TRACE_API_BEGIN, CONNECT, 0, 0);
+        rc = mqtt_obj->connect(data, connack);
+        AWS_TRACE_EVENT(AWS_TRACE_API_END, CONNECT, 0, 0);
+        if (rc != 0) {
             AWS_LIBRARY_ERROR(("MQTT connect failed : %d\r\n", rc));
-            delete mqtt_obj;
+            mqtt_storage.destroy();
             mqtt_obj = NULL;
             result = CY_RSLT_AWS_ERROR_CONNECT_FAILED;
             goto exit;
         } else {
             AWS_LIBRARY_DEBUG(("MQTT connect is successful %d\r\n", rc));
         }
+
+        /* packet identifiers of a discarded session say nothing about the new one */
+        session_present = !data.cleansession && connack.sessionPresent;
+        if( !session_present ) {
+            dispatcher.reset_duplicate_filter();
+            session.clear_subscriptions();
+        }
+        restore_session_publishes();
+
+        /* an MQTT 5 broker may ask for a different keep alive interval */
+        keep_alive.start( ( mqtt5 != NULL && mqtt5->server_keep_alive() >= 0 ) ? (uint16_t) mqtt5->server_keep_alive() : conn_params.keep_alive );
+        pingresps_seen = network_stats.pingresps_received;
+
+        metrics.connect_timings.dns_ms = network_stats.dns_ms;
+        metrics.connect_timings.tcp_ms = network_stats.tcp_ms;
+        metrics.connect_timings.tls_ms = network_stats.tls_ms;
+        metrics.connect_timings.connack_ms = (uint32_t) ( Kernel::get_ms_count() - connect_start_ms );
+        if( metrics.connects > 0 ) {
+            metrics.reconnects++;
+        }
+        metrics.connects++;
         return CY_RSLT_SUCCESS;
     }
 
 exit:
+    if(path != NULL) {
+        websocket_path_storage.destroy();
+    }
     if(mqttnetwork != NULL) {
-        delete mqttnetwork;
+        network_storage.destroy();
         mqttnetwork = NULL;
     }
+    AWSIoTCredentials::release( &network_credentials );
+    mqtt5_storage.destroy();
+    mqtt5 = NULL;
     if(ep != NULL) {
         free_endpoint(ep);
         ep = NULL;
@@ -184,30 +686,122 @@ exit:
     return result;
 }
 
+cy_rslt_t AWSIoTClient::connect_https(aws_endpoint_params_t endpoint_params)
+{
+    cy_rslt_t result = CY_RSLT_SUCCESS;
+    int port = endpoint_params.port ? endpoint_params.port : AWS_IOT_HTTPS_PORT;
+
+    ep = create_endpoint(endpoint_params.transport, endpoint_params.uri, port, endpoint_params.root_ca, endpoint_params.root_ca_length);
+    if (ep == NULL) {
+        AWS_LIBRARY_ERROR (("Error in creating endpoint\n"));
+        return CY_RSLT_AWS_ERROR_CONNECT_FAILED;
+    }
+
+    result = load_credentials();
+    if (result == CY_RSLT_SUCCESS) {
+        /* opened now so that connect reports an unreachable endpoint; publishes reuse it until disconnect */
+        result = rest_connection.open(AWSIoTClient::network, credentials, ep->uri, ep->port, ep->root_ca, ep->root_ca_length);
+    }
+    if (result != CY_RSLT_SUCCESS) {
+        AWS_LIBRARY_ERROR (("HTTPS connection to AWS endpoint failed \n"));
+        free_endpoint(ep);
+        ep = NULL;
+        return result;
+    }
+
+    if( metrics.connects > 0 ) {
+        metrics.reconnects++;
+    }
+    metrics.connects++;
+    return CY_RSLT_SUCCESS;
+}
+
+bool AWSIoTClient::rest_connected() const
+{
+    return ep != NULL && ep->transport == AWS_TRANSPORT_RESTFUL_HTTPS;
+}
+
+cy_rslt_t AWSIoTClient::connect(aws_connect_params_t conn_params, AWSIoTEndpointSelector& selector)
+{
+    cy_rslt_t result = CY_RSLT_AWS_ERROR_CONNECT_FAILED;
+    uint8_t ids[AWS_ENDPOINT_SELECTOR_MAX_ENDPOINTS];
+    uint8_t count = 0;
+    uint8_t i = 0;
+    aws_endpoint_params_t endpoint_params;
+
+    /* rank once up front, so a probe round finishing midway cannot make us retry or skip an endpoint */
+    count = selector.get_ranked(ids, AWS_ENDPOINT_SELECTOR_MAX_ENDPOINTS);
+    if (count == 0) {
+        AWS_LIBRARY_ERROR (("No Greengrass core endpoint to connect to \n"));
+        return CY_RSLT_AWS_ERROR_CONNECT_FAILED;
+    }
+
+    for (i = 0; i < count; i++) {
+        if (selector.get_endpoint(ids[i], &endpoint_params) != CY_RSLT_SUCCESS) {
+            continue;
+        }
+
+        AWS_LIBRARY_INFO(("Connecting to Greengrass core at %s:%d \n", endpoint_params.uri, endpoint_params.port));
+        result = connect(conn_params, endpoint_params);
+        if (result == CY_RSLT_SUCCESS) {
+            selector.report(ids[i], true);
+            return CY_RSLT_SUCCESS;
+        }
+
+        /* errors that do not depend on the endpoint would fail the same way on every other one */
+        if (result == CY_RSLT_AWS_ERROR_UNSUPPORTED || result == CY_RSLT_AWS_ERROR_INVALID_CLIENT_KEY) {
+            return result;
+        }
+
+        selector.report(ids[i], false);
+    }
+
+    return result;
+}
+
 cy_rslt_t AWSIoTClient::disconnect()
 {
     int rc = 0;
 
+    if( rest_connected() ) {
+        rest_connection.close();
+        free_endpoint(AWSIoTClient::ep);
+        ep = NULL;
+        return CY_RSLT_SUCCESS;
+    }
+
     if( mqtt_obj == NULL ) {
         AWS_LIBRARY_ERROR(("Device not connected to MQTT broker \n"));
         return CY_RSLT_AWS_ERROR_DISCONNECT_FAILED;
     }
 
-    AWS_LIBRARY_DEBUG(("Send MQTT dis-connect frame \n"));
-    rc = mqtt_obj->disconnect();
-    if (rc != 0) {
-        AWS_LIBRARY_ERROR(("MQTT dis-connect failed : %d\r\n", rc));
-        return CY_RSLT_AWS_ERROR_DISCONNECT_FAILED;
-    } else {
-        AWS_LIBRARY_DEBUG(("MQTT dis-connect is successful %d\r\n", rc));
+    /* a link lost to a missed PUBACK is only closed; the broker publishes the Will */
+    if( !link_lost ) {
+        AWS_LIBRARY_DEBUG(("Send MQTT dis-connect frame \n"));
+        AWS_TRACE_EVENT(AWS_TRACE_API_BEGIN, DISCONNECT, 0, 0);
+        rc = mqtt_obj->disconnect();
+        AWS_TRACE_EVENT(AWS_TRACE_API_END, DISCONNECT, 0, 0);
+        if (rc != 0) {
+            AWS_LIBRARY_ERROR(("MQTT dis-connect failed : %d\r\n", rc));
+            return CY_RSLT_AWS_ERROR_DISCONNECT_FAILED;
+        } else {
+            AWS_LIBRARY_DEBUG(("MQTT dis-connect is successful %d\r\n", rc));
+        }
     }
 
-    delete mqtt_obj;
+    mqtt_storage.destroy();
     mqtt_obj = NULL;
     mqttnetwork->disconnect();
 
-    delete mqttnetwork;
+    network_storage.destroy();
     mqttnetwork = NULL;
+    AWSIoTCredentials::release( &network_credentials );
+    mqtt5_storage.destroy();
+    mqtt5 = NULL;
+    session_present = false;
+    if( session.is_open() ) {
+        session.commit();
+    }
 
     if(ep != NULL) {
         free_endpoint(AWSIoTClient::ep);
@@ -220,8 +814,11 @@ cy_rslt_t AWSIoTClient::disconnect()
 cy_rslt_t AWSIoTClient::publish(const char* topic, const char* data, uint32_t length, aws_publish_params_t pub_params )
 {
     int rc = 0;
+    uint32_t delay_ms = 0;
+    uint64_t publish_start_ms = 0;
 
     MQTT::Message message;
+    pub_params = declared_publish_params( pub_params );
     message.qos = (MQTT::QoS) pub_params.QoS;
     message.retained = false;
     message.dup = false;
@@ -233,193 +830,1068 @@ cy_rslt_t AWSIoTClient::publish(const char* topic, const char* data, uint32_t le
         return CY_RSLT_AWS_ERROR_PUBLISH_FAILED;
     }
 
-    if( mqtt_obj == NULL ) {
+    if( rest_connected() ) {
+        aws_publish_message_t rest_message = { topic, data, length, pub_params };
+
+        return publish_https( &rest_message, 1, NULL, NULL );
+    }
+
+    if( mqtt_obj == NULL || link_lost ) {
         AWS_LIBRARY_ERROR(("Device not connected to MQTT broker \n"));
         return CY_RSLT_AWS_ERROR_PUBLISH_FAILED;
     }
 
-    rc = mqtt_obj->publish(topic, message);
-    if ( rc != 0 ) {
-        AWS_LIBRARY_ERROR(("Publish to AWS endpoint failed  : %d \n", rc ));
+    if( !prepare_publish( pub_params, strlen( topic ), publish_packet_size( topic, length, pub_params.QoS ) ) ) {
+        metrics.publish_failures++;
         return CY_RSLT_AWS_ERROR_PUBLISH_FAILED;
     }
 
-    AWS_LIBRARY_DEBUG(("Published to AWS endpoint successfully \n"));
+    /* Shape bursts to stay within the per-connection quotas instead of getting throttled by AWS IoT */
+    delay_ms = rate_limiter.reserve( Kernel::get_ms_count(), publish_packet_size(topic, length, pub_params.QoS) );
+    if( delay_ms > 0 ) {
+        AWS_LIBRARY_DEBUG(("Publish delayed by rate limiter for %lu ms \n", (unsigned long) delay_ms));
+        ThisThread::sleep_for( delay_ms );
+    }
+
+    publish_start_ms = Kernel::get_ms_count();
+    AWS_TRACE_EVENT(AWS_TRACE_API_BEGIN, PUBLISH, 0, length);
+    if( pub_params.QoS == AWS_QOS_ATLEAST_ONCE ) {
+        rc = publish_acked( topic, data, length );
+    } else {
+        rc = mqtt_obj->publish(topic, message);
+    }
+    AWS_TRACE_EVENT(AWS_TRACE_API_END, PUBLISH, 0, length);
+    if( mqtt5 != NULL ) {
+        mqtt5->clear_publish_properties();
+    }
+    if ( rc != 0 ) {
+        AWS_LIBRARY_ERROR(("Publish to AWS endpoint failed  : %d \n", rc ));
+        metrics.publish_failures++;
+        return CY_RSLT_AWS_ERROR_PUBLISH_FAILED;
+    }
+
+    metrics.publishes++;
+    if( pub_params.QoS == AWS_QOS_ATLEAST_ONCE ) {
+        record_publish_latency( &metrics, (uint32_t) ( Kernel::get_ms_count() - publish_start_ms ) );
+    }
+
+    AWS_LIBRARY_DEBUG(("Published to AWS endpoint successfully \n"));
+
+    return CY_RSLT_SUCCESS;
+}
+
+cy_rslt_t AWSIoTClient::publish_batch( const aws_publish_message_t* messages, uint8_t count, uint8_t* published, bool* resent )
+{
+    cy_rslt_t result = CY_RSLT_SUCCESS;
+    uint8_t i = 0;
+
+    if( published != NULL ) {
+        *published = 0;
+    }
+    if( messages == NULL ) {
+        return CY_RSLT_AWS_ERROR_PUBLISH_FAILED;
+    }
+    if( resent != NULL ) {
+        memset( resent, 0, count * sizeof(bool) );
+    }
+
+    if( rest_connected() ) {
+        return publish_https( messages, count, published, resent );
+    }
+
+    for( i = 0; i < count; i++ ) {
+        result = publish( messages[i].topic, messages[i].data, messages[i].length, messages[i].params );
+        if( result != CY_RSLT_SUCCESS ) {
+            return result;
+        }
+        if( published != NULL ) {
+            (*published)++;
+        }
+    }
+
+    return CY_RSLT_SUCCESS;
+}
+
+/* Tally of the responses to a batch of RESTful publishes */
+typedef struct
+{
+    const aws_publish_message_t* messages;
+    uint8_t first;                  /* Index of the first message of the group being sent */
+    uint8_t accepted;
+    uint8_t rejected;
+    uint64_t start_ms;
+    aws_iot_metrics_t* metrics;
+    bool* resent;                   /* Per message; NULL if the caller does not ask */
+} https_publish_state_t;
+
+static void https_publish_response( uint8_t index, int status, const char* body, uint32_t length, bool resent, void* arg )
+{
+    https_publish_state_t* state = (https_publish_state_t*) arg;
+    const aws_publish_message_t* message = &state->messages[state->first + index];
+
+    if( resent ) {
+        AWS_LIBRARY_DEBUG(("Publish to %s sent twice, it may be delivered twice \n", message->topic));
+        if( state->resent != NULL ) {
+            state->resent[state->first + index] = true;
+        }
+    }
+
+    if( status < 200 || status > 299 ) {
+        AWS_LIBRARY_ERROR(("Publish to %s rejected : HTTP %d \n", message->topic, status));
+        state->rejected++;
+        state->metrics->publish_failures++;
+        return;
+    }
+
+    state->accepted++;
+    state->metrics->publishes++;
+    if( message->params.QoS == AWS_QOS_ATLEAST_ONCE ) {
+        record_publish_latency( state->metrics, (uint32_t) ( Kernel::get_ms_count() - state->start_ms ) );
+    }
+}
+
+cy_rslt_t AWSIoTClient::publish_https( const aws_publish_message_t* messages, uint8_t count, uint8_t* published, bool* resent )
+{
+    static const char* const qos_query[] = { "?qos=0", "?qos=1" };
+    AWSIoTHttpsConnection::post_request requests[AWS_HTTPS_PUBLISH_GROUP_SIZE];
+    https_publish_state_t state;
+    cy_rslt_t result = CY_RSLT_SUCCESS;
+    uint32_t delay_ms = 0;
+    uint32_t wait_ms = 0;
+    uint8_t group = 0;
+    uint8_t i = 0;
+
+    for( i = 0; i < count; i++ ) {
+        if( messages[i].topic == NULL ||
+                ( messages[i].params.QoS != AWS_QOS_ATMOST_ONCE && messages[i].params.QoS != AWS_QOS_ATLEAST_ONCE ) ) {
+            AWS_LIBRARY_ERROR(("Invalid message in publish batch \n"));
+            return CY_RSLT_AWS_ERROR_PUBLISH_FAILED;
+        }
+    }
+
+    state.messages = messages;
+    state.accepted = 0;
+    state.rejected = 0;
+    state.metrics = &metrics;
+    state.resent = resent;
+
+    /* The connection pipelines each group; it stays open from one group to the next */
+    for( state.first = 0; state.first < count; state.first += group ) {
+        group = ( count - state.first < AWS_HTTPS_PUBLISH_GROUP_SIZE ) ? count - state.first : AWS_HTTPS_PUBLISH_GROUP_SIZE;
+
+        wait_ms = 0;
+        for( i = 0; i < group; i++ ) {
+            const aws_publish_message_t* message = &messages[state.first + i];
+
+            requests[i].resource = message->topic;
+            requests[i].query = qos_query[message->params.QoS];
+            requests[i].body = message->data;
+            requests[i].body_length = message->length;
+
+            delay_ms = rate_limiter.reserve( Kernel::get_ms_count(), strlen( message->topic ) + message->length );
+            wait_ms = ( delay_ms > wait_ms ) ? delay_ms : wait_ms;
+        }
+        if( wait_ms > 0 ) {
+            AWS_LIBRARY_DEBUG(("Publish delayed by rate limiter for %lu ms \n", (unsigned long) wait_ms));
+            ThisThread::sleep_for( wait_ms );
+        }
+
+        state.start_ms = Kernel::get_ms_count();
+        AWS_TRACE_EVENT(AWS_TRACE_API_BEGIN, PUBLISH, 0, group);
+        result = rest_connection.post( AWSIoTClient::network, credentials, ep->uri, ep->port, ep->root_ca, ep->root_ca_length,
+                AWS_HTTPS_PUBLISH_PATH_PREFIX, requests, group, https_publish_response, &state );
+        AWS_TRACE_EVENT(AWS_TRACE_API_END, PUBLISH, 0, group);
+        if( result != CY_RSLT_SUCCESS ) {
+            AWS_LIBRARY_ERROR(("Publish over HTTPS failed \n"));
+            break;
+        }
+    }
+
+    if( published != NULL ) {
+        *published = state.accepted;
+    }
+    if( result != CY_RSLT_SUCCESS ) {
+        /* messages without a response are counted as failed, although some may have been delivered */
+        metrics.publish_failures += count - state.accepted - state.rejected;
+        return CY_RSLT_AWS_ERROR_PUBLISH_FAILED;
+    }
+
+    return ( state.rejected == 0 ) ? CY_RSLT_SUCCESS : CY_RSLT_AWS_ERROR_PUBLISH_FAILED;
+}
+
+cy_rslt_t AWSIoTClient::register_topic( const char* topic, aws_topic_handle_t* handle )
+{
+    uint8_t i = 0;
+    uint32_t topic_length = 0;
+
+    if( topic == NULL || handle == NULL ) {
+        return CY_RSLT_AWS_ERROR_BUFFER_OVERFLOW;
+    }
+
+    /* the fixed header takes at least two bytes and the topic length two more */
+    topic_length = strlen( topic );
+    if( 2 + 2 + topic_length > AWS_MAX_PACKET_SIZE ) {
+        AWS_LIBRARY_ERROR(("Topic does not fit into a packet of %d bytes \n", AWS_MAX_PACKET_SIZE));
+        return CY_RSLT_AWS_ERROR_BUFFER_OVERFLOW;
+    }
+
+    for( i = 0; i < AWS_MAX_REGISTERED_TOPICS && topics[i].used; i++ ) {
+    }
+    if( i == AWS_MAX_REGISTERED_TOPICS ) {
+        AWS_LIBRARY_ERROR(("No free slot to register topic \n"));
+        return CY_RSLT_AWS_ERROR_BUFFER_OVERFLOW;
+    }
+
+    topics[i].used = true;
+    topics[i].priority = AWS_PRIORITY_DEFAULT;
+    topics[i].ttl_ms = 0;
+    topics[i].topic_end = AWS_TOPIC_HEADER_RESERVE + AWSIoTPublishPacket::prepare_topic( &topics[i].packet[AWS_TOPIC_HEADER_RESERVE], topic, topic_length );
+
+    handle->id = i + 1;
+    return CY_RSLT_SUCCESS;
+}
+
+void AWSIoTClient::unregister_topic( aws_topic_handle_t handle )
+{
+    if( handle.id > 0 && handle.id <= AWS_MAX_REGISTERED_TOPICS ) {
+        topics[handle.id - 1].used = false;
+    }
+}
+
+void AWSIoTClient::set_topic_priority( aws_topic_handle_t handle, aws_priority_t priority )
+{
+    if( handle.id > 0 && handle.id <= AWS_MAX_REGISTERED_TOPICS ) {
+        topics[handle.id - 1].priority = priority;
+    }
+}
+
+void AWSIoTClient::set_topic_ttl( aws_topic_handle_t handle, uint32_t ttl_ms )
+{
+    if( handle.id > 0 && handle.id <= AWS_MAX_REGISTERED_TOPICS ) {
+        topics[handle.id - 1].ttl_ms = ttl_ms;
+    }
+}
+
+cy_rslt_t AWSIoTClient::publish( aws_topic_handle_t handle, const char* data, uint32_t length, aws_publish_params_t pub_params )
+{
+    registered_topic* entry = NULL;
+    unsigned char* packet = NULL;
+    uint32_t topic_bytes = 0;
+    int packet_length = 0;
+    uint32_t delay_ms = 0;
+    uint64_t publish_start_ms = 0;
+    uint16_t packet_id = 0;
+    int rc = 0;
+
+    pub_params = declared_publish_params( pub_params );
+    if( handle.id == 0 || handle.id > AWS_MAX_REGISTERED_TOPICS || !topics[handle.id - 1].used ) {
+        AWS_LIBRARY_ERROR(("Topic handle not registered\n"));
+        return CY_RSLT_AWS_ERROR_PUBLISH_FAILED;
+    }
+    entry = &topics[handle.id - 1];
+
+    if( pub_params.QoS != AWS_QOS_ATMOST_ONCE && pub_params.QoS != AWS_QOS_ATLEAST_ONCE ) {
+        AWS_LIBRARY_ERROR(("QoS value not supported\n"));
+        return CY_RSLT_AWS_ERROR_PUBLISH_FAILED;
+    }
+
+    if( mqtt_obj == NULL || link_lost ) {
+        AWS_LIBRARY_ERROR(("Device not connected to MQTT broker \n"));
+        return CY_RSLT_AWS_ERROR_PUBLISH_FAILED;
+    }
+
+    /* same limit as a string topic publish */
+    topic_bytes = entry->topic_end - AWS_TOPIC_HEADER_RESERVE;
+    packet_length = (int) AWSIoTPublishPacket::size( topic_bytes - 2, length, pub_params.QoS );
+    if( packet_length > AWS_MAX_PACKET_SIZE ) {
+        AWS_LIBRARY_ERROR(("Message does not fit into a packet of %d bytes \n", AWS_MAX_PACKET_SIZE));
+        metrics.publish_failures++;
+        return CY_RSLT_AWS_ERROR_PUBLISH_FAILED;
+    }
+
+    if( !prepare_publish( pub_params, topic_bytes - 2, packet_length ) ) {
+        metrics.publish_failures++;
+        return CY_RSLT_AWS_ERROR_PUBLISH_FAILED;
+    }
+
+    if( pub_params.QoS == AWS_QOS_ATLEAST_ONCE ) {
+        packet_id = next_packet_id();
+    }
+    AWSIoTPublishPacket::encode_prepared( &entry->packet[AWS_TOPIC_HEADER_RESERVE], topic_bytes, pub_params.QoS, packet_id, data, length, &packet );
+
+    delay_ms = rate_limiter.reserve( Kernel::get_ms_count(), packet_length );
+    if( delay_ms > 0 ) {
+        AWS_LIBRARY_DEBUG(("Publish delayed by rate limiter for %lu ms \n", (unsigned long) delay_ms));
+        ThisThread::sleep_for( delay_ms );
+    }
+
+    publish_start_ms = Kernel::get_ms_count();
+    AWS_TRACE_EVENT(AWS_TRACE_API_BEGIN, PUBLISH, 0, length);
+    if( pub_params.QoS == AWS_QOS_ATLEAST_ONCE ) {
+        rc = ( send_acked_publish( packet, packet_length, packet_id ) == 0 ) ? packet_length : -1;
+    } else {
+        rc = mqttnetwork->write( packet, packet_length, AWSIoTClient::command_timeout );
+    }
+    AWS_TRACE_EVENT(AWS_TRACE_API_END, PUBLISH, 0, length);
+    if( mqtt5 != NULL ) {
+        mqtt5->clear_publish_properties();
+    }
+
+    if( rc != packet_length ) {
+        AWS_LIBRARY_ERROR(("Publish to AWS endpoint failed  : %d \n", rc ));
+        metrics.publish_failures++;
+        return CY_RSLT_AWS_ERROR_PUBLISH_FAILED;
+    }
+
+    metrics.publishes++;
+    if( pub_params.QoS == AWS_QOS_ATLEAST_ONCE ) {
+        record_publish_latency( &metrics, (uint32_t) ( Kernel::get_ms_count() - publish_start_ms ) );
+    }
+
+    AWS_LIBRARY_DEBUG(("Published to AWS endpoint successfully \n"));
 
     return CY_RSLT_SUCCESS;
 }
 
+cy_rslt_t AWSIoTClient::publish_chunked( const aws_chunk_params_t& params, aws_chunk_transfer_t* transfer )
+{
+    cy_rslt_t result = CY_RSLT_SUCCESS;
+    AWSIoTChunkWindow window;
+    uint32_t chunk_size = params.chunk_size ? params.chunk_size : AWS_CHUNK_DEFAULT_SIZE;
+    uint32_t chunk_count = 0;
+    uint32_t chunk = 0;
+    uint32_t length = 0;
+    uint32_t topic_length = 0;
+    uint32_t delay_ms = 0;
+    unsigned char* body = NULL;
+    unsigned char* packet = NULL;
+    unsigned char header[5];
+    uint16_t packet_id = 0;
+    uint8_t window_size = 0;
+    int header_length = 0;
+    int rc = 0;
+
+    if( mqtt_obj == NULL ) {
+        AWS_LIBRARY_ERROR(("Device not connected to MQTT broker \n"));
+        return CY_RSLT_AWS_ERROR_DISCONNECTED;
+    }
+
+    if( params.topic == NULL || params.reader == NULL || transfer == NULL || chunk_size > AWS_CHUNK_MAX_SIZE ) {
+        AWS_LIBRARY_ERROR(("Invalid chunked publish parameters \n"));
+        return CY_RSLT_AWS_ERROR_PUBLISH_FAILED;
+    }
+
+    /* an empty transfer still sends one chunk, so the receiver learns that it is complete */
+    chunk_count = ( params.total_length + chunk_size - 1 ) / chunk_size;
+    if( chunk_count == 0 ) {
+        chunk_count = 1;
+    }
+    if( transfer->chunk_count != 0 && transfer->chunk_count != chunk_count ) {
+        AWS_LIBRARY_ERROR(("Chunked publish resumed with different parameters \n"));
+        return CY_RSLT_AWS_ERROR_PUBLISH_FAILED;
+    }
+    transfer->chunk_count = chunk_count;
+
+    /* body layout: topic, packet identifier, chunk header, data; the fixed header is written in front of it per chunk */
+    topic_length = strlen( params.topic );
+    if( mqtt5 != NULL && !mqtt5->fits( topic_length, AWS_CHUNK_BUFFER_SIZE( topic_length, chunk_size ) ) ) {
+        AWS_LIBRARY_ERROR(("Chunks exceed the maximum packet size of the MQTT 5 connection \n"));
+        return CY_RSLT_AWS_ERROR_PUBLISH_FAILED;
+    }
+    if( params.buffer == NULL || params.buffer_size < AWS_CHUNK_BUFFER_SIZE( topic_length, chunk_size ) ) {
+        AWS_LIBRARY_ERROR(("Chunk buffer smaller than AWS_CHUNK_BUFFER_SIZE \n"));
+        return CY_RSLT_AWS_ERROR_PUBLISH_FAILED;
+    }
+    body = params.buffer + sizeof(header);
+    body[0] = (unsigned char) ( topic_length >> 8 );
+    body[1] = (unsigned char) topic_length;
+    memcpy( body + 2, params.topic, topic_length );
+    put_uint32( body + 2 + topic_length + 2 + 4, chunk_count );
+
+    window_size = params.window ? params.window : AWS_CHUNK_DEFAULT_WINDOW;
+    /* an MQTT 5 broker states how many QoS1 publishes it takes unacknowledged */
+    if( mqtt5 != NULL && mqtt5->receive_maximum() < window_size ) {
+        window_size = (uint8_t) mqtt5->receive_maximum();
+    }
+    window.start( transfer, window_size, AWSIoTClient::command_timeout );
+    mqttnetwork->set_ack_observer( chunk_acked, &window );
+
+    AWS_LIBRARY_DEBUG(("Chunked publish of %lu chunks starting at chunk %lu \n", (unsigned long) chunk_count, (unsigned long) transfer->acked_chunks));
+
+    while( !window.done() ) {
+        while( window.can_send() ) {
+            chunk = window.next_chunk();
+            length = ( params.total_length - chunk * chunk_size < chunk_size ) ? params.total_length - chunk * chunk_size : chunk_size;
+
+            if( params.reader( chunk * chunk_size, body + 2 + topic_length + 2 + AWS_CHUNK_HEADER_LENGTH, length, params.reader_arg ) != (int32_t) length ) {
+                AWS_LIBRARY_ERROR(("Reading chunk %lu failed \n", (unsigned long) chunk));
+                result = CY_RSLT_AWS_ERROR_PUBLISH_FAILED;
+                goto exit;
+            }
+
+            packet_id = next_packet_id();
+            body[2 + topic_length] = (unsigned char) ( packet_id >> 8 );
+            body[2 + topic_length + 1] = (unsigned char) packet_id;
+            put_uint32( body + 2 + topic_length + 2, chunk );
+
+            /* PUBLISH, QoS 1, DUP when the chunk may have reached the broker before */
+            length += 2 + topic_length + 2 + AWS_CHUNK_HEADER_LENGTH;
+            header[0] = ( MQTT_PUBLISH_TYPE << 4 ) | ( AWS_QOS_ATLEAST_ONCE << 1 ) | ( ( chunk < transfer->sent_chunks ) ? 0x08 : 0 );
+            header_length = 1 + MQTTPacket_encode( header + 1, length );
+            packet = body - header_length;
+            memcpy( packet, header, header_length );
+
+            delay_ms = rate_limiter.reserve( Kernel::get_ms_count(), header_length + length );
+            if( delay_ms > 0 ) {
+                ThisThread::sleep_for( delay_ms );
+            }
+
+            rc = mqttnetwork->write( packet, header_length + length, AWSIoTClient::command_timeout );
+            if( rc != (int) ( header_length + length ) ) {
+                AWS_LIBRARY_ERROR(("Sending chunk %lu failed : %d \n", (unsigned long) chunk, rc));
+                result = CY_RSLT_AWS_ERROR_DISCONNECTED;
+                goto exit;
+            }
+            window.sent( Kernel::get_ms_count(), packet_id );
+            metrics.publishes++;
+        }
+
+        /* read PUBACKs; they reach the window through the network's ack observer */
+        if( service_keep_alive() == -1 || mqtt_obj->yield( AWS_CHUNK_POLL_INTERVAL ) == -1 ) {
+            result = CY_RSLT_AWS_ERROR_DISCONNECTED;
+            goto exit;
+        }
+
+        if( window.timed_out( Kernel::get_ms_count() ) ) {
+            AWS_LIBRARY_ERROR(("PUBACK for chunk %lu not received within %d ms \n", (unsigned long) transfer->acked_chunks, AWSIoTClient::command_timeout));
+            result = CY_RSLT_AWS_ERROR_DISCONNECTED;
+            goto exit;
+        }
+    }
+
+    AWS_LIBRARY_DEBUG(("Chunked publish complete, %lu chunks resent \n", (unsigned long) transfer->retransmits));
+
+exit:
+    mqttnetwork->set_ack_observer( NULL, NULL );
+
+    /* the transfer is resumed from transfer->acked_chunks once the application has reconnected */
+    if( result == CY_RSLT_AWS_ERROR_DISCONNECTED ) {
+        metrics.publish_failures++;
+        drop_connection();
+    }
+    return result;
+}
+
+cy_rslt_t AWSIoTClient::download( const aws_download_params_t& params, aws_download_t* progress )
+{
+    cy_rslt_t result = CY_RSLT_SUCCESS;
+    AWSIoTDownload stream( params, progress );
+    aws_publish_params_t pub_params;
+    char request[AWS_DOWNLOAD_MESSAGE_OVERHEAD];
+    int length = 0;
+    bool subscribed = false;
+
+    if( mqtt_obj == NULL ) {
+        AWS_LIBRARY_ERROR(("Device not connected to MQTT broker \n"));
+        return CY_RSLT_AWS_ERROR_DISCONNECTED;
+    }
+
+    if( progress == NULL ) {
+        return CY_RSLT_AWS_ERROR_DOWNLOAD_FAILED;
+    }
+
+    memset( &pub_params, 0, sizeof(pub_params) );
+    result = stream.start();
+    if( result != CY_RSLT_SUCCESS ) {
+        return result;
+    }
+
+    /* a block the MQTT client cannot buffer would be dropped every time it is sent */
+    if( publish_packet_size( stream.data_topic(), stream.max_message_length(), AWS_QOS_ATLEAST_ONCE ) > AWS_MAX_PACKET_SIZE ) {
+        AWS_LIBRARY_ERROR(("Blocks of %lu bytes do not fit into AWS_MAX_PACKET_SIZE ( %d ) \n",
+                (unsigned long) ( params.block_size ? params.block_size : AWS_DOWNLOAD_DEFAULT_BLOCK_SIZE ), AWS_MAX_PACKET_SIZE));
+        return CY_RSLT_AWS_ERROR_BUFFER_OVERFLOW;
+    }
+
+    /* the blocks bypass the dispatcher: they are consumed in the receive buffer, on the thread calling this API */
+    if( mqtt_obj->subscribe( stream.data_topic(), MQTT::QOS0, AWSIoTDownload::block_received ) != 0 ||
+        mqtt_obj->subscribe( stream.rejected_topic(), MQTT::QOS0, AWSIoTDownload::request_rejected ) != 0 ) {
+        AWS_LIBRARY_ERROR(("Subscribing to the stream topics failed \n"));
+        result = CY_RSLT_AWS_ERROR_SUBSCRIBE_FAILED;
+        goto exit;
+    }
+    subscribed = true;
+
+    AWS_LIBRARY_DEBUG(("Downloading %lu blocks, %lu already received \n", (unsigned long) progress->block_count, (unsigned long) progress->blocks_received));
+
+    pub_params.QoS = AWS_QOS_ATMOST_ONCE;
+    while( !stream.done() ) {
+        while( ( length = stream.next_request( request, sizeof(request), Kernel::get_ms_count() ) ) > 0 ) {
+            if( publish( stream.get_topic(), request, length, pub_params ) != CY_RSLT_SUCCESS ) {
+                result = CY_RSLT_AWS_ERROR_DISCONNECTED;
+                goto exit;
+            }
+        }
+
+        if( service_keep_alive() == -1 || mqtt_obj->yield( AWS_DOWNLOAD_POLL_INTERVAL ) == -1 ) {
+            result = CY_RSLT_AWS_ERROR_DISCONNECTED;
+            goto exit;
+        }
+
+        result = stream.check( Kernel::get_ms_count(), AWSIoTClient::command_timeout );
+        if( result != CY_RSLT_SUCCESS ) {
+            goto exit;
+        }
+    }
+
+    AWS_LIBRARY_DEBUG(("Download complete, %lu requests, %lu retries \n", (unsigned long) progress->requests, (unsigned long) progress->retries));
+
+exit:
+    if( result == CY_RSLT_AWS_ERROR_DISCONNECTED ) {
+        drop_connection();
+    } else if( subscribed ) {
+        mqtt_obj->unsubscribe( stream.data_topic() );
+        mqtt_obj->unsubscribe( stream.rejected_topic() );
+    }
+    return result;
+}
+
+char* AWSIoTClient::claim_handler_topic( const char* topic, bool* claimed )
+{
+    int i = 0;
+    int free_slot = -1;
+
+    *claimed = false;
+    for( i = 0; i < AWS_MAX_MESSAGE_HANDLERS; i++ ) {
+        if( handler_topics[i][0] != '\0' && strcmp( handler_topics[i], topic ) == 0 ) {
+            return handler_topics[i];
+        }
+        if( free_slot < 0 && handler_topics[i][0] == '\0' ) {
+            free_slot = i;
+        }
+    }
+    if( free_slot < 0 ) {
+        AWS_LIBRARY_ERROR(("All %d message handlers in use \n", AWS_MAX_MESSAGE_HANDLERS));
+        return NULL;
+    }
+
+    strcpy( handler_topics[free_slot], topic );
+    *claimed = true;
+    return handler_topics[free_slot];
+}
+
 cy_rslt_t AWSIoTClient::subscribe(const char* topic, aws_iot_qos_level_t qos, subscriber_callback cb)
 {
     int rc = 0;
+    subscriber_callback handler = cb;
+    char* filter = NULL;
+    bool claimed = false;
+
+    if( rest_connected() ) {
+        AWS_LIBRARY_ERROR(("Not available over RESTful HTTPS \n"));
+        return CY_RSLT_AWS_ERROR_UNSUPPORTED;
+    }
 
     if( mqtt_obj == NULL ) {
         AWS_LIBRARY_ERROR(("Device not connected to MQTT broker \n"));
         return CY_RSLT_AWS_ERROR_SUBSCRIBE_FAILED;
     }
 
-    rc = mqtt_obj->subscribe(topic, (MQTT::QoS)qos, cb);
+    if( topic == NULL || strlen( topic ) > AWS_TOPIC_FILTER_MAX_LENGTH ) {
+        AWS_LIBRARY_ERROR(("Topic filter too long \n"));
+        return CY_RSLT_AWS_ERROR_SUBSCRIBE_FAILED;
+    }
+
+    /* the MQTT client keeps the filter by reference, and 'topic' may be a buffer about to be reused, such as a submission slot */
+    filter = claim_handler_topic( topic, &claimed );
+    if( filter == NULL ) {
+        return CY_RSLT_AWS_ERROR_SUBSCRIBE_FAILED;
+    }
+
+    /* Let the MQTT client call a trampoline that filters the message and queues it for the dispatch workers */
+    if( dispatcher.active() ) {
+        handler = dispatcher.add( filter, cb );
+        if( handler == NULL ) {
+            rc = -1;
+            goto exit;
+        }
+    }
+
+    /* the broker kept this subscription with the session; the MQTT client only needs to know where to deliver */
+    if( session_present && session.subscribed( filter, qos ) ) {
+        rc = mqtt_obj->setMessageHandler(filter, handler);
+        if( rc != 0 ) {
+            AWS_LIBRARY_ERROR(("No free message handler for %s \n", filter));
+            goto exit;
+        }
+        AWS_LIBRARY_DEBUG(("Subscription of %s resumed \n", filter));
+        return CY_RSLT_SUCCESS;
+    }
+
+    AWS_TRACE_EVENT(AWS_TRACE_API_BEGIN, SUBSCRIBE, 0, 0);
+    rc = mqtt_obj->subscribe(filter, (MQTT::QoS)qos, handler);
+    AWS_TRACE_EVENT(AWS_TRACE_API_END, SUBSCRIBE, 0, 0);
     if (rc != 0) {
         AWS_LIBRARY_ERROR(("MQTT subscribe failed %d\r\n", rc));
-        return CY_RSLT_AWS_ERROR_SUBSCRIBE_FAILED;
+        goto exit;
     } else {
         AWS_LIBRARY_DEBUG(("MQTT subscribtion successful %d\r\n", rc));
     }
+    session.subscribe( filter, qos );
 
     return CY_RSLT_SUCCESS;
+
+exit:
+    /* a filter subscribed before keeps its entries */
+    if( claimed ) {
+        if( handler != cb && handler != NULL ) {
+            dispatcher.remove( filter );
+        }
+        filter[0] = '\0';
+    }
+    return CY_RSLT_AWS_ERROR_SUBSCRIBE_FAILED;
 }
 
 cy_rslt_t AWSIoTClient::unsubscribe(char* topic )
 {
     int rc = 0;
+    char* filter = NULL;
+    bool claimed = false;
+
+    if( rest_connected() ) {
+        AWS_LIBRARY_ERROR(("Not available over RESTful HTTPS \n"));
+        return CY_RSLT_AWS_ERROR_UNSUPPORTED;
+    }
 
     if( mqtt_obj == NULL ) {
         AWS_LIBRARY_ERROR(("Device not connected to MQTT broker \n"));
         return CY_RSLT_AWS_ERROR_UNSUBSCRIBE_FAILED;
     }
 
+    /* forgotten first: a resumed session must not rely on a subscription that may be gone */
+    if( session.unsubscribe( topic ) != CY_RSLT_SUCCESS ) {
+        return CY_RSLT_AWS_ERROR_UNSUBSCRIBE_FAILED;
+    }
+
+    AWS_TRACE_EVENT(AWS_TRACE_API_BEGIN, UNSUBSCRIBE, 0, 0);
     rc = mqtt_obj->unsubscribe(topic);
+    AWS_TRACE_EVENT(AWS_TRACE_API_END, UNSUBSCRIBE, 0, 0);
     if (rc != 0) {
         AWS_LIBRARY_ERROR(("MQTT unsubscribe failed %d\r\n", rc));
         return CY_RSLT_AWS_ERROR_UNSUBSCRIBE_FAILED;
     } else {
         AWS_LIBRARY_DEBUG(("MQTT unsubscribe successful %d\r\n", rc));
     }
+    dispatcher.remove( topic );
+
+    /* drop the MQTT client's reference before the copy of the filter is reused */
+    filter = ( strlen( topic ) <= AWS_TOPIC_FILTER_MAX_LENGTH ) ? claim_handler_topic( topic, &claimed ) : NULL;
+    if( filter != NULL ) {
+        mqtt_obj->setMessageHandler(filter, NULL);
+        filter[0] = '\0';
+    }
 
     return CY_RSLT_SUCCESS;
 }
 
-cy_rslt_t AWSIoTClient::yield(unsigned long timeout_ms)
+AWSIoTClient::submit_request* AWSIoTClient::alloc_request( uint8_t op, const char* topic, aws_async_callback cb, void* arg )
 {
-    int rc = 0;
+    submit_request* req = submit_queue.alloc();
 
-    if ( timeout_ms < THRESHOLD_YIELD_TIMEOUT ) {
-        AWS_LIBRARY_INFO(("Recommend threshold timeout value 1000ms in order to allow adequate time for the system to receive and decode data \n"));
-        return CY_RSLT_AWS_ERROR_INVALID_YIELD_TIMEOUT;
+    if( req == NULL ) {
+        AWS_LIBRARY_ERROR(("Submission queue full \n"));
+        return NULL;
     }
 
-    if( mqtt_obj == NULL ) {
-        AWS_LIBRARY_ERROR(("Device not connected to MQTT broker \n"));
-        return CY_RSLT_AWS_ERROR_DISCONNECTED;
+    req->op = op;
+    req->callback = cb;
+    req->arg = arg;
+    req->length = 0;
+    req->priority = AWS_PRIORITY_HIGH;
+    req->ttl_ms = 0;
+    req->message_expiry = 0;
+    req->seq = 0;
+    req->submitted_ms = Kernel::get_ms_count();
+    strcpy( req->topic, topic );
+
+    return req;
+}
+
+void AWSIoTClient::restore_session_publishes()
+{
+    submit_request* req = NULL;
+    uint8_t qos = 0;
+
+    while( session.has_restorable() && ( req = alloc_request( AWS_SUBMIT_PUBLISH, "", NULL, NULL ) ) != NULL ) {
+        req->seq = session.restore_publish( req->topic, req->data, sizeof(req->data), &req->length, &qos );
+        if( req->seq == 0 ) {
+            submit_queue.release( req );
+            continue;
+        }
+        req->qos = (aws_iot_qos_level_t) qos;
+        req->priority = AWS_PRIORITY_DEFAULT;
+        submit_queue.submit( req );
+        core_util_atomic_store_u32( &async_used, 1 );
     }
+}
 
-    rc = mqtt_obj->yield( timeout_ms );
-    if( rc == -1 ) {
-        /* Send disconnect frame to broker */
-        mqtt_obj->disconnect();
+cy_rslt_t AWSIoTClient::publish_async( const char* topic, const char* data, uint32_t length, aws_publish_params_t pub_params, aws_async_callback cb, void* arg )
+{
+    submit_request* req = NULL;
+
+    pub_params = declared_publish_params( pub_params );
+    if( topic == NULL || strlen( topic ) > AWS_SUBMIT_MAX_TOPIC_LENGTH || length > AWS_SUBMIT_MAX_MESSAGE_LENGTH ) {
+        AWS_LIBRARY_ERROR(("Topic or message too long to be queued \n"));
+        return CY_RSLT_AWS_ERROR_PUBLISH_FAILED;
+    }
+    if( pub_params.QoS == AWS_QOS_ATLEAST_ONCE && session.is_open() && !AWSIoTSessionJournal::fits_publish( strlen( topic ), length ) ) {
+        AWS_LIBRARY_ERROR(("Topic and message exceed AWS_SESSION_BUFFER_SIZE and cannot be journaled \n"));
+        return CY_RSLT_AWS_ERROR_PUBLISH_FAILED;
+    }
 
-        delete mqtt_obj;
-        mqtt_obj = NULL;
-        mqttnetwork->disconnect();
+    req = alloc_request( AWS_SUBMIT_PUBLISH, topic, cb, arg );
+    if( req == NULL ) {
+        return CY_RSLT_AWS_ERROR_QUEUE_FULL;
+    }
 
-        delete mqttnetwork;
-        mqttnetwork = NULL;
+    req->qos = pub_params.QoS;
+    req->priority = pub_params.priority;
+    req->ttl_ms = pub_params.ttl_ms;
+    req->message_expiry = pub_params.message_expiry;
+    req->length = length;
+    memcpy( req->data, data, length );
 
-        return CY_RSLT_AWS_ERROR_DISCONNECTED;
+    submit_queue.submit( req );
+    core_util_atomic_store_u32( &async_used, 1 );
+
+    return CY_RSLT_SUCCESS;
+}
+
+cy_rslt_t AWSIoTClient::subscribe_async( const char* topic, aws_iot_qos_level_t qos, subscriber_callback handler, aws_async_callback cb, void* arg )
+{
+    submit_request* req = NULL;
+
+    if( topic == NULL || strlen( topic ) > AWS_SUBMIT_MAX_TOPIC_LENGTH ) {
+        AWS_LIBRARY_ERROR(("Topic too long to be queued \n"));
+        return CY_RSLT_AWS_ERROR_SUBSCRIBE_FAILED;
     }
 
+    req = alloc_request( AWS_SUBMIT_SUBSCRIBE, topic, cb, arg );
+    if( req == NULL ) {
+        return CY_RSLT_AWS_ERROR_QUEUE_FULL;
+    }
+
+    req->qos = qos;
+    req->handler = handler;
+
+    submit_queue.submit( req );
+    core_util_atomic_store_u32( &async_used, 1 );
+
     return CY_RSLT_SUCCESS;
 }
 
-void dump_response(HttpResponse* res)
+cy_rslt_t AWSIoTClient::unsubscribe_async( const char* topic, aws_async_callback cb, void* arg )
 {
-    AWS_LIBRARY_DEBUG(("Status: %d - %s\n", res->get_status_code(), res->get_status_message().c_str()));
+    submit_request* req = NULL;
 
-    AWS_LIBRARY_DEBUG(("Headers:\n"));
-    for (size_t ix = 0; ix < res->get_headers_length(); ix++)
-    {
-        AWS_LIBRARY_DEBUG(("\t%s: %s\n", res->get_headers_fields()[ix]->c_str(), res->get_headers_values()[ix]->c_str()));
+    if( topic == NULL || strlen( topic ) > AWS_SUBMIT_MAX_TOPIC_LENGTH ) {
+        AWS_LIBRARY_ERROR(("Topic too long to be queued \n"));
+        return CY_RSLT_AWS_ERROR_UNSUBSCRIBE_FAILED;
     }
 
-    AWS_LIBRARY_DEBUG(("\nBody (%lu bytes):\n\n%s\n", res->get_body_length(), res->get_body_as_string().c_str()));
+    req = alloc_request( AWS_SUBMIT_UNSUBSCRIBE, topic, cb, arg );
+    if( req == NULL ) {
+        return CY_RSLT_AWS_ERROR_QUEUE_FULL;
+    }
+
+    submit_queue.submit( req );
+    core_util_atomic_store_u32( &async_used, 1 );
 
+    return CY_RSLT_SUCCESS;
 }
 
-cy_rslt_t AWSIoTClient::discover(aws_iot_transport_type_t transport, const char* uri, const char* root_ca, uint16_t root_ca_length, aws_greengrass_callback gg_cb)
+const AWSIoTClient::registered_topic* AWSIoTClient::find_registered_topic( const char* topic ) const
 {
-    nsapi_error_t result;
-    TLSSocket* socket = new TLSSocket();
-    SocketAddress address;
-    char* discovery_uri = NULL;
+    uint32_t topic_length = strlen( topic );
+    uint8_t i = 0;
 
-    result = socket->set_client_cert_key(AWSIoTClient::certificate, AWSIoTClient::private_key);
-    if (result != 0) {
-        AWS_LIBRARY_ERROR((" Error in initializing client certificate and key : %d \n", result));
-        return CY_RSLT_AWS_ERROR_INVALID_CLIENT_KEY;
+    for( i = 0; i < AWS_MAX_REGISTERED_TOPICS; i++ ) {
+        if( topics[i].used && topics[i].topic_end == AWS_TOPIC_HEADER_RESERVE + 2 + topic_length &&
+            memcmp( &topics[i].packet[AWS_TOPIC_HEADER_RESERVE + 2], topic, topic_length ) == 0 ) {
+            return &topics[i];
+        }
     }
 
-    /* Initialize RootCA certificate */
-    result = socket->set_root_ca_cert((const char*) root_ca);
-    if (result != 0) {
-        printf (" Error in initializing rootCA certificate \n");
-        return CY_RSLT_AWS_ERROR_INVALID_ROOTCA;
+    return NULL;
+}
+
+uint32_t AWSIoTClient::request_lane( submit_request* req ) const
+{
+    aws_priority_t priority = req->priority;
+    const registered_topic* entry = NULL;
+
+    if( req->op == AWS_SUBMIT_PUBLISH && ( priority == AWS_PRIORITY_DEFAULT || req->ttl_ms == 0 ) ) {
+        entry = find_registered_topic( req->topic );
+    }
+    if( entry != NULL ) {
+        if( priority == AWS_PRIORITY_DEFAULT ) {
+            priority = entry->priority;
+        }
+        if( req->ttl_ms == 0 ) {
+            req->ttl_ms = entry->ttl_ms;
+        }
     }
+    if( priority < AWS_PRIORITY_HIGH || priority > AWS_PRIORITY_BULK ) {
+        priority = AWS_PRIORITY_NORMAL;
+    }
+
+    return (uint32_t) priority - AWS_PRIORITY_HIGH;
+}
 
-    /* Resolve hostname address */
-    result = network->gethostbyname(uri, &address);
+int AWSIoTClient::process_requests()
+{
+    submit_request* req = NULL;
+    aws_publish_params_t pub_params = AWS_PUBLISH_PARAMS_INITIALIZER;
+    cy_rslt_t result = CY_RSLT_SUCCESS;
+    aws_lane_metrics_t* lane_metrics = NULL;
+    uint32_t lane = 0;
+    bool journaled = false;
+
+    while( mqtt_obj != NULL ) {
+        /* sort in what was submitted meanwhile, so that an alarm queued during a slow publish goes out next */
+        journaled = false;
+        while( ( req = submit_queue.pop() ) != NULL ) {
+            req->bytes = strlen( req->topic ) + req->length;
+            if( req->op == AWS_SUBMIT_PUBLISH && req->qos == AWS_QOS_ATLEAST_ONCE && req->seq == 0 && session.is_open() ) {
+                req->seq = session.append_publish( req->topic, req->qos, req->data, req->length );
+                journaled = true;
+            }
+            outbound_lanes.push( req, request_lane( req ) );
+        }
+        /* one sync for the whole batch, before any of it goes out */
+        if( journaled ) {
+            session.commit();
+        }
+
+        req = outbound_lanes.pop( &lane );
+        if( req == NULL ) {
+            break;
+        }
+        lane_metrics = &metrics.lanes[lane];
+
+        /* a backlog left by an outage is mostly stale readings; drop them here rather than spend the link on them */
+        if( req->ttl_ms != 0 && Kernel::get_ms_count() - req->submitted_ms >= req->ttl_ms ) {
+            lane_metrics->expired++;
+            session.complete( req->seq );
+            if( req->callback != NULL ) {
+                req->callback( CY_RSLT_AWS_ERROR_EXPIRED, req->arg );
+            }
+            submit_queue.release( req );
+            continue;
+        }
 
-    AWS_LIBRARY_INFO((" IP address of server : %s \n", address.get_ip_address()));
+        switch( req->op ) {
+            case AWS_SUBMIT_PUBLISH:
+                pub_params.QoS = req->qos;
+                pub_params.message_expiry = req->message_expiry;
+                result = publish( req->topic, req->data, req->length, pub_params );
+                break;
+            case AWS_SUBMIT_SUBSCRIBE:
+                result = subscribe( req->topic, req->qos, req->handler );
+                break;
+            default:
+                result = unsubscribe( req->topic );
+                break;
+        }
 
-    /* set GreenGrass port */
-    address.set_port( AWS_GG_HTTPS_SERVER_PORT);
+        lane_metrics->requests++;
+        lane_metrics->bytes += req->bytes;
+        record_latency( lane_metrics->latency, &lane_metrics->latency_max_ms, (uint32_t) ( Kernel::get_ms_count() - req->submitted_ms ) );
+
+        /* a journaled publish lost with the link has no outcome yet; it goes out again after the next connect */
+        if( result != CY_RSLT_SUCCESS && connection_lost() ) {
+            if( req->seq != 0 ) {
+                outbound_lanes.push_front( req, lane );
+            } else {
+                if( req->callback != NULL ) {
+                    req->callback( result, req->arg );
+                }
+                submit_queue.release( req );
+            }
+            return -1;
+        }
 
-    result = socket->open(AWSIoTClient::network);
+        if( result == CY_RSLT_SUCCESS ) {
+            session.complete( req->seq );
+        }
+        if( req->callback != NULL ) {
+            req->callback( result, req->arg );
+        }
+        submit_queue.release( req );
+    }
 
-    /* set peer common name */
-    socket->set_hostname(uri);
+    return 0;
+}
 
-    socket->set_timeout(5000);
+cy_rslt_t AWSIoTClient::yield(unsigned long timeout_ms)
+{
+    int rc = 0;
+    uint64_t bytes_received = 0;
+    uint64_t now_ms = 0;
+    uint64_t deadline_ms = 0;
+    uint32_t slice_ms = 0;
 
-    result = socket->connect(address);
-    if (result != 0) {
-        AWS_LIBRARY_ERROR((" TLS connection to server failed : %d \n", result));
-        return CY_RSLT_AWS_ERROR_CONNECT_FAILED;
+    if ( timeout_ms < THRESHOLD_YIELD_TIMEOUT ) {
+        AWS_LIBRARY_INFO(("Recommend threshold timeout value 1000ms in order to allow adequate time for the system to receive and decode data \n"));
+        return CY_RSLT_AWS_ERROR_INVALID_YIELD_TIMEOUT;
     }
 
-    AWS_LIBRARY_DEBUG((" TLS connection to server established. Connected to server \n"));
+    if( mqtt_obj == NULL ) {
+        AWS_LIBRARY_ERROR(("Device not connected to MQTT broker \n"));
+        return CY_RSLT_AWS_ERROR_DISCONNECTED;
+    }
 
-    /* Register callback for AWS discovery payload */
-    cy_JSON_parser_register_callback( json_callback_for_discovery_payload );
+    bytes_received = network_stats.bytes_received;
+    metrics.yields++;
 
-    /* form discovery URI to send to AWS cloud */
-    uint8_t discovery_uri_length = (strlen(thing_name) + strlen(GG_REQUEST_PROTOCOL) + strlen(uri) + strlen(GREENGRASS_DISCOVERY_HTTP_REQUEST_URI_PREFIX) + 1 );
+    /* Yield in slices that end when the next PINGREQ is due, so that a long yield does not overrun the keep-alive */
+    now_ms = Kernel::get_ms_count();
+    deadline_ms = now_ms + timeout_ms;
+    do {
+        if( link_lost ) {
+            rc = -1;
+            break;
+        }
+        rc = service_keep_alive();
+        if( rc == -1 ) {
+            break;
+        }
+        rc = process_requests();
+        session.service( Kernel::get_ms_count() );
+        if( rc == -1 ) {
+            break;
+        }
+
+        slice_ms = keep_alive.next_ping_in( now_ms, network_stats.last_sent_ms, network_stats.last_received_ms );
+        if( core_util_atomic_load_u32( &async_used ) && slice_ms > AWS_SUBMIT_POLL_INTERVAL ) {
+            slice_ms = AWS_SUBMIT_POLL_INTERVAL;
+        }
+        if( slice_ms > deadline_ms - now_ms ) {
+            slice_ms = (uint32_t) ( deadline_ms - now_ms );
+        }
 
-    discovery_uri = (char *) malloc( discovery_uri_length);
-    memset( discovery_uri, 0, discovery_uri_length);
+        AWS_TRACE_EVENT(AWS_TRACE_API_BEGIN, 0, 0, 0);
+        rc = mqtt_obj->yield( slice_ms );
+        AWS_TRACE_EVENT(AWS_TRACE_API_END, 0, 0, 0);
+        now_ms = Kernel::get_ms_count();
+    } while( rc != -1 && now_ms < deadline_ms );
 
-    /* example : https://a38td4ke8seeky-ats.iot.us-east-1.amazonaws.com/greengrass/discover/thing/wiced_ggd_1 */
-    strcat( discovery_uri, GG_REQUEST_PROTOCOL );
-    strcat( discovery_uri, uri );
-    strcat( discovery_uri, GREENGRASS_DISCOVERY_HTTP_REQUEST_URI_PREFIX );
-    strcat( discovery_uri, thing_name );
+    if( network_stats.bytes_received == bytes_received ) {
+        metrics.idle_yields++;
+    }
+    if( rc == -1 ) {
+        drop_connection();
+        return CY_RSLT_AWS_ERROR_DISCONNECTED;
+    }
 
-    AWS_LIBRARY_DEBUG(("[AWS-Greengrass] Discovery URI is: %s (len:%d)\n", discovery_uri, (int) strlen(discovery_uri)));
+    return CY_RSLT_SUCCESS;
+}
 
-    HttpsRequest* get_req = new HttpsRequest(socket, HTTP_GET, discovery_uri);
+void AWSIoTClient::drop_connection()
+{
+    keep_alive.connection_lost( Kernel::get_ms_count(),
+            ( network_stats.last_sent_ms > network_stats.last_received_ms ) ? network_stats.last_sent_ms : network_stats.last_received_ms );
 
-    HttpResponse* get_res = get_req->send();
-    if (!get_res) {
-        AWS_LIBRARY_ERROR(("HttpRequest failed (error code %d)\n", get_req->get_error()));
-        return CY_RSLT_AWS_ERROR_HTTP_FAILURE;
+    /* Send disconnect frame to broker, unless the link was already given up on */
+    if( !link_lost ) {
+        mqtt_obj->disconnect();
     }
 
-    AWS_LIBRARY_DEBUG(("\n----- HTTPS GET response -----\n"));
-    dump_response(get_res);
+    mqtt_storage.destroy();
+    mqtt_obj = NULL;
+    mqttnetwork->disconnect();
+
+    network_storage.destroy();
+    mqttnetwork = NULL;
+    AWSIoTCredentials::release( &network_credentials );
+    mqtt5_storage.destroy();
+    mqtt5 = NULL;
+    session_present = false;
+}
+
+/* Context of a discovery call, handed to the response callback */
+typedef struct
+{
+    const char* const*      thing_names;
+    aws_greengrass_callback gg_cb;
+    cy_rslt_t               result;
+} discovery_request_t;
+
+static void discovery_response( uint8_t index, int status, const char* body, uint32_t length, bool resent, void* arg )
+{
+    discovery_request_t* request = (discovery_request_t*) arg;
+    cy_rslt_t result = CY_RSLT_SUCCESS;
+
+    AWS_LIBRARY_DEBUG(("[AWS-Greengrass] Discovery of %s : status %d, body (%lu bytes)\n", request->thing_names[index], status, (unsigned long) length));
 
-    result = cy_JSON_parser( (const char*)get_res->get_body_as_string().c_str(), (uint32_t) get_res->get_body_length() );
+    if( status != 200 || body == NULL ) {
+        AWS_LIBRARY_ERROR(("[AWS-Greengrass] Discovery of %s failed with HTTP status %d\n", request->thing_names[index], status));
+        request->result = CY_RSLT_AWS_ERROR_HTTP_FAILURE;
+        return;
+    }
+
+    /* Register callback for AWS discovery payload; groups reported for the previous thing are released */
+    aws_greengrass_discovery_reset();
+    cy_JSON_parser_register_callback( json_callback_for_discovery_payload );
+
+    result = cy_JSON_parser( body, length );
     if( result != CY_RSLT_SUCCESS ) {
         AWS_LIBRARY_ERROR(("[AWS-Greengrass] JSON parser error\n"));
-        return CY_RSLT_AWS_ERROR_HTTP_FAILURE;
+        request->result = CY_RSLT_AWS_ERROR_HTTP_FAILURE;
+        return;
     }
 
     discovery_data.groups = group_list;
+    discovery_data.thing_name = request->thing_names[index];
 
-    if( gg_cb ) {
-        gg_cb( &discovery_data );
+    if( request->gg_cb ) {
+        request->gg_cb( &discovery_data );
     }
+}
 
-    delete get_req;
-    delete socket;
-    free(discovery_uri);
-    return CY_RSLT_SUCCESS;
+cy_rslt_t AWSIoTClient::discover(aws_iot_transport_type_t transport, const char* uri, const char* root_ca, uint16_t root_ca_length, aws_greengrass_callback gg_cb)
+{
+    const char* thing_names[1] = { AWSIoTClient::thing_name };
+
+    return discover_things(transport, uri, root_ca, root_ca_length, thing_names, 1, gg_cb);
+}
+
+cy_rslt_t AWSIoTClient::discover_things(aws_iot_transport_type_t transport, const char* uri, const char* root_ca, uint16_t root_ca_length,
+        const char* const* thing_names, uint8_t count, aws_greengrass_callback gg_cb)
+{
+    discovery_request_t request;
+    cy_rslt_t result = CY_RSLT_SUCCESS;
+
+    result = load_credentials();
+    if (result != CY_RSLT_SUCCESS) {
+        return result;
+    }
+
+    request.thing_names = thing_names;
+    request.gg_cb = gg_cb;
+    request.result = CY_RSLT_SUCCESS;
+
+    /* The HTTPS connection is kept open, so later discoveries against the same endpoint skip DNS, TCP and TLS */
+    result = discovery_connection.get(AWSIoTClient::network, credentials, uri, AWS_GG_HTTPS_SERVER_PORT, root_ca, root_ca_length,
+            GREENGRASS_DISCOVERY_HTTP_REQUEST_URI_PREFIX, thing_names, count, discovery_response, &request);
+    if (result != CY_RSLT_SUCCESS) {
+        return result;
+    }
+
+    return request.result;
+}
+
+void AWSIoTClient::close_discovery()
+{
+    discovery_connection.close();
 }
@@ -22,6 +22,20 @@
 #define AWSCLIENT_H
 
 #include "aws_common.h"
+#include "aws_rate_limiter.h"
+#include "aws_keep_alive.h"
+#include "aws_submit_queue.h"
+#include "aws_priority_lanes.h"
+#include "aws_dispatcher.h"
+#include "aws_session_journal.h"
+#include "aws_credentials.h"
+#include "aws_https_connection.h"
+#include "aws_endpoint_selector.h"
+#include "aws_chunk_window.h"
+#include "aws_download.h"
+#include "aws_sigv4.h"
+#include "aws_storage.h"
+#include "aws_publish_packet.h"
 #include "NetworkInterface.h"
 #include "MQTTClient.h"
 #include "MQTTNetwork.h"
@@ -38,8 +52,9 @@ using namespace MQTT;
 * This library provides following features:
 *  * Single interface to communicate with AWS using different protocols:
 *     - MQTT over TCP sockets (using Client Certificates)
-*     - HTTP for Greengrass core discovery \n
-*     NOTE: MQTT over Websockets and RESTful HTTPS are not supported currently
+*     - MQTT over WebSockets on port 443 (using SigV4-signed AWS credentials, see @ref AWSIoTClient::set_sigv4_credentials)
+*     - RESTful HTTPS publishes on port 8443 (using Client Certificates, see @ref AWS_TRANSPORT_RESTFUL_HTTPS)
+*     - HTTP for Greengrass core discovery
 *  * Supports Quality of Service (QoS) levels 0 and 1
 * 
 * User can implement a AWS subscriber/publisher application by using the APIs provided in this library. To communicate with AWS IoT message broker, user should have a 'Thing', 'Policies', 'certificates' and unique client IDs for each AWS client instance. Refer to the section below for AWS IoT terminology.
@@ -65,6 +80,7 @@ using namespace MQTT;
 * * <b>Greengrass :</b> https://docs.aws.amazon.com/greengrass/latest/developerguide/what-is-gg.html
 * * <b>Authentication :</b> https://docs.aws.amazon.com/iot/latest/developerguide/authentication.html
 * * <b>MQTT Protocol :</b> http://docs.oasis-open.org/mqtt/mqtt/v3.1.1/os/mqtt-v3.1.1-os.html
+* * <b>MQTT 5 Protocol :</b> https://docs.oasis-open.org/mqtt/mqtt/v5.0/os/mqtt-v5.0-os.html
 *
 * \defgroup aws_iot AWS IoT library
 * \defgroup aws_iot_macros AWS IoT and Greengrass macros
@@ -131,6 +147,10 @@ typedef void (*aws_greengrass_callback)( aws_greengrass_discovery_callback_data_
 /** AWS IoT client subscriber callback that will be invoked whenever a message is received for the subscribed topic */
 typedef void (*subscriber_callback)( aws_iot_message_t& message);
 
+/** AWS IoT client completion callback that will be invoked by the thread calling @ref AWSIoTClient::yield once a queued request
+ *  ( @ref AWSIoTClient::publish_async, @ref AWSIoTClient::subscribe_async, @ref AWSIoTClient::unsubscribe_async ) has been processed */
+typedef void (*aws_async_callback)( cy_rslt_t result, void* arg );
+
 /**
  * @}
  */
@@ -156,14 +176,37 @@ typedef void (*subscriber_callback)( aws_iot_message_t& message);
  */
 #define DEFAULT_COMMAND_TIMEOUT 5000
 
-/** Maximum MQTT packet size including MQTT header and payload. */
+/** Maximum MQTT packet size including MQTT header and payload.
+ * Incoming messages are read into a buffer of this size; raise it when receiving larger messages, such as the blocks of
+ * @ref AWSIoTClient::download.
+ */
+#ifndef AWS_MAX_PACKET_SIZE
 #define AWS_MAX_PACKET_SIZE 100
+#endif
 
 /** Maximum number of message handlers.
  * AWS_MAX_MESSAGE_HANDLERS 5 - It means application can register 5 different callback functions for 5 different subscribed topics.
  */
 #define AWS_MAX_MESSAGE_HANDLERS 5
 
+/** Number of requests that can be waiting in the submission queue ( @ref AWSIoTClient::publish_async ). */
+#define AWS_SUBMIT_QUEUE_DEPTH 16
+
+/** Maximum topic length of a queued request. */
+#define AWS_SUBMIT_MAX_TOPIC_LENGTH 128
+
+/** Maximum message length of a queued publish. */
+#define AWS_SUBMIT_MAX_MESSAGE_LENGTH AWS_MAX_PACKET_SIZE
+
+/** Interval (in ms) at which yield checks the submission queue once requests have been queued. */
+#define AWS_SUBMIT_POLL_INTERVAL 20
+
+/** Number of topics that can be registered for publishing ( @ref AWSIoTClient::register_topic ). */
+#define AWS_MAX_REGISTERED_TOPICS 4
+
+/** Bytes kept free ahead of a registered topic for the fixed header and remaining length of the PUBLISH. */
+#define AWS_TOPIC_HEADER_RESERVE AWS_PUBLISH_HEADER_MAX_LENGTH
+
 /**
  * @}
  */
@@ -223,13 +266,200 @@ public:
      */
     void set_command_timeout( int command_timeout );
 
+    /** Configures the client-side publish rate limiter.
+     *  Publishes that exceed the configured rate are delayed (not rejected) until tokens are available, so that the connection stays within the AWS IoT per-connection quotas.
+     *  Rate limiting is disabled by default. Use @ref AWS_IOT_PUBLISH_RATE_LIMIT and @ref AWS_IOT_THROUGHPUT_LIMIT to match the AWS IoT quotas.
+     *
+     * @param[in] params          : Rate limit parameters
+     *
+     */
+    void set_rate_limit( aws_rate_limit_params_t params );
+
+    /** Sets the byte budgets of the outbound lanes that queued requests are scheduled from ( @ref publish_async ).
+     *  Lanes are served highest first; under congestion each lane gets a share of the link proportional to its budget,
+     *  so bulk telemetry is held back behind alarms without being starved. By default the bulk lane gets
+     *  @ref AWS_PRIORITY_DEFAULT_BUDGET bytes per round and each higher lane twice the budget of the lane below.
+     *
+     * @param[in] params          : Lane budgets
+     *
+     */
+    void set_priority_params( aws_priority_params_t params );
+
+    /** Returns statistics on how long publishes were delayed by the rate limiter.
+     *
+     * @param[out] stats          : Rate limiter statistics
+     *
+     */
+    void get_rate_limit_stats( aws_rate_limit_stats_t* stats );
+
+    /** Configures the faults injected by the loopback transport ( @ref AWS_TRANSPORT_MQTT_LOOPBACK ): latency, jitter, bandwidth cap,
+     *  packet drops, disconnects, half-open links and stalled writes. Applies to subsequent connects.
+     *  The loopback transport connects to an in-process MQTT broker stand-in, so reconnect and QoS1 behavior can be measured repeatably without a network.
+     *  The loopback transport is built only when AWS_IOT_LOOPBACK is defined; otherwise connect fails with CY_RSLT_AWS_ERROR_UNSUPPORTED.
+     *
+     * @param[in] faults          : Link faults; a zeroed structure describes a perfect link
+     *
+     */
+    void set_loopback_faults( mqtt_loopback_faults_t faults );
+
+    /** Sets the AWS credentials that sign WebSocket connections ( @ref AWS_TRANSPORT_MQTT_WEBSOCKET ). Such connections are
+     *  made to port 443 ( @ref AWS_IOT_WEBSOCKET_PORT ) and authenticate with a SigV4-presigned upgrade request instead of the
+     *  client certificate, so they also pass networks that only allow outbound HTTPS. Signing uses the real-time clock,
+     *  which must be set. The strings are not copied and must stay valid while the client connects.
+     *
+     * @param[in] credentials     : AWS credentials and region
+     *
+     */
+    void set_sigv4_credentials( aws_sigv4_credentials_t credentials );
+
+    /** Configures keep-alive. A PINGREQ is only sent once nothing has been sent for a full ping interval, so any outbound packet
+     *  counts as liveness. In adaptive mode the ping interval is lowered below the keep-alive passed to @ref connect when the
+     *  connection is lost while idle (typically a NAT timeout), and raised again after pings keep getting answered.
+     *  Ping round trip times and the current interval are reported by @ref get_metrics. Adaptive mode is disabled by default.
+     *
+     * @param[in] params          : Keep-alive parameters
+     *
+     */
+    void set_keep_alive_params( aws_keep_alive_params_t params );
+
+    /** Runs subscriber callbacks on a pool of worker threads instead of inside @ref yield, so that a slow callback
+     *  (for example one writing to flash) cannot delay keep-alive or the reading of further packets.
+     *  Incoming messages are copied into a bounded queue per subscription ( @ref AWS_DISPATCH_QUEUE_DEPTH messages of
+     *  AWS_DISPATCH_MAX_MESSAGE_LENGTH bytes, which must be defined at least as large as @ref AWS_MAX_PACKET_SIZE );
+     *  params.policy decides what happens when a queue is full. Messages of one subscription are delivered in order, one at a time.
+     *  Applies to subscriptions made after this call. Callbacks must then be thread safe with respect to each other.
+     *
+     * @param[in] params          : Dispatch parameters
+     *
+     * @return cy_rslt_t          : CY_RSLT_SUCCESS - on success,
+     *                              CY_RSLT_AWS_ERROR_UNSUPPORTED - if more than AWS_MAX_CONNECTIONS clients enable dispatch,
+     *                              CY_RSLT_AWS_ERROR_BUFFER_OVERFLOW - if AWS_DISPATCH_MAX_MESSAGE_LENGTH is smaller than @ref AWS_MAX_PACKET_SIZE ( @ref aws_iot_defines )
+     */
+    cy_rslt_t enable_dispatch( aws_dispatch_params_t params );
+
+    /** Uses a shared credentials object for TLS instead of the certificate and key passed to the constructor.
+     *  The client certificate, private key and root CAs are parsed once per credentials object and reused by every
+     *  @ref connect and @ref discover, so several clients using the same device identity can share one.
+     *  By default each client parses the constructor credentials on its first connect or discover and keeps them.
+     *
+     * @param[in] credentials     : Credentials to use; must outlive the client. NULL reverts to the client's own credentials
+     *
+     */
+    void set_credentials( AWSIoTCredentials* credentials );
+
+    /** Stops the dispatch workers. Queued messages are discarded and further messages are delivered from @ref yield again. */
+    void disable_dispatch();
+
+    /** Drops QoS1 messages the broker sends again, before the subscriber callbacks run. A redelivery carries the
+     *  packet identifier of the original message and the DUP flag; the client remembers the last
+     *  @ref AWS_DUPLICATE_WINDOW_SIZE identifiers, so memory is fixed and the check takes constant time.
+     *  Dropped messages are still acknowledged. The window is kept across reconnects and emptied when a clean session starts.
+     *  Works with or without @ref enable_dispatch and applies to subscriptions made after this call.
+     *  The number of dropped messages is reported by @ref get_dispatch_stats. Disabled by default.
+     *
+     * @param[in] params          : Duplicate filter parameters
+     *
+     * @return cy_rslt_t          : CY_RSLT_SUCCESS - on success,
+     *                              CY_RSLT_AWS_ERROR_UNSUPPORTED - if more than AWS_MAX_CONNECTIONS clients enable dispatch, duplicate filtering or value caching
+     */
+    cy_rslt_t enable_duplicate_filter( aws_duplicate_filter_params_t params );
+
+    /** Stops dropping QoS1 redeliveries. */
+    void disable_duplicate_filter();
+
+    /** Keeps the last message of each topic received through 'topic_filter', so that modules read the latest configuration or
+     *  desired state with @ref get_last_value instead of asking AWS again. Call before subscribing to 'topic_filter'; the value
+     *  is updated before the subscriber callback runs. Up to AWS_VALUE_CACHE_ENTRIES topics are cached in total, the one
+     *  received least recently being evicted; evictions and messages too long to cache are reported by @ref get_dispatch_stats.
+     *  Values stay cached across reconnects and unsubscribes until @ref disable_value_cache.
+     *
+     * @param[in] topic_filter    : Topic filter, as passed to @ref subscribe; copied
+     *
+     * @return cy_rslt_t          : CY_RSLT_SUCCESS - on success,
+     *                              CY_RSLT_AWS_ERROR_UNSUPPORTED - if more than AWS_MAX_CONNECTIONS clients enable dispatch, duplicate filtering
+     *                              or value caching, if the filter is longer than AWS_TOPIC_FILTER_MAX_LENGTH, or if AWS_VALUE_CACHE_MAX_FILTERS
+     *                              filters are cached already
+     */
+    cy_rslt_t enable_value_cache( const char* topic_filter );
+
+    /** Stops caching a topic filter and drops its cached values.
+     *
+     * @param[in] topic_filter    : Topic filter passed to @ref enable_value_cache
+     *
+     */
+    void disable_value_cache( const char* topic_filter );
+
+    /** Copies the last value received on a topic, without network traffic. Safe to call from any thread, subscriber callbacks included.
+     *  The version in 'value' changes whenever the payload of the topic changes, so a module can poll cheaply by passing a 'size'
+     *  of 0 and comparing versions, or compare @ref get_value_cache_version to learn that any cached value changed.
+     *
+     * @param[in]  topic          : Topic, as received (not a filter)
+     * @param[out] buffer         : Buffer receiving the payload
+     * @param[in]  size           : Size of 'buffer'
+     * @param[out] value          : Optional; length, version and age of the value, filled in whenever the topic is cached
+     *
+     * @return cy_rslt_t          : CY_RSLT_SUCCESS - on success,
+     *                              CY_RSLT_AWS_ERROR_NOT_CACHED - if no value is cached for 'topic',
+     *                              CY_RSLT_AWS_ERROR_BUFFER_OVERFLOW - if the payload is longer than 'size'; 'value' holds its length
+     */
+    cy_rslt_t get_last_value( const char* topic, char* buffer, uint32_t size, aws_cached_value_t* value = NULL );
+
+    /** Returns the version of the latest change of any cached value; 0 while nothing was cached. */
+    uint32_t get_value_cache_version();
+
+    /** Keeps the session state in a journal file so that a restarted device resumes its MQTT session with a single CONNECT.
+     *  Call before @ref connect. While enabled, connect asks for a persistent session unless conn_params.clean_session is set.
+     *  - A subscription is journaled once acknowledged. If the broker still holds the session, @ref subscribe of a journaled
+     *    topic filter with the same QoS only installs the handler, without a SUBSCRIBE round trip ( @ref session_resumed ).
+     *  - A QoS1 @ref publish_async is journaled when the thread calling @ref yield takes it from the submission queue; each
+     *    batch is synced with one fsync before any of it is sent. It stays pending until the broker acknowledges it: if the
+     *    connection is lost while it is sent, it goes back to the head of its lane and its callback runs only once it got through;
+     *    if the device is reset, it is queued again on the next connect. Delivery is at least once: it may be sent twice.
+     *    Replayed publishes are queued again oldest first. A QoS1 publish too large for a journal record is refused by @ref publish_async.
+     *  - The packet identifiers of QoS1 publishes continue after a restart instead of starting over.
+     *  Publishes of the blocking APIs are not journaled: their caller learns the outcome directly.
+     *
+     * @param[in] params          : Session journal parameters
+     *
+     * @return cy_rslt_t          : CY_RSLT_SUCCESS - on success,
+     *                              CY_RSLT_AWS_ERROR_JOURNAL_FAILED - On error ( @ref aws_iot_defines )
+     */
+    cy_rslt_t enable_session_journal( aws_session_params_t params );
+
+    /** Syncs and closes the session journal. Later connects start clean sessions again. The file is kept. */
+    void disable_session_journal();
+
+    /** Returns true if the broker kept the session for the current connection, so journaled subscriptions are still in place. */
+    bool session_resumed() const;
+
+    /** Returns statistics of the dispatch executor.
+     *
+     * @param[out] stats          : Dispatch statistics
+     *
+     */
+    void get_dispatch_stats( aws_dispatch_stats_t* stats );
+
+    /** Takes a snapshot of the client metrics: publish latency histogram, traffic counters, yield and connection
+     *  statistics and the phase timings of the last connect. Metrics are cumulative over reconnects.
+     *
+     * @param[out] metrics        : Metrics snapshot
+     *
+     */
+    void get_metrics( aws_iot_metrics_t* metrics );
+
+    /** Resets all client metrics to zero */
+    void reset_metrics();
+
     /** Discovers Greengrass cores(groups) of which this 'Thing' is part of.
+     *  The HTTPS connection to the discovery endpoint is kept open and reused by later discoveries against the same endpoint;
+     *  use @ref close_discovery to release it.
      *
      * @param[in] transport           : AWS transport to be used
      * @param[in] uri                 : URI of the AWS endpoint
      * @param[in] root_ca             : Root CA certificate
      * @param[in] root_ca_length      : Length of Root CA certificate
-     * @param[in] gg_cb               : Greengrass discovery payload callback - Notifies application of Greengrass Cores information
+     * @param[in] gg_cb               : Greengrass discovery payload callback - Notifies application of Greengrass Cores information.
+     *                                  The group list passed to the callback stays valid until the next call to discover.
      *
      * @return cy_rslt_t              : CY_RSLT_SUCCESS - on success,
      *                                  CY_RSLT_AWS_ERROR_INVALID_CLIENT_KEY, CY_RSLT_AWS_ERROR_INVALID_ROOTCA,
@@ -238,20 +468,65 @@ public:
      */
     cy_rslt_t discover( aws_iot_transport_type_t transport, const char* uri, const char* root_ca, uint16_t root_ca_length, aws_greengrass_callback gg_cb );
 
+    /** Discovers the Greengrass cores(groups) of several 'Things', for example all the devices behind a gateway.
+     *  The requests are pipelined on one kept-alive HTTPS connection ( up to @ref AWS_GG_DISCOVERY_PIPELINE_DEPTH in flight ).
+     *  The client certificate must be authorized to discover every thing in the list.
+     *
+     * @param[in] transport           : AWS transport to be used
+     * @param[in] uri                 : URI of the AWS endpoint
+     * @param[in] root_ca             : Root CA certificate
+     * @param[in] root_ca_length      : Length of Root CA certificate
+     * @param[in] thing_names         : Things to discover
+     * @param[in] count               : Number of things
+     * @param[in] gg_cb               : Greengrass discovery payload callback - invoked once per thing, in list order, with cb_data->thing_name set.
+     *                                  The group list passed to the callback stays valid until the callback for the next thing.
+     *
+     * @return cy_rslt_t              : CY_RSLT_SUCCESS - if every thing was discovered,
+     *                                  CY_RSLT_AWS_ERROR_INVALID_CLIENT_KEY, CY_RSLT_AWS_ERROR_INVALID_ROOTCA,
+     *                                  CY_RSLT_AWS_ERROR_CONNECT_FAILED, CY_RSLT_AWS_ERROR_HTTP_FAILURE - On error ( @ref aws_iot_defines )
+     *
+     */
+    cy_rslt_t discover_things( aws_iot_transport_type_t transport, const char* uri, const char* root_ca, uint16_t root_ca_length,
+                               const char* const* thing_names, uint8_t count, aws_greengrass_callback gg_cb );
+
+    /** Closes the HTTPS connection kept open by @ref discover and @ref discover_things. */
+    void close_discovery();
+
 
     /** Establishes connection to an AWS IoT or Greengrass core
      * This API is blocking and shall return when CONACK is received from server or timeout occurs
-     *
-     * @param[in] conn_params     : Connection parameters
+     * With @ref AWS_TRANSPORT_RESTFUL_HTTPS no MQTT session is set up: a TLS connection to the HTTPS endpoint
+     * ( port @ref AWS_IOT_HTTPS_PORT if 'endpoint_params.port' is 0 ) is opened and kept alive for @ref publish and
+     * @ref publish_batch, which suits devices that wake up only to send a few messages. Subscribing is not available then.
+     * With conn_params.mqtt_version set to @ref AWS_MQTT_VERSION_5 the connection speaks MQTT 5: publishes get topic aliases
+     * and the properties of their publish parameters, and the broker's Receive Maximum, Maximum Packet Size and Server Keep Alive
+     * are honoured. The loopback transport supports MQTT 3.1.1 only.
+     *
+     * @param[in] conn_params     : Connection parameters ( @ref AWS_CONNECT_PARAMS_INITIALIZER )
      * @param[in] endpoint_params : AWS IoT Endpoint parameters
      *
      * @return cy_rslt_t          : CY_RSLT_SUCCESS - On success
      *                              CY_RSLT_AWS_ERROR_CONNECT_FAILED, CY_RSLT_AWS_ERROR_INVALID_ROOTCA,
-     *                              CY_RSLT_AWS_ERROR_INVALID_CLIENT_KEY - On error ( @ref aws_iot_defines )
+     *                              CY_RSLT_AWS_ERROR_INVALID_CLIENT_KEY, CY_RSLT_AWS_ERROR_UNSUPPORTED - On error ( @ref aws_iot_defines )
      *
      */
     cy_rslt_t connect( aws_connect_params_t conn_params,aws_endpoint_params_t endpoint_params);
 
+    /** Establishes connection to the best reachable Greengrass core known to an endpoint selector
+     *  The endpoints are tried in ranked order ( @ref AWSIoTEndpointSelector::get_ranked ), falling over to the next one
+     *  when a connect fails, and the outcome of every attempt is reported back to the selector.
+     *  The selector must not be cleared while the client is connected, since the endpoint address is kept by reference.
+     *
+     * @param[in] conn_params     : Connection parameters
+     * @param[in] selector        : Ranked Greengrass core endpoints, e.g. filled from a discovery result ( @ref AWSIoTEndpointSelector::add_groups )
+     *
+     * @return cy_rslt_t          : CY_RSLT_SUCCESS - On success
+     *                              CY_RSLT_AWS_ERROR_CONNECT_FAILED, CY_RSLT_AWS_ERROR_INVALID_ROOTCA,
+     *                              CY_RSLT_AWS_ERROR_INVALID_CLIENT_KEY, CY_RSLT_AWS_ERROR_UNSUPPORTED - On error ( @ref aws_iot_defines )
+     *
+     */
+    cy_rslt_t connect( aws_connect_params_t conn_params, AWSIoTEndpointSelector& selector );
+
 
     /** Publishes message to user defined topic on AWS cloud
      * This API is blocking and shall return when PUBACK is received from server or timeout occurs
@@ -268,17 +543,128 @@ public:
      */
     cy_rslt_t publish( const char* topic, const char* data, uint32_t length, aws_publish_params_t pub_params );
 
+    /** Publishes several messages, e.g. the readings collected while a device slept
+     *  Over @ref AWS_TRANSPORT_RESTFUL_HTTPS the messages are POSTed to /topics/<topic> on the kept-alive connection,
+     *  several requests ahead of their responses, so a batch costs about one round trip per @ref AWS_GG_DISCOVERY_PIPELINE_DEPTH
+     *  messages. Delivery is at least once: requests left unanswered when a kept-alive connection turns out to be closed
+     *  are sent again once on a new connection, and the server may have processed them already. 'resent' reports which
+     *  messages this happened to, so that an application can mark or deduplicate them. Messages without a response when
+     *  this API fails may have been delivered as well.
+     *  Over MQTT the messages are published one after the other and none is sent twice.
+     *
+     * @param[in]  messages       : Messages to publish
+     * @param[in]  count          : Number of messages
+     * @param[out] published      : Number of messages accepted by the server; may be NULL
+     * @param[out] resent         : Array of 'count' flags, set for each message that was sent twice and may be delivered twice; may be NULL
+     *
+     * @return cy_rslt_t          : CY_RSLT_SUCCESS - if every message was accepted,
+     *                              CY_RSLT_AWS_ERROR_PUBLISH_FAILED - On error ( @ref aws_iot_defines )
+     *
+     */
+    cy_rslt_t publish_batch( const aws_publish_message_t* messages, uint8_t count, uint8_t* published = NULL, bool* resent = NULL );
+
+    /** Registers a topic that is published to repeatedly
+     *  The topic is encoded into a per-topic PUBLISH buffer once, so publishing through the handle only writes the
+     *  remaining length, the packet identifier and the payload. Registrations are kept across reconnects.
+     *
+     * @param[in]  topic          : Topic to register; copied
+     * @param[out] handle         : Handle to publish with
+     *
+     * @return cy_rslt_t          : CY_RSLT_SUCCESS - on success,
+     *                              CY_RSLT_AWS_ERROR_BUFFER_OVERFLOW - if @ref AWS_MAX_REGISTERED_TOPICS are registered or the topic does not fit into @ref AWS_MAX_PACKET_SIZE ( @ref aws_iot_defines )
+     *
+     */
+    cy_rslt_t register_topic( const char* topic, aws_topic_handle_t* handle );
+
+    /** Releases a topic registered with @ref register_topic.
+     *
+     * @param[in] handle          : Handle of the topic
+     *
+     */
+    void unregister_topic( aws_topic_handle_t handle );
+
+    /** Sets the lane of queued publishes to a registered topic that do not pick one themselves ( AWS_PRIORITY_DEFAULT ).
+     *
+     * @param[in] handle          : Handle of the topic
+     * @param[in] priority        : Lane for the topic; AWS_PRIORITY_DEFAULT reverts to AWS_PRIORITY_NORMAL
+     *
+     */
+    void set_topic_priority( aws_topic_handle_t handle, aws_priority_t priority );
+
+    /** Sets the time-to-live of queued publishes to a registered topic that do not set one themselves ( pub_params.ttl_ms of 0 ).
+     *
+     * @param[in] handle          : Handle of the topic
+     * @param[in] ttl_ms          : Time (in ms) after submission when a publish still waiting in the queue is discarded; 0 for no limit
+     *
+     */
+    void set_topic_ttl( aws_topic_handle_t handle, uint32_t ttl_ms );
+
+    /** Publishes message to a registered topic
+     * This API is blocking and shall return when PUBACK is received from server or timeout occurs
+     *
+     * @param[in] handle          : Handle returned by @ref register_topic
+     * @param[in] data            : Pointer to the message to be published
+     * @param[in] length          : Length of the message pointed by 'message'
+     * @param[in] pub_params      : Publish parameters
+     *
+     * @return cy_rslt_t          : CY_RSLT_SUCCESS - on success,
+     *                              CY_RSLT_AWS_ERROR_PUBLISH_FAILED - On error ( @ref aws_iot_defines )
+     *
+     */
+    cy_rslt_t publish( aws_topic_handle_t handle, const char* data, uint32_t length, aws_publish_params_t pub_params );
+
+    /** Publishes data larger than a single message as a sequence of QoS1 chunks on one topic
+     *  The data is pulled from 'params.reader' one chunk at a time into 'params.buffer', which the application sizes with
+     *  @ref AWS_CHUNK_BUFFER_SIZE; the client allocates nothing for the transfer. Each chunk
+     *  carries an @ref AWS_CHUNK_HEADER_LENGTH byte header (big-endian sequence number, then chunk count) ahead of its data.
+     *  Up to 'params.window' chunks are sent ahead of their PUBACK. This API is blocking and shall return when every
+     *  chunk is acknowledged; incoming messages are dispatched to subscribers meanwhile.
+     *
+     *  If the connection is lost, the client disconnects and this API returns CY_RSLT_AWS_ERROR_DISCONNECTED. Calling it again
+     *  with the same parameters and 'transfer' after @ref connect resumes from the last chunk acknowledged in order.
+     *  Chunks after it may be received twice; receivers should drop duplicates by sequence number.
+     *
+     * @param[in]     params      : Chunked publish parameters
+     * @param[in,out] transfer    : Progress of the transfer; zeroed for a new transfer
+     *
+     * @return cy_rslt_t          : CY_RSLT_SUCCESS - on success,
+     *                              CY_RSLT_AWS_ERROR_DISCONNECTED - if the connection was lost; reconnect and call again to resume,
+     *                              CY_RSLT_AWS_ERROR_PUBLISH_FAILED - On error ( @ref aws_iot_defines )
+     *
+     */
+    cy_rslt_t publish_chunked( const aws_chunk_params_t& params, aws_chunk_transfer_t* transfer );
+
+    /** Downloads a file served by an AWS IoT stream (MQTT-based file delivery) into a storage sink
+     *  Blocks are requested with up to 'params.window' requests in flight and may arrive in any order. Each block is decoded in
+     *  the receive buffer and written to 'params.sink' at its offset, so nothing is copied or reassembled in RAM.
+     *  This API is blocking and shall return when every block has been written; incoming messages are dispatched to
+     *  subscribers meanwhile. A data message must fit into @ref AWS_MAX_PACKET_SIZE, which has to be raised for downloads.
+     *
+     *  If the connection is lost, the client disconnects and this API returns CY_RSLT_AWS_ERROR_DISCONNECTED. Calling it again
+     *  with the same parameters and 'progress' after @ref connect requests only the blocks still missing.
+     *
+     * @param[in]     params      : Download parameters
+     * @param[in,out] progress    : Progress of the download; zeroed for a new download
+     *
+     * @return cy_rslt_t          : CY_RSLT_SUCCESS - on success,
+     *                              CY_RSLT_AWS_ERROR_DISCONNECTED - if the connection was lost; reconnect and call again to resume,
+     *                              CY_RSLT_AWS_ERROR_BUFFER_OVERFLOW, CY_RSLT_AWS_ERROR_SUBSCRIBE_FAILED,
+     *                              CY_RSLT_AWS_ERROR_DOWNLOAD_FAILED - On error ( @ref aws_iot_defines )
+     *
+     */
+    cy_rslt_t download( const aws_download_params_t& params, aws_download_t* progress );
+
 
     /** Subscribes to the user defined topic on AWS cloud 
      * This API is blocking and shall return when SUBACK is received from server or timeout occurs
      *
      *
-     * @param[in] topic           : Contains the topic to be subscribed to
+     * @param[in] topic           : Contains the topic to be subscribed to ( up to @ref AWS_TOPIC_FILTER_MAX_LENGTH characters; copied )
      * @param[in] qos             : QoS level to be used for receiving the message on the given topic
      * @param[in] cb              : Subscriber callback for the topic to receive the messages
      *
      * @return cy_rslt_t         : CY_RSLT_SUCCESS - on success
-     *                             CY_RSLT_AWS_ERROR_SUBSCRIBE_FAILED - On error ( @ref aws_iot_defines )
+     *                             CY_RSLT_AWS_ERROR_SUBSCRIBE_FAILED, CY_RSLT_AWS_ERROR_UNSUPPORTED - On error ( @ref aws_iot_defines )
      *
      */
     cy_rslt_t subscribe( const char* topic, aws_iot_qos_level_t qos, subscriber_callback cb );
@@ -288,11 +674,60 @@ public:
      * @param[in] topic           : Contains the topic to be unsubscribed from
      *
      * @return cy_rslt_t         : CY_RSLT_SUCCESS - on success
-     *                             CY_RSLT_AWS_ERROR_UNSUBSCRIBE_FAILED - On error ( @ref aws_iot_defines )
+     *                             CY_RSLT_AWS_ERROR_UNSUBSCRIBE_FAILED, CY_RSLT_AWS_ERROR_UNSUPPORTED - On error ( @ref aws_iot_defines )
      *
      */
     cy_rslt_t unsubscribe( char* topic );
 
+    /** Queues a publish to be sent by the thread calling @ref yield. Safe to call from any thread and never blocks:
+     *  topic and message are copied into a free slot of a lock-free submission queue, so the caller's buffers can be reused right away.
+     *  The thread calling @ref yield drains the queue and does all socket I/O. Publishes go out by priority lane
+     *  ( pub_params.priority, @ref set_priority_params ), in submission order per producer thread within a lane.
+     *  A publish still queued when its time-to-live ( pub_params.ttl_ms, @ref set_topic_ttl ) runs out is discarded without being sent;
+     *  'cb' then gets CY_RSLT_AWS_ERROR_EXPIRED and the lane metrics count it. On an MQTT 5 connection pub_params.message_expiry
+     *  is passed on to the broker; user properties are not, since only topic and message are copied.
+     *  While the session journal is enabled, a QoS1 publish whose topic and message do not fit in one journal record
+     *  ( AWS_SESSION_BUFFER_SIZE ) is refused rather than sent without being journaled.
+     *
+     * @param[in] topic           : Contains the topic to which the message is to be published ( up to @ref AWS_SUBMIT_MAX_TOPIC_LENGTH characters )
+     * @param[in] data            : Pointer to the message to be published
+     * @param[in] length          : Length of the message pointed by 'data' ( up to @ref AWS_SUBMIT_MAX_MESSAGE_LENGTH bytes )
+     * @param[in] pub_params      : Publish parameters
+     * @param[in] cb              : Optional callback invoked with the result of the publish
+     * @param[in] arg             : Argument passed to 'cb'
+     *
+     * @return cy_rslt_t          : CY_RSLT_SUCCESS - if the publish was queued,
+     *                              CY_RSLT_AWS_ERROR_QUEUE_FULL, CY_RSLT_AWS_ERROR_PUBLISH_FAILED - On error ( @ref aws_iot_defines )
+     *
+     */
+    cy_rslt_t publish_async( const char* topic, const char* data, uint32_t length, aws_publish_params_t pub_params, aws_async_callback cb = NULL, void* arg = NULL );
+
+    /** Queues a subscribe to be sent by the thread calling @ref yield. Safe to call from any thread and never blocks.
+     *
+     * @param[in] topic           : Contains the topic to be subscribed to ( up to @ref AWS_SUBMIT_MAX_TOPIC_LENGTH characters )
+     * @param[in] qos             : QoS level to be used for receiving the message on the given topic
+     * @param[in] handler         : Subscriber callback for the topic to receive the messages
+     * @param[in] cb              : Optional callback invoked with the result of the subscribe
+     * @param[in] arg             : Argument passed to 'cb'
+     *
+     * @return cy_rslt_t          : CY_RSLT_SUCCESS - if the subscribe was queued,
+     *                              CY_RSLT_AWS_ERROR_QUEUE_FULL, CY_RSLT_AWS_ERROR_SUBSCRIBE_FAILED - On error ( @ref aws_iot_defines )
+     *
+     */
+    cy_rslt_t subscribe_async( const char* topic, aws_iot_qos_level_t qos, subscriber_callback handler, aws_async_callback cb = NULL, void* arg = NULL );
+
+    /** Queues an unsubscribe to be sent by the thread calling @ref yield. Safe to call from any thread and never blocks.
+     *
+     * @param[in] topic           : Contains the topic to be unsubscribed from ( up to @ref AWS_SUBMIT_MAX_TOPIC_LENGTH characters )
+     * @param[in] cb              : Optional callback invoked with the result of the unsubscribe
+     * @param[in] arg             : Argument passed to 'cb'
+     *
+     * @return cy_rslt_t          : CY_RSLT_SUCCESS - if the unsubscribe was queued,
+     *                              CY_RSLT_AWS_ERROR_QUEUE_FULL, CY_RSLT_AWS_ERROR_UNSUBSCRIBE_FAILED - On error ( @ref aws_iot_defines )
+     *
+     */
+    cy_rslt_t unsubscribe_async( const char* topic, aws_async_callback cb = NULL, void* arg = NULL );
+
     /** A call to this API must be made within the keepAlive interval to keep the MQTT connection alive.
      *  This API can be invoked if no other MQTT operation is needed. 
      *  This will also allow messages to be received.
@@ -302,8 +737,10 @@ public:
      *  Therefore, publish and subscribe should be handled by a single thread.
      *  For better efficiency, the application should typically be in yield, except when publishing.
      *
-     *  For simultaneous publish and subscribe, Async mode communication should be supported in MQTT core library.
-     *  But in current Eclipse MQTT library version only Sync mode is supported.
+     *  For simultaneous publish and subscribe from several threads, let one thread own the client (connect, yield, disconnect) and
+     *  have the other threads use @ref publish_async, @ref subscribe_async and @ref unsubscribe_async. Queued requests are processed here,
+     *  and the yield is cut into slices of @ref AWS_SUBMIT_POLL_INTERVAL once anything has been queued so that they go out promptly.
+     *  Requests queued while disconnected stay queued until the next successful connect.
      *
      *  @param[in] timeout_ms     : Time to wait, in milliseconds. Recommend threshold timeout value 1000ms in order to allow adequate time for the system to receive and decode data.
      *                              Once Yield starts receiving data, it will not return even if timer(timeout_ms) expires.
@@ -332,11 +769,221 @@ private:
     const char* certificate;
     uint16_t certificate_length;
     int command_timeout;
-    MQTT::Client<MQTTNetwork, Countdown, AWS_MAX_PACKET_SIZE, AWS_MAX_MESSAGE_HANDLERS> *mqtt_obj;
+    MQTT::Client<MQTTNetwork, AWSIoTCountdown, AWS_MAX_PACKET_SIZE, AWS_MAX_MESSAGE_HANDLERS> *mqtt_obj;
     MQTTNetwork *mqttnetwork;
     mqtt_security_flag flag;
+    mqtt_loopback_faults_t loopback_faults;
+    aws_sigv4_credentials_t sigv4_credentials;
     AWSIoTEndpoint *ep;
 
+    /** Presigned upgrade path, only needed while a WebSocket connection is set up */
+    struct websocket_path
+    {
+        char value[AWS_WEBSOCKET_PATH_MAX_LENGTH];
+    };
+
+    /** MQTT 5 codec and its buffers, only needed while connected with AWS_MQTT_VERSION_5 */
+    struct mqtt5_link
+    {
+        unsigned char rx[AWS_MAX_PACKET_SIZE];
+        unsigned char tx[AWS_MAX_PACKET_SIZE + AWS_MQTT5_PROPERTIES_MAX_LENGTH];
+        AWSIoTMqtt5 codec;
+
+        mqtt5_link() : codec( rx, sizeof(rx), tx, sizeof(tx) )
+        {
+        }
+    };
+
+    /* Connection objects are re-created in place on every connect ( AWS_IOT_STATIC_ALLOCATION ) */
+    AWSIoTStorage<AWSIoTEndpoint> endpoint_storage;
+    AWSIoTStorage<websocket_path> websocket_path_storage;
+    AWSIoTStorage<MQTTNetwork> network_storage;
+    AWSIoTStorage<mqtt5_link> mqtt5_storage;
+    AWSIoTMqtt5* mqtt5;                    /**< Codec of an MQTT 5 connection; NULL for MQTT 3.1.1 */
+    AWSIoTStorage<MQTT::Client<MQTTNetwork, AWSIoTCountdown, AWS_MAX_PACKET_SIZE, AWS_MAX_MESSAGE_HANDLERS> > mqtt_storage;
+    AWSIoTRateLimiter rate_limiter;
+    AWSIoTKeepAlive keep_alive;
+    AWSIoTDispatcher dispatcher;
+    AWSIoTSessionJournal session;
+    bool session_present;
+    AWSIoTCredentials own_credentials;
+    AWSIoTCredentials* credentials;
+    AWSIoTCredentials::attachment network_credentials;   /**< Credentials held by the TLS socket of the MQTT connection */
+    AWSIoTHttpsConnection discovery_connection;
+    AWSIoTHttpsConnection rest_connection;
+    uint32_t pingresps_seen;
+
+    /** Queued request types */
+    enum
+    {
+        AWS_SUBMIT_PUBLISH,
+        AWS_SUBMIT_SUBSCRIBE,
+        AWS_SUBMIT_UNSUBSCRIBE
+    };
+
+    /** Request handed from any thread to the thread calling yield */
+    struct submit_request
+    {
+        uint8_t op;
+        aws_iot_qos_level_t qos;
+        subscriber_callback handler;
+        aws_async_callback callback;
+        void* arg;
+        uint32_t length;
+        aws_priority_t priority;
+        uint32_t ttl_ms;
+        uint32_t message_expiry;            /**< MQTT 5 Message Expiry Interval in seconds; 0 if none */
+        uint64_t submitted_ms;
+        submit_request* next;               /**< Link of the outbound lane */
+        uint32_t bytes;                     /**< Weight of the request in its lane's budget */
+        uint32_t seq;                       /**< Session journal sequence number; 0 if not journaled */
+        char topic[AWS_SUBMIT_MAX_TOPIC_LENGTH + 1];
+        char data[AWS_SUBMIT_MAX_MESSAGE_LENGTH];
+    };
+
+    AWSIoTSubmitQueue<submit_request, AWS_SUBMIT_QUEUE_DEPTH> submit_queue;
+    AWSIoTPriorityLanes<submit_request, AWS_PRIORITY_LANES> outbound_lanes;
+
+    /** PUBLISH packet of a registered topic: fixed header reserve, encoded topic, packet identifier, payload */
+    struct registered_topic
+    {
+        bool used;
+        aws_priority_t priority;
+        uint32_t ttl_ms;
+        uint16_t topic_end;
+        unsigned char packet[AWS_TOPIC_HEADER_RESERVE + AWS_MAX_PACKET_SIZE];
+    };
+
+    registered_topic topics[AWS_MAX_REGISTERED_TOPICS];
+    unsigned char publish_buffer[AWS_MAX_PACKET_SIZE];  /**< QoS1 string topic PUBLISH, written by the client so that its PUBACK can be observed */
+    bool link_lost;                        /**< A PUBACK was missed; the link is torn down without DISCONNECT */
+
+    /** Copies of the subscribed topic filters, which the MQTT client keeps by reference; empty for a free handler */
+    char handler_topics[AWS_MAX_MESSAGE_HANDLERS][AWS_TOPIC_FILTER_MAX_LENGTH + 1];
+    uint16_t last_packet_id;               /**< Packet identifier of the latest QoS1 publish, whichever API sent it */
+    uint16_t packet_lease;                 /**< Last packet identifier reserved in the session journal */
+    volatile uint32_t async_used;
+    aws_iot_metrics_t metrics;
+    mqtt_network_stats_t network_stats;
+
+    /** Sends a PINGREQ if one is due and checks that the outstanding one was answered in time.
+     *
+     * @return int                    : 0 on success; -1 if the connection should be considered lost
+     */
+    int service_keep_alive();
+
+    /** Claims a submission slot and copies the topic into it.
+     *
+     * @param[in] op                  : Request type
+     * @param[in] topic               : Topic of the request; at most @ref AWS_SUBMIT_MAX_TOPIC_LENGTH characters
+     * @param[in] cb                  : Completion callback
+     * @param[in] arg                 : Argument passed to 'cb'
+     *
+     * @return submit_request*        : Slot to complete and submit; NULL if the queue is full
+     */
+    submit_request* alloc_request( uint8_t op, const char* topic, aws_async_callback cb, void* arg );
+
+    /** Finds the client's copy of a subscribed topic filter, or copies it into a free message handler entry.
+     *
+     * @param[in]  topic              : Topic filter, at most @ref AWS_TOPIC_FILTER_MAX_LENGTH characters
+     * @param[out] claimed            : true if a free entry was taken for it
+     *
+     * @return char*                  : Copy of the filter, valid until it is unsubscribed or the next connect; NULL if all entries are in use
+     */
+    char* claim_handler_topic( const char* topic, bool* claimed );
+
+    /** Queues the journaled publishes left without an outcome by a previous run. */
+    void restore_session_publishes();
+
+    /** Reserves the next block of packet identifiers in the session journal. */
+    void lease_packet_ids();
+
+    /** Allocates the packet identifier of a QoS1 publish. Every QoS1 PUBLISH takes its identifier from here, as the
+     *  MQTT client takes any PUBACK as the answer to its own publish and so cannot share the identifier space. */
+    uint16_t next_packet_id();
+
+    /** Writes a QoS1 PUBLISH built around the MQTT client and reads until its PUBACK arrives. A missed PUBACK marks the
+     *  link lost, as the MQTT client does after a failed publish; it is then closed without sending DISCONNECT.
+     *
+     * @param[in] packet              : Whole PUBLISH packet
+     * @param[in] length              : Length of 'packet'
+     * @param[in] packet_id           : Packet identifier from @ref next_packet_id
+     *
+     * @return int                    : 0 once acknowledged, -1 on error
+     */
+    int send_acked_publish( const unsigned char* packet, int length, uint16_t packet_id );
+
+    /** Hands the MQTT 5 properties of a publish to the network and checks the limits of the connection. Does nothing on
+     *  MQTT 3.1.1 connections.
+     *
+     * @param[in] pub_params          : Publish parameters
+     * @param[in] topic_length        : Length of the topic
+     * @param[in] packet_length       : Length of the MQTT 3.1.1 PUBLISH packet
+     *
+     * @return bool                   : false if the publish cannot be sent
+     */
+    bool prepare_publish( const aws_publish_params_t& pub_params, uint32_t topic_length, uint32_t packet_length );
+
+    /** Publishes a message at QoS1 with an identifier from @ref next_packet_id, built in the client's publish buffer.
+     *
+     * @return int                    : 0 once acknowledged, -1 on error
+     */
+    int publish_acked( const char* topic, const char* data, uint32_t length );
+
+    /** Checks whether the MQTT link has failed, through the MQTT client or a missed PUBACK. */
+    bool connection_lost();
+
+    /** Parses the client certificate and private key passed to the constructor, unless the credentials already hold them.
+     *
+     * @return cy_rslt_t              : CY_RSLT_SUCCESS - on success,
+     *                                  CY_RSLT_AWS_ERROR_INVALID_CLIENT_KEY - On error
+     */
+    cy_rslt_t load_credentials();
+
+    /** Configures a TLS socket with the parsed client credentials and root CA, parsing them on first use.
+     *
+     * @param[in] socket              : TLS socket to configure
+     * @param[in] root_ca             : Root CA certificate
+     * @param[in] root_ca_length      : Length of Root CA certificate
+     * @param[out] attached           : Holds the parsed objects until the socket is gone
+     *
+     * @return cy_rslt_t              : CY_RSLT_SUCCESS - on success,
+     *                                  CY_RSLT_AWS_ERROR_INVALID_ROOTCA, CY_RSLT_AWS_ERROR_INVALID_CLIENT_KEY,
+     *                                  CY_RSLT_AWS_ERROR_IN_USE - On error
+     */
+    cy_rslt_t apply_credentials( TLSSocketWrapper& socket, const char* root_ca, uint16_t root_ca_length, AWSIoTCredentials::attachment* attached );
+
+    /** Tears down a connection found to be lost and records it for the keep-alive manager. */
+    void drop_connection();
+
+    /** True while connected through @ref AWS_TRANSPORT_RESTFUL_HTTPS instead of MQTT. */
+    bool rest_connected() const;
+
+    /** Opens the kept-alive connection of a RESTful HTTPS endpoint. */
+    cy_rslt_t connect_https( aws_endpoint_params_t endpoint_params );
+
+    /** POSTs messages to the RESTful HTTPS endpoint, pipelined; flags in 'resent' ( may be NULL ) the messages sent twice. */
+    cy_rslt_t publish_https( const aws_publish_message_t* messages, uint8_t count, uint8_t* published, bool* resent );
+
+    /** Processes queued requests, highest lane first. Called by the thread calling yield.
+     *  Stops at the first request that fails because the connection was lost; a journaled publish among them goes back to
+     *  the head of its lane, and the rest stay queued for the next connect.
+     *
+     * @return int                    : 0 on success; -1 if the connection was lost
+     */
+    int process_requests();
+
+    /** Finds the registered topic a queued request goes to.
+     *
+     * @param[in] topic               : Topic of the request
+     *
+     * @return registered_topic*      : Registration of the topic; NULL if the topic is not registered
+     */
+    const registered_topic* find_registered_topic( const char* topic ) const;
+
+    /** Picks the outbound lane of a queued request and resolves its time-to-live. */
+    uint32_t request_lane( submit_request* req ) const;
+
     /** Creates endpoint instance using the information provided to connect to server.
      *
      * @param[in] transport           : AWS transport to be used
@@ -39,6 +39,72 @@ extern "C" {
 #define AWS_DEFAULT_DNS_TIMEOUT               (10000)     // milliseconds
 #define AWS_REQUEST_TIMEOUT                   (5000)      // milliseconds
 #define AWS_IOT_DEFAULT_MQTT_PORT             (8883)
+#define AWS_MQTT_VERSION_3_1                  (3)
+#define AWS_MQTT_VERSION_3_1_1                (4)
+#define AWS_MQTT_VERSION_5                    (5)         // carried over the MQTT 3.1.1 client by rewriting its packets ( AWSIoTMqtt5 )
+#define AWS_PARAMS_VERSION                    (0x41575331u) // params_version of connect and publish parameters whose newer fields are set ( *_INITIALIZER )
+#define AWS_MQTT5_TOPIC_ALIASES               (8)         // outbound topic aliases of an MQTT 5 connection, at most the broker's Topic Alias Maximum
+#define AWS_MQTT5_PROPERTIES_MAX_LENGTH       (128)       // encoded message expiry, topic alias and user properties of one MQTT 5 publish
+#define AWS_MQTT5_SESSION_EXPIRY              (3600)      // seconds the broker keeps an MQTT 5 session that was not asked for a clean session
+#define AWS_MQTT5_PACKET_TIMEOUT              (1000)      // ms allowed for the rest of an inbound MQTT 5 packet once its first byte has arrived
+#define AWS_IOT_PUBLISH_RATE_LIMIT            (100)       // publishes per second, per connection
+#define AWS_IOT_THROUGHPUT_LIMIT              (524288)    // bytes per second, per connection
+#define AWS_METRICS_LATENCY_BUCKETS           (12)
+#define AWS_KEEP_ALIVE_PROBE_SUCCESSES        (10)        // successful idle pings before the adaptive interval is raised again
+#define AWS_DISPATCH_MAX_WORKERS              (4)
+#define AWS_TOPIC_FILTER_MAX_LENGTH           (128)       // subscribed topic filters are copied, so that callers may reuse their buffers
+#define AWS_DISPATCH_MAX_SUBSCRIPTIONS        (5)
+#define AWS_DISPATCH_QUEUE_DEPTH              (4)         // messages queued per subscription
+#ifndef AWS_DISPATCH_MAX_MESSAGE_LENGTH
+#define AWS_DISPATCH_MAX_MESSAGE_LENGTH       (100)       // topic + payload; enable_dispatch requires at least AWS_MAX_PACKET_SIZE, raise both together
+#endif
+#define AWS_DISPATCH_WORKER_STACK_SIZE        (4096)
+#define AWS_PRIORITY_LANES                    (3)         // outbound lanes of queued requests ( aws_priority_t )
+#define AWS_PRIORITY_DEFAULT_BUDGET           (1024)      // bytes per round of the bulk lane; each higher lane gets twice the budget of the one below
+#define AWS_TIMER_WHEEL_LEVELS                (4)         // levels of the shared timer wheel; with 64 slots of 1 ms each they span 2^24 ms (4.6 hours)
+#define AWS_TIMER_WHEEL_SLOT_BITS             (6)         // at most 6: a level's occupancy is kept in a 64-bit mask
+#define AWS_DUPLICATE_WINDOW_SIZE             (32)        // recent QoS1 packet identifiers remembered for duplicate suppression; power of two
+#define AWS_VALUE_CACHE_MAX_FILTERS           (4)         // topic filters whose last values are cached
+#define AWS_VALUE_CACHE_ENTRIES               (8)         // topics with a cached value; the one received least recently is evicted
+#define AWS_VALUE_CACHE_MAX_LENGTH            (128)       // topic + payload of a cached value; longer messages are not cached
+#define AWS_SESSION_MAX_SUBSCRIPTIONS         (5)         // subscriptions kept in the session journal, one per message handler
+#define AWS_SESSION_MAX_PENDING               (16)        // journaled publishes without an outcome, one per submission slot
+#define AWS_SESSION_MAX_TOPIC_LENGTH          (128)
+#define AWS_SESSION_PATH_MAX_LENGTH           (64)
+#define AWS_SESSION_BUFFER_SIZE               (512)       // records written per batch; also bounds a journaled publish (topic + message + 14 bytes), larger ones are refused
+#define AWS_SESSION_MAX_JOURNAL_SIZE          (16384)     // bytes after which the journal is compacted
+#define AWS_SESSION_DEFAULT_SYNC_INTERVAL     (1000)      // ms a lazily synced record may wait for fsync
+#define AWS_SESSION_PACKET_ID_LEASE           (256)       // packet identifiers reserved per journal record
+#define AWS_CREDENTIALS_MAX_ROOT_CA           (2)         // parsed root CA chains kept, e.g. AWS IoT and one Greengrass group
+#define AWS_ENDPOINT_SELECTOR_MAX_ENDPOINTS   (8)
+#define AWS_ENDPOINT_HOST_MAX_LENGTH          (64)
+#define AWS_ENDPOINT_PROBE_TIMEOUT            (2000)      // ms allowed for a probe's TCP connect
+#define AWS_ENDPOINT_FAILURE_PENALTY          (2000000)   // us added to an endpoint's score per consecutive failure
+#define AWS_ENDPOINT_PROBE_STACK_SIZE         (4096)
+#define AWS_CHUNK_DEFAULT_SIZE                (1024)      // payload bytes per chunk of a chunked publish
+#define AWS_CHUNK_MAX_SIZE                    (65536)     // stays well below the AWS IoT message size limit of 128 KB
+#define AWS_CHUNK_HEADER_LENGTH               (8)         // big-endian chunk sequence number and chunk count ahead of each chunk
+#define AWS_CHUNK_DEFAULT_WINDOW              (4)         // chunks awaiting PUBACK
+#define AWS_CHUNK_MAX_WINDOW                  (8)
+#define AWS_CHUNK_POLL_INTERVAL               (10)        // ms spent reading acknowledgements between sends
+#define AWS_CHUNK_BUFFER_SIZE( topic_length, chunk_size ) \
+        ( 5 + 2 + ( topic_length ) + 2 + AWS_CHUNK_HEADER_LENGTH + ( chunk_size ) )  // fixed header, topic, packet identifier, chunk header and data
+#define AWS_PUBLISH_ACK_POLL_INTERVAL         (5)         // ms spent reading between checks for the PUBACK of a QoS1 publish
+#define AWS_DOWNLOAD_DEFAULT_BLOCK_SIZE       (256)       // smallest block size served by AWS IoT MQTT-based file delivery
+#define AWS_DOWNLOAD_MAX_BLOCKS               (4096)      // blocks tracked by the bitmap of a download
+#define AWS_DOWNLOAD_DEFAULT_WINDOW           (4)         // block requests in flight
+#define AWS_DOWNLOAD_MAX_WINDOW               (8)
+#define AWS_DOWNLOAD_BLOCKS_PER_REQUEST       (4)
+#define AWS_DOWNLOAD_MAX_RETRIES              (5)         // request timeouts in a row without a new block before giving up
+#define AWS_DOWNLOAD_POLL_INTERVAL            (10)        // ms spent reading blocks between requests
+#define AWS_DOWNLOAD_TOPIC_MAX_LENGTH         (128)
+#define AWS_DOWNLOAD_MESSAGE_OVERHEAD         (96)        // JSON framing around the base64 data of a block
+#define AWS_IOT_WEBSOCKET_PORT                (443)
+#define AWS_IOT_HTTPS_PORT                    (8443)      // RESTful HTTPS publishes ( AWS_TRANSPORT_RESTFUL_HTTPS )
+#define AWS_HTTPS_PUBLISH_PATH_PREFIX         "/topics/"
+#define AWS_HTTPS_PUBLISH_GROUP_SIZE          (8)         // messages of a batch handed to the pipelined HTTPS connection at a time
+#define AWS_WEBSOCKET_PATH_MAX_LENGTH         (1536)      // presigned upgrade path; a session token takes up most of it
+#define AWS_SIGV4_SERVICE                     "iotdevicegateway"
 
 #define GREENGRASS_DISCOVERY_HTTP_REQUEST_URI_PREFIX  "/greengrass/discover/thing/"
 #define AWS_GG_HTTPS_CONNECT_TIMEOUT          (2000)
@@ -51,6 +117,11 @@ extern "C" {
 #define AWS_GG_MAX_CONNECTIONS                (1)
 
 #define AWS_GG_HTTPS_SERVER_PORT              (8443)
+#define AWS_GG_DISCOVERY_PIPELINE_DEPTH       (4)         // discovery requests sent ahead of their responses
+#define AWS_GG_DISCOVERY_MAX_RESPONSE_SIZE    (16384)
+#define AWS_GG_HTTPS_HOST_MAX_LENGTH          (128)
+#define AWS_GG_HTTPS_REQUEST_MAX_LENGTH       (512)       // request line and headers; also holds the topic of a RESTful publish
+#define AWS_GG_HTTPS_RX_BUFFER_SIZE           (512)
 
 #define GG_GROUP_ID                           "GGGroupId"
 #define GG_GROUP_KEY                          "GGGroups"
@@ -93,7 +164,9 @@ extern "C" {
 typedef enum
 {
     AWS_TRANSPORT_MQTT_NATIVE = 0,        /**< MQTT-native i.e. MQTT over TCP sockets */
-    AWS_TRANSPORT_RESTFUL_HTTPS,          /**< AWS RESTful HTTPS APIs */
+    AWS_TRANSPORT_RESTFUL_HTTPS,          /**< AWS RESTful HTTPS APIs; publish only, over a kept-alive connection to port 8443 ( @ref AWS_IOT_HTTPS_PORT ) */
+    AWS_TRANSPORT_MQTT_LOOPBACK,          /**< MQTT to an in-process broker stand-in with injected faults; no network is used; needs AWS_IOT_LOOPBACK ( @ref AWSIoTClient::set_loopback_faults ) */
+    AWS_TRANSPORT_MQTT_WEBSOCKET,         /**< MQTT over WebSockets over TLS ( port 443 ), authenticated with SigV4 ( @ref AWSIoTClient::set_sigv4_credentials ) */
     AWS_TRANSPORT_INVALID,                /**< Invalid transport type */
 } aws_iot_transport_type_t;
 
@@ -107,6 +180,17 @@ typedef enum
     AWS_QOS_INVALID        = 0x80,        /**< Invalid QoS level */
 } aws_iot_qos_level_t;
 
+/**
+ * Outbound lane of a queued request ( @ref AWSIoTClient::publish_async ). Lanes are served highest first, within per-lane byte budgets
+ */
+typedef enum
+{
+    AWS_PRIORITY_DEFAULT   = 0,           /**< Priority of the registered topic ( @ref AWSIoTClient::set_topic_priority ), otherwise AWS_PRIORITY_NORMAL */
+    AWS_PRIORITY_HIGH,                    /**< Alarms and other urgent messages; also used for queued subscribes and unsubscribes */
+    AWS_PRIORITY_NORMAL,                  /**< Regular messages */
+    AWS_PRIORITY_BULK,                    /**< Bulk telemetry that may be held back while other lanes are busy */
+} aws_priority_t;
+
 /**
  * @}
  */
@@ -207,12 +291,15 @@ typedef struct
 typedef struct
 {
     cy_linked_list_t* groups;                    /**< A linked list to Greengrass group. Each of the linked list node has information to Greengrass core ( @ref aws_greengrass_core_t ). */
+    const char*       thing_name;                /**< Thing whose groups are reported */
 
 } aws_greengrass_discovery_callback_data_t;
 
 
 /**
- * AWS IoT connection parameters
+ * AWS IoT connection parameters. Initialize them with @ref AWS_CONNECT_PARAMS_INITIALIZER before setting the fields in use.
+ * mqtt_version is read only when params_version is @ref AWS_PARAMS_VERSION, so parameters filled in field by field by an
+ * application that does not know about it still connect with MQTT 3.1.1.
  */
 typedef struct
 {
@@ -226,8 +313,15 @@ typedef struct
                                                It is mandatory to pass ALPN extension */
     uint8_t*    peer_cn;                  /**< Peer canonical name */
     uint8_t*    client_id;                /**< Application must pass the client ID information */
+    uint8_t     mqtt_version;             /**< MQTT protocol level: AWS_MQTT_VERSION_3_1, AWS_MQTT_VERSION_3_1_1 or AWS_MQTT_VERSION_5.
+                                               0 selects MQTT 3.1.1. MQTT 5 adds automatic topic aliases, honours the broker's Receive Maximum
+                                               and Maximum Packet Size, and sends message expiry and user properties ( @ref aws_publish_params_t ) */
+    uint32_t    params_version;           /**< @ref AWS_PARAMS_VERSION to have mqtt_version read; any other value selects MQTT 3.1.1 */
 } aws_connect_params_t;
 
+/** Initializer of @ref aws_connect_params_t with every field at its default */
+#define AWS_CONNECT_PARAMS_INITIALIZER        { 0, 0, NULL, NULL, NULL, NULL, NULL, 0, AWS_PARAMS_VERSION }
+
 
 /**
  * AWS IoT endpoint parameters
@@ -243,13 +337,319 @@ typedef struct
 
 
 /**
- * AWS IoT Publish parameters
+ * AWS credentials used to sign the WebSocket upgrade ( @ref AWS_TRANSPORT_MQTT_WEBSOCKET )
+ */
+typedef struct
+{
+    const char* access_key_id;            /**< AWS access key ID */
+    const char* secret_access_key;        /**< AWS secret access key */
+    const char* session_token;            /**< Session token of temporary credentials; NULL for long-term credentials */
+    const char* region;                   /**< AWS region of the endpoint, e.g. "us-east-1" */
+} aws_sigv4_credentials_t;
+
+
+/**
+ * User property of an MQTT 5 publish
+ */
+typedef struct
+{
+    const char* key;                      /**< Property name */
+    const char* value;                    /**< Property value */
+} aws_user_property_t;
+
+
+/**
+ * AWS IoT Publish parameters. Initialize them with @ref AWS_PUBLISH_PARAMS_INITIALIZER before setting the fields in use.
+ * The fields after QoS are read only when params_version is @ref AWS_PARAMS_VERSION; otherwise they take their defaults,
+ * so an application that sets QoS alone on an uninitialized struct keeps working.
  */
 typedef struct
 {
     aws_iot_qos_level_t QoS;              /**< QoS level */
+    aws_priority_t      priority;         /**< Lane of a queued publish; ignored by blocking publishes */
+    uint32_t            ttl_ms;           /**< Time-to-live of a queued publish, after which it is discarded unsent; 0 takes the
+                                               time-to-live of the registered topic ( @ref AWSIoTClient::set_topic_ttl ). Ignored by blocking publishes */
+    uint32_t            message_expiry;   /**< Seconds the broker keeps the message for subscribers that have not received it; 0 never expires.
+                                               MQTT 5 only */
+    const aws_user_property_t* user_properties; /**< User properties sent with the message, up to @ref AWS_MQTT5_PROPERTIES_MAX_LENGTH
+                                               bytes together with the message expiry. MQTT 5 only; queued publishes do not carry them */
+    uint8_t             user_property_count; /**< Number of entries in 'user_properties' */
+    uint32_t            params_version;   /**< @ref AWS_PARAMS_VERSION to have the fields after QoS read */
 } aws_publish_params_t;
 
+/** Initializer of @ref aws_publish_params_t: QoS 0 and every other field at its default */
+#define AWS_PUBLISH_PARAMS_INITIALIZER        { AWS_QOS_ATMOST_ONCE, AWS_PRIORITY_DEFAULT, 0, 0, NULL, 0, AWS_PARAMS_VERSION }
+
+/**
+ * One message of a batch publish ( @ref AWSIoTClient::publish_batch )
+ */
+typedef struct
+{
+    const char* topic;                    /**< Topic to publish to */
+    const char* data;                     /**< Message payload */
+    uint32_t length;                      /**< Length of the payload */
+    aws_publish_params_t params;          /**< Publish parameters */
+} aws_publish_message_t;
+
+/**
+ * Handle of a topic registered with @ref AWSIoTClient::register_topic. A zeroed handle is invalid.
+ */
+typedef struct
+{
+    uint8_t     id;                       /**< Registration slot plus one */
+} aws_topic_handle_t;
+
+/**
+ * Reads part of the data of a chunked publish ( @ref AWSIoTClient::publish_chunked ).
+ * A chunk can be read more than once, since unacknowledged chunks are sent again when a transfer resumes.
+ *
+ * @param[in]  offset         : Offset of the first byte to read
+ * @param[out] buffer         : Buffer to fill
+ * @param[in]  length         : Number of bytes to read
+ * @param[in]  arg            : User argument
+ *
+ * @return int32_t            : Number of bytes read; anything other than 'length' aborts the transfer
+ */
+typedef int32_t (*aws_chunk_reader_t)( uint32_t offset, uint8_t* buffer, uint32_t length, void* arg );
+
+/**
+ * AWS IoT chunked publish parameters
+ */
+typedef struct
+{
+    const char*         topic;            /**< Topic of the transfer; use one topic per transfer */
+    uint32_t            total_length;     /**< Number of bytes to publish */
+    uint32_t            chunk_size;       /**< Payload bytes per chunk, chunk header excluded; 0 selects @ref AWS_CHUNK_DEFAULT_SIZE */
+    uint8_t             window;           /**< Chunks sent ahead of their PUBACK; 0 selects @ref AWS_CHUNK_DEFAULT_WINDOW */
+    aws_chunk_reader_t  reader;           /**< Source of the data */
+    void*               reader_arg;       /**< User argument handed to the reader */
+    uint8_t*            buffer;           /**< Buffer in which every chunk is built; at least @ref AWS_CHUNK_BUFFER_SIZE ( strlen( topic ), chunk size ) bytes */
+    uint32_t            buffer_size;      /**< Size of 'buffer' */
+} aws_chunk_params_t;
+
+/**
+ * Progress of a chunked publish. Zero it before the first call; pass it back unchanged to resume after a reconnect.
+ */
+typedef struct
+{
+    uint32_t    chunk_count;              /**< Number of chunks in the transfer */
+    uint32_t    acked_chunks;             /**< Chunks acknowledged without gaps from the start; a resumed transfer restarts here */
+    uint32_t    sent_chunks;              /**< Chunks sent at least once; chunks below this are sent again with the DUP flag */
+    uint32_t    retransmits;              /**< Number of chunks sent more than once */
+} aws_chunk_transfer_t;
+
+/**
+ * Writes a downloaded block to storage ( @ref AWSIoTClient::download ). Blocks arrive in any order and each is written once.
+ *
+ * @param[in] offset          : Offset of the block in the file
+ * @param[in] data            : Block data; only valid during the call
+ * @param[in] length          : Length of the block
+ * @param[in] arg             : User argument
+ *
+ * @return int32_t            : Number of bytes written; anything other than 'length' aborts the download
+ */
+typedef int32_t (*aws_download_sink_t)( uint32_t offset, const uint8_t* data, uint32_t length, void* arg );
+
+/**
+ * AWS IoT file download parameters. The file is served by an AWS IoT stream (MQTT-based file delivery).
+ */
+typedef struct
+{
+    const char*         thing_name;       /**< Thing whose stream topics are used */
+    const char*         stream_id;        /**< Stream holding the file */
+    uint16_t            file_id;          /**< File within the stream */
+    uint32_t            file_size;        /**< Size of the file in bytes */
+    uint32_t            block_size;       /**< Bytes per block; 0 selects @ref AWS_DOWNLOAD_DEFAULT_BLOCK_SIZE */
+    uint8_t             window;           /**< Block requests in flight; 0 selects @ref AWS_DOWNLOAD_DEFAULT_WINDOW */
+    aws_download_sink_t sink;             /**< Destination of the blocks */
+    void*               sink_arg;         /**< User argument handed to the sink */
+} aws_download_params_t;
+
+/**
+ * Progress of a file download. Zero it before the first call; pass it back unchanged to resume after a reconnect.
+ */
+typedef struct
+{
+    uint32_t    block_count;              /**< Number of blocks in the file */
+    uint32_t    blocks_received;          /**< Number of distinct blocks written to the sink */
+    uint32_t    requests;                 /**< Number of block requests sent */
+    uint32_t    retries;                  /**< Number of block requests that timed out */
+    uint32_t    duplicates;               /**< Number of blocks received more than once */
+    uint8_t     bitmap[( AWS_DOWNLOAD_MAX_BLOCKS + 7 ) / 8];  /**< Blocks written to the sink, one bit per block */
+} aws_download_t;
+
+/**
+ * AWS IoT client-side publish rate limit parameters.
+ * AWS IoT throttles each connection; exceeding the quota ( @ref AWS_IOT_PUBLISH_RATE_LIMIT, @ref AWS_IOT_THROUGHPUT_LIMIT )
+ * gets messages dropped or the connection closed. A rate of 0 disables the corresponding limit.
+ */
+typedef struct
+{
+    uint32_t    publishes_per_second;     /**< Sustained number of publishes per second */
+    uint32_t    publish_burst;            /**< Number of publishes that may be sent back-to-back before shaping starts */
+    uint32_t    bytes_per_second;         /**< Sustained number of bytes (MQTT packet size) per second */
+    uint32_t    byte_burst;               /**< Number of bytes that may be sent back-to-back before shaping starts */
+} aws_rate_limit_params_t;
+
+/**
+ * Byte budgets of the outbound lanes ( @ref AWSIoTClient::set_priority_params ).
+ * Every scheduling round credits each waiting lane with its budget; a lane sends while its next request fits into its credit,
+ * higher lanes first. Budgets thus set the share of a congested link each lane gets. A budget of 0 lets the lane preempt all lower lanes.
+ */
+typedef struct
+{
+    uint32_t    budget[AWS_PRIORITY_LANES]; /**< Bytes (topic and payload) per round, indexed by priority - 1 */
+} aws_priority_params_t;
+
+/**
+ * AWS IoT client-side publish rate limit statistics
+ */
+typedef struct
+{
+    uint32_t    publishes;                /**< Number of publishes that went through the rate limiter */
+    uint32_t    delayed_publishes;        /**< Number of publishes that had to wait for tokens */
+    uint64_t    total_delay_ms;           /**< Sum of all delays imposed on publishes (in ms) */
+    uint32_t    max_delay_ms;             /**< Longest delay imposed on a single publish (in ms) */
+} aws_rate_limit_stats_t;
+
+/**
+ * AWS IoT keep-alive parameters ( @ref AWSIoTClient::set_keep_alive_params )
+ */
+typedef struct
+{
+    uint8_t     adaptive;                 /**< When set, the ping interval is lowered below the negotiated keep-alive after the connection
+                                               is lost while idle (for example by a NAT timeout), and raised again after successful pings */
+    uint16_t    min_interval;             /**< Lowest ping interval (in seconds) the adaptive mode may use */
+} aws_keep_alive_params_t;
+
+/**
+ * Policy applied when a subscription queue of the dispatcher is full ( @ref AWSIoTClient::enable_dispatch )
+ */
+typedef enum
+{
+    AWS_DISPATCH_BLOCK = 0,                  /**< The thread calling yield waits until a worker frees a slot; no message is lost */
+    AWS_DISPATCH_DROP_OLDEST,                /**< The oldest queued message of the subscription is discarded */
+    AWS_DISPATCH_DROP_NEWEST                 /**< The incoming message is discarded */
+} aws_dispatch_policy_t;
+
+/**
+ * AWS IoT dispatch parameters ( @ref AWSIoTClient::enable_dispatch )
+ */
+typedef struct
+{
+    uint8_t                 workers;          /**< Number of worker threads running subscriber callbacks ( up to AWS_DISPATCH_MAX_WORKERS ) */
+    aws_dispatch_policy_t   policy;           /**< What to do when a subscription queue is full */
+} aws_dispatch_params_t;
+
+/**
+ * AWS IoT dispatch statistics ( @ref AWSIoTClient::get_dispatch_stats )
+ */
+typedef struct
+{
+    uint32_t    dispatched;               /**< Messages handed to subscriber callbacks by the workers */
+    uint32_t    dropped;                  /**< Messages discarded because a queue was full or the message did not fit a queue slot */
+    uint32_t    blocked;                  /**< Number of times yield had to wait for a free queue slot */
+    uint32_t    max_queued;               /**< Highest number of messages waiting in a single subscription queue */
+    uint32_t    duplicates;               /**< QoS1 redeliveries dropped by the duplicate filter ( @ref AWSIoTClient::enable_duplicate_filter ) */
+    uint32_t    cache_evictions;          /**< Cached values evicted for another topic ( @ref AWSIoTClient::enable_value_cache ) */
+    uint32_t    cache_oversized;          /**< Messages longer than AWS_VALUE_CACHE_MAX_LENGTH, which were not cached */
+} aws_dispatch_stats_t;
+
+/**
+ * Value returned by the last-value cache ( @ref AWSIoTClient::get_last_value )
+ */
+typedef struct
+{
+    uint32_t    length;                   /**< Length of the payload */
+    uint32_t    version;                  /**< Cache version at which the value last changed; differs from an earlier query if the value changed since */
+    uint32_t    age_ms;                   /**< Time since the value was last received */
+    uint8_t     retained;                 /**< The value was received as a retained message */
+} aws_cached_value_t;
+
+/**
+ * AWS IoT duplicate filter parameters ( @ref AWSIoTClient::enable_duplicate_filter )
+ */
+typedef struct
+{
+    uint8_t     match_payload;            /**< Also compare a hash of topic and payload, so that a packet identifier reused for new content
+                                               is never taken for a redelivery */
+    uint8_t     ignore_dup_flag;          /**< Drop a repeated packet identifier with the same content even when the DUP flag is not set,
+                                               for brokers that redeliver without it. Only honoured together with match_payload */
+} aws_duplicate_filter_params_t;
+
+/**
+ * AWS IoT session journal parameters ( @ref AWSIoTClient::enable_session_journal )
+ */
+typedef struct
+{
+    const char* path;                     /**< Journal file on a mounted file system, e.g. "/fs/aws_session"; "<path>.tmp" is used while compacting */
+    uint32_t    sync_interval_ms;         /**< Longest time a completed publish or a new subscription waits for fsync; 0 selects AWS_SESSION_DEFAULT_SYNC_INTERVAL */
+} aws_session_params_t;
+
+/**
+ * Health of a Greengrass core endpoint as measured by @ref AWSIoTEndpointSelector
+ */
+typedef struct
+{
+    const char* host;                     /**< Host address of the endpoint; valid until the selector is cleared */
+    uint16_t    port;                     /**< Port of the endpoint */
+    uint32_t    srtt_us;                  /**< Smoothed TCP connect time (in us); 0 until a probe succeeds */
+    uint32_t    last_rtt_us;              /**< TCP connect time of the last successful probe (in us) */
+    uint16_t    failures;                 /**< Consecutive failed probes or connects */
+    uint32_t    probes;                   /**< Number of probes made */
+} aws_endpoint_score_t;
+
+/**
+ * Durations (in ms) of the phases of the last successful connect ( @ref AWSIoTClient::connect )
+ */
+typedef struct
+{
+    uint32_t    dns_ms;                   /**< Host name resolution */
+    uint32_t    tcp_ms;                   /**< TCP connection establishment */
+    uint32_t    tls_ms;                   /**< TLS handshake; 0 for non-secured connections */
+    uint32_t    connack_ms;               /**< MQTT CONNECT until CONNACK */
+} aws_connect_timings_t;
+
+/**
+ * Metrics of an outbound lane ( @ref aws_iot_metrics_t )
+ */
+typedef struct
+{
+    uint32_t    requests;                 /**< Queued requests processed from the lane */
+    uint64_t    bytes;                    /**< Topic and payload bytes of those requests */
+    uint32_t    latency[AWS_METRICS_LATENCY_BUCKETS]; /**< Histogram of submission-to-completion latency, bucketed like publish_latency */
+    uint32_t    latency_max_ms;           /**< Highest submission-to-completion latency */
+    uint32_t    expired;                  /**< Publishes discarded unsent because their time-to-live ran out; not counted in requests */
+} aws_lane_metrics_t;
+
+/**
+ * AWS IoT client metrics snapshot ( @ref AWSIoTClient::get_metrics )
+ */
+typedef struct
+{
+    uint32_t    publish_latency[AWS_METRICS_LATENCY_BUCKETS]; /**< Histogram of QoS1 publish-to-PUBACK latency. Bucket 0 counts latencies below 1 ms,
+                                                                   bucket n counts latencies in [2^(n-1), 2^n) ms and the last bucket also counts everything above */
+    uint32_t    publish_latency_max_ms;   /**< Highest QoS1 publish-to-PUBACK latency */
+    uint32_t    publishes;                /**< Number of successful publishes */
+    uint32_t    publish_failures;         /**< Number of failed publishes */
+    uint64_t    bytes_sent;               /**< Bytes written to the network */
+    uint64_t    bytes_received;           /**< Bytes read from the network */
+    uint32_t    packets_sent;             /**< MQTT packets written to the network */
+    uint32_t    packets_received;         /**< MQTT packets read from the network */
+    uint32_t    yields;                   /**< Number of yield calls */
+    uint32_t    idle_yields;              /**< Number of yield calls that did not receive any data */
+    uint32_t    connects;                 /**< Number of successful connects */
+    uint32_t    reconnects;               /**< Number of successful connects after the first one */
+    uint32_t    keep_alive_pings;         /**< Number of PINGREQ packets sent */
+    uint32_t    keep_alive_interval_ms;   /**< Current ping interval; idle time after the last outbound packet before a PINGREQ is sent */
+    uint32_t    keep_alive_timeouts;      /**< Number of PINGREQs that were not answered within the command timeout */
+    uint32_t    ping_rtt_last_ms;         /**< Round trip time of the last answered PINGREQ */
+    uint32_t    ping_rtt_min_ms;          /**< Lowest PINGREQ round trip time */
+    uint32_t    ping_rtt_max_ms;          /**< Highest PINGREQ round trip time */
+    aws_connect_timings_t connect_timings; /**< Phase timings of the last successful connect */
+    aws_lane_metrics_t lanes[AWS_PRIORITY_LANES]; /**< Queued requests per outbound lane, indexed by priority - 1 */
+} aws_iot_metrics_t;
+
 /******************************************************
  *                 Global Variables
  ******************************************************/
@@ -260,6 +660,10 @@ typedef struct
 /** JSON parser callback for Greengrass discovery */
 cy_rslt_t json_callback_for_discovery_payload (cy_JSON_object_t* json_object );
 
+/** Frees the Greengrass group list built by the discovery parser and resets the parser,
+ *  so that the next discovery payload is parsed from scratch */
+void aws_greengrass_discovery_reset( void );
+
 /**
  * @}
  */
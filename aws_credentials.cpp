@@ -0,0 +1,293 @@
+/*
+ * Copyright 2019-2020 Cypress Semiconductor Corporation
+ * SPDX-License-Identifier: Apache-2.0
+ * 
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ * 
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ * 
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+/** @file
+ *
+ * Implementation for AWS IoT TLS credentials
+ *
+ */
+#include "aws_credentials.h"
+#include "string.h"
+#include "stdlib.h"
+
+/* PEM input is a NUL-terminated string and mbedtls wants the terminator included; DER input is taken as is */
+static size_t credential_length( const char* data, uint16_t length )
+{
+    if( strncmp( data, "-----BEGIN", 10 ) == 0 ) {
+        return strlen( data ) + 1;
+    }
+    return length;
+}
+
+/* FNV-1a; identifies a root CA by content, since buffers holding discovered CAs are freed and reused */
+static uint32_t credential_hash( const char* data, size_t length )
+{
+    uint32_t hash = 2166136261u;
+    size_t i = 0;
+
+    for( i = 0; i < length; i++ ) {
+        hash ^= (uint8_t) data[i];
+        hash *= 16777619u;
+    }
+    return hash;
+}
+
+AWSIoTCredentials::AWSIoTCredentials()
+{
+    int i = 0;
+
+    cert_loaded = false;
+    cert_users = 0;
+    use_counter = 0;
+    mbedtls_x509_crt_init( &client_certificate );
+    mbedtls_pk_init( &key );
+    for( i = 0; i < AWS_CREDENTIALS_MAX_ROOT_CA; i++ ) {
+        root_cas[i].valid = false;
+        root_cas[i].last_used = 0;
+        root_cas[i].users = 0;
+        root_cas[i].data = NULL;
+        mbedtls_x509_crt_init( &root_cas[i].chain );
+    }
+}
+
+AWSIoTCredentials::~AWSIoTCredentials()
+{
+    int i = 0;
+
+    mbedtls_x509_crt_free( &client_certificate );
+    mbedtls_pk_free( &key );
+    for( i = 0; i < AWS_CREDENTIALS_MAX_ROOT_CA; i++ ) {
+        mbedtls_x509_crt_free( &root_cas[i].chain );
+        free( root_cas[i].data );
+    }
+}
+
+cy_rslt_t AWSIoTCredentials::set_client_cert_key( const char* certificate, uint16_t certificate_length, const char* private_key, uint16_t key_length )
+{
+    int ret = 0;
+    cy_rslt_t result = CY_RSLT_SUCCESS;
+
+    if( certificate == NULL || private_key == NULL ) {
+        AWS_LIBRARY_ERROR(("Client certificate and private key are required \n"));
+        return CY_RSLT_AWS_ERROR_INVALID_CLIENT_KEY;
+    }
+
+    mutex.lock();
+    /* a connected socket points at the parsed certificate and key, so they cannot be freed under it */
+    if( cert_users > 0 ) {
+        AWS_LIBRARY_ERROR(("Client certificate and private key are in use by %u connection(s) \n", (unsigned int) cert_users));
+        result = CY_RSLT_AWS_ERROR_IN_USE;
+        goto exit;
+    }
+
+    mbedtls_x509_crt_free( &client_certificate );
+    mbedtls_pk_free( &key );
+    mbedtls_x509_crt_init( &client_certificate );
+    mbedtls_pk_init( &key );
+    cert_loaded = false;
+
+    ret = mbedtls_x509_crt_parse( &client_certificate, (const unsigned char*) certificate, credential_length( certificate, certificate_length ) );
+    if( ret != 0 ) {
+        AWS_LIBRARY_ERROR(("Failed to parse client certificate : -0x%x \n", -ret));
+        result = CY_RSLT_AWS_ERROR_INVALID_CLIENT_KEY;
+        goto exit;
+    }
+
+    ret = mbedtls_pk_parse_key( &key, (const unsigned char*) private_key, credential_length( private_key, key_length ), NULL, 0 );
+    if( ret != 0 ) {
+        AWS_LIBRARY_ERROR(("Failed to parse private key : -0x%x \n", -ret));
+        result = CY_RSLT_AWS_ERROR_INVALID_CLIENT_KEY;
+        goto exit;
+    }
+    cert_loaded = true;
+
+exit:
+    mutex.unlock();
+    return result;
+}
+
+bool AWSIoTCredentials::has_client_cert_key()
+{
+    bool loaded = false;
+
+    mutex.lock();
+    loaded = cert_loaded;
+    mutex.unlock();
+
+    return loaded;
+}
+
+cy_rslt_t AWSIoTCredentials::find_root_ca( const char* root_ca, uint16_t root_ca_length, root_ca_entry** found )
+{
+    root_ca_entry* entry = NULL;
+    size_t length = credential_length( root_ca, root_ca_length );
+    uint32_t hash = credential_hash( root_ca, length );
+    int ret = 0;
+    int i = 0;
+
+    *found = NULL;
+    for( i = 0; i < AWS_CREDENTIALS_MAX_ROOT_CA; i++ ) {
+        if( root_cas[i].valid && root_cas[i].length == length && root_cas[i].hash == hash &&
+                memcmp( root_cas[i].data, root_ca, length ) == 0 ) {
+            root_cas[i].last_used = ++use_counter;
+            *found = &root_cas[i];
+            return CY_RSLT_SUCCESS;
+        }
+    }
+
+    /* Not cached yet; reuse a free entry or the least recently used one no socket holds */
+    for( i = 0; i < AWS_CREDENTIALS_MAX_ROOT_CA; i++ ) {
+        if( !root_cas[i].valid ) {
+            entry = &root_cas[i];
+            break;
+        }
+        if( root_cas[i].users == 0 && ( entry == NULL || root_cas[i].last_used < entry->last_used ) ) {
+            entry = &root_cas[i];
+        }
+    }
+    if( entry == NULL ) {
+        AWS_LIBRARY_ERROR(("All %d cached root CAs are in use; raise AWS_CREDENTIALS_MAX_ROOT_CA \n", AWS_CREDENTIALS_MAX_ROOT_CA));
+        return CY_RSLT_AWS_ERROR_IN_USE;
+    }
+
+    mbedtls_x509_crt_free( &entry->chain );
+    mbedtls_x509_crt_init( &entry->chain );
+    free( entry->data );
+    entry->data = NULL;
+    entry->valid = false;
+
+    ret = mbedtls_x509_crt_parse( &entry->chain, (const unsigned char*) root_ca, length );
+    if( ret != 0 ) {
+        AWS_LIBRARY_ERROR(("Failed to parse root CA certificate : -0x%x \n", -ret));
+        return CY_RSLT_AWS_ERROR_INVALID_ROOTCA;
+    }
+
+    /* the hash alone could take a different CA for a cached one */
+    entry->data = (unsigned char*) malloc( length );
+    if( entry->data == NULL ) {
+        AWS_LIBRARY_ERROR(("Out of memory caching root CA certificate \n"));
+        mbedtls_x509_crt_free( &entry->chain );
+        mbedtls_x509_crt_init( &entry->chain );
+        return CY_RSLT_AWS_ERROR_INVALID_ROOTCA;
+    }
+    memcpy( entry->data, root_ca, length );
+
+    entry->valid = true;
+    entry->length = length;
+    entry->hash = hash;
+    entry->last_used = ++use_counter;
+
+    *found = entry;
+    return CY_RSLT_SUCCESS;
+}
+
+cy_rslt_t AWSIoTCredentials::add_root_ca( const char* root_ca, uint16_t root_ca_length )
+{
+    root_ca_entry* entry = NULL;
+    cy_rslt_t result = CY_RSLT_SUCCESS;
+
+    if( root_ca == NULL ) {
+        return CY_RSLT_AWS_ERROR_INVALID_ROOTCA;
+    }
+
+    mutex.lock();
+    result = find_root_ca( root_ca, root_ca_length, &entry );
+    mutex.unlock();
+
+    return result;
+}
+
+cy_rslt_t AWSIoTCredentials::apply( TLSSocketWrapper& socket, const char* root_ca, uint16_t root_ca_length, attachment* attached )
+{
+    root_ca_entry* entry = NULL;
+    cy_rslt_t result = CY_RSLT_SUCCESS;
+
+    release( attached );
+
+    mutex.lock();
+    if( !cert_loaded ) {
+        AWS_LIBRARY_ERROR(("Client certificate and private key not loaded \n"));
+        result = CY_RSLT_AWS_ERROR_INVALID_CLIENT_KEY;
+        goto exit;
+    }
+
+    if( root_ca != NULL ) {
+        result = find_root_ca( root_ca, root_ca_length, &entry );
+        if( result != CY_RSLT_SUCCESS ) {
+            goto exit;
+        }
+    }
+
+    if( mbedtls_ssl_conf_own_cert( socket.get_ssl_config(), &client_certificate, &key ) != 0 ) {
+        result = CY_RSLT_AWS_ERROR_INVALID_CLIENT_KEY;
+        goto exit;
+    }
+    if( entry != NULL ) {
+        socket.set_ca_chain( &entry->chain );
+        entry->users++;
+        attached->root_ca = (int) ( entry - root_cas );
+    }
+    cert_users++;
+    attached->client_cert_key = true;
+    attached->owner = this;
+
+exit:
+    mutex.unlock();
+    return result;
+}
+
+cy_rslt_t AWSIoTCredentials::apply_root_ca( TLSSocketWrapper& socket, const char* root_ca, uint16_t root_ca_length, attachment* attached )
+{
+    root_ca_entry* entry = NULL;
+    cy_rslt_t result = CY_RSLT_SUCCESS;
+
+    release( attached );
+
+    mutex.lock();
+    result = find_root_ca( root_ca, root_ca_length, &entry );
+    if( result == CY_RSLT_SUCCESS ) {
+        socket.set_ca_chain( &entry->chain );
+        entry->users++;
+        attached->root_ca = (int) ( entry - root_cas );
+        attached->owner = this;
+    }
+    mutex.unlock();
+    return result;
+}
+
+void AWSIoTCredentials::release( attachment* attached )
+{
+    AWSIoTCredentials* owner = attached->owner;
+
+    if( owner == NULL ) {
+        return;
+    }
+
+    owner->mutex.lock();
+    if( attached->root_ca >= 0 ) {
+        owner->root_cas[attached->root_ca].users--;
+    }
+    if( attached->client_cert_key ) {
+        owner->cert_users--;
+    }
+    owner->mutex.unlock();
+
+    attached->owner = NULL;
+    attached->root_ca = -1;
+    attached->client_cert_key = false;
+}
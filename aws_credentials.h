@@ -0,0 +1,170 @@
+/*
+ * Copyright 2019-2020 Cypress Semiconductor Corporation
+ * SPDX-License-Identifier: Apache-2.0
+ * 
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ * 
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ * 
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+/** @file
+ *  Parsed TLS credentials shared by AWS IoT connections
+ */
+#ifndef AWS_CREDENTIALS_H
+#define AWS_CREDENTIALS_H
+
+#include "mbed.h"
+#include "aws_common.h"
+#include "mbedtls/ssl.h"
+#include "mbedtls/x509_crt.h"
+#include "mbedtls/pk.h"
+
+/**
+ * @addtogroup aws_iot_classes
+ *
+ * @{
+ */
+
+/** Client certificate, private key and root CA chains, parsed once and shared by every TLS connection.
+ *
+ * TLSSocketWrapper parses PEM input again for each socket, which is a measurable part of a reconnect.
+ * This class parses the material once and hands the parsed mbedtls objects to each socket, so a connect
+ * only attaches them. PEM (NUL-terminated, starting with "-----BEGIN") and DER input are both accepted.
+ *
+ * Root CA chains are cached by content, up to @ref AWS_CREDENTIALS_MAX_ROOT_CA of them; the least recently
+ * used one that no socket holds is dropped to make room. A socket holds the parsed objects from @ref apply or
+ * @ref apply_root_ca until its @ref attachment is released, and while it does they are neither replaced nor freed.
+ * RSA private key operations are not thread safe in mbedtls unless MBEDTLS_THREADING_C is enabled, so TLS
+ * handshakes sharing one credentials object should not run concurrently.
+ */
+class AWSIoTCredentials
+{
+public:
+    /** Default constructor of AWSIoTCredentials class. Nothing is loaded. */
+    AWSIoTCredentials();
+
+    /** Frees the parsed credentials. */
+    ~AWSIoTCredentials();
+
+    /** The parsed objects one TLS socket was configured with. Release it once the socket is closed; it releases
+     *  itself when destroyed. The fields are managed by AWSIoTCredentials.
+     */
+    struct attachment
+    {
+        attachment() : owner( NULL ), root_ca( -1 ), client_cert_key( false )
+        {
+        }
+
+        ~attachment()
+        {
+            AWSIoTCredentials::release( this );
+        }
+
+        AWSIoTCredentials* owner;           /**< Credentials holding the objects; NULL if nothing is attached */
+        int root_ca;                        /**< Index of the root CA chain; -1 if none */
+        bool client_cert_key;               /**< Whether the client certificate and key are attached */
+
+    private:
+        attachment( const attachment& );
+        attachment& operator=( const attachment& );
+    };
+
+    /** Parses the client certificate and private key, replacing any previously loaded ones.
+     *
+     * @param[in] certificate         : Client certificate (PEM or DER)
+     * @param[in] certificate_length  : Length of the DER certificate; ignored for PEM
+     * @param[in] private_key         : Private key (PEM or DER)
+     * @param[in] key_length          : Length of the DER key; ignored for PEM
+     *
+     * @return cy_rslt_t              : CY_RSLT_SUCCESS - on success,
+     *                                  CY_RSLT_AWS_ERROR_INVALID_CLIENT_KEY - On error,
+     *                                  CY_RSLT_AWS_ERROR_IN_USE - if a socket holds the loaded ones ( @ref aws_iot_defines )
+     */
+    cy_rslt_t set_client_cert_key( const char* certificate, uint16_t certificate_length, const char* private_key, uint16_t key_length );
+
+    /** Checks whether a client certificate and key are loaded.
+     *
+     * @return bool                   : true if @ref set_client_cert_key succeeded
+     */
+    bool has_client_cert_key();
+
+    /** Parses a root CA chain unless an identical one is already cached.
+     *
+     * @param[in] root_ca             : Root CA certificate(s) (PEM or DER)
+     * @param[in] root_ca_length      : Length of the DER certificate; ignored for PEM
+     *
+     * @return cy_rslt_t              : CY_RSLT_SUCCESS - on success,
+     *                                  CY_RSLT_AWS_ERROR_INVALID_ROOTCA - On error,
+     *                                  CY_RSLT_AWS_ERROR_IN_USE - if the cache is full of chains held by sockets ( @ref aws_iot_defines )
+     */
+    cy_rslt_t add_root_ca( const char* root_ca, uint16_t root_ca_length );
+
+    /** Configures a TLS socket with the client certificate and key and the given root CA, parsing the root CA on first use.
+     *
+     * @param[in] socket              : TLS socket, before it connects
+     * @param[in] root_ca             : Root CA certificate(s) (PEM or DER); NULL leaves the socket's CA chain unset
+     * @param[in] root_ca_length      : Length of the DER certificate; ignored for PEM
+     * @param[out] attached           : Holds the objects for the socket; anything it held before is released first
+     *
+     * @return cy_rslt_t              : CY_RSLT_SUCCESS - on success,
+     *                                  CY_RSLT_AWS_ERROR_INVALID_ROOTCA, CY_RSLT_AWS_ERROR_INVALID_CLIENT_KEY,
+     *                                  CY_RSLT_AWS_ERROR_IN_USE - On error ( @ref aws_iot_defines )
+     */
+    cy_rslt_t apply( TLSSocketWrapper& socket, const char* root_ca, uint16_t root_ca_length, attachment* attached );
+
+    /** Configures a TLS socket with the given root CA only, for connections that authenticate the client some other way.
+     *
+     * @param[in] socket              : TLS socket, before it connects
+     * @param[in] root_ca             : Root CA certificate(s) (PEM or DER)
+     * @param[in] root_ca_length      : Length of the DER certificate; ignored for PEM
+     * @param[out] attached           : Holds the chain for the socket; anything it held before is released first
+     *
+     * @return cy_rslt_t              : CY_RSLT_SUCCESS - on success,
+     *                                  CY_RSLT_AWS_ERROR_INVALID_ROOTCA, CY_RSLT_AWS_ERROR_IN_USE - On error ( @ref aws_iot_defines )
+     */
+    cy_rslt_t apply_root_ca( TLSSocketWrapper& socket, const char* root_ca, uint16_t root_ca_length, attachment* attached );
+
+    /** Lets go of the objects a socket was configured with, once the socket is closed or destroyed.
+     *
+     * @param[in] attached            : Attachment filled by @ref apply or @ref apply_root_ca; nothing happens if it holds nothing
+     *
+     */
+    static void release( attachment* attached );
+
+private:
+    struct root_ca_entry
+    {
+        bool valid;
+        uint32_t length;
+        uint32_t hash;
+        uint32_t last_used;
+        uint32_t users;                     /**< Sockets holding the chain */
+        unsigned char* data;                /**< Copy of the input, compared on a hash match */
+        mbedtls_x509_crt chain;
+    };
+
+    cy_rslt_t find_root_ca( const char* root_ca, uint16_t root_ca_length, root_ca_entry** found );
+
+    Mutex mutex;
+    bool cert_loaded;
+    uint32_t cert_users;                    /**< Sockets holding the client certificate and key */
+    mbedtls_x509_crt client_certificate;
+    mbedtls_pk_context key;
+    root_ca_entry root_cas[AWS_CREDENTIALS_MAX_ROOT_CA];
+    uint32_t use_counter;
+};
+
+/**
+ * @}
+ */
+
+#endif
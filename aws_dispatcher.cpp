@@ -0,0 +1,491 @@
+/*
+ * Copyright 2019-2020 Cypress Semiconductor Corporation
+ * SPDX-License-Identifier: Apache-2.0
+ * 
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ * 
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ * 
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+/** @file
+ *
+ * Implementation for AWS IoT subscriber callback dispatcher
+ *
+ */
+#include "aws_dispatcher.h"
+#include "string.h"
+
+/* Dispatchers currently started, one per client connection */
+static void* volatile dispatchers[AWS_MAX_CONNECTIONS];
+
+template <int INDEX>
+static void dispatch_trampoline( MQTT::MessageData& message )
+{
+    AWSIoTDispatcher* dispatcher = (AWSIoTDispatcher*) core_util_atomic_load_ptr( &dispatchers[INDEX / AWS_DISPATCH_MAX_SUBSCRIPTIONS] );
+
+    if( dispatcher != NULL ) {
+        dispatcher->enqueue( INDEX % AWS_DISPATCH_MAX_SUBSCRIPTIONS, message );
+    }
+}
+
+/* The MQTT client only takes plain function pointers, so there is one trampoline per (dispatcher, subscription entry) pair */
+template <int COUNT>
+struct trampoline_table
+{
+    static AWSIoTDispatcher::handler_t get( int index )
+    {
+        return ( index == COUNT - 1 ) ? &dispatch_trampoline<COUNT - 1> : trampoline_table<COUNT - 1>::get( index );
+    }
+};
+
+template <>
+struct trampoline_table<0>
+{
+    static AWSIoTDispatcher::handler_t get( int index )
+    {
+        (void) index;
+        return NULL;
+    }
+};
+
+AWSIoTDispatcher::AWSIoTDispatcher() : work_available( mutex ), space_available( mutex )
+{
+    int i = 0;
+
+    memset( subscriptions, 0, sizeof(subscriptions) );
+    for( i = 0; i < AWS_DISPATCH_MAX_SUBSCRIPTIONS; i++ ) {
+        subscriptions[i].cache_filter = -1;
+    }
+    memset( workers, 0, sizeof(workers) );
+    memset( &stats, 0, sizeof(stats) );
+    worker_count = 0;
+    next_entry = 0;
+    slot = -1;
+    stopping = false;
+    filtering = false;
+    policy = AWS_DISPATCH_BLOCK;
+}
+
+AWSIoTDispatcher::~AWSIoTDispatcher()
+{
+    stop();
+    if( slot >= 0 ) {
+        core_util_atomic_store_ptr( &dispatchers[slot], NULL );
+    }
+}
+
+cy_rslt_t AWSIoTDispatcher::claim_slot()
+{
+    void* expected = NULL;
+    int i = 0;
+
+    /* The slot is kept until destruction, since the MQTT client may still hold trampolines that point at it */
+    for( i = 0; slot < 0 && i < AWS_MAX_CONNECTIONS; i++ ) {
+        expected = NULL;
+        if( core_util_atomic_cas_ptr( &dispatchers[i], &expected, this ) ) {
+            slot = i;
+        }
+    }
+    if( slot < 0 ) {
+        AWS_LIBRARY_ERROR(("All %d dispatchers in use \n", AWS_MAX_CONNECTIONS));
+        return CY_RSLT_AWS_ERROR_UNSUPPORTED;
+    }
+
+    return CY_RSLT_SUCCESS;
+}
+
+cy_rslt_t AWSIoTDispatcher::start( const aws_dispatch_params_t& params )
+{
+    cy_rslt_t result = CY_RSLT_SUCCESS;
+    uint8_t count = params.workers;
+    uint8_t i = 0;
+
+    if( running() ) {
+        return CY_RSLT_SUCCESS;
+    }
+
+    result = claim_slot();
+    if( result != CY_RSLT_SUCCESS ) {
+        return result;
+    }
+
+    if( count == 0 ) {
+        count = 1;
+    } else if( count > AWS_DISPATCH_MAX_WORKERS ) {
+        count = AWS_DISPATCH_MAX_WORKERS;
+    }
+
+    mutex.lock();
+    policy = params.policy;
+    memset( &stats, 0, sizeof(stats) );
+    worker_count = count;
+    mutex.unlock();
+
+    for( i = 0; i < count; i++ ) {
+        workers[i] = new Thread( osPriorityNormal, AWS_DISPATCH_WORKER_STACK_SIZE );
+        workers[i]->start( callback( this, &AWSIoTDispatcher::worker_main ) );
+    }
+
+    return CY_RSLT_SUCCESS;
+}
+
+void AWSIoTDispatcher::stop()
+{
+    uint8_t i = 0;
+    uint8_t count = 0;
+
+    mutex.lock();
+    count = worker_count;
+    stopping = true;
+    work_available.notify_all();
+    space_available.notify_all();
+    mutex.unlock();
+
+    for( i = 0; i < count; i++ ) {
+        workers[i]->join();
+        delete workers[i];
+        workers[i] = NULL;
+    }
+
+    mutex.lock();
+    for( i = 0; i < AWS_DISPATCH_MAX_SUBSCRIPTIONS; i++ ) {
+        subscriptions[i].head = 0;
+        subscriptions[i].count = 0;
+    }
+    worker_count = 0;
+    stopping = false;
+    mutex.unlock();
+}
+
+bool AWSIoTDispatcher::running() const
+{
+    return worker_count > 0;
+}
+
+cy_rslt_t AWSIoTDispatcher::enable_duplicate_filter( const aws_duplicate_filter_params_t& params )
+{
+    cy_rslt_t result = claim_slot();
+
+    if( result != CY_RSLT_SUCCESS ) {
+        return result;
+    }
+
+    mutex.lock();
+    duplicate_filter.configure( params );
+    filtering = true;
+    mutex.unlock();
+
+    return CY_RSLT_SUCCESS;
+}
+
+void AWSIoTDispatcher::disable_duplicate_filter()
+{
+    mutex.lock();
+    filtering = false;
+    mutex.unlock();
+}
+
+void AWSIoTDispatcher::reset_duplicate_filter()
+{
+    mutex.lock();
+    duplicate_filter.reset();
+    mutex.unlock();
+}
+
+cy_rslt_t AWSIoTDispatcher::enable_value_cache( const char* topic_filter )
+{
+    cy_rslt_t result = claim_slot();
+    int i = 0;
+
+    if( result != CY_RSLT_SUCCESS ) {
+        return result;
+    }
+
+    mutex.lock();
+    if( !value_cache.add_filter( topic_filter ) ) {
+        mutex.unlock();
+        AWS_LIBRARY_ERROR(("All %d value cache filters in use \n", AWS_VALUE_CACHE_MAX_FILTERS));
+        return CY_RSLT_AWS_ERROR_UNSUPPORTED;
+    }
+    for( i = 0; i < AWS_DISPATCH_MAX_SUBSCRIPTIONS; i++ ) {
+        if( subscriptions[i].filter[0] != '\0' && strcmp( subscriptions[i].filter, topic_filter ) == 0 ) {
+            subscriptions[i].cache_filter = (int8_t) value_cache.lookup( topic_filter );
+        }
+    }
+    mutex.unlock();
+
+    return CY_RSLT_SUCCESS;
+}
+
+void AWSIoTDispatcher::disable_value_cache( const char* topic_filter )
+{
+    int i = 0;
+
+    mutex.lock();
+    value_cache.remove_filter( topic_filter );
+    for( i = 0; i < AWS_DISPATCH_MAX_SUBSCRIPTIONS; i++ ) {
+        if( subscriptions[i].filter[0] != '\0' && strcmp( subscriptions[i].filter, topic_filter ) == 0 ) {
+            subscriptions[i].cache_filter = -1;
+        }
+    }
+    mutex.unlock();
+}
+
+cy_rslt_t AWSIoTDispatcher::get_last_value( const char* topic, char* buffer, uint32_t size, aws_cached_value_t* value )
+{
+    cy_rslt_t result = CY_RSLT_SUCCESS;
+
+    mutex.lock();
+    result = value_cache.get( topic, buffer, size, value, Kernel::get_ms_count() );
+    mutex.unlock();
+
+    return result;
+}
+
+uint32_t AWSIoTDispatcher::value_cache_version()
+{
+    uint32_t version = 0;
+
+    mutex.lock();
+    version = value_cache.version();
+    mutex.unlock();
+
+    return version;
+}
+
+bool AWSIoTDispatcher::active() const
+{
+    return running() || filtering || value_cache.enabled();
+}
+
+AWSIoTDispatcher::handler_t AWSIoTDispatcher::add( const char* topic_filter, handler_t handler )
+{
+    int entry = -1;
+    int i = 0;
+
+    if( slot < 0 || strlen( topic_filter ) > AWS_TOPIC_FILTER_MAX_LENGTH ) {
+        return NULL;
+    }
+
+    mutex.lock();
+    for( i = 0; i < AWS_DISPATCH_MAX_SUBSCRIPTIONS; i++ ) {
+        if( subscriptions[i].filter[0] != '\0' && strcmp( subscriptions[i].filter, topic_filter ) == 0 ) {
+            entry = i;
+            break;
+        }
+        /* An entry whose handler is still running is not reused, or its old and new messages could overlap */
+        if( entry < 0 && subscriptions[i].filter[0] == '\0' && !subscriptions[i].busy ) {
+            entry = i;
+        }
+    }
+    if( entry >= 0 ) {
+        strcpy( subscriptions[entry].filter, topic_filter );
+        subscriptions[entry].handler = handler;
+        subscriptions[entry].cache_filter = (int8_t) value_cache.lookup( topic_filter );
+    }
+    mutex.unlock();
+
+    if( entry < 0 ) {
+        AWS_LIBRARY_ERROR(("No free dispatch entry for %s \n", topic_filter));
+        return NULL;
+    }
+
+    return trampoline_table<AWS_MAX_CONNECTIONS * AWS_DISPATCH_MAX_SUBSCRIPTIONS>::get( slot * AWS_DISPATCH_MAX_SUBSCRIPTIONS + entry );
+}
+
+void AWSIoTDispatcher::remove( const char* topic_filter )
+{
+    int i = 0;
+
+    mutex.lock();
+    for( i = 0; i < AWS_DISPATCH_MAX_SUBSCRIPTIONS; i++ ) {
+        if( subscriptions[i].filter[0] != '\0' && strcmp( subscriptions[i].filter, topic_filter ) == 0 ) {
+            subscriptions[i].filter[0] = '\0';
+            subscriptions[i].handler = NULL;
+            subscriptions[i].cache_filter = -1;
+            subscriptions[i].head = 0;
+            subscriptions[i].count = 0;
+        }
+    }
+    space_available.notify_all();
+    mutex.unlock();
+}
+
+void AWSIoTDispatcher::get_stats( aws_dispatch_stats_t* stats )
+{
+    if( stats == NULL ) {
+        return;
+    }
+
+    mutex.lock();
+    *stats = AWSIoTDispatcher::stats;
+    stats->duplicates = duplicate_filter.dropped();
+    stats->cache_evictions = value_cache.evictions();
+    stats->cache_oversized = value_cache.oversized();
+    mutex.unlock();
+}
+
+void AWSIoTDispatcher::enqueue( int entry, MQTT::MessageData& message )
+{
+    subscription* sub = &subscriptions[entry];
+    queued_message* slot_message = NULL;
+    handler_t handler = NULL;
+    const char* topic = NULL;
+    uint32_t topic_length = 0;
+
+    if( message.topicName.cstring != NULL ) {
+        topic = message.topicName.cstring;
+        topic_length = strlen( topic );
+    } else {
+        topic = message.topicName.lenstring.data;
+        topic_length = message.topicName.lenstring.len;
+    }
+
+    mutex.lock();
+    if( sub->filter[0] == '\0' ) {
+        mutex.unlock();
+        return;
+    }
+
+    /* The MQTT client still acknowledges a dropped redelivery once the trampoline returns */
+    if( filtering && duplicate_filter.duplicate( (uint8_t) entry, message ) ) {
+        mutex.unlock();
+        return;
+    }
+
+    /* Updated before the callback runs, so that a lookup from the callback or after it sees this message */
+    if( sub->cache_filter >= 0 ) {
+        value_cache.update( sub->cache_filter, topic, topic_length, message.message, Kernel::get_ms_count() );
+    }
+
+    /* Without workers the dispatcher is transparent */
+    if( !running() ) {
+        handler = sub->handler;
+        mutex.unlock();
+        handler( message );
+        return;
+    }
+
+    if( topic_length + message.message.payloadlen > AWS_DISPATCH_MAX_MESSAGE_LENGTH ) {
+        stats.dropped++;
+        mutex.unlock();
+        return;
+    }
+
+    if( sub->count == AWS_DISPATCH_QUEUE_DEPTH ) {
+        switch( policy ) {
+            case AWS_DISPATCH_DROP_NEWEST:
+                stats.dropped++;
+                mutex.unlock();
+                return;
+            case AWS_DISPATCH_DROP_OLDEST:
+                sub->head = ( sub->head + 1 ) % AWS_DISPATCH_QUEUE_DEPTH;
+                sub->count--;
+                stats.dropped++;
+                break;
+            default:
+                stats.blocked++;
+                while( sub->count == AWS_DISPATCH_QUEUE_DEPTH && sub->filter[0] != '\0' && !stopping ) {
+                    space_available.wait();
+                }
+                if( sub->filter[0] == '\0' || stopping ) {
+                    stats.dropped++;
+                    mutex.unlock();
+                    return;
+                }
+                break;
+        }
+    }
+
+    slot_message = &sub->queue[( sub->head + sub->count ) % AWS_DISPATCH_QUEUE_DEPTH];
+    slot_message->qos = message.message.qos;
+    slot_message->retained = message.message.retained;
+    slot_message->dup = message.message.dup;
+    slot_message->id = message.message.id;
+    slot_message->topic_length = topic_length;
+    slot_message->payload_length = message.message.payloadlen;
+    memcpy( slot_message->data, topic, topic_length );
+    memcpy( slot_message->data + topic_length, message.message.payload, message.message.payloadlen );
+
+    sub->count++;
+    if( sub->count > stats.max_queued ) {
+        stats.max_queued = sub->count;
+    }
+    work_available.notify_one();
+    mutex.unlock();
+}
+
+int AWSIoTDispatcher::next_ready()
+{
+    int i = 0;
+    int entry = 0;
+
+    /* Round robin, so that a busy subscription cannot starve the others */
+    for( i = 0; i < AWS_DISPATCH_MAX_SUBSCRIPTIONS; i++ ) {
+        entry = ( next_entry + i ) % AWS_DISPATCH_MAX_SUBSCRIPTIONS;
+        if( subscriptions[entry].count > 0 && !subscriptions[entry].busy ) {
+            next_entry = ( entry + 1 ) % AWS_DISPATCH_MAX_SUBSCRIPTIONS;
+            return entry;
+        }
+    }
+
+    return -1;
+}
+
+void AWSIoTDispatcher::worker_main()
+{
+    queued_message current;
+    MQTTString topic = MQTTString_initializer;
+    MQTT::Message msg;
+    subscription* sub = NULL;
+    handler_t handler = NULL;
+    int entry = 0;
+
+    mutex.lock();
+    while( !stopping ) {
+        entry = next_ready();
+        if( entry < 0 ) {
+            work_available.wait();
+            continue;
+        }
+
+        /* Copy the message out so that the slot is free while the handler runs */
+        sub = &subscriptions[entry];
+        current = sub->queue[sub->head];
+        sub->head = ( sub->head + 1 ) % AWS_DISPATCH_QUEUE_DEPTH;
+        sub->count--;
+        sub->busy = true;
+        handler = sub->handler;
+        space_available.notify_all();
+        mutex.unlock();
+
+        topic.lenstring.data = current.data;
+        topic.lenstring.len = current.topic_length;
+        msg.qos = current.qos;
+        msg.retained = current.retained;
+        msg.dup = current.dup;
+        msg.id = current.id;
+        msg.payload = current.data + current.topic_length;
+        msg.payloadlen = current.payload_length;
+
+        MQTT::MessageData data( topic, msg );
+        handler( data );
+
+        mutex.lock();
+        sub->busy = false;
+        stats.dispatched++;
+        if( sub->count > 0 ) {
+            work_available.notify_one();
+        }
+    }
+    mutex.unlock();
+}
@@ -0,0 +1,208 @@
+/*
+ * Copyright 2019-2020 Cypress Semiconductor Corporation
+ * SPDX-License-Identifier: Apache-2.0
+ * 
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ * 
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ * 
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+/** @file
+ *  Worker pool that runs AWS IoT subscriber callbacks outside of yield
+ */
+#ifndef AWS_DISPATCHER_H
+#define AWS_DISPATCHER_H
+
+#include "mbed.h"
+#include "aws_common.h"
+#include "aws_duplicate_filter.h"
+#include "aws_value_cache.h"
+#include "MQTTClient.h"
+
+/**
+ * @addtogroup aws_iot_classes
+ *
+ * @{
+ */
+
+/** Dispatch executor for subscriber callbacks.
+ *
+ * Each subscription gets a bounded queue. The MQTT client is handed a trampoline instead of the
+ * subscriber callback; the trampoline copies the incoming message into the subscription's queue and
+ * returns, so the thread calling yield goes straight back to reading packets and keeping the connection alive.
+ * Worker threads run the subscriber callbacks. A subscription is served by at most one worker at a time,
+ * so messages of a topic are delivered in the order they were received.
+ * The trampolines also run the optional QoS1 duplicate filter and fill the optional last-value cache, which work with or without workers.
+ */
+class AWSIoTDispatcher
+{
+public:
+    /** Message handler type used by the MQTT client */
+    typedef void (*handler_t)( MQTT::MessageData& message );
+
+    /** Default constructor of AWSIoTDispatcher class. No threads are started until @ref start is called. */
+    AWSIoTDispatcher();
+
+    /** Stops the workers. */
+    ~AWSIoTDispatcher();
+
+    /** Starts the worker threads.
+     *
+     * @param[in] params          : Dispatch parameters
+     *
+     * @return cy_rslt_t          : CY_RSLT_SUCCESS - on success,
+     *                              CY_RSLT_AWS_ERROR_UNSUPPORTED - if all AWS_MAX_CONNECTIONS dispatchers are in use
+     */
+    cy_rslt_t start( const aws_dispatch_params_t& params );
+
+    /** Stops and joins the worker threads. Queued messages are discarded; messages received afterwards are delivered synchronously. */
+    void stop();
+
+    /** Checks whether the workers are running.
+     *
+     * @return bool               : true between @ref start and @ref stop
+     */
+    bool running() const;
+
+    /** Starts dropping QoS1 redeliveries before the subscriber callbacks run. Without workers, callbacks keep running from yield.
+     *
+     * @param[in] params          : Duplicate filter parameters
+     *
+     * @return cy_rslt_t          : CY_RSLT_SUCCESS - on success,
+     *                              CY_RSLT_AWS_ERROR_UNSUPPORTED - if all AWS_MAX_CONNECTIONS dispatchers are in use
+     */
+    cy_rslt_t enable_duplicate_filter( const aws_duplicate_filter_params_t& params );
+
+    /** Stops dropping QoS1 redeliveries. */
+    void disable_duplicate_filter();
+
+    /** Forgets the packet identifiers seen so far; called when a clean session starts. */
+    void reset_duplicate_filter();
+
+    /** Starts caching the last value of each topic received through a topic filter.
+     *
+     * @param[in] topic_filter    : Topic filter, up to AWS_TOPIC_FILTER_MAX_LENGTH characters; copied
+     *
+     * @return cy_rslt_t          : CY_RSLT_SUCCESS - on success,
+     *                              CY_RSLT_AWS_ERROR_UNSUPPORTED - if all AWS_MAX_CONNECTIONS dispatchers are in use, the filter is too long
+     *                              or AWS_VALUE_CACHE_MAX_FILTERS filters are cached already
+     */
+    cy_rslt_t enable_value_cache( const char* topic_filter );
+
+    /** Stops caching a topic filter and drops its values.
+     *
+     * @param[in] topic_filter    : Topic filter passed to @ref enable_value_cache
+     *
+     */
+    void disable_value_cache( const char* topic_filter );
+
+    /** Copies the cached value of a topic. May be called from any thread.
+     *
+     * @param[in]  topic          : Topic, as received
+     * @param[out] buffer         : Buffer receiving the payload
+     * @param[in]  size           : Size of 'buffer'
+     * @param[out] value          : Length, version and age of the value
+     *
+     * @return cy_rslt_t          : CY_RSLT_SUCCESS - on success,
+     *                              CY_RSLT_AWS_ERROR_NOT_CACHED, CY_RSLT_AWS_ERROR_BUFFER_OVERFLOW - On error
+     */
+    cy_rslt_t get_last_value( const char* topic, char* buffer, uint32_t size, aws_cached_value_t* value );
+
+    /** Returns the version of the latest change of a cached value. May be called from any thread. */
+    uint32_t value_cache_version();
+
+    /** Checks whether subscriptions must be registered through @ref add.
+     *
+     * @return bool               : true while the workers run, the duplicate filter is enabled or a topic filter is cached
+     */
+    bool active() const;
+
+    /** Adds a subscription.
+     *
+     * @param[in] topic_filter    : Topic filter; copied, up to AWS_TOPIC_FILTER_MAX_LENGTH characters
+     * @param[in] handler         : Subscriber callback to run on the workers
+     *
+     * @return handler_t          : Trampoline to register with the MQTT client instead of 'handler'; NULL if no entry is free
+     */
+    handler_t add( const char* topic_filter, handler_t handler );
+
+    /** Removes a subscription and discards its queued messages.
+     *
+     * @param[in] topic_filter    : Topic filter passed to @ref add
+     *
+     */
+    void remove( const char* topic_filter );
+
+    /** Returns the dispatch statistics.
+     *
+     * @param[out] stats          : Statistics collected since @ref start
+     *
+     */
+    void get_stats( aws_dispatch_stats_t* stats );
+
+    /** Queues a message for a subscription. Called by the trampolines from the thread calling yield.
+     *
+     * @param[in] entry           : Subscription entry
+     * @param[in] message         : Message received by the MQTT client
+     *
+     */
+    void enqueue( int entry, MQTT::MessageData& message );
+
+private:
+    /** Copy of a received message; topic and payload share one buffer */
+    struct queued_message
+    {
+        MQTT::QoS qos;
+        bool retained;
+        bool dup;
+        unsigned short id;
+        uint16_t topic_length;
+        uint16_t payload_length;
+        char data[AWS_DISPATCH_MAX_MESSAGE_LENGTH];
+    };
+
+    struct subscription
+    {
+        char filter[AWS_TOPIC_FILTER_MAX_LENGTH + 1];   /**< Empty for a free entry */
+        handler_t handler;
+        bool busy;                  /**< A worker is running the handler; keeps per-topic ordering */
+        int8_t cache_filter;        /**< Last-value cache filter the messages update; -1 if not cached */
+        uint8_t head;
+        uint8_t count;
+        queued_message queue[AWS_DISPATCH_QUEUE_DEPTH];
+    };
+
+    cy_rslt_t claim_slot();
+    void worker_main();
+    int next_ready();
+
+    Mutex mutex;
+    ConditionVariable work_available;
+    ConditionVariable space_available;
+    subscription subscriptions[AWS_DISPATCH_MAX_SUBSCRIPTIONS];
+    AWSIoTDuplicateFilter duplicate_filter;
+    AWSIoTValueCache value_cache;
+    Thread* workers[AWS_DISPATCH_MAX_WORKERS];
+    uint8_t worker_count;
+    uint8_t next_entry;
+    int slot;
+    bool stopping;
+    bool filtering;
+    aws_dispatch_policy_t policy;
+    aws_dispatch_stats_t stats;
+};
+
+/**
+ * @}
+ */
+
+#endif
@@ -0,0 +1,365 @@
+/*
+ * Copyright 2019-2020 Cypress Semiconductor Corporation
+ * SPDX-License-Identifier: Apache-2.0
+ * 
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ * 
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ * 
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+
+/** @file
+ *
+ * Implementation for block-stream file download over AWS IoT MQTT-based file delivery
+ *
+ */
+#include "aws_download.h"
+#include "string.h"
+#include "stdlib.h"
+
+#define AWS_DOWNLOAD_CLIENT_TOKEN   "aws-iot-dl"
+
+/* Downloads currently active, one per client connection */
+static void* volatile downloads[AWS_MAX_CONNECTIONS];
+
+static bool topic_equals( MQTT::MessageData& message, const char* topic )
+{
+    if( message.topicName.cstring != NULL ) {
+        return strcmp( message.topicName.cstring, topic ) == 0;
+    }
+    return (size_t) message.topicName.lenstring.len == strlen( topic ) &&
+           memcmp( message.topicName.lenstring.data, topic, message.topicName.lenstring.len ) == 0;
+}
+
+/* Finds '"key":' in a flat JSON object and returns the value that follows. Keys of the data
+ * message are single letters and base64 never contains quotes, so a plain scan is enough. */
+static const char* json_value( const char* json, uint32_t length, char key )
+{
+    uint32_t i = 0;
+
+    for( i = 0; i + 4 <= length; i++ ) {
+        if( json[i] == '"' && json[i + 1] == key && json[i + 2] == '"' && json[i + 3] == ':' ) {
+            return json + i + 4;
+        }
+    }
+    return NULL;
+}
+
+static int base64_value( char c )
+{
+    if( c >= 'A' && c <= 'Z' ) {
+        return c - 'A';
+    } else if( c >= 'a' && c <= 'z' ) {
+        return c - 'a' + 26;
+    } else if( c >= '0' && c <= '9' ) {
+        return c - '0' + 52;
+    } else if( c == '+' ) {
+        return 62;
+    } else if( c == '/' ) {
+        return 63;
+    }
+    return -1;
+}
+
+/* Decodes base64 in place; the output never catches up with the input. Returns the decoded length or -1. */
+static int32_t base64_decode_in_place( char* data, uint32_t length )
+{
+    uint32_t in = 0;
+    uint32_t out = 0;
+    uint32_t bits = 0;
+    int bit_count = 0;
+    int value = 0;
+
+    for( in = 0; in < length && data[in] != '='; in++ ) {
+        value = base64_value( data[in] );
+        if( value < 0 ) {
+            return -1;
+        }
+        bits = ( bits << 6 ) | (uint32_t) value;
+        bit_count += 6;
+        if( bit_count >= 8 ) {
+            bit_count -= 8;
+            data[out++] = (char) ( bits >> bit_count );
+        }
+    }
+    return (int32_t) out;
+}
+
+AWSIoTDownload::AWSIoTDownload( const aws_download_params_t& download_params, aws_download_t* download_progress ) :
+        params( download_params ), progress( download_progress )
+{
+    slot = -1;
+    block_size = params.block_size ? params.block_size : AWS_DOWNLOAD_DEFAULT_BLOCK_SIZE;
+    window = params.window ? params.window : AWS_DOWNLOAD_DEFAULT_WINDOW;
+    if( window > AWS_DOWNLOAD_MAX_WINDOW ) {
+        window = AWS_DOWNLOAD_MAX_WINDOW;
+    }
+    cursor = 0;
+    timeouts = 0;
+    error = CY_RSLT_SUCCESS;
+    memset( requests, 0, sizeof(requests) );
+    request_topic[0] = block_topic[0] = reject_topic[0] = '\0';
+}
+
+AWSIoTDownload::~AWSIoTDownload()
+{
+    if( slot >= 0 ) {
+        core_util_atomic_store_ptr( &downloads[slot], NULL );
+    }
+}
+
+cy_rslt_t AWSIoTDownload::start()
+{
+    uint32_t block_count = 0;
+    void* expected = NULL;
+    int i = 0;
+    int n = 0;
+
+    if( params.thing_name == NULL || params.stream_id == NULL || params.sink == NULL || params.file_size == 0 ) {
+        AWS_LIBRARY_ERROR(("Invalid download parameters \n"));
+        return CY_RSLT_AWS_ERROR_DOWNLOAD_FAILED;
+    }
+
+    block_count = ( params.file_size + block_size - 1 ) / block_size;
+    if( block_count > AWS_DOWNLOAD_MAX_BLOCKS ) {
+        AWS_LIBRARY_ERROR(("File has %lu blocks, only %d can be tracked \n", (unsigned long) block_count, AWS_DOWNLOAD_MAX_BLOCKS));
+        return CY_RSLT_AWS_ERROR_BUFFER_OVERFLOW;
+    }
+    if( progress->block_count != 0 && progress->block_count != block_count ) {
+        AWS_LIBRARY_ERROR(("Download resumed with different parameters \n"));
+        return CY_RSLT_AWS_ERROR_DOWNLOAD_FAILED;
+    }
+    progress->block_count = block_count;
+
+    n = snprintf( request_topic, sizeof(request_topic), "$aws/things/%s/streams/%s/get/json", params.thing_name, params.stream_id );
+    if( n <= 0 || n >= (int) sizeof(request_topic) ) {
+        return CY_RSLT_AWS_ERROR_BUFFER_OVERFLOW;
+    }
+    snprintf( block_topic, sizeof(block_topic), "$aws/things/%s/streams/%s/data/json", params.thing_name, params.stream_id );
+    n = snprintf( reject_topic, sizeof(reject_topic), "$aws/things/%s/streams/%s/rejected/json", params.thing_name, params.stream_id );
+    if( n <= 0 || n >= (int) sizeof(reject_topic) ) {
+        return CY_RSLT_AWS_ERROR_BUFFER_OVERFLOW;
+    }
+
+    for( i = 0; i < AWS_MAX_CONNECTIONS; i++ ) {
+        expected = NULL;
+        if( core_util_atomic_cas_ptr( &downloads[i], &expected, this ) ) {
+            slot = i;
+            return CY_RSLT_SUCCESS;
+        }
+    }
+
+    AWS_LIBRARY_ERROR(("Too many downloads active \n"));
+    return CY_RSLT_AWS_ERROR_DOWNLOAD_FAILED;
+}
+
+uint32_t AWSIoTDownload::max_message_length() const
+{
+    return AWS_DOWNLOAD_MESSAGE_OVERHEAD + 4 * ( ( block_size + 2 ) / 3 );
+}
+
+bool AWSIoTDownload::done() const
+{
+    return progress->blocks_received >= progress->block_count;
+}
+
+bool AWSIoTDownload::received( uint32_t block ) const
+{
+    return ( progress->bitmap[block / 8] & ( 1 << ( block % 8 ) ) ) != 0;
+}
+
+bool AWSIoTDownload::in_flight( uint32_t block ) const
+{
+    uint8_t i = 0;
+
+    for( i = 0; i < window; i++ ) {
+        if( requests[i].active && block >= requests[i].first && block < requests[i].first + requests[i].count ) {
+            return true;
+        }
+    }
+    return false;
+}
+
+/* A request is finished once all of its blocks are in, which frees its place in the window */
+void AWSIoTDownload::retire()
+{
+    uint8_t i = 0;
+    uint32_t block = 0;
+
+    for( i = 0; i < window; i++ ) {
+        if( !requests[i].active ) {
+            continue;
+        }
+        for( block = requests[i].first; block < requests[i].first + requests[i].count && received( block ); block++ ) {
+        }
+        if( block == requests[i].first + requests[i].count ) {
+            requests[i].active = false;
+        }
+    }
+}
+
+int AWSIoTDownload::next_request( char* buffer, uint32_t size, uint64_t now_ms )
+{
+    uint8_t i = 0;
+    uint32_t first = 0;
+    uint32_t count = 0;
+    int length = 0;
+
+    retire();
+
+    for( i = 0; i < window && requests[i].active; i++ ) {
+    }
+    if( i == window ) {
+        return 0;
+    }
+
+    for( first = cursor; first < progress->block_count && ( received( first ) || in_flight( first ) ); first++ ) {
+    }
+    if( first == progress->block_count ) {
+        /* the rest is in flight; gaps are requested again when their request times out */
+        cursor = first;
+        return 0;
+    }
+
+    for( count = 1; count < AWS_DOWNLOAD_BLOCKS_PER_REQUEST && first + count < progress->block_count &&
+            !received( first + count ) && !in_flight( first + count ); count++ ) {
+    }
+
+    length = snprintf( buffer, size, "{\"c\":\"" AWS_DOWNLOAD_CLIENT_TOKEN "\",\"f\":%u,\"l\":%lu,\"o\":%lu,\"n\":%lu}",
+            params.file_id, (unsigned long) block_size, (unsigned long) first, (unsigned long) count );
+    if( length <= 0 || length >= (int) size ) {
+        return 0;
+    }
+
+    requests[i].active = true;
+    requests[i].first = first;
+    requests[i].count = count;
+    requests[i].sent_ms = now_ms;
+    cursor = first + count;
+    progress->requests++;
+
+    return length;
+}
+
+cy_rslt_t AWSIoTDownload::check( uint64_t now_ms, uint32_t timeout_ms )
+{
+    uint8_t i = 0;
+
+    if( error != CY_RSLT_SUCCESS ) {
+        return error;
+    }
+
+    retire();
+
+    for( i = 0; i < window; i++ ) {
+        if( !requests[i].active || now_ms - requests[i].sent_ms <= timeout_ms ) {
+            continue;
+        }
+
+        requests[i].active = false;
+        if( requests[i].first < cursor ) {
+            cursor = requests[i].first;
+        }
+        progress->retries++;
+
+        if( ++timeouts > AWS_DOWNLOAD_MAX_RETRIES ) {
+            AWS_LIBRARY_ERROR(("No block received after %d requests timed out \n", AWS_DOWNLOAD_MAX_RETRIES));
+            return CY_RSLT_AWS_ERROR_DOWNLOAD_FAILED;
+        }
+    }
+
+    return CY_RSLT_SUCCESS;
+}
+
+void AWSIoTDownload::deliver( char* payload, uint32_t length )
+{
+    const char* end = payload + length;
+    const char* value = NULL;
+    char* data = NULL;
+    uint32_t data_length = 0;
+    uint32_t block = 0;
+    uint32_t expected = 0;
+    int32_t decoded = 0;
+
+    value = json_value( payload, length, 'f' );
+    if( value == NULL || (uint16_t) strtoul( value, NULL, 10 ) != params.file_id ) {
+        return;
+    }
+
+    value = json_value( payload, length, 'i' );
+    if( value == NULL ) {
+        return;
+    }
+    block = strtoul( value, NULL, 10 );
+    if( block >= progress->block_count ) {
+        return;
+    }
+    if( received( block ) ) {
+        progress->duplicates++;
+        return;
+    }
+
+    value = json_value( payload, length, 'p' );
+    if( value == NULL || *value != '"' ) {
+        return;
+    }
+    data = (char*) value + 1;
+    while( data + data_length < end && data[data_length] != '"' ) {
+        data_length++;
+    }
+
+    expected = ( block == progress->block_count - 1 ) ? params.file_size - block * block_size : block_size;
+    decoded = base64_decode_in_place( data, data_length );
+    if( decoded < 0 || (uint32_t) decoded != expected ) {
+        AWS_LIBRARY_DEBUG(("Dropping malformed block %lu \n", (unsigned long) block));
+        return;
+    }
+
+    if( params.sink( block * block_size, (const uint8_t*) data, expected, params.sink_arg ) != (int32_t) expected ) {
+        AWS_LIBRARY_ERROR(("Sink failed to write block %lu \n", (unsigned long) block));
+        error = CY_RSLT_AWS_ERROR_DOWNLOAD_FAILED;
+        return;
+    }
+
+    progress->bitmap[block / 8] |= (uint8_t) ( 1 << ( block % 8 ) );
+    progress->blocks_received++;
+    timeouts = 0;
+}
+
+void AWSIoTDownload::block_received( MQTT::MessageData& message )
+{
+    AWSIoTDownload* download = NULL;
+    int i = 0;
+
+    for( i = 0; i < AWS_MAX_CONNECTIONS; i++ ) {
+        download = (AWSIoTDownload*) core_util_atomic_load_ptr( &downloads[i] );
+        if( download != NULL && topic_equals( message, download->block_topic ) ) {
+            download->deliver( (char*) message.message.payload, message.message.payloadlen );
+            return;
+        }
+    }
+}
+
+void AWSIoTDownload::request_rejected( MQTT::MessageData& message )
+{
+    AWSIoTDownload* download = NULL;
+    int i = 0;
+
+    for( i = 0; i < AWS_MAX_CONNECTIONS; i++ ) {
+        download = (AWSIoTDownload*) core_util_atomic_load_ptr( &downloads[i] );
+        if( download != NULL && topic_equals( message, download->reject_topic ) ) {
+            AWS_LIBRARY_ERROR(("Block request rejected : %.*s \n", (int) message.message.payloadlen, (char*) message.message.payload));
+            download->error = CY_RSLT_AWS_ERROR_DOWNLOAD_FAILED;
+            return;
+        }
+    }
+}
@@ -0,0 +1,141 @@
+/*
+ * Copyright 2019-2020 Cypress Semiconductor Corporation
+ * SPDX-License-Identifier: Apache-2.0
+ * 
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ * 
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ * 
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+/** @file
+ *  Block-stream file download over AWS IoT MQTT-based file delivery
+ */
+#ifndef AWS_DOWNLOAD_H
+#define AWS_DOWNLOAD_H
+
+#include "mbed.h"
+#include "aws_common.h"
+#include "MQTTClient.h"
+
+/**
+ * @addtogroup aws_iot_classes
+ *
+ * @{
+ */
+
+/** Request scheduling and block reassembly of a file download.
+ *
+ * Blocks are requested from the stream's "get" topic in runs of up to @ref AWS_DOWNLOAD_BLOCKS_PER_REQUEST, with up to
+ * 'window' requests in flight, so the link stays busy instead of carrying one block per round trip. Blocks arrive on
+ * the stream's "data" topic in any order. Each is base64-decoded in place in the MQTT client's receive buffer and
+ * handed straight to the sink, and a bit is set in the caller-owned bitmap ( @ref aws_download_t ). A request that
+ * has not delivered all of its blocks in time is dropped, and its missing blocks are requested again.
+ *
+ * The MQTT client only takes plain function pointers as message handlers, so active downloads are registered in a
+ * static table and found again by topic.
+ */
+class AWSIoTDownload
+{
+public:
+    /** Constructor of AWSIoTDownload class.
+     *
+     * @param[in] params          : Download parameters; must stay valid while the download is active
+     * @param[in] progress        : Progress of the download, updated as blocks arrive
+     *
+     */
+    AWSIoTDownload( const aws_download_params_t& params, aws_download_t* progress );
+
+    /** Unregisters the download. */
+    ~AWSIoTDownload();
+
+    /** Validates the parameters, builds the stream topics and registers the download with the message handlers.
+     *
+     * @return cy_rslt_t          : CY_RSLT_SUCCESS - on success,
+     *                              CY_RSLT_AWS_ERROR_BUFFER_OVERFLOW - if a topic is too long or the file has too many blocks,
+     *                              CY_RSLT_AWS_ERROR_DOWNLOAD_FAILED - if the parameters are invalid or too many downloads are active ( @ref aws_iot_defines )
+     */
+    cy_rslt_t start();
+
+    /** Returns the topic blocks are requested on. */
+    const char* get_topic() const { return request_topic; }
+
+    /** Returns the topic blocks arrive on. */
+    const char* data_topic() const { return block_topic; }
+
+    /** Returns the topic rejected requests are reported on. */
+    const char* rejected_topic() const { return reject_topic; }
+
+    /** Returns the size of the largest data message, topic excluded. */
+    uint32_t max_message_length() const;
+
+    /** Returns true once every block has been written to the sink. */
+    bool done() const;
+
+    /** Builds the next block request, if the window has room and blocks are left to request.
+     *
+     * @param[out] buffer         : Request payload
+     * @param[in]  size           : Size of 'buffer'
+     * @param[in]  now_ms         : Current time in milliseconds
+     *
+     * @return int                : Length of the payload; 0 if nothing is to be requested now
+     */
+    int next_request( char* buffer, uint32_t size, uint64_t now_ms );
+
+    /** Drops requests that timed out, so their missing blocks are requested again.
+     *
+     * @param[in] now_ms          : Current time in milliseconds
+     * @param[in] timeout_ms      : Time allowed for a request to deliver its blocks
+     *
+     * @return cy_rslt_t          : CY_RSLT_SUCCESS - while the download can go on,
+     *                              CY_RSLT_AWS_ERROR_DOWNLOAD_FAILED - if it was rejected, the sink failed or retries ran out ( @ref aws_iot_defines )
+     */
+    cy_rslt_t check( uint64_t now_ms, uint32_t timeout_ms );
+
+    /** Message handler for the data topic. */
+    static void block_received( MQTT::MessageData& message );
+
+    /** Message handler for the rejected topic. */
+    static void request_rejected( MQTT::MessageData& message );
+
+private:
+    struct request
+    {
+        bool     active;
+        uint32_t first;
+        uint32_t count;
+        uint64_t sent_ms;
+    };
+
+    bool received( uint32_t block ) const;
+    bool in_flight( uint32_t block ) const;
+    void retire();
+    void deliver( char* payload, uint32_t length );
+
+    const aws_download_params_t& params;
+    aws_download_t* progress;
+    int slot;
+    uint32_t block_size;
+    uint8_t window;
+    uint32_t cursor;
+    uint8_t timeouts;
+    cy_rslt_t error;
+    request requests[AWS_DOWNLOAD_MAX_WINDOW];
+    char request_topic[AWS_DOWNLOAD_TOPIC_MAX_LENGTH];
+    char block_topic[AWS_DOWNLOAD_TOPIC_MAX_LENGTH];
+    char reject_topic[AWS_DOWNLOAD_TOPIC_MAX_LENGTH];
+};
+
+/**
+ * @}
+ */
+
+#endif
@@ -0,0 +1,117 @@
+/*
+ * Copyright 2019-2020 Cypress Semiconductor Corporation
+ * SPDX-License-Identifier: Apache-2.0
+ * 
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ * 
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ * 
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+
+/** @file
+ *
+ * Implementation for AWS IoT QoS1 duplicate filter
+ *
+ */
+#include "aws_duplicate_filter.h"
+#include "string.h"
+
+#if ( AWS_DUPLICATE_WINDOW_SIZE & ( AWS_DUPLICATE_WINDOW_SIZE - 1 ) ) != 0
+#error "AWS_DUPLICATE_WINDOW_SIZE must be a power of two"
+#endif
+
+#if AWS_DISPATCH_MAX_SUBSCRIPTIONS > 32
+#error "AWS_DISPATCH_MAX_SUBSCRIPTIONS exceeds the subscriber bits of a window entry"
+#endif
+
+/* 32-bit FNV-1a */
+static uint32_t duplicate_hash( uint32_t hash, const void* data, size_t length )
+{
+    const uint8_t* bytes = (const uint8_t*) data;
+    size_t i = 0;
+
+    for( i = 0; i < length; i++ ) {
+        hash = ( hash ^ bytes[i] ) * 16777619u;
+    }
+    return hash;
+}
+
+AWSIoTDuplicateFilter::AWSIoTDuplicateFilter()
+{
+    aws_duplicate_filter_params_t params;
+
+    memset( &params, 0, sizeof(params) );
+    configure( params );
+    drops = 0;
+}
+
+void AWSIoTDuplicateFilter::configure( const aws_duplicate_filter_params_t& params )
+{
+    match_payload = ( params.match_payload != 0 );
+    /* without the hash, an identifier reused for a new message would be dropped */
+    ignore_dup_flag = match_payload && ( params.ignore_dup_flag != 0 );
+    reset();
+}
+
+void AWSIoTDuplicateFilter::reset()
+{
+    memset( window, 0, sizeof(window) );
+}
+
+bool AWSIoTDuplicateFilter::duplicate( uint8_t subscriber, MQTT::MessageData& message )
+{
+    entry* e = &window[message.message.id & ( AWS_DUPLICATE_WINDOW_SIZE - 1 )];
+    uint32_t bit = 1u << subscriber;
+    uint32_t hash = 0;
+
+    if( message.message.qos != MQTT::QOS1 || message.message.id == 0 ) {
+        return false;
+    }
+
+    if( match_payload ) {
+        hash = 2166136261u;
+        if( message.topicName.cstring != NULL ) {
+            hash = duplicate_hash( hash, message.topicName.cstring, strlen( message.topicName.cstring ) );
+        } else {
+            hash = duplicate_hash( hash, message.topicName.lenstring.data, message.topicName.lenstring.len );
+        }
+        hash = duplicate_hash( hash, message.message.payload, message.message.payloadlen );
+    }
+
+    if( e->id != message.message.id || e->hash != hash ) {
+        /* new identifier, or one the broker reused for another message */
+        e->id = message.message.id;
+        e->hash = hash;
+        e->subscribers = bit;
+        return false;
+    }
+
+    if( ( e->subscribers & bit ) == 0 ) {
+        /* same packet, handed to another matching subscription */
+        e->subscribers |= bit;
+        return false;
+    }
+
+    if( message.message.dup || ignore_dup_flag ) {
+        drops++;
+        return true;
+    }
+
+    /* identifier reused for the same content without the DUP flag: a new message */
+    e->subscribers = bit;
+    return false;
+}
+
+uint32_t AWSIoTDuplicateFilter::dropped() const
+{
+    return drops;
+}
@@ -0,0 +1,94 @@
+/*
+ * Copyright 2019-2020 Cypress Semiconductor Corporation
+ * SPDX-License-Identifier: Apache-2.0
+ * 
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ * 
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ * 
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+
+/** @file
+ *  Window of recently received QoS1 packet identifiers, used to drop redeliveries
+ */
+#ifndef AWS_DUPLICATE_FILTER_H
+#define AWS_DUPLICATE_FILTER_H
+
+#include "mbed.h"
+#include "aws_common.h"
+#include "MQTTClient.h"
+
+/**
+ * @addtogroup aws_iot_classes
+ *
+ * @{
+ */
+
+/** Receive-side duplicate filter for QoS1 messages.
+ *
+ * A broker that does not get a PUBACK in time sends the message again with the same packet identifier and the DUP flag set.
+ * The filter keeps a fixed window of the AWS_DUPLICATE_WINDOW_SIZE most recent packet identifiers, indexed by the low bits
+ * of the identifier: brokers hand out identifiers in sequence, so the recent ones land in distinct entries and a lookup
+ * is a single compare. Each entry remembers which subscriptions already got the message, since the MQTT client hands
+ * a message matching several topic filters to each of them. Optionally a hash of topic and payload is kept as well,
+ * so that an identifier reused for new content is not taken for a redelivery.
+ *
+ * The filter is not thread safe; @ref AWSIoTDispatcher serializes calls.
+ */
+class AWSIoTDuplicateFilter
+{
+public:
+    /** Default constructor of AWSIoTDuplicateFilter class. The window starts empty. */
+    AWSIoTDuplicateFilter();
+
+    /** Configures the filter and empties the window.
+     *
+     * @param[in] params          : Duplicate filter parameters
+     *
+     */
+    void configure( const aws_duplicate_filter_params_t& params );
+
+    /** Empties the window, for example when a clean session starts. Counters are kept. */
+    void reset();
+
+    /** Checks a received message and records it in the window.
+     *
+     * @param[in] subscriber      : Index (below 32) of the subscription the message is delivered to
+     * @param[in] message         : Message received by the MQTT client
+     *
+     * @return bool               : true if the subscription already got this message and it must be dropped
+     */
+    bool duplicate( uint8_t subscriber, MQTT::MessageData& message );
+
+    /** Returns the number of messages dropped since construction. */
+    uint32_t dropped() const;
+
+private:
+    /** Recently received packet identifier; identifier 0 is never used by MQTT and marks an empty entry */
+    struct entry
+    {
+        uint16_t id;
+        uint32_t hash;
+        uint32_t subscribers;       /**< Bit per subscription that got the message */
+    };
+
+    entry window[AWS_DUPLICATE_WINDOW_SIZE];
+    bool match_payload;
+    bool ignore_dup_flag;
+    uint32_t drops;
+};
+
+/**
+ * @}
+ */
+
+#endif
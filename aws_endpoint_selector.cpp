@@ -0,0 +1,346 @@
+/*
+ * Copyright 2019-2020 Cypress Semiconductor Corporation
+ * SPDX-License-Identifier: Apache-2.0
+ * 
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ * 
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ * 
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+
+/** @file
+ *
+ * Implementation for RTT-ranked Greengrass core endpoint selection
+ *
+ */
+#include "aws_endpoint_selector.h"
+#include "string.h"
+#include "stdlib.h"
+
+AWSIoTEndpointSelector::AWSIoTEndpointSelector() : wake( mutex )
+{
+    count = 0;
+    generation = 0;
+    thread = NULL;
+    probe_network = NULL;
+    interval_ms = 0;
+    stopping = false;
+}
+
+AWSIoTEndpointSelector::~AWSIoTEndpointSelector()
+{
+    stop();
+}
+
+cy_rslt_t AWSIoTEndpointSelector::add( const char* host, uint16_t port, const char* root_ca, uint16_t root_ca_length )
+{
+    cy_rslt_t result = CY_RSLT_SUCCESS;
+    endpoint* ep = NULL;
+
+    if( host == NULL || strlen( host ) > AWS_ENDPOINT_HOST_MAX_LENGTH ) {
+        AWS_LIBRARY_ERROR(("Endpoint host name invalid or too long \n"));
+        return CY_RSLT_AWS_ERROR_BUFFER_OVERFLOW;
+    }
+
+    mutex.lock();
+
+    if( count == AWS_ENDPOINT_SELECTOR_MAX_ENDPOINTS ) {
+        AWS_LIBRARY_ERROR(("Endpoint selector full, dropping %s:%d \n", host, port));
+        result = CY_RSLT_AWS_ERROR_BUFFER_OVERFLOW;
+        goto exit;
+    }
+
+    ep = &endpoints[count];
+    memset( ep, 0, sizeof(*ep) );
+    strcpy( ep->host, host );
+    ep->port = port;
+    ep->root_ca = root_ca;
+    ep->root_ca_length = root_ca_length;
+    count++;
+
+exit:
+    mutex.unlock();
+    return result;
+}
+
+cy_rslt_t AWSIoTEndpointSelector::add_groups( cy_linked_list_t* groups )
+{
+    cy_rslt_t result = CY_RSLT_SUCCESS;
+    cy_linked_list_node_t* group_node = NULL;
+    cy_linked_list_node_t* connection_node = NULL;
+    aws_greengrass_core_t* core = NULL;
+    aws_greengrass_core_connection_t* connection = NULL;
+
+    if( groups == NULL ) {
+        return CY_RSLT_SUCCESS;
+    }
+
+    for( group_node = groups->front; group_node != NULL; group_node = group_node->next ) {
+        core = (aws_greengrass_core_t*) group_node->data;
+        for( connection_node = core->info.connections.front; connection_node != NULL; connection_node = connection_node->next ) {
+            connection = (aws_greengrass_core_connection_t*) connection_node->data;
+            result = add( connection->info.ip_address, (uint16_t) atoi( connection->info.port ),
+                          core->info.root_ca_certificate, core->info.root_ca_length );
+            if( result != CY_RSLT_SUCCESS ) {
+                return result;
+            }
+        }
+    }
+
+    return CY_RSLT_SUCCESS;
+}
+
+void AWSIoTEndpointSelector::clear()
+{
+    mutex.lock();
+    count = 0;
+    /* in-flight probe results belong to the old list and must not land on reused slots */
+    generation++;
+    mutex.unlock();
+}
+
+uint32_t AWSIoTEndpointSelector::score( const endpoint& ep ) const
+{
+    uint64_t total = ep.srtt_us;
+
+    if( ep.probes == 0 || ep.srtt_us == 0 ) {
+        /* never reached yet: rank behind anything that answered within the probe timeout */
+        total = (uint64_t) AWS_ENDPOINT_PROBE_TIMEOUT * 1000;
+    }
+
+    /* a few thousand failures would wrap a 32 bit score and rank a dead endpoint first */
+    total += (uint64_t) ep.failures * AWS_ENDPOINT_FAILURE_PENALTY;
+
+    return ( total > UINT32_MAX ) ? UINT32_MAX : (uint32_t) total;
+}
+
+bool AWSIoTEndpointSelector::probe_one( NetworkInterface* network, const char* host, uint16_t port, uint32_t* rtt_us )
+{
+    TCPSocket socket;
+    SocketAddress address;
+    Timer timer;
+    nsapi_error_t error = NSAPI_ERROR_OK;
+
+    if( network->gethostbyname( host, &address ) != NSAPI_ERROR_OK ) {
+        return false;
+    }
+    address.set_port( port );
+
+    if( socket.open( network ) != NSAPI_ERROR_OK ) {
+        return false;
+    }
+    socket.set_timeout( AWS_ENDPOINT_PROBE_TIMEOUT );
+
+    /* only the TCP handshake is timed; name resolution is usually answered from the cache */
+    timer.start();
+    error = socket.connect( address );
+    timer.stop();
+    socket.close();
+
+    if( error != NSAPI_ERROR_OK && error != NSAPI_ERROR_IS_CONNECTED ) {
+        AWS_LIBRARY_DEBUG(("Probe of %s:%d failed : %d \n", host, port, error));
+        return false;
+    }
+
+    *rtt_us = (uint32_t) timer.read_us();
+    if( *rtt_us == 0 ) {
+        *rtt_us = 1;
+    }
+    return true;
+}
+
+void AWSIoTEndpointSelector::probe( NetworkInterface* network )
+{
+    uint8_t i = 0;
+    uint32_t gen = 0;
+    char host[AWS_ENDPOINT_HOST_MAX_LENGTH + 1];
+    uint16_t port = 0;
+    uint32_t rtt_us = 0;
+    bool reachable = false;
+
+    for( i = 0; ; i++ ) {
+        /* copy the endpoint out so the connect runs without holding the lock */
+        mutex.lock();
+        if( i >= count || stopping ) {
+            mutex.unlock();
+            break;
+        }
+        strcpy( host, endpoints[i].host );
+        port = endpoints[i].port;
+        gen = generation;
+        mutex.unlock();
+
+        reachable = probe_one( network, host, port, &rtt_us );
+
+        mutex.lock();
+        if( gen == generation && i < count ) {
+            endpoint& ep = endpoints[i];
+            ep.probes++;
+            if( reachable ) {
+                ep.last_rtt_us = rtt_us;
+                ep.srtt_us = ( ep.srtt_us == 0 ) ? rtt_us : ( ( 7 * (uint64_t) ep.srtt_us + rtt_us ) / 8 );
+                ep.failures = 0;
+            } else if( ep.failures < UINT16_MAX ) {
+                ep.failures++;
+            }
+        }
+        mutex.unlock();
+    }
+}
+
+void AWSIoTEndpointSelector::probe_main()
+{
+    NetworkInterface* network = NULL;
+
+    mutex.lock();
+    while( !stopping ) {
+        network = probe_network;
+        mutex.unlock();
+
+        probe( network );
+
+        mutex.lock();
+        if( !stopping ) {
+            wake.wait_for( interval_ms );
+        }
+    }
+    mutex.unlock();
+}
+
+cy_rslt_t AWSIoTEndpointSelector::start( NetworkInterface* network, uint32_t interval )
+{
+    if( network == NULL ) {
+        return CY_RSLT_AWS_ERROR_CONNECT_FAILED;
+    }
+
+    stop();
+
+    mutex.lock();
+    probe_network = network;
+    interval_ms = interval;
+    stopping = false;
+    mutex.unlock();
+
+    thread = new Thread( osPriorityBelowNormal, AWS_ENDPOINT_PROBE_STACK_SIZE );
+    thread->start( callback( this, &AWSIoTEndpointSelector::probe_main ) );
+
+    return CY_RSLT_SUCCESS;
+}
+
+void AWSIoTEndpointSelector::stop()
+{
+    if( thread == NULL ) {
+        return;
+    }
+
+    mutex.lock();
+    stopping = true;
+    wake.notify_all();
+    mutex.unlock();
+
+    thread->join();
+    delete thread;
+    thread = NULL;
+
+    mutex.lock();
+    stopping = false;
+    mutex.unlock();
+}
+
+uint8_t AWSIoTEndpointSelector::get_ranked( uint8_t* ids, uint8_t max )
+{
+    uint8_t i = 0;
+    uint8_t j = 0;
+    uint8_t n = 0;
+    uint32_t scores[AWS_ENDPOINT_SELECTOR_MAX_ENDPOINTS];
+    uint8_t order[AWS_ENDPOINT_SELECTOR_MAX_ENDPOINTS];
+
+    mutex.lock();
+
+    n = ( count < max ) ? count : max;
+
+    /* stable insertion sort over the whole list, then truncate; ties keep the discovery order */
+    for( i = 0; i < count; i++ ) {
+        uint32_t s = score( endpoints[i] );
+        for( j = i; j > 0 && scores[j - 1] > s; j-- ) {
+            scores[j] = scores[j - 1];
+            order[j] = order[j - 1];
+        }
+        scores[j] = s;
+        order[j] = i;
+    }
+
+    mutex.unlock();
+
+    memcpy( ids, order, n );
+    return n;
+}
+
+cy_rslt_t AWSIoTEndpointSelector::get_endpoint( uint8_t id, aws_endpoint_params_t* params )
+{
+    cy_rslt_t result = CY_RSLT_SUCCESS;
+
+    mutex.lock();
+
+    if( id >= count ) {
+        result = CY_RSLT_AWS_ERROR_CONNECT_FAILED;
+        goto exit;
+    }
+
+    params->transport = AWS_TRANSPORT_MQTT_NATIVE;
+    params->uri = endpoints[id].host;
+    params->port = endpoints[id].port;
+    params->root_ca = endpoints[id].root_ca;
+    params->root_ca_length = endpoints[id].root_ca_length;
+
+exit:
+    mutex.unlock();
+    return result;
+}
+
+cy_rslt_t AWSIoTEndpointSelector::get_score( uint8_t id, aws_endpoint_score_t* score )
+{
+    cy_rslt_t result = CY_RSLT_SUCCESS;
+
+    mutex.lock();
+
+    if( id >= count ) {
+        result = CY_RSLT_AWS_ERROR_CONNECT_FAILED;
+        goto exit;
+    }
+
+    score->host = endpoints[id].host;
+    score->port = endpoints[id].port;
+    score->srtt_us = endpoints[id].srtt_us;
+    score->last_rtt_us = endpoints[id].last_rtt_us;
+    score->failures = endpoints[id].failures;
+    score->probes = endpoints[id].probes;
+
+exit:
+    mutex.unlock();
+    return result;
+}
+
+void AWSIoTEndpointSelector::report( uint8_t id, bool success )
+{
+    mutex.lock();
+
+    if( id < count ) {
+        if( success ) {
+            endpoints[id].failures = 0;
+        } else if( endpoints[id].failures < UINT16_MAX ) {
+            endpoints[id].failures++;
+        }
+    }
+
+    mutex.unlock();
+}
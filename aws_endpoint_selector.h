@@ -0,0 +1,168 @@
+/*
+ * Copyright 2019-2020 Cypress Semiconductor Corporation
+ * SPDX-License-Identifier: Apache-2.0
+ * 
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ * 
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ * 
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+/** @file
+ *  RTT-ranked selection of Greengrass core endpoints
+ */
+#ifndef AWS_ENDPOINT_SELECTOR_H
+#define AWS_ENDPOINT_SELECTOR_H
+
+#include "mbed.h"
+#include "aws_common.h"
+
+/**
+ * @addtogroup aws_iot_classes
+ *
+ * @{
+ */
+
+/** Ranks Greengrass core endpoints by measured reachability.
+ *
+ * Each endpoint is probed with a plain TCP connect, which is far cheaper than a TLS handshake but still
+ * shows whether the core is reachable over that address and how far away it is. The connect time is
+ * smoothed like TCP's SRTT (1/8 weight per sample), and every consecutive failure adds
+ * @ref AWS_ENDPOINT_FAILURE_PENALTY to the score. Endpoints are ranked by score, lowest first; endpoints
+ * that were never probed rank behind reachable ones and ahead of failing ones.
+ *
+ * Probing can run on a background thread ( @ref start ) or be triggered explicitly ( @ref probe ).
+ * Results of real connects can be fed back with @ref report, which is what @ref AWSIoTClient::connect does
+ * when it fails over along the ranked list.
+ */
+class AWSIoTEndpointSelector
+{
+public:
+    /** Default constructor of AWSIoTEndpointSelector class. The selector starts empty. */
+    AWSIoTEndpointSelector();
+
+    /** Stops background probing. */
+    ~AWSIoTEndpointSelector();
+
+    /** Adds an endpoint.
+     *
+     * @param[in] host            : IP address or host name; copied
+     * @param[in] port            : Port of the endpoint
+     * @param[in] root_ca         : Root CA certificate of the core; kept by reference
+     * @param[in] root_ca_length  : Length of Root CA certificate
+     *
+     * @return cy_rslt_t          : CY_RSLT_SUCCESS - on success,
+     *                              CY_RSLT_AWS_ERROR_BUFFER_OVERFLOW - if the selector is full or the host name is too long ( @ref aws_iot_defines )
+     */
+    cy_rslt_t add( const char* host, uint16_t port, const char* root_ca, uint16_t root_ca_length );
+
+    /** Adds every connection endpoint of every core in a discovery result ( @ref aws_greengrass_discovery_callback_data_t ).
+     *  The root CAs are kept by reference, so the discovery result must stay valid while the selector is used.
+     *
+     * @param[in] groups          : Group list reported by discovery
+     *
+     * @return cy_rslt_t          : CY_RSLT_SUCCESS - on success,
+     *                              CY_RSLT_AWS_ERROR_BUFFER_OVERFLOW - if not all endpoints fit ( @ref aws_iot_defines )
+     */
+    cy_rslt_t add_groups( cy_linked_list_t* groups );
+
+    /** Removes all endpoints. */
+    void clear();
+
+    /** Probes every endpoint once, synchronously.
+     *
+     * @param[in] network         : Network interface to probe over
+     *
+     */
+    void probe( NetworkInterface* network );
+
+    /** Starts probing every endpoint periodically on a background thread.
+     *
+     * @param[in] network         : Network interface to probe over
+     * @param[in] interval        : Time between probe rounds (in ms)
+     *
+     * @return cy_rslt_t          : CY_RSLT_SUCCESS - on success
+     */
+    cy_rslt_t start( NetworkInterface* network, uint32_t interval );
+
+    /** Stops background probing and waits for the probe thread to exit. */
+    void stop();
+
+    /** Returns the endpoints ordered from best to worst.
+     *
+     * @param[out] ids            : Endpoint identifiers, best first
+     * @param[in]  max            : Size of 'ids'
+     *
+     * @return uint8_t            : Number of identifiers written
+     */
+    uint8_t get_ranked( uint8_t* ids, uint8_t max );
+
+    /** Returns the connection parameters of an endpoint, for @ref AWSIoTClient::connect.
+     *
+     * @param[in]  id             : Endpoint identifier from @ref get_ranked
+     * @param[out] params         : Endpoint parameters; the URI points into the selector and stays valid until @ref clear
+     *
+     * @return cy_rslt_t          : CY_RSLT_SUCCESS - on success,
+     *                              CY_RSLT_AWS_ERROR_CONNECT_FAILED - if 'id' is unknown ( @ref aws_iot_defines )
+     */
+    cy_rslt_t get_endpoint( uint8_t id, aws_endpoint_params_t* params );
+
+    /** Returns the measured health of an endpoint.
+     *
+     * @param[in]  id             : Endpoint identifier from @ref get_ranked
+     * @param[out] score          : Endpoint health
+     *
+     * @return cy_rslt_t          : CY_RSLT_SUCCESS - on success,
+     *                              CY_RSLT_AWS_ERROR_CONNECT_FAILED - if 'id' is unknown ( @ref aws_iot_defines )
+     */
+    cy_rslt_t get_score( uint8_t id, aws_endpoint_score_t* score );
+
+    /** Feeds back the outcome of a real connection attempt.
+     *
+     * @param[in] id              : Endpoint identifier from @ref get_ranked
+     * @param[in] success         : true if the connect succeeded
+     *
+     */
+    void report( uint8_t id, bool success );
+
+private:
+    struct endpoint
+    {
+        char host[AWS_ENDPOINT_HOST_MAX_LENGTH + 1];
+        uint16_t port;
+        const char* root_ca;
+        uint16_t root_ca_length;
+        uint32_t srtt_us;
+        uint32_t last_rtt_us;
+        uint16_t failures;
+        uint32_t probes;
+    };
+
+    uint32_t score( const endpoint& ep ) const;
+    bool probe_one( NetworkInterface* network, const char* host, uint16_t port, uint32_t* rtt_us );
+    void probe_main();
+
+    Mutex mutex;
+    ConditionVariable wake;
+    endpoint endpoints[AWS_ENDPOINT_SELECTOR_MAX_ENDPOINTS];
+    uint8_t count;
+    uint32_t generation;
+    Thread* thread;
+    NetworkInterface* probe_network;
+    uint32_t interval_ms;
+    bool stopping;
+};
+
+/**
+ * @}
+ */
+
+#endif
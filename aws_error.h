@@ -100,6 +100,27 @@
 /** Buffer overflow while receiving packet */
 #define CY_RSLT_AWS_ERROR_BUFFER_OVERFLOW           (cy_rslt_t)(CY_RSLT_AWS_ERR_BASE + 12)
 
+/** Requested protocol or feature is not supported */
+#define CY_RSLT_AWS_ERROR_UNSUPPORTED               (cy_rslt_t)(CY_RSLT_AWS_ERR_BASE + 13)
+
+/** No free slot in the submission queue */
+#define CY_RSLT_AWS_ERROR_QUEUE_FULL                (cy_rslt_t)(CY_RSLT_AWS_ERR_BASE + 14)
+
+/** File download rejected by the server, aborted by the storage sink or out of retries */
+#define CY_RSLT_AWS_ERROR_DOWNLOAD_FAILED           (cy_rslt_t)(CY_RSLT_AWS_ERR_BASE + 15)
+
+/** Queued message discarded because its time-to-live ran out before it could be sent */
+#define CY_RSLT_AWS_ERROR_EXPIRED                   (cy_rslt_t)(CY_RSLT_AWS_ERR_BASE + 16)
+
+/** Session journal could not be read or written */
+#define CY_RSLT_AWS_ERROR_JOURNAL_FAILED            (cy_rslt_t)(CY_RSLT_AWS_ERR_BASE + 17)
+
+/** No value cached for the topic */
+#define CY_RSLT_AWS_ERROR_NOT_CACHED                (cy_rslt_t)(CY_RSLT_AWS_ERR_BASE + 18)
+
+/** Credentials still attached to an open connection */
+#define CY_RSLT_AWS_ERROR_IN_USE                    (cy_rslt_t)(CY_RSLT_AWS_ERR_BASE + 19)
+
 /**
  * @}
  */
@@ -152,7 +152,7 @@ static void greengrass_initialize_core_node( char* group_id, uint16_t length )
     if( !group_id || !length )
         return;
 
-    core = malloc( sizeof(aws_greengrass_core_t) );
+    core = calloc( 1, sizeof(aws_greengrass_core_t) );
     if( !core )
     {
         return;
@@ -172,12 +172,43 @@ static void greengrass_initialize_core_node( char* group_id, uint16_t length )
     return;
 }
 
+/* Replace the '\' 'n' sequences which AWS adds to the root CA cert by newlines; copies runs between escapes with memcpy */
+static uint16_t greengrass_unescape_newlines( char* dst, const char* src, uint16_t length )
+{
+    const char* end = src + length;
+    const char* escape = NULL;
+    char* out = dst;
+    size_t run = 0;
+
+    while( src < end )
+    {
+        escape = memchr( src, '\\', (size_t)(end - src) );
+        run = (size_t)( ( escape ? escape : end ) - src );
+        memcpy( out, src, run );
+        out += run;
+        src += run;
+        if( !escape )
+        {
+            break;
+        }
+
+        if( ( src + 1 < end ) && ( 'n' == *(src + 1) ) )
+        {
+            *out++ = '\n';
+            src += 2;
+        }
+        else
+        {
+            *out++ = *src++;
+        }
+    }
+
+    return (uint16_t)( out - dst );
+}
+
 static void greengrass_add_core_root_ca( char* root_ca, uint16_t length )
 {
-    char* src;
-    char* dst;
-    int i = 0;
-    int count = 0;
+    uint16_t unescaped_length = 0;
 
     cy_linked_list_node_t* node = NULL;
     aws_greengrass_core_t* core = NULL;
@@ -193,24 +224,14 @@ static void greengrass_add_core_root_ca( char* root_ca, uint16_t length )
     info = &core->info;
 
     info->root_ca_certificate = malloc((size_t)length + 1);
-
-    /* Remove '\' 'n' characters which is added by AWS in the root CA cert. */
-    src = root_ca;
-    dst = info->root_ca_certificate;
-    for (i = 0; i < length; i++)
+    if( !info->root_ca_certificate )
     {
-        if ( ('\\' == *src) && ('n' == *(src + 1)) )
-        {
-            src += 2;
-            *dst++ = '\n';
-            i++;
-            count++;
-            continue;
-        }
-        *dst++ = *src++;
+        return;
     }
 
-    info->root_ca_certificate[length-count] = '\0';
+    unescaped_length = greengrass_unescape_newlines( info->root_ca_certificate, root_ca, length );
+    info->root_ca_certificate[unescaped_length] = '\0';
+    info->root_ca_length = unescaped_length;
     return;
 }
 
@@ -321,7 +342,7 @@ static void greengrass_initialize_connection_node( char* host_address, uint16_t
     connection_list = &core_info->connections;
 
     /* hostAddress field indicates start of a new connection entry for this core */
-    connection = malloc(sizeof(aws_greengrass_core_connection_t) );
+    connection = calloc( 1, sizeof(aws_greengrass_core_connection_t) );
     if( !connection )
     {
         return;
@@ -341,6 +362,44 @@ static void greengrass_initialize_connection_node( char* host_address, uint16_t
     return;
 }
 
+void aws_greengrass_discovery_reset( void )
+{
+    cy_linked_list_node_t* node = NULL;
+    cy_linked_list_node_t* connection_node = NULL;
+    aws_greengrass_core_t* core = NULL;
+    aws_greengrass_core_connection_t* connection = NULL;
+
+    json_object_counter = 0;
+    gg_group_found = 0;
+
+    if( !group_list )
+    {
+        return;
+    }
+
+    while( group_list->count > 0 && cy_linked_list_remove_node_from_front( group_list, &node ) == CY_RSLT_SUCCESS )
+    {
+        core = (aws_greengrass_core_t*)node->data;
+        while( core->info.connections.count > 0 &&
+               cy_linked_list_remove_node_from_front( &core->info.connections, &connection_node ) == CY_RSLT_SUCCESS )
+        {
+            connection = (aws_greengrass_core_connection_t*)connection_node->data;
+            free( connection->info.ip_address );
+            free( connection->info.port );
+            free( connection->info.metadata );
+            free( connection );
+        }
+        free( core->info.group_id );
+        free( core->info.thing_arn );
+        free( core->info.root_ca_certificate );
+        free( core );
+    }
+
+    cy_linked_list_deinit( group_list );
+    free( group_list );
+    group_list = NULL;
+}
+
 cy_rslt_t json_callback_for_discovery_payload (cy_JSON_object_t* json_object )
 {
     /* Make sure that first JSON object is "GGGroups"; if we find it, all good; else it is probably not a valid json payload */
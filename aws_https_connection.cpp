@@ -0,0 +1,388 @@
+/*
+ * Copyright 2019-2020 Cypress Semiconductor Corporation
+ * SPDX-License-Identifier: Apache-2.0
+ * 
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ * 
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ * 
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+/** @file
+ *
+ * Implementation for persistent HTTPS connection used for Greengrass discovery and RESTful publishes
+ *
+ */
+#include "aws_https_connection.h"
+#include "string.h"
+#include "stdlib.h"
+
+AWSIoTHttpsConnection::AWSIoTHttpsConnection()
+{
+    socket = NULL;
+    host[0] = '\0';
+    port = 0;
+    connects = 0;
+#ifdef AWS_IOT_STATIC_ALLOCATION
+    /* sized for the largest response accepted, so on_body never needs to grow it */
+    body = body_storage;
+    body_capacity = sizeof(body_storage);
+#else
+    body = NULL;
+    body_capacity = 0;
+#endif
+    body_length = 0;
+    body_overflow = false;
+    message_complete = false;
+    keep_alive = false;
+    rx_start = 0;
+    rx_end = 0;
+
+    http_parser_settings_init( &settings );
+    settings.on_body = on_body;
+    settings.on_message_complete = on_message_complete;
+}
+
+AWSIoTHttpsConnection::~AWSIoTHttpsConnection()
+{
+    close();
+#ifndef AWS_IOT_STATIC_ALLOCATION
+    free( body );
+#endif
+}
+
+void AWSIoTHttpsConnection::close()
+{
+    if( socket != NULL ) {
+        socket->close();
+        socket_storage.destroy();
+        socket = NULL;
+    }
+    AWSIoTCredentials::release( &socket_credentials );
+    host[0] = '\0';
+    port = 0;
+    rx_start = 0;
+    rx_end = 0;
+}
+
+uint32_t AWSIoTHttpsConnection::get_connects() const
+{
+    return connects;
+}
+
+cy_rslt_t AWSIoTHttpsConnection::open( NetworkInterface* network, AWSIoTCredentials* credentials, const char* host, uint16_t port, const char* root_ca, uint16_t root_ca_length )
+{
+    SocketAddress address;
+    nsapi_error_t ret = NSAPI_ERROR_OK;
+    cy_rslt_t result = CY_RSLT_SUCCESS;
+
+    if( socket != NULL && AWSIoTHttpsConnection::port == port && strcmp( AWSIoTHttpsConnection::host, host ) == 0 ) {
+        return CY_RSLT_SUCCESS;
+    }
+    close();
+
+    if( strlen( host ) > AWS_GG_HTTPS_HOST_MAX_LENGTH ) {
+        AWS_LIBRARY_ERROR(("Host name too long : %s \n", host));
+        return CY_RSLT_AWS_ERROR_CONNECT_FAILED;
+    }
+
+    socket = socket_storage.create();
+
+    result = credentials->apply( *socket, root_ca, root_ca_length, &socket_credentials );
+    if( result != CY_RSLT_SUCCESS ) {
+        AWS_LIBRARY_ERROR((" Error in initializing credentials \n"));
+        goto exit;
+    }
+
+    ret = network->gethostbyname( host, &address );
+    if( ret != NSAPI_ERROR_OK ) {
+        AWS_LIBRARY_ERROR((" DNS lookup of %s failed : %d \n", host, ret));
+        result = CY_RSLT_AWS_ERROR_CONNECT_FAILED;
+        goto exit;
+    }
+    address.set_port( port );
+
+    socket->open( network );
+    socket->set_hostname( host );
+    socket->set_timeout( AWS_GREENGRASS_DISCOVERY_TIMEOUT );
+
+    ret = socket->connect( address );
+    if( ret != NSAPI_ERROR_OK ) {
+        AWS_LIBRARY_ERROR((" TLS connection to server failed : %d \n", ret));
+        result = CY_RSLT_AWS_ERROR_CONNECT_FAILED;
+        goto exit;
+    }
+
+    strcpy( AWSIoTHttpsConnection::host, host );
+    AWSIoTHttpsConnection::port = port;
+    connects++;
+    AWS_LIBRARY_DEBUG((" TLS connection to %s:%d established \n", host, port));
+
+    return CY_RSLT_SUCCESS;
+
+exit:
+    socket_storage.destroy();
+    socket = NULL;
+    AWSIoTCredentials::release( &socket_credentials );
+    return result;
+}
+
+cy_rslt_t AWSIoTHttpsConnection::send_all( const char* data, uint32_t length )
+{
+    nsapi_size_or_error_t ret = 0;
+    uint32_t sent = 0;
+
+    while( sent < length ) {
+        ret = socket->send( data + sent, length - sent );
+        if( ret <= 0 ) {
+            AWS_LIBRARY_DEBUG(("Sending request failed : %d \n", (int) ret));
+            return CY_RSLT_AWS_ERROR_HTTP_FAILURE;
+        }
+        sent += ret;
+    }
+
+    return CY_RSLT_SUCCESS;
+}
+
+/* Percent-encodes what may not appear in a path segment; '/' is kept so that MQTT topic levels map to path levels */
+static int append_path_encoded( char* out, int size, const char* resource )
+{
+    static const char hex[] = "0123456789ABCDEF";
+    int length = 0;
+    char c;
+
+    for( ; *resource != '\0'; resource++ ) {
+        c = *resource;
+        if( ( c >= 'A' && c <= 'Z' ) || ( c >= 'a' && c <= 'z' ) || ( c >= '0' && c <= '9' ) || strchr( "-._~!$&'()*+,;=:@/", c ) != NULL ) {
+            if( length + 1 >= size ) {
+                return -1;
+            }
+            out[length++] = c;
+        } else {
+            if( length + 3 >= size ) {
+                return -1;
+            }
+            out[length++] = '%';
+            out[length++] = hex[ (unsigned char) c >> 4 ];
+            out[length++] = hex[ (unsigned char) c & 0x0F ];
+        }
+    }
+    return length;
+}
+
+cy_rslt_t AWSIoTHttpsConnection::send_request( const request_batch& batch, uint8_t index )
+{
+    char request[AWS_GG_HTTPS_REQUEST_MAX_LENGTH];
+    const post_request* post = ( batch.posts != NULL ) ? &batch.posts[index] : NULL;
+    const char* resource = ( post != NULL ) ? post->resource : batch.resources[index];
+    int length = 0;
+    int ret = 0;
+
+    length = snprintf( request, sizeof(request), "%s %s", ( post != NULL ) ? "POST" : "GET", batch.path_prefix );
+    if( length > 0 && length < (int) sizeof(request) ) {
+        ret = append_path_encoded( request + length, sizeof(request) - length, resource );
+        length = ( ret < 0 ) ? -1 : length + ret;
+    }
+    if( length > 0 ) {
+        if( post != NULL ) {
+            ret = snprintf( request + length, sizeof(request) - length, "%s HTTP/1.1\r\nHost: %s\r\nContent-Length: %lu\r\n\r\n",
+                    post->query ? post->query : "", host, (unsigned long) post->body_length );
+        } else {
+            ret = snprintf( request + length, sizeof(request) - length, " HTTP/1.1\r\nHost: %s\r\n\r\n", host );
+        }
+        length = ( ret < 0 || ret >= (int) sizeof(request) - length ) ? -1 : length + ret;
+    }
+    if( length < 0 ) {
+        AWS_LIBRARY_ERROR(("Request for %s%s too long \n", batch.path_prefix, resource));
+        return CY_RSLT_AWS_ERROR_HTTP_FAILURE;
+    }
+
+    if( post == NULL || post->body_length == 0 ) {
+        return send_all( request, length );
+    }
+
+    /* A small body goes out in the same TLS record as the headers */
+    if( post->body_length <= sizeof(request) - length ) {
+        memcpy( request + length, post->body, post->body_length );
+        return send_all( request, length + post->body_length );
+    }
+    if( send_all( request, length ) != CY_RSLT_SUCCESS ) {
+        return CY_RSLT_AWS_ERROR_HTTP_FAILURE;
+    }
+    return send_all( post->body, post->body_length );
+}
+
+int AWSIoTHttpsConnection::on_body( http_parser* parser, const char* at, size_t length )
+{
+    AWSIoTHttpsConnection* connection = (AWSIoTHttpsConnection*) parser->data;
+    uint32_t needed = connection->body_length + length + 1;
+    uint32_t capacity = connection->body_capacity ? connection->body_capacity : 1024;
+    char* grown = NULL;
+
+    if( connection->body_overflow || needed > AWS_GG_DISCOVERY_MAX_RESPONSE_SIZE + 1 ) {
+        connection->body_overflow = true;
+        return 0;
+    }
+
+    if( needed > connection->body_capacity ) {
+        while( capacity < needed ) {
+            capacity *= 2;
+        }
+        grown = (char*) realloc( connection->body, capacity );
+        if( grown == NULL ) {
+            connection->body_overflow = true;
+            return 0;
+        }
+        connection->body = grown;
+        connection->body_capacity = capacity;
+    }
+
+    memcpy( connection->body + connection->body_length, at, length );
+    connection->body_length += length;
+    connection->body[connection->body_length] = '\0';
+
+    return 0;
+}
+
+int AWSIoTHttpsConnection::on_message_complete( http_parser* parser )
+{
+    AWSIoTHttpsConnection* connection = (AWSIoTHttpsConnection*) parser->data;
+
+    connection->message_complete = true;
+    connection->keep_alive = ( http_should_keep_alive( parser ) != 0 );
+
+    /* Stop right after this response; whatever follows in the buffer belongs to the next one */
+    http_parser_pause( parser, 1 );
+
+    return 0;
+}
+
+cy_rslt_t AWSIoTHttpsConnection::read_response( int* status, bool* keep_alive )
+{
+    nsapi_size_or_error_t ret = 0;
+    size_t parsed = 0;
+
+    http_parser_init( &parser, HTTP_RESPONSE );
+    parser.data = this;
+    body_length = 0;
+    body_overflow = false;
+    message_complete = false;
+    AWSIoTHttpsConnection::keep_alive = false;
+
+    while( !message_complete ) {
+        if( rx_start == rx_end ) {
+            ret = socket->recv( rx_buffer, sizeof(rx_buffer) );
+            if( ret < 0 ) {
+                AWS_LIBRARY_DEBUG(("Receiving response failed : %d \n", (int) ret));
+                return CY_RSLT_AWS_ERROR_HTTP_FAILURE;
+            }
+            if( ret == 0 ) {
+                /* Closed by the server; this still completes a response whose length is given by the close */
+                http_parser_execute( &parser, &settings, NULL, 0 );
+                if( !message_complete ) {
+                    return CY_RSLT_AWS_ERROR_HTTP_FAILURE;
+                }
+                AWSIoTHttpsConnection::keep_alive = false;
+                break;
+            }
+            rx_start = 0;
+            rx_end = ret;
+        }
+
+        parsed = http_parser_execute( &parser, &settings, rx_buffer + rx_start, rx_end - rx_start );
+        rx_start += parsed;
+        if( HTTP_PARSER_ERRNO( &parser ) == HPE_PAUSED ) {
+            http_parser_pause( &parser, 0 );
+        } else if( HTTP_PARSER_ERRNO( &parser ) != HPE_OK ) {
+            AWS_LIBRARY_ERROR(("Malformed HTTP response : %s \n", http_errno_name( HTTP_PARSER_ERRNO( &parser ) )));
+            return CY_RSLT_AWS_ERROR_HTTP_FAILURE;
+        }
+    }
+
+    if( body_overflow ) {
+        AWS_LIBRARY_ERROR(("HTTP response larger than %d bytes \n", AWS_GG_DISCOVERY_MAX_RESPONSE_SIZE));
+        return CY_RSLT_AWS_ERROR_HTTP_FAILURE;
+    }
+
+    *status = parser.status_code;
+    *keep_alive = AWSIoTHttpsConnection::keep_alive;
+
+    return CY_RSLT_SUCCESS;
+}
+
+cy_rslt_t AWSIoTHttpsConnection::get( NetworkInterface* network, AWSIoTCredentials* credentials, const char* host, uint16_t port, const char* root_ca, uint16_t root_ca_length,
+                                      const char* path_prefix, const char* const* resources, uint8_t count, response_callback cb, void* arg )
+{
+    request_batch batch = { path_prefix, resources, NULL, count };
+
+    return pipeline( network, credentials, host, port, root_ca, root_ca_length, batch, cb, arg );
+}
+
+cy_rslt_t AWSIoTHttpsConnection::post( NetworkInterface* network, AWSIoTCredentials* credentials, const char* host, uint16_t port, const char* root_ca, uint16_t root_ca_length,
+                                       const char* path_prefix, const post_request* requests, uint8_t count, response_callback cb, void* arg )
+{
+    request_batch batch = { path_prefix, NULL, requests, count };
+
+    return pipeline( network, credentials, host, port, root_ca, root_ca_length, batch, cb, arg );
+}
+
+cy_rslt_t AWSIoTHttpsConnection::pipeline( NetworkInterface* network, AWSIoTCredentials* credentials, const char* host, uint16_t port, const char* root_ca, uint16_t root_ca_length,
+                                           const request_batch& batch, response_callback cb, void* arg )
+{
+    cy_rslt_t result = CY_RSLT_SUCCESS;
+    uint8_t count = batch.count;
+    uint8_t next_request = 0;
+    uint8_t next_response = 0;
+    uint8_t resent_end = 0;
+    bool retried = false;
+    bool alive = false;
+    int status = 0;
+
+    while( next_response < count ) {
+        result = open( network, credentials, host, port, root_ca, root_ca_length );
+        if( result != CY_RSLT_SUCCESS ) {
+            return result;
+        }
+
+        /* Keep up to AWS_GG_DISCOVERY_PIPELINE_DEPTH requests in flight */
+        while( next_request < count && next_request - next_response < AWS_GG_DISCOVERY_PIPELINE_DEPTH ) {
+            if( send_request( batch, next_request ) != CY_RSLT_SUCCESS ) {
+                break;
+            }
+            next_request++;
+        }
+
+        result = ( next_request > next_response ) ? read_response( &status, &alive ) : CY_RSLT_AWS_ERROR_HTTP_FAILURE;
+        if( result != CY_RSLT_SUCCESS ) {
+            close();
+            if( retried ) {
+                return CY_RSLT_AWS_ERROR_HTTP_FAILURE;
+            }
+            /* A reused connection may have been closed by the server while idle; send unanswered requests once more.
+             * They may have been processed, so their responses are flagged as resent. */
+            retried = true;
+            resent_end = ( next_request > resent_end ) ? next_request : resent_end;
+            next_request = next_response;
+            continue;
+        }
+        retried = false;
+
+        cb( next_response, status, body, body_length, next_response < resent_end, arg );
+        next_response++;
+
+        if( !alive ) {
+            close();
+            next_request = next_response;
+        }
+    }
+
+    return CY_RSLT_SUCCESS;
+}
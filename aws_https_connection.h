@@ -0,0 +1,183 @@
+/*
+ * Copyright 2019-2020 Cypress Semiconductor Corporation
+ * SPDX-License-Identifier: Apache-2.0
+ * 
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ * 
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ * 
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+/** @file
+ *  Persistent HTTPS connection used for Greengrass discovery and RESTful publishes
+ */
+#ifndef AWS_HTTPS_CONNECTION_H
+#define AWS_HTTPS_CONNECTION_H
+
+#include "mbed.h"
+#include "aws_common.h"
+#include "aws_credentials.h"
+#include "aws_storage.h"
+#include "http_parser.h"
+
+/**
+ * @addtogroup aws_iot_classes
+ *
+ * @{
+ */
+
+/** Keep-alive HTTPS connection for GET and POST requests.
+ *
+ * The TLS connection is kept open between calls and reused as long as the host and port stay the same,
+ * so repeated requests skip DNS, TCP and TLS. Requests are pipelined: up to
+ * @ref AWS_GG_DISCOVERY_PIPELINE_DEPTH requests are written before their responses are read back in order.
+ * If the server closes the connection (for example an idle keep-alive timeout, or "Connection: close"),
+ * requests that were not answered yet are sent again once on a fresh connection. A POST resent this way may
+ * have been processed already, so POSTs get at-least-once delivery; the response callback is told which requests
+ * were resent. Requests written after a response carrying "Connection: close" are not counted: the server does
+ * not process them.
+ */
+class AWSIoTHttpsConnection
+{
+public:
+    /** Called for each response, in request order. 'body' is only valid during the call. 'resent' is true if the
+     *  request was written again after its connection failed, so the server may have received it twice. */
+    typedef void (*response_callback)( uint8_t index, int status, const char* body, uint32_t length, bool resent, void* arg );
+
+    /** One POST request: path_prefix + resource ( percent-encoded ) + query, with the given body */
+    struct post_request
+    {
+        const char* resource;
+        const char* query;        /**< Starts with '?'; NULL for none */
+        const char* body;
+        uint32_t body_length;
+    };
+
+    /** Default constructor of AWSIoTHttpsConnection class. No connection is opened until @ref get is called. */
+    AWSIoTHttpsConnection();
+
+    /** Closes the connection. */
+    ~AWSIoTHttpsConnection();
+
+    /** Sends pipelined GET requests for path_prefix + resources[i] and reports each response.
+     *
+     * @param[in] network         : Network interface used for a new connection
+     * @param[in] credentials     : Parsed client credentials used for a new connection
+     * @param[in] host            : Server host name
+     * @param[in] port            : Server port
+     * @param[in] root_ca         : Root CA certificate of the server
+     * @param[in] root_ca_length  : Length of Root CA certificate
+     * @param[in] path_prefix     : Common start of the request paths
+     * @param[in] resources       : Last path segment of each request
+     * @param[in] count           : Number of requests
+     * @param[in] cb              : Response callback
+     * @param[in] arg             : Argument passed to 'cb'
+     *
+     * @return cy_rslt_t          : CY_RSLT_SUCCESS - if every request got a response,
+     *                              CY_RSLT_AWS_ERROR_INVALID_ROOTCA, CY_RSLT_AWS_ERROR_INVALID_CLIENT_KEY,
+     *                              CY_RSLT_AWS_ERROR_CONNECT_FAILED, CY_RSLT_AWS_ERROR_HTTP_FAILURE - On error ( @ref aws_iot_defines )
+     */
+    cy_rslt_t get( NetworkInterface* network, AWSIoTCredentials* credentials, const char* host, uint16_t port, const char* root_ca, uint16_t root_ca_length,
+                   const char* path_prefix, const char* const* resources, uint8_t count, response_callback cb, void* arg );
+
+    /** Sends pipelined POST requests and reports each response.
+     *
+     * @param[in] network         : Network interface used for a new connection
+     * @param[in] credentials     : Parsed client credentials used for a new connection
+     * @param[in] host            : Server host name
+     * @param[in] port            : Server port
+     * @param[in] root_ca         : Root CA certificate of the server
+     * @param[in] root_ca_length  : Length of Root CA certificate
+     * @param[in] path_prefix     : Common start of the request paths
+     * @param[in] requests        : Requests
+     * @param[in] count           : Number of requests
+     * @param[in] cb              : Response callback
+     * @param[in] arg             : Argument passed to 'cb'
+     *
+     * @return cy_rslt_t          : CY_RSLT_SUCCESS - if every request got a response,
+     *                              CY_RSLT_AWS_ERROR_INVALID_ROOTCA, CY_RSLT_AWS_ERROR_INVALID_CLIENT_KEY,
+     *                              CY_RSLT_AWS_ERROR_CONNECT_FAILED, CY_RSLT_AWS_ERROR_HTTP_FAILURE - On error ( @ref aws_iot_defines )
+     */
+    cy_rslt_t post( NetworkInterface* network, AWSIoTCredentials* credentials, const char* host, uint16_t port, const char* root_ca, uint16_t root_ca_length,
+                    const char* path_prefix, const post_request* requests, uint8_t count, response_callback cb, void* arg );
+
+    /** Opens the connection ahead of the first request, unless one to the same host and port is open already.
+     *
+     * @param[in] network         : Network interface
+     * @param[in] credentials     : Parsed client credentials
+     * @param[in] host            : Server host name
+     * @param[in] port            : Server port
+     * @param[in] root_ca         : Root CA certificate of the server
+     * @param[in] root_ca_length  : Length of Root CA certificate
+     *
+     * @return cy_rslt_t          : CY_RSLT_SUCCESS - on success,
+     *                              CY_RSLT_AWS_ERROR_INVALID_ROOTCA, CY_RSLT_AWS_ERROR_INVALID_CLIENT_KEY,
+     *                              CY_RSLT_AWS_ERROR_CONNECT_FAILED - On error ( @ref aws_iot_defines )
+     */
+    cy_rslt_t open( NetworkInterface* network, AWSIoTCredentials* credentials, const char* host, uint16_t port, const char* root_ca, uint16_t root_ca_length );
+
+    /** Closes the connection, if open. */
+    void close();
+
+    /** Returns the number of TLS connections opened so far; compared with the number of requests, it shows how well connections are reused.
+     *
+     * @return uint32_t           : Number of connections opened
+     */
+    uint32_t get_connects() const;
+
+private:
+    /** Requests of one get or post call; exactly one of resources and posts is set */
+    struct request_batch
+    {
+        const char* path_prefix;
+        const char* const* resources;
+        const post_request* posts;
+        uint8_t count;
+    };
+
+    cy_rslt_t pipeline( NetworkInterface* network, AWSIoTCredentials* credentials, const char* host, uint16_t port, const char* root_ca, uint16_t root_ca_length,
+                        const request_batch& batch, response_callback cb, void* arg );
+    cy_rslt_t send_request( const request_batch& batch, uint8_t index );
+    cy_rslt_t send_all( const char* data, uint32_t length );
+    cy_rslt_t read_response( int* status, bool* keep_alive );
+
+    static int on_body( http_parser* parser, const char* at, size_t length );
+    static int on_message_complete( http_parser* parser );
+
+    TLSSocket* socket;
+    AWSIoTStorage<TLSSocket> socket_storage;
+    AWSIoTCredentials::attachment socket_credentials;
+    char host[AWS_GG_HTTPS_HOST_MAX_LENGTH + 1];
+    uint16_t port;
+    uint32_t connects;
+
+    http_parser parser;
+    http_parser_settings settings;
+    char* body;
+    uint32_t body_length;
+    uint32_t body_capacity;
+    bool body_overflow;
+#ifdef AWS_IOT_STATIC_ALLOCATION
+    char body_storage[AWS_GG_DISCOVERY_MAX_RESPONSE_SIZE + 1];
+#endif
+    bool message_complete;
+    bool keep_alive;
+
+    char rx_buffer[AWS_GG_HTTPS_RX_BUFFER_SIZE];
+    uint32_t rx_start;             /**< Received bytes not parsed yet belong to the next pipelined response */
+    uint32_t rx_end;
+};
+
+/**
+ * @}
+ */
+
+#endif
@@ -0,0 +1,165 @@
+/*
+ * Copyright 2019-2020 Cypress Semiconductor Corporation
+ * SPDX-License-Identifier: Apache-2.0
+ * 
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ * 
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ * 
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+/** @file
+ *
+ * Implementation for AWS IoT keep-alive manager
+ *
+ */
+#include "aws_keep_alive.h"
+#include "string.h"
+
+AWSIoTKeepAlive::AWSIoTKeepAlive()
+{
+    aws_keep_alive_params_t params;
+
+    memset( &params, 0, sizeof(params) );
+    keep_alive_ms = 0;
+    configure( params );
+    reset_metrics();
+}
+
+void AWSIoTKeepAlive::configure( const aws_keep_alive_params_t& params )
+{
+    AWSIoTKeepAlive::params = params;
+    interval_ms = keep_alive_ms;
+    probe_successes = 0;
+}
+
+void AWSIoTKeepAlive::start( uint16_t keep_alive_s )
+{
+    uint32_t negotiated_ms = (uint32_t) keep_alive_s * 1000;
+
+    if( negotiated_ms != keep_alive_ms || interval_ms == 0 || interval_ms > negotiated_ms ) {
+        keep_alive_ms = negotiated_ms;
+        interval_ms = negotiated_ms;
+        probe_successes = 0;
+    }
+    outstanding = false;
+}
+
+uint32_t AWSIoTKeepAlive::next_ping_in( uint64_t now_ms, uint64_t last_sent_ms, uint64_t last_received_ms ) const
+{
+    uint64_t send_due;
+    uint64_t receive_due;
+    uint64_t due;
+
+    if( interval_ms == 0 || outstanding ) {
+        return UINT32_MAX;
+    }
+
+    send_due = last_sent_ms + interval_ms;
+    receive_due = last_received_ms + 2 * (uint64_t) interval_ms;
+    due = ( send_due < receive_due ) ? send_due : receive_due;
+
+    return ( due <= now_ms ) ? 0 : (uint32_t) ( due - now_ms );
+}
+
+void AWSIoTKeepAlive::ping_sent( uint64_t now_ms )
+{
+    outstanding = true;
+    ping_sent_ms = now_ms;
+}
+
+void AWSIoTKeepAlive::pong_received( uint64_t at_ms )
+{
+    uint32_t rtt_ms;
+
+    if( !outstanding ) {
+        return;
+    }
+    outstanding = false;
+
+    rtt_ms = ( at_ms > ping_sent_ms ) ? (uint32_t) ( at_ms - ping_sent_ms ) : 0;
+    rtt_last_ms = rtt_ms;
+    if( rtt_ms < rtt_min_ms ) {
+        rtt_min_ms = rtt_ms;
+    }
+    if( rtt_ms > rtt_max_ms ) {
+        rtt_max_ms = rtt_ms;
+    }
+
+    /* The link survived a full idle interval; after enough of those, probe a longer one */
+    if( params.adaptive && interval_ms < keep_alive_ms && ++probe_successes >= AWS_KEEP_ALIVE_PROBE_SUCCESSES ) {
+        interval_ms += ( interval_ms / 8 > 1000 ) ? interval_ms / 8 : 1000;
+        if( interval_ms > keep_alive_ms ) {
+            interval_ms = keep_alive_ms;
+        }
+        probe_successes = 0;
+    }
+}
+
+bool AWSIoTKeepAlive::ping_timed_out( uint64_t now_ms, uint32_t timeout_ms )
+{
+    if( !outstanding || now_ms < ping_sent_ms + timeout_ms ) {
+        return false;
+    }
+    outstanding = false;
+    timeouts++;
+    return true;
+}
+
+void AWSIoTKeepAlive::connection_lost( uint64_t now_ms, uint64_t last_activity_ms )
+{
+    uint64_t idle_ms;
+    uint32_t min_ms = (uint32_t) params.min_interval * 1000;
+
+    outstanding = false;
+    if( !params.adaptive || interval_ms == 0 || now_ms <= last_activity_ms ) {
+        return;
+    }
+
+    /* A loss after a short idle period is not a mapping timeout; only react once the link sat idle for at least the floor */
+    idle_ms = now_ms - last_activity_ms;
+    if( idle_ms < min_ms ) {
+        return;
+    }
+
+    /* The mapping expired somewhere within the idle period; ping well inside it from now on */
+    if( idle_ms > interval_ms ) {
+        idle_ms = interval_ms;
+    }
+    interval_ms = (uint32_t) ( idle_ms * 3 / 4 );
+    if( interval_ms < min_ms ) {
+        interval_ms = min_ms;
+    }
+    if( interval_ms == 0 ) {
+        interval_ms = 1000;
+    }
+    probe_successes = 0;
+}
+
+void AWSIoTKeepAlive::get_metrics( aws_iot_metrics_t* metrics ) const
+{
+    if( metrics == NULL ) {
+        return;
+    }
+    metrics->keep_alive_interval_ms = interval_ms;
+    metrics->keep_alive_timeouts = timeouts;
+    metrics->ping_rtt_last_ms = rtt_last_ms;
+    metrics->ping_rtt_min_ms = ( rtt_min_ms == UINT32_MAX ) ? 0 : rtt_min_ms;
+    metrics->ping_rtt_max_ms = rtt_max_ms;
+}
+
+void AWSIoTKeepAlive::reset_metrics()
+{
+    timeouts = 0;
+    rtt_last_ms = 0;
+    rtt_min_ms = UINT32_MAX;
+    rtt_max_ms = 0;
+}
@@ -0,0 +1,182 @@
+/*
+ * Copyright 2019-2020 Cypress Semiconductor Corporation
+ * SPDX-License-Identifier: Apache-2.0
+ * 
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ * 
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ * 
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+/** @file
+ *  Keep-alive manager for AWS IoT MQTT connections
+ */
+#ifndef AWS_KEEP_ALIVE_H
+#define AWS_KEEP_ALIVE_H
+
+#include "mbed.h"
+#include "aws_common.h"
+
+/**
+ * @addtogroup aws_iot_classes
+ *
+ * @{
+ */
+
+/** Timer handed to MQTT::Client.
+ *
+ * Behaves like the Countdown timer of MQTTmbed.h for command timeouts. MQTT::Client uses the seconds
+ * based countdown() only to arm its keep-alive timers; those never expire here, so the MQTT client does
+ * not send PINGREQs on its own and keep-alive is left to @ref AWSIoTKeepAlive.
+ */
+class AWSIoTCountdown
+{
+public:
+    AWSIoTCountdown() : end_ms( 0 )
+    {
+    }
+
+    AWSIoTCountdown( int ms )
+    {
+        countdown_ms( ms );
+    }
+
+    bool expired()
+    {
+        return Kernel::get_ms_count() >= end_ms;
+    }
+
+    void countdown_ms( unsigned long ms )
+    {
+        end_ms = Kernel::get_ms_count() + ms;
+    }
+
+    void countdown( int seconds )
+    {
+        (void) seconds;
+        end_ms = UINT64_MAX;
+    }
+
+    int left_ms()
+    {
+        uint64_t now = Kernel::get_ms_count();
+
+        if( end_ms <= now ) {
+            return 0;
+        }
+        return ( end_ms - now > INT32_MAX ) ? INT32_MAX : (int) ( end_ms - now );
+    }
+
+private:
+    uint64_t end_ms;
+};
+
+/** Keep-alive manager for an MQTT connection.
+ *
+ * Any packet written to the broker counts as liveness, so a PINGREQ is only due once nothing has been
+ * sent for a full ping interval. To still notice half-open connections on links that only ever send,
+ * a PINGREQ is also due when nothing has been received for two ping intervals.
+ *
+ * In adaptive mode the ping interval is lowered when the connection is lost after sitting idle (the
+ * usual symptom of a NAT or firewall mapping timing out before the broker keep-alive), and raised back
+ * towards the negotiated keep-alive after @ref AWS_KEEP_ALIVE_PROBE_SUCCESSES answered idle pings.
+ * The manager does no I/O; the caller sends the PINGREQ and reports back.
+ */
+class AWSIoTKeepAlive
+{
+public:
+    /** Default constructor of AWSIoTKeepAlive class. Adaptive mode is off until @ref configure is called. */
+    AWSIoTKeepAlive();
+
+    /** Configures the keep-alive behaviour. The learned ping interval is discarded.
+     *
+     * @param[in] params          : Keep-alive parameters
+     *
+     */
+    void configure( const aws_keep_alive_params_t& params );
+
+    /** Starts keep-alive for a new connection. The learned ping interval is kept across connections
+     *  as long as the negotiated keep-alive does not change.
+     *
+     * @param[in] keep_alive_s    : Keep-alive interval sent in the CONNECT packet (in seconds); 0 disables pinging
+     *
+     */
+    void start( uint16_t keep_alive_s );
+
+    /** Returns the time until the next PINGREQ is due.
+     *
+     * @param[in] now_ms          : Current time in milliseconds
+     * @param[in] last_sent_ms    : Time at which the last packet was written
+     * @param[in] last_received_ms: Time at which the last packet was read
+     *
+     * @return uint32_t           : Time (in ms) until a PINGREQ must be sent; 0 if one is due now. UINT32_MAX while pinging is disabled or a PINGREQ is outstanding
+     */
+    uint32_t next_ping_in( uint64_t now_ms, uint64_t last_sent_ms, uint64_t last_received_ms ) const;
+
+    /** Records that a PINGREQ was sent.
+     *
+     * @param[in] now_ms          : Time at which the PINGREQ was written
+     *
+     */
+    void ping_sent( uint64_t now_ms );
+
+    /** Records a PINGRESP.
+     *
+     * @param[in] at_ms           : Time at which the PINGRESP was read
+     *
+     */
+    void pong_received( uint64_t at_ms );
+
+    /** Checks whether the outstanding PINGREQ went unanswered for too long.
+     *
+     * @param[in] now_ms          : Current time in milliseconds
+     * @param[in] timeout_ms      : Time to wait for a PINGRESP (in ms)
+     *
+     * @return bool               : true if the connection should be considered lost
+     */
+    bool ping_timed_out( uint64_t now_ms, uint32_t timeout_ms );
+
+    /** Records that the connection was lost, and lowers the ping interval in adaptive mode if the link had been idle.
+     *
+     * @param[in] now_ms          : Time at which the loss was detected
+     * @param[in] last_activity_ms: Time of the last packet written or read
+     *
+     */
+    void connection_lost( uint64_t now_ms, uint64_t last_activity_ms );
+
+    /** Fills the keep-alive fields of the client metrics.
+     *
+     * @param[out] metrics        : Metrics structure to update
+     *
+     */
+    void get_metrics( aws_iot_metrics_t* metrics ) const;
+
+    /** Clears the ping round trip and timeout counters. */
+    void reset_metrics();
+
+private:
+    aws_keep_alive_params_t params;
+    uint32_t keep_alive_ms;         /**< Negotiated keep-alive; the ping interval never exceeds it */
+    uint32_t interval_ms;           /**< Current ping interval */
+    uint32_t probe_successes;       /**< Answered idle pings since the interval was last changed */
+    bool outstanding;
+    uint64_t ping_sent_ms;
+    uint32_t timeouts;
+    uint32_t rtt_last_ms;
+    uint32_t rtt_min_ms;
+    uint32_t rtt_max_ms;
+};
+
+/**
+ * @}
+ */
+
+#endif
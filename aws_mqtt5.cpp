@@ -0,0 +1,639 @@
+/*
+ * Copyright 2019-2020 Cypress Semiconductor Corporation
+ * SPDX-License-Identifier: Apache-2.0
+ * 
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ * 
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ * 
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/** @file
+ *
+ * Implementation for AWS IoT MQTT 5 framing
+ *
+ */
+#include "aws_mqtt5.h"
+#include "string.h"
+
+#define MQTT5_CONNECT                 1
+#define MQTT5_CONNACK                 2
+#define MQTT5_PUBLISH                 3
+#define MQTT5_PUBACK                  4
+#define MQTT5_PUBREC                  5
+#define MQTT5_PUBREL                  6
+#define MQTT5_PUBCOMP                 7
+#define MQTT5_SUBSCRIBE               8
+#define MQTT5_SUBACK                  9
+#define MQTT5_UNSUBSCRIBE             10
+#define MQTT5_UNSUBACK                11
+#define MQTT5_PINGRESP                13
+#define MQTT5_DISCONNECT              14
+
+#define MQTT5_MESSAGE_EXPIRY          0x02
+#define MQTT5_SESSION_EXPIRY          0x11
+#define MQTT5_SERVER_KEEP_ALIVE       0x13
+#define MQTT5_RECEIVE_MAXIMUM         0x21
+#define MQTT5_TOPIC_ALIAS_MAXIMUM     0x22
+#define MQTT5_TOPIC_ALIAS             0x23
+#define MQTT5_USER_PROPERTY           0x26
+#define MQTT5_MAXIMUM_PACKET_SIZE     0x27
+
+#define MQTT5_HEADER_RESERVE          5           // room for the fixed header ahead of a body built in the send buffer
+#define MQTT5_ALIAS_PROPERTY_LENGTH   3
+
+static uint16_t get_uint16( const unsigned char* buffer )
+{
+    return (uint16_t) ( ( buffer[0] << 8 ) | buffer[1] );
+}
+
+static uint32_t get_uint32( const unsigned char* buffer )
+{
+    return ( (uint32_t) buffer[0] << 24 ) | ( (uint32_t) buffer[1] << 16 ) | ( (uint32_t) buffer[2] << 8 ) | buffer[3];
+}
+
+static unsigned char* put_uint16( unsigned char* buffer, uint32_t value )
+{
+    buffer[0] = (unsigned char) ( value >> 8 );
+    buffer[1] = (unsigned char) value;
+    return buffer + 2;
+}
+
+static unsigned char* put_uint32( unsigned char* buffer, uint32_t value )
+{
+    buffer[0] = (unsigned char) ( value >> 24 );
+    buffer[1] = (unsigned char) ( value >> 16 );
+    buffer[2] = (unsigned char) ( value >> 8 );
+    buffer[3] = (unsigned char) value;
+    return buffer + 4;
+}
+
+static unsigned char* put_string( unsigned char* buffer, const char* value )
+{
+    uint32_t length = strlen( value );
+
+    buffer = put_uint16( buffer, length );
+    memcpy( buffer, value, length );
+    return buffer + length;
+}
+
+/* Variable byte integer, as used for the remaining length and the property length */
+static unsigned char* put_length( unsigned char* buffer, uint32_t value )
+{
+    do {
+        *buffer = (unsigned char) ( value % 128 );
+        value /= 128;
+        if( value > 0 ) {
+            *buffer |= 128;
+        }
+        buffer++;
+    } while( value > 0 );
+
+    return buffer;
+}
+
+static uint32_t length_size( uint32_t value )
+{
+    uint32_t size = 1;
+
+    while( value >= 128 ) {
+        value /= 128;
+        size++;
+    }
+    return size;
+}
+
+/* Returns the bytes taken by the variable byte integer; -1 if it is malformed or cut short */
+static int get_length( const unsigned char* buffer, uint32_t available, uint32_t* value )
+{
+    uint32_t multiplier = 1;
+    uint32_t i = 0;
+
+    *value = 0;
+    for( i = 0; i < available && i < 4; i++ ) {
+        *value += ( buffer[i] & 127 ) * multiplier;
+        multiplier *= 128;
+        if( ( buffer[i] & 128 ) == 0 ) {
+            return (int) i + 1;
+        }
+    }
+    return -1;
+}
+
+/* Returns the size of a property value; -1 for an unknown property or a value cut short */
+static int property_size( unsigned char id, const unsigned char* value, uint32_t available )
+{
+    uint32_t size = 0;
+
+    switch( id ) {
+        case 0x01: case 0x17: case 0x19: case 0x24: case 0x25: case 0x28: case 0x29: case 0x2A:
+            size = 1;
+            break;
+        case 0x13: case 0x21: case 0x22: case 0x23:
+            size = 2;
+            break;
+        case 0x02: case 0x11: case 0x18: case 0x27:
+            size = 4;
+            break;
+        case 0x0B:
+            return get_length( value, available, &size );
+        case 0x03: case 0x08: case 0x09: case 0x12: case 0x15: case 0x16: case 0x1A: case 0x1C: case 0x1F:
+            if( available < 2 ) {
+                return -1;
+            }
+            size = 2 + get_uint16( value );
+            break;
+        case MQTT5_USER_PROPERTY:
+            if( available < 2 ) {
+                return -1;
+            }
+            size = 2 + get_uint16( value );
+            if( available < size + 2 ) {
+                return -1;
+            }
+            size += 2 + get_uint16( value + size );
+            break;
+        default:
+            return -1;
+    }
+
+    return ( size <= available ) ? (int) size : -1;
+}
+
+/* MQTT 3.1.1 CONNACK return code closest to an MQTT 5 reason code */
+static unsigned char connack_return_code( unsigned char reason )
+{
+    switch( reason ) {
+        case 0x00:
+            return 0;
+        case 0x84:              /* Unsupported Protocol Version */
+            return 1;
+        case 0x85:              /* Client Identifier not valid */
+            return 2;
+        case 0x86:              /* Bad User Name or Password */
+            return 4;
+        case 0x87:              /* Not authorized */
+            return 5;
+        default:
+            return 3;
+    }
+}
+
+AWSIoTMqtt5::AWSIoTMqtt5( unsigned char* rx_buffer, uint32_t rx_size, unsigned char* tx_buffer, uint32_t tx_size )
+{
+    rx = rx_buffer;
+    rx_capacity = rx_size;
+    tx = tx_buffer;
+    tx_capacity = tx_size;
+    reset();
+    clear_publish_properties();
+}
+
+void AWSIoTMqtt5::reset()
+{
+    rx_start = 0;
+    rx_length = 0;
+    broker_receive_maximum = 65535;
+    broker_alias_maximum = 0;
+    broker_packet_size = UINT32_MAX;
+    broker_keep_alive = -1;
+    broker_disconnect_reason = 0;
+    memset( aliases, 0, sizeof(aliases) );
+    alias_clock = 0;
+}
+
+int AWSIoTMqtt5::set_publish_properties( uint32_t message_expiry, const aws_user_property_t* properties, uint8_t count )
+{
+    uint32_t length = ( message_expiry != 0 ) ? 5 : 0;
+    uint8_t i = 0;
+
+    clear_publish_properties();
+    if( properties == NULL ) {
+        count = 0;
+    }
+    for( i = 0; i < count; i++ ) {
+        if( properties[i].key == NULL || properties[i].value == NULL ) {
+            return -1;
+        }
+        length += 1 + 2 + strlen( properties[i].key ) + 2 + strlen( properties[i].value );
+    }
+    /* a topic alias may come on top */
+    if( length + MQTT5_ALIAS_PROPERTY_LENGTH > AWS_MQTT5_PROPERTIES_MAX_LENGTH ) {
+        AWS_LIBRARY_ERROR(("MQTT 5: publish properties exceed %d bytes \n", AWS_MQTT5_PROPERTIES_MAX_LENGTH));
+        return -1;
+    }
+
+    expiry = message_expiry;
+    user_properties = properties;
+    user_property_count = count;
+    properties_length = length;
+    return 0;
+}
+
+void AWSIoTMqtt5::clear_publish_properties()
+{
+    expiry = 0;
+    user_properties = NULL;
+    user_property_count = 0;
+    properties_length = 0;
+}
+
+bool AWSIoTMqtt5::fits( uint32_t topic_length, uint32_t packet_length ) const
+{
+    uint32_t property_length = properties_length + MQTT5_ALIAS_PROPERTY_LENGTH;
+
+    /* the packet up to the payload is built in the send buffer */
+    if( MQTT5_HEADER_RESERVE + 2 + topic_length + 2 + length_size( property_length ) + property_length > tx_capacity ) {
+        return false;
+    }
+    /* the remaining length may take one byte more as well */
+    return packet_length + length_size( property_length ) + property_length + 1 <= broker_packet_size;
+}
+
+int AWSIoTMqtt5::encode( const unsigned char* packet, int length, int* resume )
+{
+    uint32_t remaining = 0;
+    int used = -1;
+
+    *resume = 0;
+    if( length >= 2 ) {
+        used = get_length( packet + 1, length - 1, &remaining );
+    }
+    if( used < 0 || 1 + used + remaining != (uint32_t) length ) {
+        AWS_LIBRARY_ERROR(("MQTT 5: outbound packet is not whole \n"));
+        return -1;
+    }
+
+    switch( packet[0] >> 4 ) {
+        case MQTT5_CONNECT:
+            return encode_connect( packet, 1 + used, length, resume );
+        case MQTT5_PUBLISH:
+            return encode_publish( packet, 1 + used, length, resume );
+        case MQTT5_SUBSCRIBE:
+        case MQTT5_UNSUBSCRIBE:
+            /* empty properties after the packet identifier; the subscription options of MQTT 3.1.1 mean the same in MQTT 5 */
+            if( remaining < 2 ) {
+                return -1;
+            }
+            memcpy( tx + MQTT5_HEADER_RESERVE, packet + 1 + used, 2 );
+            tx[MQTT5_HEADER_RESERVE + 2] = 0;
+            return finish( packet[0], 3, packet, 1 + used + 2, length, resume );
+        default:
+            /* PUBACK, PINGREQ and DISCONNECT are the same in MQTT 5 when they carry no reason code */
+            return 0;
+    }
+}
+
+int AWSIoTMqtt5::encode_connect( const unsigned char* packet, uint32_t header, uint32_t length, int* resume )
+{
+    static const unsigned char protocol[] = { 0, 4, 'M', 'Q', 'T', 'T', AWS_MQTT_VERSION_3_1_1 };
+    const unsigned char* body = packet + header;
+    unsigned char* out = tx + MQTT5_HEADER_RESERVE;
+    uint32_t client_id_length = 0;
+    unsigned char flags = 0;
+
+    /* an MQTT 3.1.1 variable header differs from the MQTT 5 one by the protocol level and the properties only */
+    if( length - header < 12 || memcmp( body, protocol, sizeof(protocol) ) != 0 ) {
+        return -1;
+    }
+    flags = body[7];
+    client_id_length = get_uint16( body + 10 );
+    if( length - header < 12 + client_id_length ||
+            MQTT5_HEADER_RESERVE + 10 + 11 + 2 + client_id_length + 1 > tx_capacity ) {
+        return -1;
+    }
+
+    /* a new connection: the broker knows no aliases yet and sends its limits with the CONNACK */
+    reset();
+
+    memcpy( out, body, 10 );
+    out[6] = AWS_MQTT_VERSION_5;
+    out += 10;
+
+    /* without clean session the session has to outlive the connection explicitly */
+    *out++ = ( flags & 0x02 ) ? 5 : 10;
+    if( ( flags & 0x02 ) == 0 ) {
+        *out++ = MQTT5_SESSION_EXPIRY;
+        out = put_uint32( out, AWS_MQTT5_SESSION_EXPIRY );
+    }
+    *out++ = MQTT5_MAXIMUM_PACKET_SIZE;
+    out = put_uint32( out, rx_capacity );
+
+    memcpy( out, body + 10, 2 + client_id_length );
+    out += 2 + client_id_length;
+    if( flags & 0x04 ) {
+        /* empty will properties ahead of the will topic */
+        *out++ = 0;
+    }
+
+    return finish( packet[0], out - ( tx + MQTT5_HEADER_RESERVE ), packet, header + 12 + client_id_length, length, resume );
+}
+
+int AWSIoTMqtt5::encode_publish( const unsigned char* packet, uint32_t header, uint32_t length, int* resume )
+{
+    const unsigned char* body = packet + header;
+    unsigned char* out = tx + MQTT5_HEADER_RESERVE;
+    uint32_t id_length = ( ( packet[0] >> 1 ) & 0x03 ) ? 2 : 0;
+    uint32_t alias_count = ( broker_alias_maximum < AWS_MQTT5_TOPIC_ALIASES ) ? broker_alias_maximum : AWS_MQTT5_TOPIC_ALIASES;
+    uint32_t property_length = properties_length;
+    uint32_t topic_length = 0;
+    uint32_t slot = 0;
+    uint32_t i = 0;
+    bool use_alias = false;
+    bool known = false;
+    int rc = -1;
+
+    if( length - header < 2 ) {
+        goto exit;
+    }
+    topic_length = get_uint16( body );
+    if( length - header < 2 + topic_length + id_length ) {
+        goto exit;
+    }
+
+    /* topics longer than an alias entry are always sent in full */
+    if( alias_count > 0 && topic_length > 0 && topic_length <= AWS_TOPIC_FILTER_MAX_LENGTH ) {
+        use_alias = true;
+        property_length += MQTT5_ALIAS_PROPERTY_LENGTH;
+        for( i = 0; i < alias_count && !known; i++ ) {
+            if( aliases[i].length == topic_length && memcmp( aliases[i].topic, body + 2, topic_length ) == 0 ) {
+                slot = i;
+                known = true;
+            }
+        }
+        /* a free alias, or else the least recently used one is taken over */
+        for( i = 1; !known && i < alias_count && aliases[slot].length != 0; i++ ) {
+            if( aliases[i].length == 0 || aliases[i].used < aliases[slot].used ) {
+                slot = i;
+            }
+        }
+    }
+
+    if( 2 + ( known ? 0 : topic_length ) + id_length + length_size( property_length ) + property_length > tx_capacity - MQTT5_HEADER_RESERVE ) {
+        AWS_LIBRARY_ERROR(("MQTT 5: topic and properties do not fit into the send buffer \n"));
+        goto exit;
+    }
+
+    /* an aliased topic goes out empty once the broker has been told the alias */
+    out = put_uint16( out, known ? 0 : topic_length );
+    if( !known ) {
+        memcpy( out, body + 2, topic_length );
+        out += topic_length;
+    }
+    memcpy( out, body + 2 + topic_length, id_length );
+    out += id_length;
+
+    out = put_length( out, property_length );
+    if( expiry != 0 ) {
+        *out++ = MQTT5_MESSAGE_EXPIRY;
+        out = put_uint32( out, expiry );
+    }
+    if( use_alias ) {
+        *out++ = MQTT5_TOPIC_ALIAS;
+        out = put_uint16( out, slot + 1 );
+    }
+    for( i = 0; i < user_property_count; i++ ) {
+        *out++ = MQTT5_USER_PROPERTY;
+        out = put_string( out, user_properties[i].key );
+        out = put_string( out, user_properties[i].value );
+    }
+
+    rc = finish( packet[0], out - ( tx + MQTT5_HEADER_RESERVE ), packet, header + 2 + topic_length + id_length, length, resume );
+    if( rc >= 0 && use_alias ) {
+        aliases[slot].used = ++alias_clock;
+        if( !known ) {
+            memcpy( aliases[slot].topic, body + 2, topic_length );
+            aliases[slot].length = (uint16_t) topic_length;
+        }
+    }
+
+exit:
+    /* properties belong to a single publish, whether it went out or not */
+    clear_publish_properties();
+    return rc;
+}
+
+int AWSIoTMqtt5::finish( unsigned char first_byte, uint32_t body_length, const unsigned char* packet, uint32_t tail_offset, uint32_t length, int* resume )
+{
+    uint32_t tail_length = length - tail_offset;
+    uint32_t remaining = body_length + tail_length;
+    uint32_t header_length = 1 + length_size( remaining );
+    uint32_t prefix_length = header_length + body_length;
+
+    if( header_length + remaining > broker_packet_size ) {
+        AWS_LIBRARY_ERROR(("MQTT 5: packet of %lu bytes exceeds the broker's maximum packet size \n", (unsigned long) ( header_length + remaining )));
+        return -1;
+    }
+
+    memmove( tx + header_length, tx + MQTT5_HEADER_RESERVE, body_length );
+    tx[0] = first_byte;
+    put_length( tx + 1, remaining );
+
+    /* a packet that fits into the send buffer goes out in one write */
+    if( prefix_length + tail_length <= tx_capacity ) {
+        memcpy( tx + prefix_length, packet + tail_offset, tail_length );
+        prefix_length += tail_length;
+        tail_offset = length;
+    }
+
+    *resume = (int) tail_offset;
+    return (int) prefix_length;
+}
+
+unsigned char* AWSIoTMqtt5::tx_buffer()
+{
+    return tx;
+}
+
+unsigned char* AWSIoTMqtt5::rx_buffer()
+{
+    return rx;
+}
+
+uint32_t AWSIoTMqtt5::rx_size() const
+{
+    return rx_capacity;
+}
+
+int AWSIoTMqtt5::read_properties( const unsigned char* buffer, uint32_t available, unsigned char type )
+{
+    uint32_t length = 0;
+    uint32_t offset = 0;
+    uint32_t end = 0;
+    unsigned char id = 0;
+    int used = get_length( buffer, available, &length );
+    int size = 0;
+
+    if( used < 0 || used + length > available ) {
+        return -1;
+    }
+
+    end = used + length;
+    for( offset = used; offset < end; offset += size ) {
+        id = buffer[offset++];
+        size = property_size( id, buffer + offset, end - offset );
+        if( size < 0 ) {
+            return -1;
+        }
+
+        if( type != MQTT5_CONNACK ) {
+            /* the broker was granted no topic aliases */
+            if( id == MQTT5_TOPIC_ALIAS ) {
+                return -1;
+            }
+            continue;
+        }
+        /* limits of 0 are protocol errors; the defaults are kept */
+        if( id == MQTT5_RECEIVE_MAXIMUM && get_uint16( buffer + offset ) != 0 ) {
+            broker_receive_maximum = get_uint16( buffer + offset );
+        } else if( id == MQTT5_TOPIC_ALIAS_MAXIMUM ) {
+            broker_alias_maximum = get_uint16( buffer + offset );
+        } else if( id == MQTT5_MAXIMUM_PACKET_SIZE && get_uint32( buffer + offset ) != 0 ) {
+            broker_packet_size = get_uint32( buffer + offset );
+        } else if( id == MQTT5_SERVER_KEEP_ALIVE ) {
+            broker_keep_alive = get_uint16( buffer + offset );
+        }
+    }
+
+    return (int) end;
+}
+
+int AWSIoTMqtt5::repack( uint32_t header, uint32_t remaining )
+{
+    unsigned char first_byte = rx[0];
+
+    /* the body stays where it is; the shorter fixed header is written right in front of it */
+    rx_start = header - 1 - length_size( remaining );
+    rx[rx_start] = first_byte;
+    put_length( rx + rx_start + 1, remaining );
+    rx_length = header - rx_start + remaining;
+    return 0;
+}
+
+int AWSIoTMqtt5::decode( uint32_t length )
+{
+    uint32_t remaining = 0;
+    uint32_t header = 0;
+    uint32_t offset = 0;
+    uint32_t count = 0;
+    uint32_t i = 0;
+    unsigned char flags = 0;
+    unsigned char reason = 0;
+    int used = -1;
+    int rc = 0;
+
+    rx_start = 0;
+    rx_length = 0;
+    if( length >= 2 ) {
+        used = get_length( rx + 1, length - 1, &remaining );
+    }
+    if( used < 0 || 1 + used + remaining != length ) {
+        return -1;
+    }
+    header = 1 + used;
+
+    switch( rx[0] >> 4 ) {
+        case MQTT5_CONNACK:
+            if( remaining < 2 || ( remaining > 2 && read_properties( rx + header + 2, remaining - 2, MQTT5_CONNACK ) < 0 ) ) {
+                return -1;
+            }
+            flags = rx[header];
+            reason = rx[header + 1];
+            if( reason != 0 ) {
+                AWS_LIBRARY_ERROR(("MQTT 5: connection refused, reason code 0x%02x \n", reason));
+            }
+            rx[1] = 2;
+            rx[2] = flags;
+            rx[3] = connack_return_code( reason );
+            rx_length = 4;
+            return 0;
+
+        case MQTT5_PUBLISH:
+            if( remaining < 2 ) {
+                return -1;
+            }
+            offset = header + 2 + get_uint16( rx + header ) + ( ( ( rx[0] >> 1 ) & 0x03 ) ? 2 : 0 );
+            rc = ( offset <= length ) ? read_properties( rx + offset, length - offset, MQTT5_PUBLISH ) : -1;
+            if( rc < 0 ) {
+                return -1;
+            }
+            memmove( rx + offset, rx + offset + rc, length - offset - rc );
+            return repack( header, remaining - rc );
+
+        case MQTT5_SUBACK:
+            rc = ( remaining >= 2 ) ? read_properties( rx + header + 2, remaining - 2, MQTT5_SUBACK ) : -1;
+            if( rc < 0 ) {
+                return -1;
+            }
+            /* granted QoS is the same in MQTT 3.1.1; every failure reason becomes the one failure return code */
+            count = remaining - 2 - rc;
+            for( i = 0; i < count; i++ ) {
+                reason = rx[header + 2 + rc + i];
+                rx[header + 2 + i] = ( reason >= 0x80 ) ? 0x80 : reason;
+            }
+            return repack( header, 2 + count );
+
+        case MQTT5_PUBACK:
+        case MQTT5_PUBREC:
+        case MQTT5_PUBREL:
+        case MQTT5_PUBCOMP:
+        case MQTT5_UNSUBACK:
+            /* reason codes and properties have no MQTT 3.1.1 counterpart; the network reports a refused PUBACK to its ack observer */
+            if( remaining < 2 ) {
+                return -1;
+            }
+            return repack( header, 2 );
+
+        case MQTT5_PINGRESP:
+            rx_length = length;
+            return 0;
+
+        case MQTT5_DISCONNECT:
+            broker_disconnect_reason = ( remaining > 0 ) ? rx[header] : 0;
+            AWS_LIBRARY_ERROR(("MQTT 5: broker closed the connection, reason code 0x%02x \n", broker_disconnect_reason));
+            return -1;
+
+        default:
+            return -1;
+    }
+}
+
+int AWSIoTMqtt5::take( unsigned char* buffer, int length )
+{
+    uint32_t count = ( length > 0 ) ? (uint32_t) length : 0;
+
+    if( count > rx_length ) {
+        count = rx_length;
+    }
+    memcpy( buffer, rx + rx_start, count );
+    rx_start += count;
+    rx_length -= count;
+    return (int) count;
+}
+
+uint32_t AWSIoTMqtt5::pending() const
+{
+    return rx_length;
+}
+
+uint16_t AWSIoTMqtt5::receive_maximum() const
+{
+    return broker_receive_maximum;
+}
+
+int32_t AWSIoTMqtt5::server_keep_alive() const
+{
+    return broker_keep_alive;
+}
+
+uint8_t AWSIoTMqtt5::disconnect_reason() const
+{
+    return broker_disconnect_reason;
+}
@@ -0,0 +1,180 @@
+/*
+ * Copyright 2019-2020 Cypress Semiconductor Corporation
+ * SPDX-License-Identifier: Apache-2.0
+ * 
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ * 
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ * 
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/** @file
+ *  MQTT 5 framing of the packets of the MQTT 3.1.1 client
+ */
+#ifndef AWS_MQTT5_H
+#define AWS_MQTT5_H
+
+#include <stdint.h>
+#include "aws_common.h"
+
+/**
+ * @addtogroup aws_iot_classes
+ *
+ * @{
+ */
+
+/** Translates between the MQTT 3.1.1 packets of the MQTT client and MQTT 5 on the wire.
+ *
+ * The Eclipse Paho embedded client speaks MQTT 3.1.1 only, so an MQTT 5 connection is carried by rewriting every packet
+ * in the network ( MQTTNetwork.h ): outbound packets get the MQTT 5 protocol level and properties, inbound packets lose
+ * their properties and have their reason codes mapped onto MQTT 3.1.1 return codes. On the way the codec
+ * - takes the broker's Receive Maximum, Topic Alias Maximum, Maximum Packet Size and Server Keep Alive from the CONNACK,
+ * - sends a topic alias instead of the topic once the broker has been told the alias, reusing the least recently
+ *   used alias when all are taken,
+ * - adds the message expiry and user properties set for the next PUBLISH.
+ *
+ * The broker may not send topic aliases ( Topic Alias Maximum 0 ), so every received PUBLISH names its topic.
+ * A codec serves a single connection and is not thread safe.
+ */
+class AWSIoTMqtt5
+{
+public:
+    /** Constructor of AWSIoTMqtt5 class.
+     *
+     * @param[in] rx_buffer       : Buffer for one inbound packet; its size is announced to the broker as Maximum Packet Size
+     * @param[in] rx_size         : Size of 'rx_buffer'
+     * @param[in] tx_buffer       : Buffer for the translated start of an outbound packet
+     * @param[in] tx_size         : Size of 'tx_buffer'
+     *
+     */
+    AWSIoTMqtt5( unsigned char* rx_buffer, uint32_t rx_size, unsigned char* tx_buffer, uint32_t tx_size );
+
+    /** Sets the properties sent with the next PUBLISH. They are used once, or until @ref clear_publish_properties.
+     *
+     * @param[in] message_expiry  : Message Expiry Interval in seconds; 0 sends none
+     * @param[in] properties      : User properties; must stay valid until the PUBLISH is written
+     * @param[in] count           : Number of entries in 'properties'
+     *
+     * @return int                : 0 on success; -1 if the properties exceed @ref AWS_MQTT5_PROPERTIES_MAX_LENGTH
+     */
+    int set_publish_properties( uint32_t message_expiry, const aws_user_property_t* properties, uint8_t count );
+
+    /** Drops the properties set for the next PUBLISH. */
+    void clear_publish_properties();
+
+    /** Checks that a PUBLISH with the properties set for it can be sent.
+     *
+     * @param[in] topic_length    : Length of its topic
+     * @param[in] packet_length   : Length of the MQTT 3.1.1 packet
+     *
+     * @return bool               : false if it would exceed the broker's Maximum Packet Size or the send buffer
+     */
+    bool fits( uint32_t topic_length, uint32_t packet_length ) const;
+
+    /** Translates an outbound MQTT 3.1.1 packet. The MQTT 5 packet is the returned number of bytes of the send buffer,
+     *  followed by the bytes of 'packet' from 'resume' on.
+     *
+     * @param[in]  packet         : Whole MQTT 3.1.1 packet
+     * @param[in]  length         : Length of 'packet'
+     * @param[out] resume         : Offset in 'packet' of the bytes sent unchanged after the send buffer
+     *
+     * @return int                : Bytes of the send buffer to write first; -1 if the packet is malformed or exceeds a limit
+     */
+    int encode( const unsigned char* packet, int length, int* resume );
+
+    /** Returns the send buffer filled by @ref encode. */
+    unsigned char* tx_buffer();
+
+    /** Returns the buffer an inbound MQTT 5 packet is read into before @ref decode. */
+    unsigned char* rx_buffer();
+
+    /** Returns the size of the receive buffer. */
+    uint32_t rx_size() const;
+
+    /** Translates the MQTT 5 packet in the receive buffer in place; the MQTT 3.1.1 packet is then handed out by @ref take.
+     *
+     * @param[in] length          : Length of the packet
+     *
+     * @return int                : 0 on success; -1 if the packet is malformed or the broker closes the connection
+     */
+    int decode( uint32_t length );
+
+    /** Copies bytes of the translated inbound packet.
+     *
+     * @param[out] buffer         : Buffer to fill
+     * @param[in]  length         : Size of 'buffer'
+     *
+     * @return int                : Bytes copied
+     */
+    int take( unsigned char* buffer, int length );
+
+    /** Returns the number of bytes of the translated inbound packet not taken yet. */
+    uint32_t pending() const;
+
+    /** Returns the number of QoS1 publishes the broker accepts unacknowledged; 65535 if it set no Receive Maximum. */
+    uint16_t receive_maximum() const;
+
+    /** Returns the keep alive interval in seconds chosen by the broker; -1 if it kept the client's. */
+    int32_t server_keep_alive() const;
+
+    /** Returns the reason code of the DISCONNECT sent by the broker; 0 if there was none. */
+    uint8_t disconnect_reason() const;
+
+private:
+    /** Outbound topic alias; the alias is the index of the entry plus one */
+    struct alias
+    {
+        uint32_t used;                      /**< Alias clock at the last publish to the topic */
+        uint16_t length;                    /**< Topic length; 0 marks an alias not handed out yet */
+        char topic[AWS_TOPIC_FILTER_MAX_LENGTH];
+    };
+
+    unsigned char* rx;
+    uint32_t rx_capacity;
+    uint32_t rx_start;
+    uint32_t rx_length;
+    unsigned char* tx;
+    uint32_t tx_capacity;
+
+    uint16_t broker_receive_maximum;
+    uint16_t broker_alias_maximum;
+    uint32_t broker_packet_size;
+    int32_t broker_keep_alive;
+    uint8_t broker_disconnect_reason;
+
+    alias aliases[AWS_MQTT5_TOPIC_ALIASES];
+    uint32_t alias_clock;
+
+    uint32_t expiry;
+    const aws_user_property_t* user_properties;
+    uint8_t user_property_count;
+    uint32_t properties_length;             /**< Encoded length of the expiry and user properties */
+
+    /** Forgets the aliases and limits of the previous connection */
+    void reset();
+
+    int encode_connect( const unsigned char* packet, uint32_t header, uint32_t length, int* resume );
+    int encode_publish( const unsigned char* packet, uint32_t header, uint32_t length, int* resume );
+
+    /** Puts the fixed header in front of the body built in the send buffer; the packet goes on with packet[tail_offset, length) */
+    int finish( unsigned char first_byte, uint32_t body_length, const unsigned char* packet, uint32_t tail_offset, uint32_t length, int* resume );
+
+    /** Walks the properties of an inbound packet, taking the broker's limits from a CONNACK; returns their length, -1 if malformed */
+    int read_properties( const unsigned char* buffer, uint32_t available, unsigned char type );
+
+    /** Moves the fixed header of the inbound packet up to its body after the body was shortened */
+    int repack( uint32_t header, uint32_t remaining );
+};
+
+/**
+ * @}
+ */
+
+#endif
@@ -0,0 +1,183 @@
+/*
+ * Copyright 2019-2020 Cypress Semiconductor Corporation
+ * SPDX-License-Identifier: Apache-2.0
+ * 
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ * 
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ * 
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+
+/** @file
+ *  Priority lanes with per-lane byte budgets for the outbound request path
+ */
+#ifndef AWS_PRIORITY_LANES_H
+#define AWS_PRIORITY_LANES_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+/**
+ * @addtogroup aws_iot_classes
+ *
+ * @{
+ */
+
+/** Outbound scheduler over LANES priority lanes, lane 0 being the highest.
+ *
+ * Requests are linked into per-lane FIFOs through their 'next' member and weighted by their 'bytes' member, so the
+ * lanes never allocate. @ref pop implements deficit round robin in priority order: each round credits every waiting
+ * lane with its byte budget, and the highest lane whose head fits into its credit goes first. A busy high lane thus
+ * gets its budget ahead of everyone else in each round, while lower lanes still get theirs; a budget of 0 makes a lane
+ * strictly preemptive. Not thread safe; owned by the thread calling yield, like the consumer side of @ref AWSIoTSubmitQueue.
+ */
+template <typename T, uint32_t LANES>
+class AWSIoTPriorityLanes
+{
+public:
+    AWSIoTPriorityLanes()
+    {
+        for( uint32_t i = 0; i < LANES; i++ ) {
+            lanes[i].head = NULL;
+            lanes[i].tail = NULL;
+            lanes[i].budget = 0;
+            lanes[i].deficit = 0;
+        }
+    }
+
+    /** Sets the byte budget a lane is credited with per round.
+     *
+     * @param[in] lane            : Lane index
+     * @param[in] budget          : Bytes per round; 0 to always serve the lane first
+     *
+     */
+    void set_budget( uint32_t lane, uint32_t budget )
+    {
+        lanes[lane].budget = budget;
+    }
+
+    /** Appends a request to a lane.
+     *
+     * @param[in] item            : Request; its 'bytes' member must be set
+     * @param[in] lane            : Lane index
+     *
+     */
+    void push( T* item, uint32_t lane )
+    {
+        item->next = NULL;
+        if( lanes[lane].tail != NULL ) {
+            lanes[lane].tail->next = item;
+        } else {
+            lanes[lane].head = item;
+        }
+        lanes[lane].tail = item;
+    }
+
+    /** Puts a request taken with @ref pop back at the head of its lane, e.g. one that could not be sent because the link was lost.
+     *  The lane gets back the credit the request took.
+     *
+     * @param[in] item            : Request returned by @ref pop
+     * @param[in] lane            : Lane returned by @ref pop
+     *
+     */
+    void push_front( T* item, uint32_t lane )
+    {
+        item->next = lanes[lane].head;
+        if( lanes[lane].head == NULL ) {
+            lanes[lane].tail = item;
+        }
+        lanes[lane].head = item;
+        if( lanes[lane].budget != 0 ) {
+            lanes[lane].deficit += item->bytes;
+        }
+    }
+
+    /** Takes the next request to send.
+     *
+     * @param[out] lane           : Lane the request was taken from
+     *
+     * @return T*                 : Next request; NULL if all lanes are empty
+     */
+    T* pop( uint32_t* lane )
+    {
+        uint32_t i = 0;
+        bool waiting = false;
+        T* item = NULL;
+
+        for( ;; ) {
+            waiting = false;
+            for( i = 0; i < LANES; i++ ) {
+                item = lanes[i].head;
+                if( item == NULL ) {
+                    continue;
+                }
+                waiting = true;
+                if( lanes[i].budget != 0 && item->bytes > lanes[i].deficit ) {
+                    continue;
+                }
+
+                if( lanes[i].budget != 0 ) {
+                    lanes[i].deficit -= item->bytes;
+                }
+                lanes[i].head = item->next;
+                if( lanes[i].head == NULL ) {
+                    /* an idle lane does not bank credit */
+                    lanes[i].tail = NULL;
+                    lanes[i].deficit = 0;
+                }
+                *lane = i;
+                return item;
+            }
+            if( !waiting ) {
+                return NULL;
+            }
+
+            /* no head fits into its credit: start a new round */
+            for( i = 0; i < LANES; i++ ) {
+                if( lanes[i].head != NULL ) {
+                    lanes[i].deficit += lanes[i].budget;
+                }
+            }
+        }
+    }
+
+    /** Checks whether requests are waiting.
+     *
+     * @return bool               : true if @ref pop would return a request
+     */
+    bool empty() const
+    {
+        for( uint32_t i = 0; i < LANES; i++ ) {
+            if( lanes[i].head != NULL ) {
+                return false;
+            }
+        }
+        return true;
+    }
+
+private:
+    struct lane
+    {
+        T* head;
+        T* tail;
+        uint32_t budget;
+        uint32_t deficit;
+    };
+
+    lane lanes[LANES];
+};
+
+/**
+ * @}
+ */
+
+#endif
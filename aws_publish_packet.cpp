@@ -0,0 +1,120 @@
+/*
+ * Copyright 2019-2020 Cypress Semiconductor Corporation
+ * SPDX-License-Identifier: Apache-2.0
+ * 
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ * 
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ * 
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+/** @file
+ *
+ * Implementation for AWS IoT PUBLISH packet encoding
+ *
+ */
+#include "aws_publish_packet.h"
+#include "string.h"
+
+#define PUBLISH_PACKET_TYPE     ( 3 )
+
+uint32_t AWSIoTPublishPacket::size( uint32_t topic_length, uint32_t length, aws_iot_qos_level_t qos )
+{
+    uint32_t remaining_length = 2 + topic_length + length + ( ( qos == AWS_QOS_ATMOST_ONCE ) ? 0 : 2 );
+    uint32_t size = 1 + remaining_length;
+
+    /* Remaining length is encoded with 7 bits per byte */
+    do {
+        size++;
+        remaining_length >>= 7;
+    } while( remaining_length > 0 );
+
+    return size;
+}
+
+int AWSIoTPublishPacket::encode_header( unsigned char* header, aws_iot_qos_level_t qos, uint32_t remaining_length )
+{
+    int header_length = 1;
+
+    header[0] = (unsigned char) ( ( PUBLISH_PACKET_TYPE << 4 ) | ( qos << 1 ) );
+    do {
+        header[header_length] = (unsigned char) ( remaining_length & 0x7f );
+        remaining_length >>= 7;
+        if( remaining_length > 0 ) {
+            header[header_length] |= 0x80;
+        }
+        header_length++;
+    } while( remaining_length > 0 );
+
+    return header_length;
+}
+
+int AWSIoTPublishPacket::encode( unsigned char* buffer, uint32_t buffer_size, const char* topic, uint32_t topic_length,
+                                 aws_iot_qos_level_t qos, uint16_t packet_id, const char* data, uint32_t length )
+{
+    uint32_t remaining_length = 2 + topic_length + length + ( ( qos == AWS_QOS_ATMOST_ONCE ) ? 0 : 2 );
+    unsigned char* body = NULL;
+
+    if( size( topic_length, length, qos ) > buffer_size ) {
+        return -1;
+    }
+
+    body = buffer + encode_header( buffer, qos, remaining_length );
+    body[0] = (unsigned char) ( topic_length >> 8 );
+    body[1] = (unsigned char) topic_length;
+    memcpy( body + 2, topic, topic_length );
+    body += 2 + topic_length;
+    if( qos != AWS_QOS_ATMOST_ONCE ) {
+        body[0] = (unsigned char) ( packet_id >> 8 );
+        body[1] = (unsigned char) packet_id;
+        body += 2;
+    }
+    if( length > 0 ) {
+        memcpy( body, data, length );
+    }
+
+    return (int) ( body + length - buffer );
+}
+
+uint32_t AWSIoTPublishPacket::prepare_topic( unsigned char* topic_start, const char* topic, uint32_t topic_length )
+{
+    topic_start[0] = (unsigned char) ( topic_length >> 8 );
+    topic_start[1] = (unsigned char) topic_length;
+    memcpy( topic_start + 2, topic, topic_length );
+
+    return 2 + topic_length;
+}
+
+int AWSIoTPublishPacket::encode_prepared( unsigned char* topic_start, uint32_t topic_bytes, aws_iot_qos_level_t qos, uint16_t packet_id,
+                                          const char* data, uint32_t length, unsigned char** packet )
+{
+    unsigned char header[AWS_PUBLISH_HEADER_MAX_LENGTH];
+    unsigned char* payload = topic_start + topic_bytes;
+    uint32_t remaining_length = topic_bytes + length;
+    int header_length = 0;
+
+    if( qos != AWS_QOS_ATMOST_ONCE ) {
+        payload[0] = (unsigned char) ( packet_id >> 8 );
+        payload[1] = (unsigned char) packet_id;
+        payload += 2;
+        remaining_length += 2;
+    }
+    if( length > 0 ) {
+        memcpy( payload, data, length );
+    }
+
+    /* the header length depends on the remaining length, so it is built aside and moved up to the topic */
+    header_length = encode_header( header, qos, remaining_length );
+    *packet = topic_start - header_length;
+    memcpy( *packet, header, header_length );
+
+    return (int) ( header_length + remaining_length );
+}
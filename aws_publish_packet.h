@@ -0,0 +1,104 @@
+/*
+ * Copyright 2019-2020 Cypress Semiconductor Corporation
+ * SPDX-License-Identifier: Apache-2.0
+ * 
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ * 
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ * 
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/** @file
+ *  Encoding of the PUBLISH packets the client writes to the network itself
+ */
+#ifndef AWS_PUBLISH_PACKET_H
+#define AWS_PUBLISH_PACKET_H
+
+#include <stdint.h>
+#include "aws_common.h"
+
+/**
+ * @addtogroup aws_iot_classes
+ *
+ * @{
+ */
+
+/** Bytes a PUBLISH fixed header takes at most: the packet type and four bytes of remaining length. */
+#define AWS_PUBLISH_HEADER_MAX_LENGTH 5
+
+/** Builds MQTT 3.1.1 PUBLISH packets in caller-provided buffers, without allocating.
+ *
+ * A string topic publish is encoded whole into one buffer. A registered topic is laid out once with @ref prepare_topic;
+ * each publish then only appends the packet identifier and payload behind it and writes the fixed header in front.
+ */
+class AWSIoTPublishPacket
+{
+public:
+    /** Returns the size of a PUBLISH packet on the wire.
+     *
+     * @param[in] topic_length    : Length of the topic
+     * @param[in] length          : Length of the payload
+     * @param[in] qos             : QoS level; a packet identifier is added above QoS 0
+     *
+     * @return uint32_t           : Size of the packet, fixed header included
+     */
+    static uint32_t size( uint32_t topic_length, uint32_t length, aws_iot_qos_level_t qos );
+
+    /** Encodes a PUBLISH packet for a topic string.
+     *
+     * @param[out] buffer         : Buffer for the packet
+     * @param[in]  buffer_size    : Size of 'buffer'
+     * @param[in]  topic          : Topic
+     * @param[in]  topic_length   : Length of 'topic'
+     * @param[in]  qos            : QoS level
+     * @param[in]  packet_id      : Packet identifier; ignored for QoS 0
+     * @param[in]  data           : Payload
+     * @param[in]  length         : Length of 'data'
+     *
+     * @return int                : Length of the packet; -1 if it does not fit into 'buffer'
+     */
+    static int encode( unsigned char* buffer, uint32_t buffer_size, const char* topic, uint32_t topic_length,
+                       aws_iot_qos_level_t qos, uint16_t packet_id, const char* data, uint32_t length );
+
+    /** Writes the topic of a registered topic publish; @ref AWS_PUBLISH_HEADER_MAX_LENGTH bytes in front of it stay free for the fixed header.
+     *
+     * @param[out] topic_start    : Where the topic length and topic go
+     * @param[in]  topic          : Topic
+     * @param[in]  topic_length   : Length of 'topic'
+     *
+     * @return uint32_t           : Bytes written; the packet identifier or payload follows them
+     */
+    static uint32_t prepare_topic( unsigned char* topic_start, const char* topic, uint32_t topic_length );
+
+    /** Completes a PUBLISH packet around a topic written by @ref prepare_topic. The caller checks that the packet
+     *  fits, with @ref size, before calling.
+     *
+     * @param[in,out] topic_start : Topic written by @ref prepare_topic
+     * @param[in]  topic_bytes    : Value returned by @ref prepare_topic
+     * @param[in]  qos            : QoS level
+     * @param[in]  packet_id      : Packet identifier; ignored for QoS 0
+     * @param[in]  data           : Payload
+     * @param[in]  length         : Length of 'data'
+     * @param[out] packet         : First byte of the packet, inside the bytes kept free in front of the topic
+     *
+     * @return int                : Length of the packet
+     */
+    static int encode_prepared( unsigned char* topic_start, uint32_t topic_bytes, aws_iot_qos_level_t qos, uint16_t packet_id,
+                                const char* data, uint32_t length, unsigned char** packet );
+
+private:
+    static int encode_header( unsigned char* header, aws_iot_qos_level_t qos, uint32_t remaining_length );
+};
+
+/**
+ * @}
+ */
+
+#endif
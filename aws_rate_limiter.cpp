@@ -0,0 +1,108 @@
+/*
+ * Copyright 2019-2020 Cypress Semiconductor Corporation
+ * SPDX-License-Identifier: Apache-2.0
+ * 
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ * 
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ * 
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+/** @file
+ *
+ * Implementation for AWS IoT publish rate limiter
+ *
+ */
+#include "aws_rate_limiter.h"
+#include "string.h"
+
+AWSIoTRateLimiter::AWSIoTRateLimiter()
+{
+    aws_rate_limit_params_t params;
+
+    memset( &params, 0, sizeof(params) );
+    configure( params );
+}
+
+void AWSIoTRateLimiter::configure( const aws_rate_limit_params_t& params )
+{
+    /* A zero burst still has to let one publish through */
+    publishes.rate = params.publishes_per_second;
+    publishes.capacity = (int64_t) ( params.publish_burst ? params.publish_burst : 1 ) * 1000;
+    publishes.level = publishes.capacity;
+
+    bytes.rate = params.bytes_per_second;
+    bytes.capacity = (int64_t) ( params.byte_burst ? params.byte_burst : params.bytes_per_second ) * 1000;
+    bytes.level = bytes.capacity;
+
+    last_ms = 0;
+    started = false;
+    memset( &stats, 0, sizeof(stats) );
+}
+
+uint32_t AWSIoTRateLimiter::take( bucket& b, uint64_t elapsed_ms, uint32_t tokens )
+{
+    if( b.rate == 0 ) {
+        return 0;
+    }
+
+    b.level += (int64_t) elapsed_ms * b.rate;
+    if( b.level > b.capacity ) {
+        b.level = b.capacity;
+    }
+
+    b.level -= (int64_t) tokens * 1000;
+    if( b.level >= 0 ) {
+        return 0;
+    }
+
+    /* Round up so that the caller never wakes up before the debt is paid off */
+    return (uint32_t) ( ( -b.level + b.rate - 1 ) / b.rate );
+}
+
+uint32_t AWSIoTRateLimiter::reserve( uint64_t now_ms, uint32_t size )
+{
+    uint64_t elapsed_ms = 0;
+    uint32_t delay_ms = 0;
+    uint32_t byte_delay_ms = 0;
+
+    if( started && now_ms > last_ms ) {
+        elapsed_ms = now_ms - last_ms;
+    }
+    if( !started || now_ms > last_ms ) {
+        last_ms = now_ms;
+    }
+    started = true;
+
+    delay_ms = take( publishes, elapsed_ms, 1 );
+    byte_delay_ms = take( bytes, elapsed_ms, size );
+    if( byte_delay_ms > delay_ms ) {
+        delay_ms = byte_delay_ms;
+    }
+
+    stats.publishes++;
+    if( delay_ms > 0 ) {
+        stats.delayed_publishes++;
+        stats.total_delay_ms += delay_ms;
+        if( delay_ms > stats.max_delay_ms ) {
+            stats.max_delay_ms = delay_ms;
+        }
+    }
+
+    return delay_ms;
+}
+
+void AWSIoTRateLimiter::get_stats( aws_rate_limit_stats_t* stats ) const
+{
+    if( stats != NULL ) {
+        *stats = AWSIoTRateLimiter::stats;
+    }
+}
@@ -0,0 +1,91 @@
+/*
+ * Copyright 2019-2020 Cypress Semiconductor Corporation
+ * SPDX-License-Identifier: Apache-2.0
+ * 
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ * 
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ * 
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+/** @file
+ *  Token-bucket rate limiter used to shape AWS IoT publishes
+ */
+#ifndef AWS_RATE_LIMITER_H
+#define AWS_RATE_LIMITER_H
+
+#include "aws_common.h"
+
+/**
+ * @addtogroup aws_iot_classes
+ *
+ * @{
+ */
+
+/** Token-bucket rate limiter for the AWS IoT publish path.
+ *
+ * Two buckets are kept, one counting publishes and one counting bytes. A publish always gets its tokens;
+ * when a bucket runs dry it goes into debt and the caller is told how long to wait before sending,
+ * so bursts are shaped instead of rejected. The limiter does not sleep by itself, which lets both the
+ * blocking publish path and a queued publish path schedule around the returned delay.
+ */
+class AWSIoTRateLimiter
+{
+public:
+    /** Default constructor of AWSIoTRateLimiter class. Rate limiting is disabled until @ref configure is called. */
+    AWSIoTRateLimiter();
+
+    /** Configures the rate limits. Buckets start full.
+     *
+     * @param[in] params          : Rate limit parameters
+     *
+     */
+    void configure( const aws_rate_limit_params_t& params );
+
+    /** Reserves tokens for one publish.
+     *
+     * @param[in] now_ms          : Current time in milliseconds
+     * @param[in] bytes           : Size of the MQTT packet to be sent
+     *
+     * @return uint32_t           : Time (in ms) the caller must wait before sending the publish; 0 if it can go out now
+     */
+    uint32_t reserve( uint64_t now_ms, uint32_t bytes );
+
+    /** Returns the rate limiter statistics.
+     *
+     * @param[out] stats          : Statistics collected since the last call to @ref configure
+     *
+     */
+    void get_stats( aws_rate_limit_stats_t* stats ) const;
+
+private:
+    /** Single token bucket. Levels are kept in milli-tokens so that a rate in tokens/second refills 'rate' milli-tokens per ms. */
+    struct bucket
+    {
+        uint32_t rate;              /**< Refill rate in tokens per second; 0 means unlimited */
+        int64_t  capacity;          /**< Bucket depth in milli-tokens */
+        int64_t  level;             /**< Current level in milli-tokens; negative while in debt */
+    };
+
+    uint32_t take( bucket& b, uint64_t elapsed_ms, uint32_t tokens );
+
+    bucket publishes;
+    bucket bytes;
+    uint64_t last_ms;
+    bool started;
+    aws_rate_limit_stats_t stats;
+};
+
+/**
+ * @}
+ */
+
+#endif
@@ -0,0 +1,780 @@
+/*
+ * Copyright 2019-2020 Cypress Semiconductor Corporation
+ * SPDX-License-Identifier: Apache-2.0
+ * 
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ * 
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ * 
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+/** @file
+ *
+ * Implementation for AWS IoT session journal
+ *
+ */
+#include "aws_session_journal.h"
+#include "aws_error.h"
+#include "string.h"
+
+/* CRC-32 of type, length and body, type, body length (little-endian) */
+#define SESSION_RECORD_HEADER_LENGTH    (7)
+/* sequence number, QoS and topic length ahead of the topic and message of a publish record */
+#define SESSION_PUBLISH_PREFIX_LENGTH   (7)
+#define SESSION_VERSION                 (1)
+
+/** Record types */
+enum
+{
+    SESSION_RECORD_HEADER = 1,
+    SESSION_RECORD_PACKET_ID,
+    SESSION_RECORD_SUBSCRIBE,
+    SESSION_RECORD_UNSUBSCRIBE,
+    SESSION_RECORD_CLEAN,
+    SESSION_RECORD_PUBLISH,
+    SESSION_RECORD_DONE
+};
+
+static const uint8_t session_magic[5] = { 'A', 'W', 'S', 'J', SESSION_VERSION };
+
+/* Reflected CRC-32 (IEEE 802.3), bitwise: records are short and written rarely */
+static uint32_t session_crc( uint32_t crc, const void* data, uint32_t length )
+{
+    const uint8_t* bytes = (const uint8_t*) data;
+    uint32_t i = 0;
+    int bit = 0;
+
+    for( i = 0; i < length; i++ ) {
+        crc ^= bytes[i];
+        for( bit = 0; bit < 8; bit++ ) {
+            crc = ( crc >> 1 ) ^ ( 0xEDB88320u & ( 0u - ( crc & 1 ) ) );
+        }
+    }
+    return crc;
+}
+
+static void session_put32( uint8_t* out, uint32_t value )
+{
+    out[0] = (uint8_t) value;
+    out[1] = (uint8_t) ( value >> 8 );
+    out[2] = (uint8_t) ( value >> 16 );
+    out[3] = (uint8_t) ( value >> 24 );
+}
+
+static uint32_t session_get32( const uint8_t* in )
+{
+    return (uint32_t) in[0] | ( (uint32_t) in[1] << 8 ) | ( (uint32_t) in[2] << 16 ) | ( (uint32_t) in[3] << 24 );
+}
+
+static bool session_write( int fd, const void* data, uint32_t length )
+{
+    const uint8_t* bytes = (const uint8_t*) data;
+    ssize_t rc = 0;
+
+    while( length > 0 ) {
+        rc = ::write( fd, bytes, length );
+        if( rc <= 0 ) {
+            return false;
+        }
+        bytes += rc;
+        length -= rc;
+    }
+    return true;
+}
+
+static ssize_t session_read( int fd, void* data, uint32_t length )
+{
+    uint8_t* bytes = (uint8_t*) data;
+    uint32_t total = 0;
+    ssize_t rc = 0;
+
+    while( total < length ) {
+        rc = ::read( fd, bytes + total, length - total );
+        if( rc < 0 ) {
+            return rc;
+        }
+        if( rc == 0 ) {
+            break;
+        }
+        total += rc;
+    }
+    return total;
+}
+
+AWSIoTSessionJournal::AWSIoTSessionJournal()
+{
+    fd = -1;
+    path[0] = '\0';
+    tmp_path[0] = '\0';
+    sync_interval_ms = AWS_SESSION_DEFAULT_SYNC_INTERVAL;
+    file_end = 0;
+    used = 0;
+    dirty = false;
+    dirty_since_ms = 0;
+    next_seq = 1;
+    next_packet_id = 0;
+    memset( subscriptions, 0, sizeof(subscriptions) );
+    memset( pending, 0, sizeof(pending) );
+}
+
+AWSIoTSessionJournal::~AWSIoTSessionJournal()
+{
+    close();
+}
+
+cy_rslt_t AWSIoTSessionJournal::open( const aws_session_params_t& params )
+{
+    int tmp_fd = -1;
+
+    close();
+
+    if( params.path == NULL || strlen( params.path ) >= sizeof(path) ) {
+        AWS_LIBRARY_ERROR(("Session journal path missing or too long \n"));
+        return CY_RSLT_AWS_ERROR_JOURNAL_FAILED;
+    }
+    strcpy( path, params.path );
+    strcpy( tmp_path, path );
+    strcat( tmp_path, ".tmp" );
+    sync_interval_ms = params.sync_interval_ms ? params.sync_interval_ms : AWS_SESSION_DEFAULT_SYNC_INTERVAL;
+
+    fd = ::open( path, O_RDWR );
+    if( fd < 0 ) {
+        /* a compaction got as far as removing the journal: its replacement is complete */
+        tmp_fd = ::open( tmp_path, O_RDONLY );
+        if( tmp_fd >= 0 ) {
+            ::close( tmp_fd );
+            rename( tmp_path, path );
+            fd = ::open( path, O_RDWR );
+        }
+    }
+    if( fd < 0 ) {
+        fd = ::open( path, O_RDWR | O_CREAT, 0666 );
+    }
+    if( fd < 0 ) {
+        AWS_LIBRARY_ERROR(("Cannot open session journal %s \n", path));
+        return CY_RSLT_AWS_ERROR_JOURNAL_FAILED;
+    }
+
+    if( !load() ) {
+        /* torn tail, a foreign file or a new one: rewrite it from what could be replayed */
+        if( !compact() ) {
+            fail();
+            return CY_RSLT_AWS_ERROR_JOURNAL_FAILED;
+        }
+    }
+
+    AWS_LIBRARY_DEBUG(("Session journal %s opened, %lu bytes \n", path, (unsigned long) file_end));
+    return CY_RSLT_SUCCESS;
+}
+
+void AWSIoTSessionJournal::close()
+{
+    if( fd >= 0 ) {
+        commit();
+    }
+    if( fd >= 0 ) {
+        ::close( fd );
+        fd = -1;
+    }
+    file_end = 0;
+    used = 0;
+    dirty = false;
+    next_seq = 1;
+    next_packet_id = 0;
+    memset( subscriptions, 0, sizeof(subscriptions) );
+    memset( pending, 0, sizeof(pending) );
+}
+
+bool AWSIoTSessionJournal::is_open() const
+{
+    return fd >= 0;
+}
+
+int AWSIoTSessionJournal::find_subscription( const char* topic ) const
+{
+    int i = 0;
+
+    for( i = 0; i < AWS_SESSION_MAX_SUBSCRIPTIONS; i++ ) {
+        if( subscriptions[i].used && strcmp( subscriptions[i].topic, topic ) == 0 ) {
+            return i;
+        }
+    }
+    return -1;
+}
+
+AWSIoTSessionJournal::subscription* AWSIoTSessionJournal::subscription_slot( const char* topic )
+{
+    int index = find_subscription( topic );
+    uint8_t i = 0;
+
+    if( index >= 0 ) {
+        return &subscriptions[index];
+    }
+    for( i = 0; i < AWS_SESSION_MAX_SUBSCRIPTIONS; i++ ) {
+        if( !subscriptions[i].used ) {
+            return &subscriptions[i];
+        }
+    }
+    return NULL;
+}
+
+bool AWSIoTSessionJournal::subscribed( const char* topic, uint8_t qos ) const
+{
+    int index = find_subscription( topic );
+
+    return index >= 0 && subscriptions[index].qos == qos;
+}
+
+void AWSIoTSessionJournal::subscribe( const char* topic, uint8_t qos )
+{
+    subscription* entry = NULL;
+
+    if( fd < 0 || strlen( topic ) > AWS_SESSION_MAX_TOPIC_LENGTH ) {
+        return;
+    }
+
+    entry = subscription_slot( topic );
+    if( entry == NULL ) {
+        /* not journaled; a restart simply subscribes again */
+        return;
+    }
+
+    if( append( SESSION_RECORD_SUBSCRIBE, &qos, 1, topic, strlen( topic ) ) == 0 ) {
+        return;
+    }
+    entry->used = true;
+    entry->qos = qos;
+    strcpy( entry->topic, topic );
+    mark_dirty();
+}
+
+cy_rslt_t AWSIoTSessionJournal::unsubscribe( const char* topic )
+{
+    int index = -1;
+
+    if( fd < 0 ) {
+        return CY_RSLT_SUCCESS;
+    }
+
+    index = find_subscription( topic );
+    if( index < 0 ) {
+        return CY_RSLT_SUCCESS;
+    }
+
+    subscriptions[index].used = false;
+    if( append( SESSION_RECORD_UNSUBSCRIBE, topic, strlen( topic ) ) == 0 ) {
+        return CY_RSLT_AWS_ERROR_JOURNAL_FAILED;
+    }
+    return commit();
+}
+
+cy_rslt_t AWSIoTSessionJournal::clear_subscriptions()
+{
+    if( fd < 0 ) {
+        return CY_RSLT_SUCCESS;
+    }
+
+    memset( subscriptions, 0, sizeof(subscriptions) );
+    if( append( SESSION_RECORD_CLEAN, NULL, 0 ) == 0 ) {
+        return CY_RSLT_AWS_ERROR_JOURNAL_FAILED;
+    }
+    return commit();
+}
+
+uint32_t AWSIoTSessionJournal::append_publish( const char* topic, uint8_t qos, const char* data, uint32_t length )
+{
+    pending_publish* entry = NULL;
+    uint8_t prefix[SESSION_PUBLISH_PREFIX_LENGTH];
+    uint32_t topic_length = strlen( topic );
+    uint32_t offset = 0;
+    uint8_t i = 0;
+
+    if( fd < 0 ) {
+        return 0;
+    }
+
+    for( i = 0; entry == NULL && i < AWS_SESSION_MAX_PENDING; i++ ) {
+        if( pending[i].seq == 0 ) {
+            entry = &pending[i];
+        }
+    }
+    if( entry == NULL || !fits_publish( topic_length, length ) ) {
+        AWS_LIBRARY_DEBUG(("Publish not journaled \n"));
+        return 0;
+    }
+
+    session_put32( prefix, next_seq );
+    prefix[4] = qos;
+    prefix[5] = (uint8_t) topic_length;
+    prefix[6] = (uint8_t) ( topic_length >> 8 );
+
+    /* the offset is that of the record, which follows what is still buffered */
+    offset = append( SESSION_RECORD_PUBLISH, prefix, sizeof(prefix), topic, topic_length, data, length );
+    if( offset == 0 ) {
+        return 0;
+    }
+
+    entry->seq = next_seq;
+    entry->offset = offset - ( SESSION_RECORD_HEADER_LENGTH + sizeof(prefix) + topic_length + length );
+    entry->length = SESSION_RECORD_HEADER_LENGTH + sizeof(prefix) + topic_length + length;
+    entry->restorable = false;
+
+    next_seq++;
+    if( next_seq == 0 ) {
+        next_seq = 1;
+    }
+    return entry->seq;
+}
+
+void AWSIoTSessionJournal::complete( uint32_t seq )
+{
+    uint8_t record[4];
+    uint8_t i = 0;
+
+    if( fd < 0 || seq == 0 ) {
+        return;
+    }
+
+    for( i = 0; i < AWS_SESSION_MAX_PENDING; i++ ) {
+        if( pending[i].seq == seq ) {
+            pending[i].seq = 0;
+            session_put32( record, seq );
+            if( append( SESSION_RECORD_DONE, record, sizeof(record) ) != 0 ) {
+                mark_dirty();
+            }
+            return;
+        }
+    }
+}
+
+bool AWSIoTSessionJournal::has_restorable() const
+{
+    uint8_t i = 0;
+
+    for( i = 0; fd >= 0 && i < AWS_SESSION_MAX_PENDING; i++ ) {
+        if( pending[i].seq != 0 && pending[i].restorable ) {
+            return true;
+        }
+    }
+    return false;
+}
+
+uint32_t AWSIoTSessionJournal::restore_publish( char* topic, char* data, uint32_t size, uint32_t* length, uint8_t* qos )
+{
+    pending_publish* entry = NULL;
+    const uint8_t* body = buffer + SESSION_RECORD_HEADER_LENGTH;
+    uint32_t topic_length = 0;
+    uint32_t message_length = 0;
+    uint8_t i = 0;
+
+    /* oldest first; sequence numbers wrap, so compare their distance behind the next one */
+    for( i = 0; fd >= 0 && i < AWS_SESSION_MAX_PENDING; i++ ) {
+        if( pending[i].seq != 0 && pending[i].restorable &&
+            ( entry == NULL || next_seq - pending[i].seq > next_seq - entry->seq ) ) {
+            entry = &pending[i];
+        }
+    }
+    if( entry == NULL ) {
+        return 0;
+    }
+    entry->restorable = false;
+
+    /* validated on replay; the message is needed only now */
+    if( !flush() || !read_record( entry->offset, entry->length ) ) {
+        AWS_LIBRARY_ERROR(("Cannot read journaled publish \n"));
+        return 0;
+    }
+
+    topic_length = body[5] | ( body[6] << 8 );
+    message_length = entry->length - SESSION_RECORD_HEADER_LENGTH - SESSION_PUBLISH_PREFIX_LENGTH - topic_length;
+    if( message_length > size ) {
+        /* journaled by a build with larger messages; it can never be queued */
+        complete( entry->seq );
+        return 0;
+    }
+
+    memcpy( topic, body + SESSION_PUBLISH_PREFIX_LENGTH, topic_length );
+    topic[topic_length] = '\0';
+    memcpy( data, body + SESSION_PUBLISH_PREFIX_LENGTH + topic_length, message_length );
+    *length = message_length;
+    *qos = body[4];
+
+    return entry->seq;
+}
+
+bool AWSIoTSessionJournal::fits_publish( uint32_t topic_length, uint32_t length )
+{
+    return topic_length <= AWS_SESSION_MAX_TOPIC_LENGTH &&
+           length <= AWS_SESSION_BUFFER_SIZE - SESSION_RECORD_HEADER_LENGTH - SESSION_PUBLISH_PREFIX_LENGTH - topic_length;
+}
+
+uint16_t AWSIoTSessionJournal::packet_id() const
+{
+    return next_packet_id;
+}
+
+cy_rslt_t AWSIoTSessionJournal::set_packet_id( uint16_t next )
+{
+    uint8_t record[2];
+
+    if( fd < 0 ) {
+        return CY_RSLT_SUCCESS;
+    }
+
+    next_packet_id = next;
+    record[0] = (uint8_t) next;
+    record[1] = (uint8_t) ( next >> 8 );
+    if( append( SESSION_RECORD_PACKET_ID, record, sizeof(record) ) == 0 ) {
+        return CY_RSLT_AWS_ERROR_JOURNAL_FAILED;
+    }
+    return commit();
+}
+
+cy_rslt_t AWSIoTSessionJournal::commit()
+{
+    if( fd < 0 ) {
+        return CY_RSLT_AWS_ERROR_JOURNAL_FAILED;
+    }
+    if( used == 0 && !dirty ) {
+        return CY_RSLT_SUCCESS;
+    }
+
+    if( !flush() || fsync( fd ) != 0 ) {
+        AWS_LIBRARY_ERROR(("Cannot sync session journal \n"));
+        fail();
+        return CY_RSLT_AWS_ERROR_JOURNAL_FAILED;
+    }
+    dirty = false;
+
+    if( file_end > AWS_SESSION_MAX_JOURNAL_SIZE && !compact() ) {
+        fail();
+        return CY_RSLT_AWS_ERROR_JOURNAL_FAILED;
+    }
+    return CY_RSLT_SUCCESS;
+}
+
+void AWSIoTSessionJournal::service( uint64_t now_ms )
+{
+    if( fd >= 0 && dirty && now_ms >= dirty_since_ms && now_ms - dirty_since_ms >= sync_interval_ms ) {
+        commit();
+    }
+}
+
+void AWSIoTSessionJournal::mark_dirty()
+{
+    if( !dirty ) {
+        dirty = true;
+        dirty_since_ms = Kernel::get_ms_count();
+    }
+}
+
+void AWSIoTSessionJournal::fail()
+{
+    /* the state in RAM no longer matches the file; stop journaling rather than resume from a wrong state */
+    AWS_LIBRARY_ERROR(("Session journal %s disabled \n", path));
+    if( fd >= 0 ) {
+        ::close( fd );
+        fd = -1;
+    }
+    used = 0;
+    dirty = false;
+    memset( subscriptions, 0, sizeof(subscriptions) );
+    memset( pending, 0, sizeof(pending) );
+}
+
+uint32_t AWSIoTSessionJournal::encode( uint8_t* out, uint8_t type, const void* a, uint32_t a_length, const void* b, uint32_t b_length,
+                                       const void* c, uint32_t c_length )
+{
+    uint32_t body_length = a_length + b_length + c_length;
+    uint32_t crc = 0xFFFFFFFFu;
+
+    out[4] = type;
+    out[5] = (uint8_t) body_length;
+    out[6] = (uint8_t) ( body_length >> 8 );
+    if( a_length > 0 ) {
+        memcpy( out + SESSION_RECORD_HEADER_LENGTH, a, a_length );
+    }
+    if( b_length > 0 ) {
+        memcpy( out + SESSION_RECORD_HEADER_LENGTH + a_length, b, b_length );
+    }
+    if( c_length > 0 ) {
+        memcpy( out + SESSION_RECORD_HEADER_LENGTH + a_length + b_length, c, c_length );
+    }
+    crc = session_crc( crc, out + 4, SESSION_RECORD_HEADER_LENGTH - 4 + body_length );
+    session_put32( out, ~crc );
+
+    return SESSION_RECORD_HEADER_LENGTH + body_length;
+}
+
+uint32_t AWSIoTSessionJournal::append( uint8_t type, const void* a, uint32_t a_length, const void* b, uint32_t b_length,
+                                       const void* c, uint32_t c_length )
+{
+    uint32_t length = SESSION_RECORD_HEADER_LENGTH + a_length + b_length + c_length;
+
+    if( fd < 0 ) {
+        return 0;
+    }
+    if( length > sizeof(buffer) ) {
+        AWS_LIBRARY_ERROR(("Record of %lu bytes exceeds AWS_SESSION_BUFFER_SIZE \n", (unsigned long) length));
+        return 0;
+    }
+    if( used + length > sizeof(buffer) && !flush() ) {
+        fail();
+        return 0;
+    }
+
+    encode( buffer + used, type, a, a_length, b, b_length, c, c_length );
+    used += length;
+
+    /* end of the record in the file, never 0 */
+    return file_end + used;
+}
+
+bool AWSIoTSessionJournal::flush()
+{
+    if( used == 0 ) {
+        return true;
+    }
+
+    /* FAT only appends at the end found on open, so position explicitly */
+    if( lseek( fd, file_end, SEEK_SET ) < 0 || !session_write( fd, buffer, used ) ) {
+        return false;
+    }
+    file_end += used;
+    used = 0;
+    dirty = true;
+    return true;
+}
+
+bool AWSIoTSessionJournal::read_record( uint32_t offset, uint16_t length )
+{
+    if( length > sizeof(buffer) || lseek( fd, offset, SEEK_SET ) < 0 ) {
+        return false;
+    }
+    return session_read( fd, buffer, length ) == length;
+}
+
+bool AWSIoTSessionJournal::load()
+{
+    uint32_t offset = 0;
+    uint32_t position = 0;
+    uint32_t length = 0;
+    uint16_t body_length = 0;
+    ssize_t count = 0;
+    bool header_seen = false;
+
+    while( true ) {
+        if( lseek( fd, offset, SEEK_SET ) < 0 ) {
+            break;
+        }
+        count = session_read( fd, buffer, sizeof(buffer) );
+        if( count <= 0 ) {
+            break;
+        }
+
+        position = 0;
+        while( (uint32_t) count - position >= SESSION_RECORD_HEADER_LENGTH ) {
+            body_length = buffer[position + 5] | ( buffer[position + 6] << 8 );
+            length = SESSION_RECORD_HEADER_LENGTH + body_length;
+            if( length > (uint32_t) count - position ) {
+                break;
+            }
+            if( ~session_crc( 0xFFFFFFFFu, &buffer[position + 4], length - 4 ) != session_get32( &buffer[position] ) ) {
+                break;
+            }
+            if( !header_seen ) {
+                if( buffer[position + 4] != SESSION_RECORD_HEADER || body_length != sizeof(session_magic) ||
+                    memcmp( &buffer[position + SESSION_RECORD_HEADER_LENGTH], session_magic, sizeof(session_magic) ) != 0 ) {
+                    break;
+                }
+                header_seen = true;
+            } else {
+                apply( buffer[position + 4], &buffer[position + SESSION_RECORD_HEADER_LENGTH], body_length, offset + position );
+            }
+            position += length;
+        }
+
+        offset += position;
+        if( position < (uint32_t) count ) {
+            /* a record cut short, corrupted or beyond the buffer: everything from here on is lost */
+            if( position == 0 || (uint32_t) count < sizeof(buffer) ) {
+                break;
+            }
+        }
+    }
+
+    file_end = offset;
+    if( !header_seen ) {
+        memset( subscriptions, 0, sizeof(subscriptions) );
+        memset( pending, 0, sizeof(pending) );
+        return false;
+    }
+    return lseek( fd, 0, SEEK_END ) == (off_t) file_end;
+}
+
+void AWSIoTSessionJournal::apply( uint8_t type, const uint8_t* body, uint16_t length, uint32_t offset )
+{
+    subscription* entry = NULL;
+    char topic[AWS_SESSION_MAX_TOPIC_LENGTH + 1];
+    int index = -1;
+    uint32_t seq = 0;
+    uint16_t topic_length = 0;
+    uint8_t i = 0;
+
+    switch( type ) {
+        case SESSION_RECORD_PACKET_ID:
+            if( length == 2 ) {
+                next_packet_id = body[0] | ( body[1] << 8 );
+            }
+            break;
+        case SESSION_RECORD_SUBSCRIBE:
+        case SESSION_RECORD_UNSUBSCRIBE:
+            topic_length = ( type == SESSION_RECORD_SUBSCRIBE ) ? length - 1 : length;
+            if( length < 1 || topic_length > AWS_SESSION_MAX_TOPIC_LENGTH ) {
+                break;
+            }
+            memcpy( topic, body + length - topic_length, topic_length );
+            topic[topic_length] = '\0';
+            if( type == SESSION_RECORD_UNSUBSCRIBE ) {
+                index = find_subscription( topic );
+                if( index >= 0 ) {
+                    subscriptions[index].used = false;
+                }
+                break;
+            }
+            entry = subscription_slot( topic );
+            if( entry != NULL ) {
+                entry->used = true;
+                entry->qos = body[0];
+                strcpy( entry->topic, topic );
+            }
+            break;
+        case SESSION_RECORD_CLEAN:
+            memset( subscriptions, 0, sizeof(subscriptions) );
+            break;
+        case SESSION_RECORD_PUBLISH:
+            if( length < SESSION_PUBLISH_PREFIX_LENGTH ) {
+                break;
+            }
+            seq = session_get32( body );
+            topic_length = body[5] | ( body[6] << 8 );
+            if( seq == 0 || topic_length > AWS_SESSION_MAX_TOPIC_LENGTH || topic_length > length - SESSION_PUBLISH_PREFIX_LENGTH ) {
+                break;
+            }
+            for( i = 0; i < AWS_SESSION_MAX_PENDING; i++ ) {
+                if( pending[i].seq == 0 ) {
+                    pending[i].seq = seq;
+                    pending[i].offset = offset;
+                    pending[i].length = SESSION_RECORD_HEADER_LENGTH + length;
+                    pending[i].restorable = true;
+                    break;
+                }
+            }
+            if( seq >= next_seq ) {
+                next_seq = seq + 1;
+            }
+            break;
+        case SESSION_RECORD_DONE:
+            if( length != 4 ) {
+                break;
+            }
+            seq = session_get32( body );
+            for( i = 0; i < AWS_SESSION_MAX_PENDING; i++ ) {
+                if( pending[i].seq == seq ) {
+                    pending[i].seq = 0;
+                }
+            }
+            break;
+        default:
+            /* written by a later version; skipped */
+            break;
+    }
+}
+
+bool AWSIoTSessionJournal::compact()
+{
+    int new_fd = -1;
+    uint32_t new_end = 0;
+    uint32_t length = 0;
+    uint8_t record[2];
+    uint8_t qos = 0;
+    uint8_t i = 0;
+
+    if( !flush() ) {
+        return false;
+    }
+
+    new_fd = ::open( tmp_path, O_RDWR | O_CREAT | O_TRUNC, 0666 );
+    if( new_fd < 0 ) {
+        AWS_LIBRARY_ERROR(("Cannot create %s \n", tmp_path));
+        return false;
+    }
+
+    length = encode( buffer, SESSION_RECORD_HEADER, session_magic, sizeof(session_magic) );
+    record[0] = (uint8_t) next_packet_id;
+    record[1] = (uint8_t) ( next_packet_id >> 8 );
+    length += encode( buffer + length, SESSION_RECORD_PACKET_ID, record, sizeof(record) );
+    if( !session_write( new_fd, buffer, length ) ) {
+        goto exit;
+    }
+    new_end = length;
+
+    for( i = 0; i < AWS_SESSION_MAX_SUBSCRIPTIONS; i++ ) {
+        if( subscriptions[i].used ) {
+            qos = subscriptions[i].qos;
+            length = encode( buffer, SESSION_RECORD_SUBSCRIBE, &qos, 1, subscriptions[i].topic, strlen( subscriptions[i].topic ) );
+            if( !session_write( new_fd, buffer, length ) ) {
+                goto exit;
+            }
+            new_end += length;
+        }
+    }
+
+    /* publishes are copied as they are, so their records keep sequence number and CRC */
+    for( i = 0; i < AWS_SESSION_MAX_PENDING; i++ ) {
+        if( pending[i].seq != 0 ) {
+            if( !read_record( pending[i].offset, pending[i].length ) || !session_write( new_fd, buffer, pending[i].length ) ) {
+                goto exit;
+            }
+            pending[i].offset = new_end;
+            new_end += pending[i].length;
+        }
+    }
+
+    if( fsync( new_fd ) != 0 ) {
+        goto exit;
+    }
+    ::close( new_fd );
+    new_fd = -1;
+
+    /* from here on, open() finds either the old journal or the complete new one */
+    ::close( fd );
+    fd = -1;
+    remove( path );
+    if( rename( tmp_path, path ) != 0 ) {
+        AWS_LIBRARY_ERROR(("Cannot replace %s \n", path));
+        return false;
+    }
+    fd = ::open( path, O_RDWR );
+    if( fd < 0 ) {
+        return false;
+    }
+
+    file_end = new_end;
+    dirty = false;
+    AWS_LIBRARY_DEBUG(("Session journal compacted to %lu bytes \n", (unsigned long) file_end));
+    return true;
+
+exit:
+    AWS_LIBRARY_ERROR(("Cannot write %s \n", tmp_path));
+    ::close( new_fd );
+    return false;
+}
@@ -0,0 +1,219 @@
+/*
+ * Copyright 2019-2020 Cypress Semiconductor Corporation
+ * SPDX-License-Identifier: Apache-2.0
+ * 
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ * 
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ * 
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+/** @file
+ *  Journal of the MQTT session state, kept in a file so that a restarted device resumes its persistent session
+ */
+#ifndef AWS_SESSION_JOURNAL_H
+#define AWS_SESSION_JOURNAL_H
+
+#include "mbed.h"
+#include "aws_common.h"
+
+/**
+ * @addtogroup aws_iot_classes
+ *
+ * @{
+ */
+
+/** Append-only journal of the client's session state: subscriptions held by the broker, queued QoS1 publishes that have
+ * no outcome yet and the next client-assigned packet identifier.
+ *
+ * Each change is appended as a record framed by a CRC-32, so replay stops cleanly at a record torn by a reset, and the
+ * file is then rewritten from the replayed state. Records collect in a RAM buffer of AWS_SESSION_BUFFER_SIZE bytes and
+ * go out with a single fsync in @ref commit: a batch of publishes costs one flash sync, taken before any of them is sent.
+ * Records whose loss is harmless (a subscription made or a publish completed; after a reset they only cause a repeated
+ * SUBSCRIBE or a duplicate publish) wait for the next commit, at most the sync interval. Once the file exceeds
+ * AWS_SESSION_MAX_JOURNAL_SIZE it is compacted into "<path>.tmp", which replaces the journal by rename.
+ *
+ * The journal is not thread safe; the client uses it from the thread that calls connect and yield.
+ */
+class AWSIoTSessionJournal
+{
+public:
+    /** Default constructor of AWSIoTSessionJournal class. The journal starts closed. */
+    AWSIoTSessionJournal();
+
+    /** Destructor of AWSIoTSessionJournal class. Commits and closes the journal. */
+    ~AWSIoTSessionJournal();
+
+    /** Opens the journal file, creating it if needed, and replays it.
+     *
+     * @param[in] params          : Session journal parameters
+     *
+     * @return cy_rslt_t          : CY_RSLT_SUCCESS - on success,
+     *                              CY_RSLT_AWS_ERROR_JOURNAL_FAILED - On error ( @ref aws_iot_defines )
+     */
+    cy_rslt_t open( const aws_session_params_t& params );
+
+    /** Commits pending records and closes the file. The replayed state is dropped. */
+    void close();
+
+    /** Returns true while the journal file is open. */
+    bool is_open() const;
+
+    /** Checks whether the journal holds a subscription.
+     *
+     * @param[in] topic           : Topic filter
+     * @param[in] qos             : QoS of the subscription
+     *
+     * @return bool               : true if 'topic' was subscribed with 'qos' and not unsubscribed since
+     */
+    bool subscribed( const char* topic, uint8_t qos ) const;
+
+    /** Records a subscription acknowledged by the broker. Synced lazily.
+     *
+     * @param[in] topic           : Topic filter
+     * @param[in] qos             : QoS of the subscription
+     *
+     */
+    void subscribe( const char* topic, uint8_t qos );
+
+    /** Records an unsubscribe and syncs it. Called before the UNSUBSCRIBE is sent: a journal that still listed the
+     *  subscription would make a resumed session skip a SUBSCRIBE the broker no longer holds.
+     *
+     * @param[in] topic           : Topic filter
+     *
+     * @return cy_rslt_t          : CY_RSLT_SUCCESS - on success,
+     *                              CY_RSLT_AWS_ERROR_JOURNAL_FAILED - On error
+     */
+    cy_rslt_t unsubscribe( const char* topic );
+
+    /** Forgets all subscriptions and syncs, for a connection on which the broker had no session. */
+    cy_rslt_t clear_subscriptions();
+
+    /** Records a QoS1 publish; it stays pending until @ref complete. Becomes durable with the next @ref commit.
+     *
+     * @param[in] topic           : Topic of the publish
+     * @param[in] qos             : QoS of the publish
+     * @param[in] data            : Message
+     * @param[in] length          : Length of the message
+     *
+     * @return uint32_t           : Journal sequence number of the publish; 0 if it could not be recorded
+     */
+    uint32_t append_publish( const char* topic, uint8_t qos, const char* data, uint32_t length );
+
+    /** Records the outcome of a publish. Synced lazily.
+     *
+     * @param[in] seq             : Sequence number returned by @ref append_publish or @ref restore_publish
+     *
+     */
+    void complete( uint32_t seq );
+
+    /** Checks whether a publish fits in one journal record.
+     *
+     * @param[in] topic_length    : Length of the topic
+     * @param[in] length          : Length of the message
+     *
+     * @return bool               : true if @ref append_publish can record it
+     */
+    static bool fits_publish( uint32_t topic_length, uint32_t length );
+
+    /** Returns true if a replayed publish still has to be queued again. */
+    bool has_restorable() const;
+
+    /** Reads the oldest replayed publish that has not been queued again since @ref open.
+     *
+     * @param[out] topic          : Buffer of AWS_SESSION_MAX_TOPIC_LENGTH + 1 bytes receiving the topic
+     * @param[out] data           : Buffer of 'size' bytes receiving the message
+     * @param[in]  size           : Size of 'data'
+     * @param[out] length         : Length of the message
+     * @param[out] qos            : QoS of the publish
+     *
+     * @return uint32_t           : Sequence number of the publish; 0 if none is left or it could not be read
+     */
+    uint32_t restore_publish( char* topic, char* data, uint32_t size, uint32_t* length, uint8_t* qos );
+
+    /** Returns the next packet identifier recorded by @ref set_packet_id, 0 if none. */
+    uint16_t packet_id() const;
+
+    /** Records the next packet identifier and syncs it.
+     *
+     * @param[in] next            : Next packet identifier
+     *
+     * @return cy_rslt_t          : CY_RSLT_SUCCESS - on success,
+     *                              CY_RSLT_AWS_ERROR_JOURNAL_FAILED - On error
+     */
+    cy_rslt_t set_packet_id( uint16_t next );
+
+    /** Writes out buffered records and syncs the file; compacts it once it has grown too large.
+     *
+     * @return cy_rslt_t          : CY_RSLT_SUCCESS - on success,
+     *                              CY_RSLT_AWS_ERROR_JOURNAL_FAILED - On error
+     */
+    cy_rslt_t commit();
+
+    /** Commits lazily synced records once they have waited for the sync interval.
+     *
+     * @param[in] now_ms          : Current time in ms
+     *
+     */
+    void service( uint64_t now_ms );
+
+private:
+    /** Subscription held by the broker */
+    struct subscription
+    {
+        bool used;
+        uint8_t qos;
+        char topic[AWS_SESSION_MAX_TOPIC_LENGTH + 1];
+    };
+
+    /** Publish without an outcome; its topic and message stay in the file */
+    struct pending_publish
+    {
+        uint32_t seq;
+        uint32_t offset;                    /**< File offset of the record */
+        uint16_t length;                    /**< Length of the record */
+        bool restorable;                    /**< Replayed from the file and not queued again yet */
+    };
+
+    uint32_t encode( uint8_t* out, uint8_t type, const void* a, uint32_t a_length, const void* b = NULL, uint32_t b_length = 0,
+                     const void* c = NULL, uint32_t c_length = 0 );
+    uint32_t append( uint8_t type, const void* a, uint32_t a_length, const void* b = NULL, uint32_t b_length = 0,
+                     const void* c = NULL, uint32_t c_length = 0 );
+    bool flush();
+    bool read_record( uint32_t offset, uint16_t length );
+    bool load();
+    void apply( uint8_t type, const uint8_t* body, uint16_t length, uint32_t offset );
+    bool compact();
+    int find_subscription( const char* topic ) const;
+    subscription* subscription_slot( const char* topic );
+    void fail();
+    void mark_dirty();
+
+    int fd;
+    char path[AWS_SESSION_PATH_MAX_LENGTH];
+    char tmp_path[AWS_SESSION_PATH_MAX_LENGTH + 4];
+    uint32_t sync_interval_ms;
+    uint32_t file_end;
+    uint32_t used;
+    bool dirty;
+    uint64_t dirty_since_ms;
+    uint32_t next_seq;
+    uint16_t next_packet_id;
+    subscription subscriptions[AWS_SESSION_MAX_SUBSCRIPTIONS];
+    pending_publish pending[AWS_SESSION_MAX_PENDING];
+    uint8_t buffer[AWS_SESSION_BUFFER_SIZE];
+};
+
+/**
+ * @}
+ */
+
+#endif
@@ -0,0 +1,235 @@
+/*
+ * Copyright 2019-2020 Cypress Semiconductor Corporation
+ * SPDX-License-Identifier: Apache-2.0
+ * 
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ * 
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ * 
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+
+/** @file
+ *
+ * Implementation of SigV4 presigning for the AWS IoT WebSocket upgrade
+ *
+ */
+#include "aws_sigv4.h"
+#include "string.h"
+#include "mbedtls/md.h"
+#include "mbedtls/sha256.h"
+
+#define SIGV4_ALGORITHM             "AWS4-HMAC-SHA256"
+#define SIGV4_WEBSOCKET_PATH        "/mqtt"
+#define SIGV4_EMPTY_PAYLOAD_HASH    "e3b0c44298fc1c149afbf4c8996fb92427ae41e4649b934ca495991b7852b855"
+#define SIGV4_MAX_SECRET_LENGTH     (128)
+#define SIGV4_EARLIEST_TIME         (1577836800)    // 2020-01-01; anything earlier means the clock was never set
+
+/* Bounded string builder; once it overflows every further append is dropped */
+typedef struct
+{
+    char* buffer;
+    uint32_t size;
+    uint32_t length;
+    bool overflow;
+} sigv4_writer_t;
+
+static void sigv4_append( sigv4_writer_t* writer, const char* data, uint32_t length )
+{
+    if( writer->overflow || writer->length + length >= writer->size ) {
+        writer->overflow = true;
+        return;
+    }
+    memcpy( writer->buffer + writer->length, data, length );
+    writer->length += length;
+    writer->buffer[writer->length] = '\0';
+}
+
+static void sigv4_append_string( sigv4_writer_t* writer, const char* data )
+{
+    sigv4_append( writer, data, strlen( data ) );
+}
+
+/* URI-encodes everything but the unreserved characters, as SigV4 requires for query values */
+static void sigv4_append_encoded( sigv4_writer_t* writer, const char* data )
+{
+    static const char hex[] = "0123456789ABCDEF";
+    char escaped[3];
+    char c;
+
+    for( ; *data != '\0'; data++ ) {
+        c = *data;
+        if( ( c >= 'A' && c <= 'Z' ) || ( c >= 'a' && c <= 'z' ) || ( c >= '0' && c <= '9' ) ||
+                c == '-' || c == '_' || c == '.' || c == '~' ) {
+            sigv4_append( writer, &c, 1 );
+        } else {
+            escaped[0] = '%';
+            escaped[1] = hex[ (unsigned char) c >> 4 ];
+            escaped[2] = hex[ (unsigned char) c & 0x0F ];
+            sigv4_append( writer, escaped, 3 );
+        }
+    }
+}
+
+static void sigv4_hex( const unsigned char* data, uint32_t length, char* out )
+{
+    static const char hex[] = "0123456789abcdef";
+    uint32_t i;
+
+    for( i = 0; i < length; i++ ) {
+        out[2 * i] = hex[ data[i] >> 4 ];
+        out[2 * i + 1] = hex[ data[i] & 0x0F ];
+    }
+    out[2 * length] = '\0';
+}
+
+static int sigv4_hmac( const unsigned char* key, uint32_t key_length, const char* data, unsigned char out[32] )
+{
+    return mbedtls_md_hmac( mbedtls_md_info_from_type( MBEDTLS_MD_SHA256 ), key, key_length,
+            (const unsigned char*) data, strlen( data ), out );
+}
+
+static void sigv4_put_digits( char* out, uint32_t value, int digits )
+{
+    while( digits-- > 0 ) {
+        out[digits] = (char) ( '0' + value % 10 );
+        value /= 10;
+    }
+}
+
+/* YYYYMMDD and YYYYMMDDTHHMMSSZ of a UTC time; days are converted to a civil date directly so no gmtime is needed */
+static void sigv4_format_time( time_t now, char date[9], char amz_date[17] )
+{
+    int64_t days = (int64_t) now / 86400;
+    uint32_t seconds = (uint32_t) ( (int64_t) now % 86400 );
+    int64_t era;
+    uint32_t day_of_era;
+    uint32_t year_of_era;
+    uint32_t day_of_year;
+    uint32_t mp;
+    uint32_t day;
+    uint32_t month;
+    int64_t year;
+
+    days += 719468;
+    era = days / 146097;
+    day_of_era = (uint32_t) ( days - era * 146097 );
+    year_of_era = ( day_of_era - day_of_era / 1460 + day_of_era / 36524 - day_of_era / 146096 ) / 365;
+    day_of_year = day_of_era - ( 365 * year_of_era + year_of_era / 4 - year_of_era / 100 );
+    mp = ( 5 * day_of_year + 2 ) / 153;
+    day = day_of_year - ( 153 * mp + 2 ) / 5 + 1;
+    month = ( mp < 10 ) ? mp + 3 : mp - 9;
+    year = (int64_t) year_of_era + era * 400 + ( month <= 2 ? 1 : 0 );
+
+    sigv4_put_digits( date, (uint32_t) year, 4 );
+    sigv4_put_digits( date + 4, month, 2 );
+    sigv4_put_digits( date + 6, day, 2 );
+    date[8] = '\0';
+
+    memcpy( amz_date, date, 8 );
+    amz_date[8] = 'T';
+    sigv4_put_digits( amz_date + 9, seconds / 3600, 2 );
+    sigv4_put_digits( amz_date + 11, seconds / 60 % 60, 2 );
+    sigv4_put_digits( amz_date + 13, seconds % 60, 2 );
+    amz_date[15] = 'Z';
+    amz_date[16] = '\0';
+}
+
+cy_rslt_t AWSIoTSigV4::presign_websocket_path( const char* host, const aws_sigv4_credentials_t& credentials, time_t now,
+        char* path, uint32_t path_size )
+{
+    sigv4_writer_t writer = { path, path_size, 0, false };
+    mbedtls_sha256_context sha;
+    unsigned char digest[32];
+    unsigned char key[32];
+    char secret[ 4 + SIGV4_MAX_SECRET_LENGTH + 1 ];
+    char hex[65];
+    char date[9];
+    char amz_date[17];
+    char scope[96];
+    char string_to_sign[ sizeof(SIGV4_ALGORITHM) + sizeof(amz_date) + sizeof(scope) + sizeof(hex) ];
+    uint32_t query_start;
+    int rc = 0;
+
+    if( host == NULL || path == NULL || credentials.access_key_id == NULL || credentials.secret_access_key == NULL ||
+            credentials.region == NULL || strlen( credentials.secret_access_key ) > SIGV4_MAX_SECRET_LENGTH ) {
+        AWS_LIBRARY_ERROR (("SigV4 credentials not set \n"));
+        return CY_RSLT_AWS_ERROR_INVALID_CLIENT_KEY;
+    }
+    if( now < SIGV4_EARLIEST_TIME ) {
+        AWS_LIBRARY_ERROR (("Real-time clock not set; cannot sign the WebSocket upgrade \n"));
+        return CY_RSLT_AWS_ERROR_CONNECT_FAILED;
+    }
+
+    sigv4_format_time( now, date, amz_date );
+    if( snprintf( scope, sizeof(scope), "%s/%s/" AWS_SIGV4_SERVICE "/aws4_request", date, credentials.region ) >= (int) sizeof(scope) ) {
+        return CY_RSLT_AWS_ERROR_BUFFER_OVERFLOW;
+    }
+
+    /* canonical query string, parameters in sorted order; it is also the start of the final path */
+    sigv4_append_string( &writer, SIGV4_WEBSOCKET_PATH "?" );
+    query_start = writer.length;
+    sigv4_append_string( &writer, "X-Amz-Algorithm=" SIGV4_ALGORITHM "&X-Amz-Credential=" );
+    sigv4_append_encoded( &writer, credentials.access_key_id );
+    sigv4_append_string( &writer, "%2F" );
+    sigv4_append_encoded( &writer, scope );
+    sigv4_append_string( &writer, "&X-Amz-Date=" );
+    sigv4_append_string( &writer, amz_date );
+    sigv4_append_string( &writer, "&X-Amz-SignedHeaders=host" );
+    if( writer.overflow ) {
+        return CY_RSLT_AWS_ERROR_BUFFER_OVERFLOW;
+    }
+
+    /* canonical request, hashed as it is written */
+    mbedtls_sha256_init( &sha );
+    rc = mbedtls_sha256_starts_ret( &sha, 0 );
+    rc = rc ? rc : mbedtls_sha256_update_ret( &sha, (const unsigned char*) "GET\n" SIGV4_WEBSOCKET_PATH "\n",
+            sizeof("GET\n" SIGV4_WEBSOCKET_PATH "\n") - 1 );
+    rc = rc ? rc : mbedtls_sha256_update_ret( &sha, (const unsigned char*) path + query_start, writer.length - query_start );
+    rc = rc ? rc : mbedtls_sha256_update_ret( &sha, (const unsigned char*) "\nhost:", 6 );
+    rc = rc ? rc : mbedtls_sha256_update_ret( &sha, (const unsigned char*) host, strlen( host ) );
+    rc = rc ? rc : mbedtls_sha256_update_ret( &sha, (const unsigned char*) "\n\nhost\n" SIGV4_EMPTY_PAYLOAD_HASH,
+            sizeof("\n\nhost\n" SIGV4_EMPTY_PAYLOAD_HASH) - 1 );
+    rc = rc ? rc : mbedtls_sha256_finish_ret( &sha, digest );
+    mbedtls_sha256_free( &sha );
+    if( rc != 0 ) {
+        return CY_RSLT_AWS_ERROR_CONNECT_FAILED;
+    }
+    sigv4_hex( digest, sizeof(digest), hex );
+    snprintf( string_to_sign, sizeof(string_to_sign), SIGV4_ALGORITHM "\n%s\n%s\n%s", amz_date, scope, hex );
+
+    /* signing key: HMAC chain over date, region, service and terminator, keyed with "AWS4" + secret */
+    snprintf( secret, sizeof(secret), "AWS4%s", credentials.secret_access_key );
+    rc = sigv4_hmac( (const unsigned char*) secret, strlen( secret ), date, key );
+    rc = rc ? rc : sigv4_hmac( key, sizeof(key), credentials.region, key );
+    rc = rc ? rc : sigv4_hmac( key, sizeof(key), AWS_SIGV4_SERVICE, key );
+    rc = rc ? rc : sigv4_hmac( key, sizeof(key), "aws4_request", key );
+    rc = rc ? rc : sigv4_hmac( key, sizeof(key), string_to_sign, digest );
+    memset( secret, 0, sizeof(secret) );
+    memset( key, 0, sizeof(key) );
+    if( rc != 0 ) {
+        return CY_RSLT_AWS_ERROR_CONNECT_FAILED;
+    }
+    sigv4_hex( digest, sizeof(digest), hex );
+
+    sigv4_append_string( &writer, "&X-Amz-Signature=" );
+    sigv4_append_string( &writer, hex );
+    if( credentials.session_token != NULL ) {
+        /* AWS IoT expects the token outside the signed query */
+        sigv4_append_string( &writer, "&X-Amz-Security-Token=" );
+        sigv4_append_encoded( &writer, credentials.session_token );
+    }
+    if( writer.overflow ) {
+        AWS_LIBRARY_ERROR (("Presigned WebSocket path exceeds %lu bytes \n", (unsigned long) path_size));
+        return CY_RSLT_AWS_ERROR_BUFFER_OVERFLOW;
+    }
+    return CY_RSLT_SUCCESS;
+}
@@ -0,0 +1,64 @@
+/*
+ * Copyright 2019-2020 Cypress Semiconductor Corporation
+ * SPDX-License-Identifier: Apache-2.0
+ * 
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ * 
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ * 
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+
+/** @file
+ *  AWS Signature Version 4 presigning of the AWS IoT WebSocket upgrade
+ */
+#ifndef AWS_SIGV4_H
+#define AWS_SIGV4_H
+
+#include <time.h>
+#include "aws_common.h"
+
+/**
+ * @addtogroup aws_iot_classes
+ *
+ * @{
+ */
+
+/** SigV4 query signing for MQTT over WebSockets ( @ref AWS_TRANSPORT_MQTT_WEBSOCKET ).
+ *
+ * AWS IoT authenticates a WebSocket connection from the query string of the upgrade request instead of a client
+ * certificate. Only the Host header is signed and the payload is empty, as for any presigned GET; a session token is
+ * appended after the signature. The canonical request is hashed as it is written, so the only buffer is the caller's path.
+ */
+class AWSIoTSigV4
+{
+public:
+    /** Builds the presigned upgrade path: /mqtt?X-Amz-Algorithm=AWS4-HMAC-SHA256&X-Amz-Credential=...&X-Amz-Signature=...
+     *
+     * @param[in]  host           : Host name of the AWS IoT endpoint, as sent in the Host header
+     * @param[in]  credentials    : AWS credentials and region
+     * @param[in]  now            : Current UTC time, in seconds since the epoch
+     * @param[out] path           : Buffer for the path
+     * @param[in]  path_size      : Size of the path buffer
+     *
+     * @return cy_rslt_t          : CY_RSLT_SUCCESS - on success,
+     *                              CY_RSLT_AWS_ERROR_INVALID_CLIENT_KEY, CY_RSLT_AWS_ERROR_CONNECT_FAILED,
+     *                              CY_RSLT_AWS_ERROR_BUFFER_OVERFLOW - On error ( @ref aws_iot_defines )
+     */
+    static cy_rslt_t presign_websocket_path( const char* host, const aws_sigv4_credentials_t& credentials, time_t now,
+            char* path, uint32_t path_size );
+};
+
+/**
+ * @}
+ */
+
+#endif
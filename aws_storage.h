@@ -0,0 +1,106 @@
+/*
+ * Copyright 2019-2020 Cypress Semiconductor Corporation
+ * SPDX-License-Identifier: Apache-2.0
+ * 
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ * 
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ * 
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+/** @file
+ *  Storage for the objects a client creates per connection
+ *
+ *  By default connection objects are allocated with new and deleted again on disconnect. When AWS_IOT_STATIC_ALLOCATION
+ *  is defined (for example in mbed_app.json "macros"), they are constructed in place in storage inside their owner
+ *  instead, so connect, disconnect and discover cycles do not allocate from the heap. mbed TLS still allocates its
+ *  own buffers during the handshake; configure MBEDTLS_MEMORY_BUFFER_ALLOC_C to serve those from a static pool as well.
+ */
+#ifndef AWS_STORAGE_H
+#define AWS_STORAGE_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <new>
+#include <utility>
+
+/**
+ * @addtogroup aws_iot_classes
+ *
+ * @{
+ */
+
+/** Holds at most one object of type T at a time, on the heap or in place ( AWS_IOT_STATIC_ALLOCATION ). */
+template<typename T>
+class AWSIoTStorage
+{
+public:
+    AWSIoTStorage() : object( NULL )
+    {
+    }
+
+    ~AWSIoTStorage()
+    {
+        destroy();
+    }
+
+    /** Constructs the object, destroying the previous one if any.
+     *
+     * @return T*                 : The object
+     */
+    template<typename... Args>
+    T* create( Args&&... args )
+    {
+        destroy();
+#ifdef AWS_IOT_STATIC_ALLOCATION
+        object = new ( storage ) T( std::forward<Args>( args )... );
+#else
+        object = new T( std::forward<Args>( args )... );
+#endif
+        return object;
+    }
+
+    /** Destroys the object, if any. */
+    void destroy()
+    {
+        if( object == NULL ) {
+            return;
+        }
+#ifdef AWS_IOT_STATIC_ALLOCATION
+        object->~T();
+#else
+        delete object;
+#endif
+        object = NULL;
+    }
+
+    /** Returns the object; NULL if none was created. */
+    T* get() const
+    {
+        return object;
+    }
+
+private:
+    AWSIoTStorage( const AWSIoTStorage& );
+    AWSIoTStorage& operator=( const AWSIoTStorage& );
+
+    T* object;
+#ifdef AWS_IOT_STATIC_ALLOCATION
+    /* uint64_t elements keep the storage aligned for any member of T */
+    uint64_t storage[( sizeof(T) + sizeof(uint64_t) - 1 ) / sizeof(uint64_t)];
+#endif
+};
+
+/**
+ * @}
+ */
+
+#endif
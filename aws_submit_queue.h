@@ -0,0 +1,178 @@
+/*
+ * Copyright 2019-2020 Cypress Semiconductor Corporation
+ * SPDX-License-Identifier: Apache-2.0
+ * 
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ * 
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ * 
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+/** @file
+ *  Lock-free multi-producer, single-consumer submission queue
+ */
+#ifndef AWS_SUBMIT_QUEUE_H
+#define AWS_SUBMIT_QUEUE_H
+
+#include "platform/mbed_critical.h"
+#include <stdint.h>
+#include <stddef.h>
+
+/**
+ * @addtogroup aws_iot_classes
+ *
+ * @{
+ */
+
+/** Fixed-size, lock-free submission queue.
+ *
+ * Requests live in a pool of N slots owned by the queue, so submitting never allocates. Any thread may
+ * claim a free slot with @ref alloc, fill it in and hand it over with @ref submit; a single owner thread
+ * takes requests in submission order with @ref pop and returns the slot with @ref release.
+ *
+ * Both lists are singly linked through slot indices and updated with compare-and-swap only:
+ * - The free list is a stack popped by producers. Its head carries a 16-bit tag that changes on
+ *   every update, so a producer that read a stale link cannot win the swap (ABA).
+ * - Producers push submissions onto a second stack. The owner detaches the whole stack at once and
+ *   reverses it, which restores per-producer FIFO order without ever contending with producers again.
+ */
+template <typename T, uint32_t N>
+class AWSIoTSubmitQueue
+{
+    static_assert( N > 0 && N < 0xFFFF, "Submit queue depth must fit a 16-bit slot index" );
+
+public:
+    AWSIoTSubmitQueue() : free_head( 1 ), pending_head( 0 ), ready_head( 0 )
+    {
+        /* Links hold slot index + 1 so that 0 can terminate a list */
+        for( uint32_t i = 0; i < N; i++ ) {
+            links[i] = ( i + 1 < N ) ? i + 2 : 0;
+        }
+    }
+
+    /** Claims a free slot. May be called from any thread.
+     *
+     * @return T*                 : Slot to fill in; NULL if all slots are in use
+     */
+    T* alloc()
+    {
+        uint32_t head = core_util_atomic_load_u32( &free_head );
+        uint32_t index;
+
+        do {
+            index = head & 0xFFFF;
+            if( index == 0 ) {
+                return NULL;
+            }
+        } while( !core_util_atomic_cas_u32( &free_head, &head, next_tag( head ) | links[index - 1] ) );
+
+        return &slots[index - 1];
+    }
+
+    /** Queues a slot obtained from @ref alloc. May be called from any thread.
+     *
+     * @param[in] item            : Slot to queue
+     *
+     */
+    void submit( T* item )
+    {
+        uint32_t index = slot_index( item );
+        uint32_t head = core_util_atomic_load_u32( &pending_head );
+
+        do {
+            links[index] = head;
+        } while( !core_util_atomic_cas_u32( &pending_head, &head, index + 1 ) );
+    }
+
+    /** Takes the oldest queued request. Owner thread only.
+     *
+     * @return T*                 : Oldest request; NULL if nothing is queued
+     */
+    T* pop()
+    {
+        uint32_t index;
+
+        if( ready_head == 0 ) {
+            take_pending();
+        }
+        if( ready_head == 0 ) {
+            return NULL;
+        }
+
+        index = ready_head;
+        ready_head = links[index - 1];
+        return &slots[index - 1];
+    }
+
+    /** Returns a slot taken with @ref pop to the free pool. Owner thread only.
+     *
+     * @param[in] item            : Slot to release
+     *
+     */
+    void release( T* item )
+    {
+        uint32_t index = slot_index( item );
+        uint32_t head = core_util_atomic_load_u32( &free_head );
+
+        do {
+            links[index] = head & 0xFFFF;
+        } while( !core_util_atomic_cas_u32( &free_head, &head, next_tag( head ) | ( index + 1 ) ) );
+    }
+
+    /** Checks whether requests are waiting. Owner thread only.
+     *
+     * @return bool               : true if @ref pop would return a request
+     */
+    bool empty()
+    {
+        return ready_head == 0 && core_util_atomic_load_u32( &pending_head ) == 0;
+    }
+
+private:
+    static uint32_t next_tag( uint32_t head )
+    {
+        return ( head + 0x10000 ) & 0xFFFF0000;
+    }
+
+    uint32_t slot_index( T* item ) const
+    {
+        return (uint32_t) ( item - slots );
+    }
+
+    /** Detaches everything producers pushed so far and reverses it into submission order */
+    void take_pending()
+    {
+        uint32_t head = core_util_atomic_load_u32( &pending_head );
+        uint32_t next;
+
+        while( head != 0 && !core_util_atomic_cas_u32( &pending_head, &head, 0 ) ) {
+        }
+
+        while( head != 0 ) {
+            next = links[head - 1];
+            links[head - 1] = ready_head;
+            ready_head = head;
+            head = next;
+        }
+    }
+
+    T slots[N];
+    volatile uint32_t links[N];
+    volatile uint32_t free_head;      /**< Tag in the upper 16 bits, slot index + 1 in the lower 16 bits */
+    volatile uint32_t pending_head;   /**< Slot index + 1 of the newest submission */
+    uint32_t ready_head;              /**< Slot index + 1 of the oldest detached submission */
+};
+
+/**
+ * @}
+ */
+
+#endif
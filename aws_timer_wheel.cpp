@@ -0,0 +1,290 @@
+/*
+ * Copyright 2019-2020 Cypress Semiconductor Corporation
+ * SPDX-License-Identifier: Apache-2.0
+ * 
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ * 
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ * 
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+
+/** @file
+ *
+ * Implementation for the AWS IoT hierarchical timer wheel
+ *
+ */
+#include "aws_timer_wheel.h"
+
+#if AWS_TIMER_WHEEL_SLOT_BITS > 6
+#error "AWS_TIMER_WHEEL_SLOT_BITS must not exceed 6"
+#endif
+
+#define WHEEL_SLOTS         ( 1u << AWS_TIMER_WHEEL_SLOT_BITS )
+#define WHEEL_MASK          ( WHEEL_SLOTS - 1 )
+#define WHEEL_SPAN( level ) ( (uint64_t) 1 << ( AWS_TIMER_WHEEL_SLOT_BITS * ( level ) ) )
+
+static AWSIoTTimerWheel shared_wheel;
+
+static uint32_t lowest_bit( uint64_t bits )
+{
+#if defined(__GNUC__) || defined(__clang__)
+    return (uint32_t) __builtin_ctzll( bits );
+#else
+    uint32_t i = 0;
+
+    while( ( bits & 1 ) == 0 ) {
+        bits >>= 1;
+        i++;
+    }
+    return i;
+#endif
+}
+
+AWSIoTTimerWheel::AWSIoTTimerWheel()
+{
+    uint32_t level = 0;
+    uint32_t i = 0;
+
+    for( level = 0; level < AWS_TIMER_WHEEL_LEVELS; level++ ) {
+        for( i = 0; i < WHEEL_SLOTS; i++ ) {
+            slots[level][i].next = &slots[level][i];
+            slots[level][i].prev = &slots[level][i];
+        }
+        occupied[level] = 0;
+    }
+    current = 0;
+    count = 0;
+    started = false;
+}
+
+AWSIoTTimerWheel& AWSIoTTimerWheel::shared()
+{
+    return shared_wheel;
+}
+
+void AWSIoTTimerWheel::start( uint64_t now_ms )
+{
+    if( !started ) {
+        current = now_ms;
+        started = true;
+    }
+}
+
+void AWSIoTTimerWheel::insert( timer* t, uint64_t earliest )
+{
+    uint64_t expiry = ( t->expiry_ms > earliest ) ? t->expiry_ms : earliest;
+    uint32_t level = 0;
+    uint32_t index = 0;
+    link* head = NULL;
+
+    while( level < AWS_TIMER_WHEEL_LEVELS - 1 && expiry - current >= WHEEL_SPAN( level + 1 ) ) {
+        level++;
+    }
+    /* beyond the top level: park in its furthest slot and get re-sorted when that slot cascades */
+    if( expiry - current >= WHEEL_SPAN( AWS_TIMER_WHEEL_LEVELS ) ) {
+        expiry = current + WHEEL_SPAN( AWS_TIMER_WHEEL_LEVELS ) - 1;
+    }
+
+    index = (uint32_t) ( expiry >> ( AWS_TIMER_WHEEL_SLOT_BITS * level ) ) & WHEEL_MASK;
+    head = &slots[level][index];
+    t->node.next = head;
+    t->node.prev = head->prev;
+    head->prev->next = &t->node;
+    head->prev = &t->node;
+    occupied[level] |= (uint64_t) 1 << index;
+}
+
+void AWSIoTTimerWheel::unlink( timer* t )
+{
+    link* prev = t->node.prev;
+    uint32_t slot = 0;
+
+    prev->next = t->node.next;
+    t->node.next->prev = prev;
+    t->node.next = NULL;
+    t->node.prev = NULL;
+    count--;
+
+    /* the slot went empty if what is left is a sentinel pointing at itself */
+    if( prev->next == prev ) {
+        slot = (uint32_t) ( prev - &slots[0][0] );
+        if( slot < AWS_TIMER_WHEEL_LEVELS * WHEEL_SLOTS ) {
+            occupied[slot / WHEEL_SLOTS] &= ~( (uint64_t) 1 << ( slot % WHEEL_SLOTS ) );
+        }
+    }
+}
+
+void AWSIoTTimerWheel::schedule( timer* t, uint64_t expiry_ms, callback_t callback, void* arg )
+{
+    mutex.lock();
+    start( Kernel::get_ms_count() );
+    if( t->node.next != NULL ) {
+        unlink( t );
+    }
+    t->expiry_ms = expiry_ms;
+    t->callback = callback;
+    t->arg = arg;
+    /* the slot under the cursor has fired already */
+    insert( t, current + 1 );
+    count++;
+    mutex.unlock();
+}
+
+void AWSIoTTimerWheel::cancel( timer* t )
+{
+    mutex.lock();
+    if( t->node.next != NULL ) {
+        unlink( t );
+    }
+    mutex.unlock();
+}
+
+bool AWSIoTTimerWheel::pending( const timer* t ) const
+{
+    bool armed = false;
+
+    mutex.lock();
+    armed = ( t->node.next != NULL );
+    mutex.unlock();
+    return armed;
+}
+
+uint64_t AWSIoTTimerWheel::next_tick() const
+{
+    uint64_t next = UINT64_MAX;
+    uint64_t tick = 0;
+    uint64_t later = 0;
+    uint64_t base = 0;
+    uint32_t shift = 0;
+    uint32_t index = 0;
+    uint32_t level = 0;
+
+    /* level 0 gives expiry ticks; higher levels give the tick their slot cascades at */
+    for( level = 0; level < AWS_TIMER_WHEEL_LEVELS; level++ ) {
+        if( occupied[level] == 0 ) {
+            continue;
+        }
+        shift = AWS_TIMER_WHEEL_SLOT_BITS * level;
+        index = (uint32_t) ( current >> shift ) & WHEEL_MASK;
+        base = current & ~( WHEEL_SPAN( level + 1 ) - 1 );
+        later = ( index == WHEEL_MASK ) ? 0 : occupied[level] & ( ~(uint64_t) 0 << ( index + 1 ) );
+        if( later != 0 ) {
+            tick = base + ( (uint64_t) lowest_bit( later ) << shift );
+        } else {
+            /* the slot under the cursor has already cascaded this turn, so it holds the next turn's timers */
+            tick = base + WHEEL_SPAN( level + 1 ) + ( (uint64_t) lowest_bit( occupied[level] ) << shift );
+        }
+        if( tick < next ) {
+            next = tick;
+        }
+    }
+
+    return next;
+}
+
+void AWSIoTTimerWheel::cascade( uint32_t level )
+{
+    uint32_t index = (uint32_t) ( current >> ( AWS_TIMER_WHEEL_SLOT_BITS * level ) ) & WHEEL_MASK;
+    link* head = &slots[level][index];
+    link pending_list;
+    timer* t = NULL;
+
+    if( head->next == head ) {
+        occupied[level] &= ~( (uint64_t) 1 << index );
+        return;
+    }
+
+    /* detach the slot first: a timer may go back into the same slot if it lies a full turn ahead */
+    pending_list.next = head->next;
+    pending_list.prev = head->prev;
+    pending_list.next->prev = &pending_list;
+    pending_list.prev->next = &pending_list;
+    head->next = head;
+    head->prev = head;
+    occupied[level] &= ~( (uint64_t) 1 << index );
+
+    while( pending_list.next != &pending_list ) {
+        t = (timer*) pending_list.next;
+        pending_list.next = t->node.next;
+        t->node.next->prev = &pending_list;
+        /* a timer due now lands in the level 0 slot that fires right after the cascade */
+        insert( t, current );
+    }
+}
+
+uint32_t AWSIoTTimerWheel::fire( link* head )
+{
+    uint32_t fired = 0;
+    timer* t = NULL;
+
+    while( head->next != head ) {
+        t = (timer*) head->next;
+        unlink( t );
+        fired++;
+        t->callback( t->arg );
+    }
+    return fired;
+}
+
+uint32_t AWSIoTTimerWheel::advance( uint64_t now_ms )
+{
+    uint32_t fired = 0;
+    uint32_t level = 0;
+    uint64_t tick = 0;
+
+    mutex.lock();
+    start( now_ms );
+    while( count > 0 ) {
+        tick = next_tick();
+        if( tick > now_ms ) {
+            break;
+        }
+        current = tick;
+
+        for( level = 1; level < AWS_TIMER_WHEEL_LEVELS; level++ ) {
+            if( ( current & ( WHEEL_SPAN( level ) - 1 ) ) != 0 ) {
+                break;
+            }
+            cascade( level );
+        }
+        fired += fire( &slots[0][current & WHEEL_MASK] );
+    }
+    /* nothing is due in between, so the cursor can jump */
+    if( now_ms > current ) {
+        current = now_ms;
+    }
+    mutex.unlock();
+
+    return fired;
+}
+
+uint32_t AWSIoTTimerWheel::next_expiry_in( uint64_t now_ms )
+{
+    uint64_t tick = 0;
+
+    mutex.lock();
+    tick = ( count > 0 ) ? next_tick() : UINT64_MAX;
+    mutex.unlock();
+
+    if( tick == UINT64_MAX ) {
+        return UINT32_MAX;
+    }
+    if( tick <= now_ms ) {
+        return 0;
+    }
+    return ( tick - now_ms > UINT32_MAX - 1 ) ? UINT32_MAX - 1 : (uint32_t) ( tick - now_ms );
+}
+
+uint32_t AWSIoTTimerWheel::size() const
+{
+    return count;
+}
@@ -0,0 +1,144 @@
+/*
+ * Copyright 2019-2020 Cypress Semiconductor Corporation
+ * SPDX-License-Identifier: Apache-2.0
+ * 
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ * 
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ * 
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+
+/** @file
+ *  Hierarchical timer wheel shared by the AWS IoT connections of a process
+ */
+#ifndef AWS_TIMER_WHEEL_H
+#define AWS_TIMER_WHEEL_H
+
+#include "mbed.h"
+#include "aws_common.h"
+
+/**
+ * @addtogroup aws_iot_classes
+ *
+ * @{
+ */
+
+/** Hierarchical timing wheel with 1 ms ticks.
+ *
+ * AWS_TIMER_WHEEL_LEVELS levels of 2^AWS_TIMER_WHEEL_SLOT_BITS slots each; level n covers deadlines up to 2^((n+1)*bits) ms ahead,
+ * and anything further out waits in the top level. Timers are intrusive and linked into their slot, so @ref schedule and
+ * @ref cancel are O(1) and the wheel never allocates. @ref advance moves a slot's timers one level down when the level
+ * below wraps, skipping empty slots with a bitmap per level, so its cost follows the number of timers due rather than
+ * the time elapsed.
+ *
+ * Callbacks run inside @ref advance, on whichever thread calls it, with the wheel locked: they must be short (typically
+ * setting a flag for their owner), but once @ref cancel returns the callback is guaranteed not to run.
+ */
+class AWSIoTTimerWheel
+{
+public:
+    /** Callback run when a timer expires */
+    typedef void (*callback_t)( void* arg );
+
+    /** Slot list link */
+    struct link
+    {
+        link* next;
+        link* prev;
+    };
+
+    /** Timer owned by the caller; must stay valid while it is pending */
+    struct timer
+    {
+        timer() : expiry_ms( 0 ), callback( NULL ), arg( NULL )
+        {
+            node.next = NULL;
+            node.prev = NULL;
+        }
+
+        link node;                  /**< First member, so that a link in a slot list is the timer itself */
+        uint64_t expiry_ms;
+        callback_t callback;
+        void* arg;
+    };
+
+    /** Default constructor of AWSIoTTimerWheel class. The wheel starts at the time of the first call. */
+    AWSIoTTimerWheel();
+
+    /** Returns the wheel shared by all connections of the process. */
+    static AWSIoTTimerWheel& shared();
+
+    /** Arms a timer; a pending timer is moved to the new deadline.
+     *
+     * @param[in] t               : Timer to arm
+     * @param[in] expiry_ms       : Absolute deadline ( Kernel::get_ms_count() based ); past deadlines expire on the next tick
+     * @param[in] callback        : Function to run on expiry
+     * @param[in] arg             : Argument passed to 'callback'
+     *
+     */
+    void schedule( timer* t, uint64_t expiry_ms, callback_t callback, void* arg );
+
+    /** Disarms a timer. Does nothing if it is not pending.
+     *
+     * @param[in] t               : Timer to disarm
+     *
+     */
+    void cancel( timer* t );
+
+    /** Checks whether a timer is armed.
+     *
+     * @param[in] t               : Timer to check
+     *
+     * @return bool               : true until the timer expires or is cancelled
+     */
+    bool pending( const timer* t ) const;
+
+    /** Runs the callbacks of the timers due up to 'now_ms'.
+     *
+     * @param[in] now_ms          : Current time in milliseconds
+     *
+     * @return uint32_t           : Number of timers that expired
+     */
+    uint32_t advance( uint64_t now_ms );
+
+    /** Returns a lower bound of the time until the next timer expires, for bounding a sleep.
+     *
+     * @param[in] now_ms          : Current time in milliseconds
+     *
+     * @return uint32_t           : Time (in ms) the caller may wait before calling @ref advance; UINT32_MAX if no timer is pending
+     */
+    uint32_t next_expiry_in( uint64_t now_ms );
+
+    /** Returns the number of pending timers. */
+    uint32_t size() const;
+
+private:
+    void start( uint64_t now_ms );
+    void insert( timer* t, uint64_t earliest );
+    void unlink( timer* t );
+    void cascade( uint32_t level );
+    uint32_t fire( link* head );
+    uint64_t next_tick() const;
+
+    mutable Mutex mutex;
+    link slots[AWS_TIMER_WHEEL_LEVELS][1 << AWS_TIMER_WHEEL_SLOT_BITS];
+    uint64_t occupied[AWS_TIMER_WHEEL_LEVELS];  /**< Bit per non-empty slot */
+    uint64_t current;                           /**< Last tick processed */
+    uint32_t count;
+    bool started;
+};
+
+/**
+ * @}
+ */
+
+#endif
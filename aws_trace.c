@@ -0,0 +1,145 @@
+/*
+ * Copyright 2019-2020 Cypress Semiconductor Corporation
+ * SPDX-License-Identifier: Apache-2.0
+ * 
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ * 
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ * 
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+/** @file
+ *
+ * Implementation of the packet trace ring buffer and its Chrome trace export
+ *
+ */
+
+#include "aws_trace.h"
+#include "platform/mbed_critical.h"
+#include "hal/us_ticker_api.h"
+#include "string.h"
+
+#ifdef AWS_IOT_TRACE
+
+/******************************************************
+ *               Variable Definitions
+ ******************************************************/
+
+static aws_trace_event_t trace_buffer[AWS_TRACE_BUFFER_SIZE];
+static volatile uint32_t trace_head = 0;
+
+static const char* const packet_names[] =
+{
+    "yield", "CONNECT", "CONNACK", "PUBLISH", "PUBACK", "PUBREC", "PUBREL", "PUBCOMP",
+    "SUBSCRIBE", "SUBACK", "UNSUBSCRIBE", "UNSUBACK", "PINGREQ", "PINGRESP", "DISCONNECT", "AUTH"
+};
+
+/******************************************************
+ *               Function Definitions
+ ******************************************************/
+
+void aws_trace_record( aws_trace_event_type_t event, uint8_t packet_type, uint16_t packet_id, uint32_t bytes )
+{
+    /* Claim a slot; the sequence number is published last so readers can skip slots that are still being written */
+    uint32_t sequence = core_util_atomic_incr_u32( &trace_head, 1 ) - 1;
+    aws_trace_event_t* slot = &trace_buffer[sequence & (AWS_TRACE_BUFFER_SIZE - 1)];
+
+    core_util_atomic_store_u32( &slot->sequence, 0 );
+    slot->timestamp_us = us_ticker_read();
+    slot->bytes = bytes;
+    slot->packet_id = packet_id;
+    slot->event = (uint8_t) event;
+    slot->packet_type = packet_type & 0x0F;
+    core_util_atomic_store_u32( &slot->sequence, sequence + 1 );
+}
+
+uint32_t aws_trace_snapshot( aws_trace_event_t* events, uint32_t max_events )
+{
+    uint32_t head = core_util_atomic_load_u32( &trace_head );
+    uint32_t first = ( head > AWS_TRACE_BUFFER_SIZE ) ? head - AWS_TRACE_BUFFER_SIZE : 0;
+    uint32_t count = 0;
+    uint32_t i;
+
+    for( i = first; i < head && count < max_events; i++ )
+    {
+        const aws_trace_event_t* slot = &trace_buffer[i & (AWS_TRACE_BUFFER_SIZE - 1)];
+
+        events[count] = *slot;
+        /* Skip slots that were overwritten or still in progress while copying */
+        if( core_util_atomic_load_u32( &slot->sequence ) == i + 1 && events[count].sequence == i + 1 )
+        {
+            count++;
+        }
+    }
+    return count;
+}
+
+void aws_trace_reset( void )
+{
+    memset( trace_buffer, 0, sizeof(trace_buffer) );
+    core_util_atomic_store_u32( &trace_head, 0 );
+}
+
+void aws_trace_dump( FILE* stream )
+{
+    static aws_trace_event_t events[AWS_TRACE_BUFFER_SIZE];
+    static const char* const span_names[] = { "api", "api", "send", "send", "recv", "recv" };
+    uint32_t count = aws_trace_snapshot( events, AWS_TRACE_BUFFER_SIZE );
+    uint32_t i;
+
+    fprintf( stream, "{\"traceEvents\":[\n" );
+    for( i = 0; i < count; i++ )
+    {
+        const aws_trace_event_t* e = &events[i];
+        /* Timestamps are relative to the oldest event, which also absorbs the 32-bit ticker wrap */
+        uint32_t ts = e->timestamp_us - events[0].timestamp_us;
+        const char* name = packet_names[e->packet_type];
+        const char* phase = "i";
+
+        if( e->event < AWS_TRACE_PACKET_OUT )
+        {
+            phase = ( e->event & 1 ) ? "E" : "B";
+            if( e->event != AWS_TRACE_API_BEGIN && e->event != AWS_TRACE_API_END )
+            {
+                name = span_names[e->event];
+            }
+        }
+
+        fprintf( stream, "%s{\"name\":\"%s%s\",\"ph\":\"%s\",\"ts\":%lu,\"pid\":1,\"tid\":1%s,\"args\":{\"type\":\"%s\",\"id\":%u,\"bytes\":%lu}}\n",
+                 ( i == 0 ) ? "" : ",",
+                 ( e->event == AWS_TRACE_PACKET_IN ) ? "in " : ( e->event == AWS_TRACE_PACKET_OUT ) ? "out " : "",
+                 name, phase, (unsigned long) ts,
+                 ( phase[0] == 'i' ) ? ",\"s\":\"t\"" : "",
+                 packet_names[e->packet_type], (unsigned) e->packet_id, (unsigned long) e->bytes );
+    }
+    fprintf( stream, "]}\n" );
+}
+
+#else
+
+void aws_trace_record( aws_trace_event_type_t event, uint8_t packet_type, uint16_t packet_id, uint32_t bytes )
+{
+}
+
+uint32_t aws_trace_snapshot( aws_trace_event_t* events, uint32_t max_events )
+{
+    return 0;
+}
+
+void aws_trace_reset( void )
+{
+}
+
+void aws_trace_dump( FILE* stream )
+{
+}
+
+#endif
@@ -0,0 +1,105 @@
+/*
+ * Copyright 2019-2020 Cypress Semiconductor Corporation
+ * SPDX-License-Identifier: Apache-2.0
+ * 
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ * 
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ * 
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+/** @file
+ *  Compile-time packet tracing for latency attribution
+ *
+ *  Tracing is compiled in only when AWS_IOT_TRACE is defined (for example in mbed_app.json "macros").
+ *  Otherwise every hook expands to nothing.
+ */
+#pragma once
+
+#include <stdint.h>
+#include <stdio.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/******************************************************
+ *                      Macros
+ ******************************************************/
+
+/** Number of events kept in the trace ring buffer; must be a power of two */
+#ifndef AWS_TRACE_BUFFER_SIZE
+#define AWS_TRACE_BUFFER_SIZE                 (256)
+#endif
+
+#ifdef AWS_IOT_TRACE
+#define AWS_TRACE_ENABLED                     (1)
+#define AWS_TRACE_EVENT( event, packet_type, packet_id, bytes )   aws_trace_record( (event), (uint8_t)(packet_type), (uint16_t)(packet_id), (uint32_t)(bytes) )
+#else
+#define AWS_TRACE_ENABLED                     (0)
+#define AWS_TRACE_EVENT( event, packet_type, packet_id, bytes )
+#endif
+
+/******************************************************
+ *                   Enumerations
+ ******************************************************/
+
+/**
+ * Trace event types. BEGIN/END events form nested spans, PACKET events mark MQTT packet boundaries.
+ */
+typedef enum
+{
+    AWS_TRACE_API_BEGIN = 0,              /**< Client API entered; packet_type is the MQTT packet the call sends (0 for yield) */
+    AWS_TRACE_API_END,                    /**< Client API returned */
+    AWS_TRACE_SEND_BEGIN,                 /**< Socket send started; serialization of the packet has completed */
+    AWS_TRACE_SEND_END,                   /**< Socket send returned */
+    AWS_TRACE_RECV_BEGIN,                 /**< Socket receive started */
+    AWS_TRACE_RECV_END,                   /**< Socket receive returned */
+    AWS_TRACE_PACKET_OUT,                 /**< Complete MQTT packet written */
+    AWS_TRACE_PACKET_IN,                  /**< Complete MQTT packet read; decoding starts */
+} aws_trace_event_type_t;
+
+/******************************************************
+ *                    Structures
+ ******************************************************/
+
+/**
+ * Trace ring buffer entry
+ */
+typedef struct
+{
+    uint32_t    sequence;                 /**< Sequence number + 1 of the event stored in this slot; 0 if the slot is being written */
+    uint32_t    timestamp_us;             /**< Microsecond ticker value */
+    uint32_t    bytes;                    /**< Byte count of the packet or socket operation */
+    uint16_t    packet_id;                /**< MQTT packet identifier; 0 if the packet has none */
+    uint8_t     event;                    /**< Event type ( @ref aws_trace_event_type_t ) */
+    uint8_t     packet_type;              /**< MQTT control packet type */
+} aws_trace_event_t;
+
+/******************************************************
+ *               Function Declarations
+ ******************************************************/
+
+/** Records an event into the trace ring buffer. Safe to call from several threads; the oldest events are overwritten. */
+void aws_trace_record( aws_trace_event_type_t event, uint8_t packet_type, uint16_t packet_id, uint32_t bytes );
+
+/** Copies the buffered events, oldest first, and returns the number of events copied */
+uint32_t aws_trace_snapshot( aws_trace_event_t* events, uint32_t max_events );
+
+/** Discards all buffered events */
+void aws_trace_reset( void );
+
+/** Writes the buffered events as a Chrome trace / Perfetto compatible JSON document */
+void aws_trace_dump( FILE* stream );
+
+#ifdef __cplusplus
+} /*extern "C" */
+#endif
@@ -0,0 +1,202 @@
+/*
+ * Copyright 2019-2020 Cypress Semiconductor Corporation
+ * SPDX-License-Identifier: Apache-2.0
+ * 
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ * 
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ * 
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+/** @file
+ *
+ * Implementation for AWS IoT last-value cache
+ *
+ */
+#include "aws_value_cache.h"
+#include "aws_error.h"
+#include "string.h"
+
+AWSIoTValueCache::AWSIoTValueCache()
+{
+    int i = 0;
+
+    memset( filters, 0, sizeof(filters) );
+    memset( entries, 0, sizeof(entries) );
+    for( i = 0; i < AWS_VALUE_CACHE_ENTRIES; i++ ) {
+        entries[i].filter = -1;
+    }
+    current_version = 0;
+    evicted = 0;
+    too_long = 0;
+}
+
+bool AWSIoTValueCache::add_filter( const char* filter )
+{
+    int i = 0;
+
+    if( lookup( filter ) >= 0 ) {
+        return true;
+    }
+    if( strlen( filter ) > AWS_TOPIC_FILTER_MAX_LENGTH ) {
+        return false;
+    }
+    for( i = 0; i < AWS_VALUE_CACHE_MAX_FILTERS; i++ ) {
+        if( filters[i][0] == '\0' ) {
+            strcpy( filters[i], filter );
+            return true;
+        }
+    }
+    return false;
+}
+
+void AWSIoTValueCache::remove_filter( const char* filter )
+{
+    int index = lookup( filter );
+    int i = 0;
+
+    if( index < 0 ) {
+        return;
+    }
+    filters[index][0] = '\0';
+    for( i = 0; i < AWS_VALUE_CACHE_ENTRIES; i++ ) {
+        if( entries[i].filter == index ) {
+            entries[i].filter = -1;
+        }
+    }
+}
+
+int AWSIoTValueCache::lookup( const char* filter ) const
+{
+    int i = 0;
+
+    for( i = 0; i < AWS_VALUE_CACHE_MAX_FILTERS; i++ ) {
+        if( filters[i][0] != '\0' && strcmp( filters[i], filter ) == 0 ) {
+            return i;
+        }
+    }
+    return -1;
+}
+
+bool AWSIoTValueCache::enabled() const
+{
+    int i = 0;
+
+    for( i = 0; i < AWS_VALUE_CACHE_MAX_FILTERS; i++ ) {
+        if( filters[i][0] != '\0' ) {
+            return true;
+        }
+    }
+    return false;
+}
+
+int AWSIoTValueCache::find( const char* topic, uint32_t topic_length ) const
+{
+    int i = 0;
+
+    for( i = 0; i < AWS_VALUE_CACHE_ENTRIES; i++ ) {
+        if( entries[i].filter >= 0 && entries[i].topic_length == topic_length &&
+            memcmp( entries[i].data, topic, topic_length ) == 0 ) {
+            return i;
+        }
+    }
+    return -1;
+}
+
+void AWSIoTValueCache::update( int filter, const char* topic, uint32_t topic_length, const MQTT::Message& message, uint64_t now_ms )
+{
+    entry* e = NULL;
+    int index = find( topic, topic_length );
+    int i = 0;
+
+    if( topic_length + message.payloadlen > AWS_VALUE_CACHE_MAX_LENGTH ) {
+        too_long++;
+        if( index >= 0 ) {
+            entries[index].filter = -1;
+            current_version++;
+        }
+        return;
+    }
+
+    if( index >= 0 ) {
+        e = &entries[index];
+        if( e->payload_length == message.payloadlen &&
+            memcmp( e->data + e->topic_length, message.payload, message.payloadlen ) == 0 ) {
+            e->received_ms = now_ms;
+            e->retained = message.retained;
+            return;
+        }
+    } else {
+        /* a free entry, else the one received least recently */
+        for( i = 0; i < AWS_VALUE_CACHE_ENTRIES; i++ ) {
+            if( entries[i].filter < 0 ) {
+                e = &entries[i];
+                break;
+            }
+            if( e == NULL || entries[i].received_ms < e->received_ms ) {
+                e = &entries[i];
+            }
+        }
+        if( e->filter >= 0 ) {
+            evicted++;
+        }
+        e->topic_length = topic_length;
+        memcpy( e->data, topic, topic_length );
+    }
+
+    e->filter = (int8_t) filter;
+    e->received_ms = now_ms;
+    e->retained = message.retained;
+    e->payload_length = message.payloadlen;
+    memcpy( e->data + e->topic_length, message.payload, message.payloadlen );
+    e->version = ++current_version;
+}
+
+cy_rslt_t AWSIoTValueCache::get( const char* topic, char* buffer, uint32_t size, aws_cached_value_t* value, uint64_t now_ms ) const
+{
+    int index = find( topic, strlen( topic ) );
+    const entry* e = NULL;
+
+    if( index < 0 ) {
+        return CY_RSLT_AWS_ERROR_NOT_CACHED;
+    }
+    e = &entries[index];
+
+    if( value != NULL ) {
+        value->length = e->payload_length;
+        value->version = e->version;
+        value->age_ms = (uint32_t) ( now_ms - e->received_ms );
+        value->retained = e->retained;
+    }
+    if( e->payload_length > size ) {
+        return CY_RSLT_AWS_ERROR_BUFFER_OVERFLOW;
+    }
+    if( e->payload_length > 0 ) {
+        memcpy( buffer, e->data + e->topic_length, e->payload_length );
+    }
+
+    return CY_RSLT_SUCCESS;
+}
+
+uint32_t AWSIoTValueCache::version() const
+{
+    return current_version;
+}
+
+uint32_t AWSIoTValueCache::evictions() const
+{
+    return evicted;
+}
+
+uint32_t AWSIoTValueCache::oversized() const
+{
+    return too_long;
+}
@@ -0,0 +1,140 @@
+/*
+ * Copyright 2019-2020 Cypress Semiconductor Corporation
+ * SPDX-License-Identifier: Apache-2.0
+ * 
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ * 
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ * 
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+/** @file
+ *  Last received value of topics matching selected subscriptions, readable without network traffic
+ */
+#ifndef AWS_VALUE_CACHE_H
+#define AWS_VALUE_CACHE_H
+
+#include "mbed.h"
+#include "aws_common.h"
+#include "MQTTClient.h"
+
+/**
+ * @addtogroup aws_iot_classes
+ *
+ * @{
+ */
+
+/** Last-value cache.
+ *
+ * Keeps the latest message of every topic received through one of up to AWS_VALUE_CACHE_MAX_FILTERS topic filters, in a fixed
+ * pool of AWS_VALUE_CACHE_ENTRIES values; a wildcard filter may fill several entries. When the pool is full, the value received
+ * least recently is evicted. A message longer than AWS_VALUE_CACHE_MAX_LENGTH (topic and payload) is not cached, and the topic's
+ * previous value is dropped rather than served stale.
+ *
+ * Every change of a cached value takes the next cache version. A reader compares the version of a value, or of the whole cache,
+ * with the one it saw last to learn of changes without copying the payload. A repeated message with an unchanged payload only
+ * refreshes the age of the value.
+ *
+ * The cache is not thread safe; @ref AWSIoTDispatcher serializes calls.
+ */
+class AWSIoTValueCache
+{
+public:
+    /** Default constructor of AWSIoTValueCache class. The cache starts without filters. */
+    AWSIoTValueCache();
+
+    /** Starts caching the messages of a topic filter.
+     *
+     * @param[in] filter          : Topic filter, up to AWS_TOPIC_FILTER_MAX_LENGTH characters; copied
+     *
+     * @return bool               : false if the filter is too long or AWS_VALUE_CACHE_MAX_FILTERS filters are cached already
+     */
+    bool add_filter( const char* filter );
+
+    /** Stops caching a topic filter and drops its values.
+     *
+     * @param[in] filter          : Topic filter passed to @ref add_filter
+     *
+     */
+    void remove_filter( const char* filter );
+
+    /** Checks whether messages of a subscription are cached.
+     *
+     * @param[in] filter          : Topic filter of the subscription
+     *
+     * @return int                : Index of 'filter' to pass to @ref update; -1 if it was not added with @ref add_filter
+     */
+    int lookup( const char* filter ) const;
+
+    /** Returns true if any filter is cached. */
+    bool enabled() const;
+
+    /** Records a received message.
+     *
+     * @param[in] filter          : Index returned by @ref lookup for the subscription the message was received through
+     * @param[in] topic           : Topic of the message, not NUL-terminated
+     * @param[in] topic_length    : Length of 'topic'
+     * @param[in] message         : Message received by the MQTT client
+     * @param[in] now_ms          : Current time in ms
+     *
+     */
+    void update( int filter, const char* topic, uint32_t topic_length, const MQTT::Message& message, uint64_t now_ms );
+
+    /** Copies the cached value of a topic.
+     *
+     * @param[in]  topic          : Topic, as received
+     * @param[out] buffer         : Buffer receiving the payload; may be NULL if 'size' is 0
+     * @param[in]  size           : Size of 'buffer'
+     * @param[out] value          : Length, version and age of the value; filled in whenever the topic is cached
+     * @param[in]  now_ms         : Current time in ms
+     *
+     * @return cy_rslt_t          : CY_RSLT_SUCCESS - on success,
+     *                              CY_RSLT_AWS_ERROR_NOT_CACHED - if no value is cached for 'topic',
+     *                              CY_RSLT_AWS_ERROR_BUFFER_OVERFLOW - if the payload is longer than 'size'
+     */
+    cy_rslt_t get( const char* topic, char* buffer, uint32_t size, aws_cached_value_t* value, uint64_t now_ms ) const;
+
+    /** Returns the version of the latest change; 0 while nothing was cached. */
+    uint32_t version() const;
+
+    /** Returns the number of values evicted to make room for another topic. */
+    uint32_t evictions() const;
+
+    /** Returns the number of messages too long to be cached. */
+    uint32_t oversized() const;
+
+private:
+    /** Cached value; topic and payload share one buffer */
+    struct entry
+    {
+        int8_t filter;                      /**< Index of the filter the value was received through; -1 for a free entry */
+        uint32_t version;
+        uint64_t received_ms;
+        bool retained;
+        uint16_t topic_length;
+        uint16_t payload_length;
+        char data[AWS_VALUE_CACHE_MAX_LENGTH];
+    };
+
+    int find( const char* topic, uint32_t topic_length ) const;
+
+    char filters[AWS_VALUE_CACHE_MAX_FILTERS][AWS_TOPIC_FILTER_MAX_LENGTH + 1];
+    entry entries[AWS_VALUE_CACHE_ENTRIES];
+    uint32_t current_version;
+    uint32_t evicted;
+    uint32_t too_long;
+};
+
+/**
+ * @}
+ */
+
+#endif
@@ -0,0 +1,203 @@
+/*
+ * Copyright 2019-2020 Cypress Semiconductor Corporation
+ * SPDX-License-Identifier: Apache-2.0
+ * 
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ * 
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ * 
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/** @file
+ *
+ * Checks on Linux that the connection storage and the PUBLISH encoding do not allocate once AWS_IOT_STATIC_ALLOCATION
+ * is defined. Each path runs ALLOCATION_CYCLES times while operator new and the malloc family called from the library
+ * objects are counted; the result is printed as one JSON object per path and any allocation fails the run.
+ *
+ */
+#define AWS_IOT_STATIC_ALLOCATION
+
+#include "mbed.h"
+#include "aws_common.h"
+#include "aws_storage.h"
+#include "aws_keep_alive.h"
+#include "aws_publish_packet.h"
+#include "MQTTClient.h"
+
+#define ALLOCATION_CYCLES             (10000)
+#define ALLOCATION_PACKET_SIZE        (1024)
+#define ALLOCATION_TOPIC              "dt/bench/device-0001/telemetry"
+
+extern "C" void* __real_malloc( size_t size );
+extern "C" void* __real_calloc( size_t count, size_t size );
+extern "C" void* __real_realloc( void* pointer, size_t size );
+
+typedef void (*allocation_fn)( uint32_t cycle );
+
+static bool counting = false;
+static uint32_t allocations = 0;
+static volatile uint32_t sink = 0;
+
+/******************************************************
+ *               Allocation counting
+ ******************************************************/
+
+/* the library objects are linked with --wrap for the malloc family */
+extern "C" void* __wrap_malloc( size_t size )
+{
+    allocations += counting ? 1 : 0;
+    return __real_malloc( size );
+}
+
+extern "C" void* __wrap_calloc( size_t count, size_t size )
+{
+    allocations += counting ? 1 : 0;
+    return __real_calloc( count, size );
+}
+
+extern "C" void* __wrap_realloc( void* pointer, size_t size )
+{
+    allocations += counting ? 1 : 0;
+    return __real_realloc( pointer, size );
+}
+
+void* operator new( size_t size )
+{
+    void* pointer = NULL;
+
+    allocations += counting ? 1 : 0;
+    pointer = __real_malloc( size ? size : 1 );
+    if( pointer == NULL ) {
+        throw std::bad_alloc();
+    }
+    return pointer;
+}
+
+void* operator new[]( size_t size )
+{
+    return operator new( size );
+}
+
+void* operator new( size_t size, const std::nothrow_t& ) noexcept
+{
+    allocations += counting ? 1 : 0;
+    return __real_malloc( size ? size : 1 );
+}
+
+void* operator new[]( size_t size, const std::nothrow_t& tag ) noexcept
+{
+    return operator new( size, tag );
+}
+
+void operator delete( void* pointer ) noexcept
+{
+    free( pointer );
+}
+
+void operator delete[]( void* pointer ) noexcept
+{
+    free( pointer );
+}
+
+void operator delete( void* pointer, size_t ) noexcept
+{
+    free( pointer );
+}
+
+void operator delete[]( void* pointer, size_t ) noexcept
+{
+    free( pointer );
+}
+
+static bool check( const char* name, allocation_fn fn )
+{
+    uint32_t cycle = 0;
+
+    allocations = 0;
+    counting = true;
+    for( cycle = 0; cycle < ALLOCATION_CYCLES; cycle++ ) {
+        fn( cycle );
+    }
+    counting = false;
+
+    printf( "{\"test\":\"%s\",\"cycles\":%u,\"allocations\":%lu}\n", name, ALLOCATION_CYCLES, (unsigned long) allocations );
+    fflush( stdout );
+    return allocations == 0;
+}
+
+/******************************************************
+ *               Connection storage
+ ******************************************************/
+
+/* the network is never used; only the MQTT client object is constructed */
+class NullNetwork
+{
+public:
+    int read( unsigned char* buffer, int length, int timeout_ms )
+    {
+        return -1;
+    }
+
+    int write( unsigned char* buffer, int length, int timeout_ms )
+    {
+        return -1;
+    }
+};
+
+typedef MQTT::Client<NullNetwork, AWSIoTCountdown, ALLOCATION_PACKET_SIZE, 5> allocation_client_t;
+
+static NullNetwork network;
+static AWSIoTStorage<allocation_client_t> client_storage;
+
+/* connect and disconnect: the MQTT client is created and destroyed again */
+static void storage_cycle( uint32_t cycle )
+{
+    allocation_client_t* client = client_storage.create( network, 1000 + cycle );
+
+    sink += client->isConnected() ? 1 : 0;
+    client_storage.destroy();
+}
+
+/******************************************************
+ *               PUBLISH encoding
+ ******************************************************/
+
+static unsigned char packet[ALLOCATION_PACKET_SIZE];
+static char payload[ALLOCATION_PACKET_SIZE / 2];
+
+/* publish by topic string */
+static void publish_string_cycle( uint32_t cycle )
+{
+    sink += AWSIoTPublishPacket::encode( packet, sizeof(packet), ALLOCATION_TOPIC, strlen( ALLOCATION_TOPIC ), AWS_QOS_ATLEAST_ONCE,
+                                         (uint16_t) ( cycle | 1 ), payload, cycle % sizeof(payload) );
+}
+
+/* publish by registered topic handle; the topic is written once, as by register_topic */
+static void publish_handle_cycle( uint32_t cycle )
+{
+    static uint32_t topic_bytes = AWSIoTPublishPacket::prepare_topic( packet + AWS_PUBLISH_HEADER_MAX_LENGTH, ALLOCATION_TOPIC, strlen( ALLOCATION_TOPIC ) );
+    unsigned char* start = NULL;
+
+    sink += AWSIoTPublishPacket::encode_prepared( packet + AWS_PUBLISH_HEADER_MAX_LENGTH, topic_bytes, AWS_QOS_ATLEAST_ONCE,
+                                                  (uint16_t) ( cycle | 1 ), payload, cycle % sizeof(payload), &start );
+}
+
+int main( void )
+{
+    bool passed = true;
+
+    memset( payload, 'p', sizeof(payload) );
+
+    passed &= check( "storage_cycle", storage_cycle );
+    passed &= check( "publish_string", publish_string_cycle );
+    passed &= check( "publish_handle", publish_handle_cycle );
+
+    return passed ? 0 : 1;
+}
@@ -0,0 +1,756 @@
+/*
+ * Copyright 2019-2020 Cypress Semiconductor Corporation
+ * SPDX-License-Identifier: Apache-2.0
+ * 
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ * 
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ * 
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/** @file
+ *
+ * Micro-benchmarks of the MQTT PUBLISH encoding, subscriber dispatch, Greengrass discovery parsing, the timer wheel,
+ * the submission queue and WebSocket masking, run on Linux.
+ *
+ * Every result is printed as one JSON object per line, for example
+ *
+ *     {"benchmark":"publish_encode","param":1024,"iterations":4194304,"ns_per_op":61.2,"ns_per_op_min":60.8}
+ *
+ * 'param' is the payload or frame size, the number of subscriptions, the number of Greengrass groups, the CA size in bytes, the
+ * number of pending timers or the number of producer threads;
+ * 'ns_per_op' is the median of BENCHMARK_REPETITIONS timed runs and 'ns_per_op_min' the fastest. Pass a name prefix
+ * to run a subset, e.g. 'aws_benchmark dispatch'.
+ *
+ */
+#include "mbed.h"
+#include "aws_common.h"
+#include "aws_dispatcher.h"
+#include "aws_publish_packet.h"
+#include "aws_submit_queue.h"
+#include "aws_timer_wheel.h"
+#include "MQTTClient.h"
+#include "MQTTWebSocket.h"
+
+#define BENCHMARK_REPETITIONS         (7)
+#define BENCHMARK_MIN_RUN_NS          (20000000ull)   // a timed run is grown until it lasts at least this long
+#define BENCHMARK_PACKET_SIZE         (16384 + 256)
+#define BENCHMARK_MAX_FILTERS         (32)
+#define BENCHMARK_MAX_GROUPS          (50)
+#define BENCHMARK_MAX_CA_LENGTH       (8192)
+#define BENCHMARK_TOPIC               "dt/bench/device-0001/telemetry"
+#define BENCHMARK_MAX_PRODUCERS       (16)
+#define BENCHMARK_QUEUE_DEPTH         (16)            // AWS_SUBMIT_QUEUE_DEPTH of the client
+#define BENCHMARK_MAX_TIMERS          (100000)
+#define BENCHMARK_TIMER_SPREAD        (1u << 20)      // ms over which timer deadlines are spread; reaches the third wheel level
+
+extern "C" uint16_t benchmark_unescape_root_ca( char* dst, const char* src, uint16_t length );
+
+typedef void (*benchmark_fn)( void* context, uint64_t iterations );
+
+static const char* name_prefix = NULL;
+static volatile uint32_t sink = 0;
+
+static uint64_t now_ns( void )
+{
+    struct timespec now;
+
+    clock_gettime( CLOCK_MONOTONIC, &now );
+    return (uint64_t) now.tv_sec * 1000000000ull + (uint64_t) now.tv_nsec;
+}
+
+static int compare_double( const void* a, const void* b )
+{
+    double x = *(const double*) a;
+    double y = *(const double*) b;
+
+    return ( x > y ) - ( x < y );
+}
+
+static void run( const char* name, uint32_t param, benchmark_fn fn, void* context )
+{
+    double ns_per_op[BENCHMARK_REPETITIONS];
+    uint64_t iterations = 1;
+    uint64_t start = 0;
+    uint64_t elapsed = 0;
+    int i = 0;
+
+    if( name_prefix != NULL && strncmp( name, name_prefix, strlen( name_prefix ) ) != 0 ) {
+        return;
+    }
+
+    /* warm up and size a run */
+    for( ;; ) {
+        start = now_ns();
+        fn( context, iterations );
+        elapsed = now_ns() - start;
+        if( elapsed >= BENCHMARK_MIN_RUN_NS ) {
+            break;
+        }
+        iterations *= ( elapsed < BENCHMARK_MIN_RUN_NS / 16 ) ? 8 : 2;
+    }
+
+    for( i = 0; i < BENCHMARK_REPETITIONS; i++ ) {
+        start = now_ns();
+        fn( context, iterations );
+        ns_per_op[i] = (double) ( now_ns() - start ) / (double) iterations;
+    }
+    qsort( ns_per_op, BENCHMARK_REPETITIONS, sizeof(double), compare_double );
+
+    printf( "{\"benchmark\":\"%s\",\"param\":%lu,\"iterations\":%llu,\"ns_per_op\":%.1f,\"ns_per_op_min\":%.1f}\n",
+            name, (unsigned long) param, (unsigned long long) iterations, ns_per_op[BENCHMARK_REPETITIONS / 2], ns_per_op[0] );
+    fflush( stdout );
+}
+
+/******************************************************
+ *               PUBLISH encode and decode
+ ******************************************************/
+
+typedef struct
+{
+    unsigned char packet[BENCHMARK_PACKET_SIZE];
+    unsigned char payload[BENCHMARK_PACKET_SIZE];
+    int payload_length;
+    int packet_length;
+} publish_context_t;
+
+static void publish_encode( void* context, uint64_t iterations )
+{
+    publish_context_t* ctx = (publish_context_t*) context;
+    MQTTString topic = MQTTString_initializer;
+    uint64_t i = 0;
+
+    topic.cstring = (char*) BENCHMARK_TOPIC;
+    for( i = 0; i < iterations; i++ ) {
+        sink += MQTTSerialize_publish( ctx->packet, sizeof(ctx->packet), 0, 1, 0, (unsigned short) ( i | 1 ),
+                                       topic, ctx->payload, ctx->payload_length );
+    }
+}
+
+static void publish_decode( void* context, uint64_t iterations )
+{
+    publish_context_t* ctx = (publish_context_t*) context;
+    MQTTString topic = MQTTString_initializer;
+    unsigned char* payload = NULL;
+    unsigned char dup = 0;
+    unsigned char retained = 0;
+    unsigned short packet_id = 0;
+    int qos = 0;
+    int payload_length = 0;
+    uint64_t i = 0;
+
+    for( i = 0; i < iterations; i++ ) {
+        MQTTDeserialize_publish( &dup, &qos, &retained, &packet_id, &topic, &payload, &payload_length, ctx->packet, ctx->packet_length );
+        sink += payload_length + packet_id;
+    }
+}
+
+/* QoS1 PUBLISH of the client for a topic string: strlen and the whole packet, per publish */
+static void publish_string( void* context, uint64_t iterations )
+{
+    publish_context_t* ctx = (publish_context_t*) context;
+    uint64_t i = 0;
+
+    for( i = 0; i < iterations; i++ ) {
+        sink += AWSIoTPublishPacket::encode( ctx->packet, sizeof(ctx->packet), BENCHMARK_TOPIC, strlen( BENCHMARK_TOPIC ), AWS_QOS_ATLEAST_ONCE,
+                                             (uint16_t) ( i | 1 ), (const char*) ctx->payload, ctx->payload_length );
+    }
+}
+
+/* QoS1 PUBLISH of the client for a registered topic: identifier, payload and fixed header around the stored topic */
+static void publish_handle( void* context, uint64_t iterations )
+{
+    publish_context_t* ctx = (publish_context_t*) context;
+    unsigned char* topic_start = ctx->packet + AWS_PUBLISH_HEADER_MAX_LENGTH;
+    unsigned char* packet = NULL;
+    uint32_t topic_bytes = AWSIoTPublishPacket::prepare_topic( topic_start, BENCHMARK_TOPIC, strlen( BENCHMARK_TOPIC ) );
+    uint64_t i = 0;
+
+    for( i = 0; i < iterations; i++ ) {
+        sink += AWSIoTPublishPacket::encode_prepared( topic_start, topic_bytes, AWS_QOS_ATLEAST_ONCE, (uint16_t) ( i | 1 ),
+                                                      (const char*) ctx->payload, ctx->payload_length, &packet );
+    }
+}
+
+static void benchmark_publish( void )
+{
+    static const int sizes[] = { 0, 16, 128, 1024, 4096, 16384 };
+    static publish_context_t ctx;
+    MQTTString topic = MQTTString_initializer;
+    uint32_t i = 0;
+
+    topic.cstring = (char*) BENCHMARK_TOPIC;
+    for( i = 0; i < sizeof(sizes) / sizeof(sizes[0]); i++ ) {
+        ctx.payload_length = sizes[i];
+        memset( ctx.payload, 'x', ctx.payload_length );
+        run( "publish_encode", sizes[i], publish_encode, &ctx );
+        run( "publish_string", sizes[i], publish_string, &ctx );
+        run( "publish_handle", sizes[i], publish_handle, &ctx );
+
+        ctx.packet_length = MQTTSerialize_publish( ctx.packet, sizeof(ctx.packet), 0, 1, 0, 1, topic, ctx.payload, ctx.payload_length );
+        run( "publish_decode", sizes[i], publish_decode, &ctx );
+    }
+}
+
+/******************************************************
+ *               Subscriber dispatch
+ ******************************************************/
+
+/* Network that hands the MQTT client one recorded packet per yield */
+class BenchmarkNetwork
+{
+public:
+    BenchmarkNetwork() : data( NULL ), length( 0 ), offset( 0 ) {}
+
+    void replay( const unsigned char* packet, int packet_length )
+    {
+        data = packet;
+        length = packet_length;
+        offset = 0;
+        pending = true;
+    }
+
+    int read( unsigned char* buffer, int len, int timeout )
+    {
+        (void) timeout;
+        if( len > length - offset ) {
+            len = length - offset;
+        }
+        memcpy( buffer, data + offset, len );
+        offset += len;
+        pending = ( offset < length );
+        return len;
+    }
+
+    int write( unsigned char* buffer, int len, int timeout )
+    {
+        (void) buffer;
+        (void) timeout;
+        return len;
+    }
+
+    /** True while replayed bytes are left; a yield ends once they are consumed */
+    static bool pending;
+
+private:
+    const unsigned char* data;
+    int length;
+    int offset;
+};
+
+bool BenchmarkNetwork::pending = false;
+
+/* Countdown that runs out as soon as the replayed packet has been read, so that a yield costs one packet */
+class BenchmarkCountdown
+{
+public:
+    BenchmarkCountdown() {}
+    BenchmarkCountdown( int ms ) { (void) ms; }
+    bool expired() { return !BenchmarkNetwork::pending; }
+    void countdown_ms( unsigned long ms ) { (void) ms; }
+    void countdown( int seconds ) { (void) seconds; }
+    int left_ms() { return BenchmarkNetwork::pending ? 1000 : 0; }
+};
+
+typedef MQTT::Client<BenchmarkNetwork, BenchmarkCountdown, BENCHMARK_PACKET_SIZE, BENCHMARK_MAX_FILTERS> benchmark_client_t;
+
+typedef struct
+{
+    BenchmarkNetwork network;
+    benchmark_client_t* client;
+    unsigned char packet[256];
+    int packet_length;
+} dispatch_context_t;
+
+static char filters[BENCHMARK_MAX_FILTERS][32];
+
+static void count_message( MQTT::MessageData& message )
+{
+    sink += message.message.payloadlen;
+}
+
+static void dispatch( void* context, uint64_t iterations )
+{
+    dispatch_context_t* ctx = (dispatch_context_t*) context;
+    uint64_t i = 0;
+
+    for( i = 0; i < iterations; i++ ) {
+        ctx->network.replay( ctx->packet, ctx->packet_length );
+        ctx->client->yield( 1000 );
+    }
+}
+
+/* Connects a client to the replaying network and records a QoS0 PUBLISH that only the last of 'count' filters matches */
+static void dispatch_setup( dispatch_context_t* ctx, uint32_t count )
+{
+    static const unsigned char connack[] = { 0x20, 0x02, 0x00, 0x00 };
+    MQTTPacket_connectData options = MQTTPacket_connectData_initializer;
+    MQTTString topic = MQTTString_initializer;
+    char name[32];
+    unsigned char payload[32];
+    uint32_t i = 0;
+
+    for( i = 0; i < BENCHMARK_MAX_FILTERS; i++ ) {
+        snprintf( filters[i], sizeof(filters[i]), "bench/%lu/+/state", (unsigned long) i );
+    }
+
+    ctx->client = new benchmark_client_t( ctx->network );
+    options.MQTTVersion = 4;
+    options.clientID.cstring = (char*) "benchmark";
+    options.keepAliveInterval = 0;
+    ctx->network.replay( connack, sizeof(connack) );
+    if( ctx->client->connect( options ) != 0 ) {
+        fprintf( stderr, "benchmark: connect to the replaying network failed\n" );
+        exit( 1 );
+    }
+
+    snprintf( name, sizeof(name), "bench/%lu/device/state", (unsigned long) ( count - 1 ) );
+    topic.cstring = name;
+    memset( payload, 'x', sizeof(payload) );
+    ctx->packet_length = MQTTSerialize_publish( ctx->packet, sizeof(ctx->packet), 0, 0, 0, 0, topic, payload, sizeof(payload) );
+}
+
+static void benchmark_dispatch( void )
+{
+    static const uint32_t counts[] = { 1, 2, 4, 8, 16, 32 };
+    dispatch_context_t ctx;
+    AWSIoTDispatcher* dispatcher = NULL;
+    uint32_t i = 0;
+    uint32_t j = 0;
+
+    /* straight from the MQTT client's handler table, as without a dispatcher */
+    for( i = 0; i < sizeof(counts) / sizeof(counts[0]); i++ ) {
+        dispatch_setup( &ctx, counts[i] );
+        for( j = 0; j < counts[i]; j++ ) {
+            ctx.client->setMessageHandler( filters[j], count_message );
+        }
+        run( "dispatch", counts[i], dispatch, &ctx );
+        delete ctx.client;
+    }
+
+    /* through the dispatcher's trampolines, updating the last-value cache of the matching subscription */
+    for( i = 1; i <= AWS_DISPATCH_MAX_SUBSCRIPTIONS; i++ ) {
+        dispatch_setup( &ctx, i );
+        dispatcher = new AWSIoTDispatcher();
+        dispatcher->enable_value_cache( filters[i - 1] );
+        for( j = 0; j < i; j++ ) {
+            ctx.client->setMessageHandler( filters[j], dispatcher->add( filters[j], count_message ) );
+        }
+        run( "dispatch_cached", i, dispatch, &ctx );
+        delete dispatcher;
+        delete ctx.client;
+    }
+}
+
+/******************************************************
+ *               Greengrass discovery
+ ******************************************************/
+
+typedef struct
+{
+    cy_JSON_object_t objects[1 + BENCHMARK_MAX_GROUPS * 16];
+    uint32_t count;
+    char strings[BENCHMARK_MAX_GROUPS][4][64];
+    char root_ca[BENCHMARK_MAX_CA_LENGTH + 1];
+    char unescaped[BENCHMARK_MAX_CA_LENGTH + 1];
+    uint16_t root_ca_length;
+} discovery_context_t;
+
+/* PEM body of 'length' bytes as AWS sends it, with every line break escaped as '\' 'n' */
+static uint16_t record_root_ca( char* buffer, uint32_t length )
+{
+    static const char begin[] = GG_BEGIN_CERTIFICATE "\\n";
+    static const char end[] = "\\n-----END CERTIFICATE-----\\n";
+    uint32_t used = 0;
+    uint32_t column = 0;
+
+    memcpy( buffer, begin, sizeof(begin) - 1 );
+    used = sizeof(begin) - 1;
+    while( used + sizeof(end) - 1 < length ) {
+        if( column == 64 && used + 2 + sizeof(end) - 1 < length ) {
+            buffer[used++] = '\\';
+            buffer[used++] = 'n';
+            column = 0;
+        } else {
+            buffer[used] = 'A' + (char) ( used % 26 );
+            used++;
+            column++;
+        }
+    }
+    memcpy( buffer + used, end, sizeof(end) - 1 );
+    used += sizeof(end) - 1;
+    buffer[used] = '\0';
+
+    return (uint16_t) used;
+}
+
+static void record_object( discovery_context_t* ctx, const char* key, cy_JSON_type_t type, const char* value )
+{
+    cy_JSON_object_t* object = &ctx->objects[ctx->count++];
+
+    object->object_string = (char*) key;
+    object->object_string_length = (uint8_t) strlen( key );
+    object->value_type = type;
+    object->value = (char*) value;
+    object->value_length = (uint16_t) strlen( value );
+    object->parent_object = NULL;
+}
+
+/* The objects the JSON parser reports for a discovery response of 'groups' groups, each with one core, two connections and a CA */
+static void record_discovery_response( discovery_context_t* ctx, uint32_t groups )
+{
+    uint32_t i = 0;
+    uint32_t j = 0;
+
+    ctx->count = 0;
+    record_object( ctx, GG_GROUP_KEY, JSON_ARRAY_TYPE, "" );
+    for( i = 0; i < groups; i++ ) {
+        snprintf( ctx->strings[i][0], sizeof(ctx->strings[i][0]), "%08lx-1d2f-4c4e-9d3b-6a1b2c3d4e5f", (unsigned long) i );
+        snprintf( ctx->strings[i][1], sizeof(ctx->strings[i][1]), "arn:aws:iot:us-east-1:123456789012:thing/core-%lu", (unsigned long) i );
+        snprintf( ctx->strings[i][2], sizeof(ctx->strings[i][2]), "192.168.%lu.10", (unsigned long) i );
+        snprintf( ctx->strings[i][3], sizeof(ctx->strings[i][3]), "10.0.%lu.10", (unsigned long) i );
+
+        record_object( ctx, GG_GROUP_ID, JSON_STRING_TYPE, ctx->strings[i][0] );
+        record_object( ctx, "Cores", JSON_ARRAY_TYPE, "" );
+        record_object( ctx, GG_CORE_THING_ARN, JSON_STRING_TYPE, ctx->strings[i][1] );
+        record_object( ctx, "Connections", JSON_ARRAY_TYPE, "" );
+        for( j = 0; j < 2; j++ ) {
+            record_object( ctx, "Id", JSON_STRING_TYPE, "AutoIP_0" );
+            record_object( ctx, GG_HOST_ADDRESS, JSON_STRING_TYPE, ctx->strings[i][2 + j] );
+            record_object( ctx, GG_PORT, JSON_NUMBER_TYPE, "8883" );
+            record_object( ctx, GG_METADATA, JSON_STRING_TYPE, "" );
+        }
+        record_object( ctx, GG_ROOT_CAS, JSON_ARRAY_TYPE, "" );
+        record_object( ctx, "", JSON_STRING_TYPE, ctx->root_ca );
+    }
+}
+
+static void discovery_parse( void* context, uint64_t iterations )
+{
+    discovery_context_t* ctx = (discovery_context_t*) context;
+    uint64_t i = 0;
+    uint32_t j = 0;
+
+    for( i = 0; i < iterations; i++ ) {
+        aws_greengrass_discovery_reset();
+        for( j = 0; j < ctx->count; j++ ) {
+            sink += json_callback_for_discovery_payload( &ctx->objects[j] );
+        }
+    }
+    aws_greengrass_discovery_reset();
+}
+
+static void root_ca_unescape( void* context, uint64_t iterations )
+{
+    discovery_context_t* ctx = (discovery_context_t*) context;
+    uint64_t i = 0;
+
+    for( i = 0; i < iterations; i++ ) {
+        sink += benchmark_unescape_root_ca( ctx->unescaped, ctx->root_ca, ctx->root_ca_length );
+    }
+}
+
+static void benchmark_discovery( void )
+{
+    static const uint32_t groups[] = { 1, 5, 10, 25, 50 };
+    static const uint32_t ca_lengths[] = { 1200, 2000, 4096, 8192 };
+    static discovery_context_t ctx;
+    uint32_t i = 0;
+
+    /* a typical Amazon root CA is about 1.2 KB once escaped */
+    ctx.root_ca_length = record_root_ca( ctx.root_ca, 1200 );
+    for( i = 0; i < sizeof(groups) / sizeof(groups[0]); i++ ) {
+        record_discovery_response( &ctx, groups[i] );
+        run( "discovery_parse", groups[i], discovery_parse, &ctx );
+    }
+
+    for( i = 0; i < sizeof(ca_lengths) / sizeof(ca_lengths[0]); i++ ) {
+        ctx.root_ca_length = record_root_ca( ctx.root_ca, ca_lengths[i] );
+        run( "root_ca_unescape", ctx.root_ca_length, root_ca_unescape, &ctx );
+    }
+}
+
+/******************************************************
+ *               Timer wheel
+ ******************************************************/
+
+typedef struct
+{
+    AWSIoTTimerWheel* wheel;
+    AWSIoTTimerWheel::timer* timers;
+    uint32_t count;
+    uint64_t now_ms;                        /**< Time the wheel was last advanced to */
+} timer_context_t;
+
+static AWSIoTTimerWheel::timer timers[BENCHMARK_MAX_TIMERS];
+
+static void count_expiry( void* arg )
+{
+    (void) arg;
+    sink++;
+}
+
+/* deadlines scattered over the spread, the same sequence on every run */
+static uint32_t timer_offset( uint64_t i )
+{
+    return 1 + (uint32_t) ( ( i * 2654435761u ) % BENCHMARK_TIMER_SPREAD );
+}
+
+/* with 'count' timers pending, move one to a new deadline: cancel and insert */
+static void timer_rearm( void* context, uint64_t iterations )
+{
+    timer_context_t* ctx = (timer_context_t*) context;
+    uint64_t i = 0;
+
+    for( i = 0; i < iterations; i++ ) {
+        ctx->wheel->schedule( &ctx->timers[i % ctx->count], ctx->now_ms + timer_offset( i ), count_expiry, NULL );
+    }
+}
+
+/* arm up to 'count' timers, then cancel them all again */
+static void timer_insert_cancel( void* context, uint64_t iterations )
+{
+    timer_context_t* ctx = (timer_context_t*) context;
+    uint64_t done = 0;
+    uint32_t batch = 0;
+    uint32_t i = 0;
+
+    for( done = 0; done < iterations; done += batch ) {
+        batch = ( iterations - done < ctx->count ) ? (uint32_t) ( iterations - done ) : ctx->count;
+        for( i = 0; i < batch; i++ ) {
+            ctx->wheel->schedule( &ctx->timers[i], ctx->now_ms + timer_offset( done + i ), count_expiry, NULL );
+        }
+        for( i = 0; i < batch; i++ ) {
+            ctx->wheel->cancel( &ctx->timers[i] );
+        }
+    }
+}
+
+/* arm up to 'count' timers, then advance the wheel across the spread so that every one of them expires */
+static void timer_insert_expire( void* context, uint64_t iterations )
+{
+    timer_context_t* ctx = (timer_context_t*) context;
+    uint64_t done = 0;
+    uint32_t batch = 0;
+    uint32_t i = 0;
+
+    for( done = 0; done < iterations; done += batch ) {
+        batch = ( iterations - done < ctx->count ) ? (uint32_t) ( iterations - done ) : ctx->count;
+        for( i = 0; i < batch; i++ ) {
+            ctx->wheel->schedule( &ctx->timers[i], ctx->now_ms + timer_offset( done + i ), count_expiry, NULL );
+        }
+        ctx->now_ms += BENCHMARK_TIMER_SPREAD;
+        sink += ctx->wheel->advance( ctx->now_ms );
+    }
+}
+
+static void benchmark_timers( void )
+{
+    static const uint32_t counts[] = { 1000, 10000, BENCHMARK_MAX_TIMERS };
+    timer_context_t ctx;
+    uint32_t i = 0;
+    uint32_t j = 0;
+
+    ctx.timers = timers;
+    for( i = 0; i < sizeof(counts) / sizeof(counts[0]); i++ ) {
+        /* a wheel per count, so that timers left from the previous one do not add to the load */
+        ctx.wheel = new AWSIoTTimerWheel();
+        ctx.count = counts[i];
+        ctx.now_ms = Kernel::get_ms_count();
+        ctx.wheel->advance( ctx.now_ms );
+
+        run( "timer_insert_cancel", counts[i], timer_insert_cancel, &ctx );
+        run( "timer_insert_expire", counts[i], timer_insert_expire, &ctx );
+
+        for( j = 0; j < counts[i]; j++ ) {
+            ctx.wheel->schedule( &timers[j], ctx.now_ms + timer_offset( j ), count_expiry, NULL );
+        }
+        run( "timer_rearm", counts[i], timer_rearm, &ctx );
+        for( j = 0; j < counts[i]; j++ ) {
+            ctx.wheel->cancel( &timers[j] );
+        }
+        delete ctx.wheel;
+    }
+}
+
+/******************************************************
+ *               Submission queue
+ ******************************************************/
+
+typedef struct
+{
+    uint32_t producer;
+    uint32_t seq;
+} submit_item_t;
+
+typedef AWSIoTSubmitQueue<submit_item_t, BENCHMARK_QUEUE_DEPTH> submit_queue_t;
+
+typedef struct
+{
+    submit_queue_t* queue;
+    uint32_t producers;
+    uint64_t per_producer;
+} submit_context_t;
+
+/* publish_async: claim a slot, fill it in and queue it, retrying while the pool is exhausted */
+static void submit_produce( submit_context_t* ctx, uint32_t producer )
+{
+    submit_item_t* item = NULL;
+    uint64_t i = 0;
+
+    for( i = 0; i < ctx->per_producer; i++ ) {
+        while( ( item = ctx->queue->alloc() ) == NULL ) {
+            std::this_thread::yield();
+        }
+        item->producer = producer;
+        item->seq = (uint32_t) i;
+        ctx->queue->submit( item );
+    }
+}
+
+/* 'producers' threads submit, the calling thread drains as yield does; one operation is one request through the queue */
+static void submit_contended( void* context, uint64_t iterations )
+{
+    submit_context_t* ctx = (submit_context_t*) context;
+    std::thread threads[BENCHMARK_MAX_PRODUCERS];
+    uint32_t next_seq[BENCHMARK_MAX_PRODUCERS];
+    submit_item_t* item = NULL;
+    uint64_t total = 0;
+    uint64_t taken = 0;
+    uint32_t i = 0;
+
+    ctx->per_producer = ( iterations + ctx->producers - 1 ) / ctx->producers;
+    total = ctx->per_producer * ctx->producers;
+    memset( next_seq, 0, sizeof(next_seq) );
+
+    for( i = 0; i < ctx->producers; i++ ) {
+        threads[i] = std::thread( submit_produce, ctx, i );
+    }
+
+    while( taken < total ) {
+        item = ctx->queue->pop();
+        if( item == NULL ) {
+            std::this_thread::yield();
+            continue;
+        }
+        /* the queue keeps each producer's submissions in order */
+        if( item->seq != next_seq[item->producer]++ ) {
+            fprintf( stderr, "benchmark: submission %lu of producer %lu out of order\n", (unsigned long) item->seq, (unsigned long) item->producer );
+            exit( 1 );
+        }
+        ctx->queue->release( item );
+        taken++;
+    }
+
+    for( i = 0; i < ctx->producers; i++ ) {
+        threads[i].join();
+    }
+}
+
+static void benchmark_submit( void )
+{
+    submit_context_t ctx;
+    uint32_t producers = 0;
+
+    ctx.queue = new submit_queue_t();
+    for( producers = 1; producers <= BENCHMARK_MAX_PRODUCERS; producers++ ) {
+        ctx.producers = producers;
+        run( "submit_contended", producers, submit_contended, &ctx );
+    }
+    delete ctx.queue;
+}
+
+/******************************************************
+ *               WebSocket masking
+ ******************************************************/
+
+typedef struct
+{
+    unsigned char in[BENCHMARK_PACKET_SIZE];
+    unsigned char out[BENCHMARK_PACKET_SIZE];
+    unsigned char mask[4];
+    size_t length;
+} mask_context_t;
+
+/* the byte loop the word-wise kernel replaced */
+static void mask_bytes( const unsigned char* in, unsigned char* out, size_t len, const unsigned char mask[4], size_t offset )
+{
+    size_t i = 0;
+
+    for( i = 0; i < len; i++ ) {
+        out[i] = in[i] ^ mask[( offset + i ) & 3];
+    }
+}
+
+static void websocket_mask( void* context, uint64_t iterations )
+{
+    mask_context_t* ctx = (mask_context_t*) context;
+    uint64_t i = 0;
+
+    for( i = 0; i < iterations; i++ ) {
+        mqtt_websocket_mask( ctx->in, ctx->out, ctx->length, ctx->mask, 0 );
+        sink += ctx->out[ctx->length - 1];
+    }
+}
+
+static void websocket_mask_bytes( void* context, uint64_t iterations )
+{
+    mask_context_t* ctx = (mask_context_t*) context;
+    uint64_t i = 0;
+
+    for( i = 0; i < iterations; i++ ) {
+        mask_bytes( ctx->in, ctx->out, ctx->length, ctx->mask, 0 );
+        sink += ctx->out[ctx->length - 1];
+    }
+}
+
+static void benchmark_websocket( void )
+{
+    static const size_t sizes[] = { 16, 128, 1024, 16384 };
+    static mask_context_t ctx;
+    static unsigned char expected[BENCHMARK_PACKET_SIZE];
+    size_t i = 0;
+
+    for( i = 0; i < sizeof(ctx.in); i++ ) {
+        ctx.in[i] = (unsigned char) ( i * 31 + 7 );
+    }
+    memcpy( ctx.mask, "\x5a\xc3\x0f\x96", sizeof(ctx.mask) );
+
+    for( i = 0; i < sizeof(sizes) / sizeof(sizes[0]); i++ ) {
+        ctx.length = sizes[i];
+
+        /* a frame continued at an odd offset into an odd address exercises the kernel's head and tail */
+        mask_bytes( ctx.in, expected, ctx.length, ctx.mask, 3 );
+        mqtt_websocket_mask( ctx.in, ctx.out + 1, ctx.length - 1, ctx.mask, 3 );
+        if( memcmp( expected, ctx.out + 1, ctx.length - 1 ) != 0 ) {
+            fprintf( stderr, "benchmark: mqtt_websocket_mask differs from the byte loop for %lu bytes\n", (unsigned long) ctx.length );
+            exit( 1 );
+        }
+
+        run( "websocket_mask", sizes[i], websocket_mask, &ctx );
+        run( "websocket_mask_bytes", sizes[i], websocket_mask_bytes, &ctx );
+    }
+}
+
+int main( int argc, char* argv[] )
+{
+    if( argc > 1 ) {
+        name_prefix = argv[1];
+    }
+
+    benchmark_publish();
+    benchmark_dispatch();
+    benchmark_discovery();
+    benchmark_timers();
+    benchmark_submit();
+    benchmark_websocket();
+
+    return 0;
+}
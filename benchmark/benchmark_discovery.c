@@ -0,0 +1,28 @@
+/*
+ * Copyright 2019-2020 Cypress Semiconductor Corporation
+ * SPDX-License-Identifier: Apache-2.0
+ * 
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ * 
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ * 
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/** @file
+ *
+ * Exposes the static root CA unescape of the Greengrass discovery parser to the benchmark
+ *
+ */
+#include "../aws_greengrass_discovery.c"
+
+uint16_t benchmark_unescape_root_ca( char* dst, const char* src, uint16_t length )
+{
+    return greengrass_unescape_newlines( dst, src, length );
+}
@@ -0,0 +1,52 @@
+/*
+ * Copyright 2019-2020 Cypress Semiconductor Corporation
+ * SPDX-License-Identifier: Apache-2.0
+ * 
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ * 
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ * 
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/** @file
+ *  Linux stand-in for the JSON parser types of the connectivity utilities; the benchmark replays parsed objects
+ *  instead of running the parser
+ */
+#ifndef AWS_BENCHMARK_JSON_H
+#define AWS_BENCHMARK_JSON_H
+
+#include <stdint.h>
+#include "cy_result.h"
+
+typedef enum
+{
+    JSON_STRING_TYPE,
+    JSON_NUMBER_TYPE,
+    JSON_VALUE_TYPE,
+    JSON_ARRAY_TYPE,
+    JSON_OBJECT_TYPE,
+    JSON_BOOLEAN_TYPE,
+    JSON_NULL_TYPE,
+    UNKNOWN_JSON_TYPE
+} cy_JSON_type_t;
+
+typedef struct cy_JSON_object
+{
+    char*                  object_string;
+    uint8_t                object_string_length;
+    cy_JSON_type_t         value_type;
+    char*                  value;
+    uint16_t               value_length;
+    struct cy_JSON_object* parent_object;
+} cy_JSON_object_t;
+
+typedef cy_rslt_t (*cy_JSON_callback_t)( cy_JSON_object_t* json_object );
+
+#endif
@@ -0,0 +1,33 @@
+/*
+ * Copyright 2019-2020 Cypress Semiconductor Corporation
+ * SPDX-License-Identifier: Apache-2.0
+ * 
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ * 
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ * 
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/** @file
+ *  Linux stand-in for the result type of the Cypress core library
+ */
+#ifndef AWS_BENCHMARK_CY_RESULT_H
+#define AWS_BENCHMARK_CY_RESULT_H
+
+#include <stdint.h>
+
+typedef uint32_t cy_rslt_t;
+
+#define CY_RSLT_SUCCESS                    ( (cy_rslt_t) 0u )
+#define CY_RSLT_TYPE_ERROR                 ( 2u )
+#define CY_RSLT_CREATE( type, module, code ) \
+    ( ( ( (module) & 0x3FFFu ) << 18u ) | ( ( (type) & 0x3u ) << 16u ) | ( (code) & 0xFFFFu ) )
+
+#endif
@@ -0,0 +1,29 @@
+/*
+ * Copyright 2019-2020 Cypress Semiconductor Corporation
+ * SPDX-License-Identifier: Apache-2.0
+ * 
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ * 
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ * 
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/** @file
+ *  Linux stand-in for the middleware result modules of the Cypress core library
+ */
+#ifndef AWS_BENCHMARK_CY_RESULT_MW_H
+#define AWS_BENCHMARK_CY_RESULT_MW_H
+
+#include "cy_result.h"
+
+#define CY_RSLT_MODULE_MIDDLEWARE_BASE     ( 0x0A0u )
+#define CY_RSLT_MODULE_AWS_BASE            ( CY_RSLT_MODULE_MIDDLEWARE_BASE + 3 )
+
+#endif
@@ -0,0 +1,114 @@
+/*
+ * Copyright 2019-2020 Cypress Semiconductor Corporation
+ * SPDX-License-Identifier: Apache-2.0
+ * 
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ * 
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ * 
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/** @file
+ *  Linux stand-in for the parts of Mbed OS the benchmarked sources use. Only the single-threaded paths run under the
+ *  benchmark; the RTOS classes are backed by the C++ standard library so that the sources compile unchanged.
+ */
+#ifndef AWS_BENCHMARK_MBED_H
+#define AWS_BENCHMARK_MBED_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <atomic>
+#include <condition_variable>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include "platform/mbed_critical.h"
+
+namespace Kernel {
+    inline uint64_t get_ms_count()
+    {
+        struct timespec now;
+
+        clock_gettime( CLOCK_MONOTONIC, &now );
+        return (uint64_t) now.tv_sec * 1000 + (uint64_t) now.tv_nsec / 1000000;
+    }
+}
+
+namespace mbed {
+    template <typename F> class Callback;
+
+    template <typename R>
+    class Callback<R()>
+    {
+    public:
+        Callback() {}
+        template <typename T, typename M>
+        Callback( T* object, M method ) : call( std::bind( method, object ) ) {}
+        R operator()() const { return call(); }
+    private:
+        std::function<R()> call;
+    };
+
+    template <typename T, typename M>
+    Callback<void()> callback( T* object, M method )
+    {
+        return Callback<void()>( object, method );
+    }
+}
+
+namespace rtos {
+    enum osPriority { osPriorityNormal };
+    typedef int32_t osStatus;
+
+    class Mutex
+    {
+    public:
+        void lock() { mutex.lock(); }
+        void unlock() { mutex.unlock(); }
+        bool trylock() { return mutex.try_lock(); }
+    private:
+        std::recursive_mutex mutex;
+    };
+
+    class ConditionVariable
+    {
+    public:
+        ConditionVariable( Mutex& mutex ) : mutex( mutex ) {}
+        void wait() { condition.wait( mutex ); }
+        void notify_one() { condition.notify_one(); }
+        void notify_all() { condition.notify_all(); }
+    private:
+        Mutex& mutex;
+        std::condition_variable_any condition;
+    };
+
+    class Thread
+    {
+    public:
+        Thread( osPriority priority = osPriorityNormal, uint32_t stack_size = 0 ) { (void) priority; (void) stack_size; }
+        osStatus start( mbed::Callback<void()> task ) { thread = std::thread( task ); return 0; }
+        osStatus join() { thread.join(); return 0; }
+    private:
+        std::thread thread;
+    };
+
+    namespace ThisThread {
+        inline void sleep_for( uint32_t ms ) { std::this_thread::sleep_for( std::chrono::milliseconds( ms ) ); }
+    }
+}
+
+using namespace mbed;
+using namespace rtos;
+
+#endif
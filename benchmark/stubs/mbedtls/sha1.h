@@ -0,0 +1,36 @@
+/*
+ * Copyright 2019-2020 Cypress Semiconductor Corporation
+ * SPDX-License-Identifier: Apache-2.0
+ * 
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ * 
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ * 
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/** @file
+ *  Linux stand-in for the mbed TLS SHA-1 declarations used by MQTTWebSocket.h; the benchmarks never compute a digest.
+ */
+#ifndef AWS_BENCHMARK_MBEDTLS_SHA1_H
+#define AWS_BENCHMARK_MBEDTLS_SHA1_H
+
+#include <stddef.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+int mbedtls_sha1_ret( const unsigned char* input, size_t ilen, unsigned char output[20] );
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
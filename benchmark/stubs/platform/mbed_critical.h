@@ -0,0 +1,67 @@
+/*
+ * Copyright 2019-2020 Cypress Semiconductor Corporation
+ * SPDX-License-Identifier: Apache-2.0
+ * 
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ * 
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ * 
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/** @file
+ *  Linux stand-in for the atomic operations of Mbed OS, built on the GCC __atomic builtins.
+ */
+#ifndef AWS_BENCHMARK_MBED_CRITICAL_H
+#define AWS_BENCHMARK_MBED_CRITICAL_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+inline bool core_util_atomic_cas_u32( volatile uint32_t* ptr, uint32_t* expected, uint32_t desired )
+{
+    return __atomic_compare_exchange_n( ptr, expected, desired, false, __ATOMIC_SEQ_CST, __ATOMIC_SEQ_CST );
+}
+
+inline bool core_util_atomic_cas_ptr( void* volatile* ptr, void** expected, void* desired )
+{
+    return __atomic_compare_exchange_n( ptr, expected, desired, false, __ATOMIC_SEQ_CST, __ATOMIC_SEQ_CST );
+}
+
+inline uint8_t core_util_atomic_load_u8( const volatile uint8_t* ptr )
+{
+    return __atomic_load_n( ptr, __ATOMIC_SEQ_CST );
+}
+
+inline uint32_t core_util_atomic_load_u32( const volatile uint32_t* ptr )
+{
+    return __atomic_load_n( ptr, __ATOMIC_SEQ_CST );
+}
+
+inline void* core_util_atomic_load_ptr( void* const volatile* ptr )
+{
+    return __atomic_load_n( ptr, __ATOMIC_SEQ_CST );
+}
+
+inline void core_util_atomic_store_u8( volatile uint8_t* ptr, uint8_t desired )
+{
+    __atomic_store_n( ptr, desired, __ATOMIC_SEQ_CST );
+}
+
+inline void core_util_atomic_store_u32( volatile uint32_t* ptr, uint32_t desired )
+{
+    __atomic_store_n( ptr, desired, __ATOMIC_SEQ_CST );
+}
+
+inline void core_util_atomic_store_ptr( void* volatile* ptr, void* desired )
+{
+    __atomic_store_n( ptr, desired, __ATOMIC_SEQ_CST );
+}
+
+#endif